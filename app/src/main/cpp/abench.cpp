@@ -0,0 +1,112 @@
+//
+// Headless benchmark statistics.
+//
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+
+#include "abench.h"
+#include "util.h"
+#define LOG_TAG "abench"
+
+namespace {
+
+const char* const STAGE_NAMES[] = {"acquire", "overlay", "draw", "gpu", "frame"};
+
+int64_t clockNs(clockid_t id) {
+    timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Nearest-rank percentile of sorted
+double percentileUs(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t i = std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+} // namespace
+
+ABench::ABench(int frames) : target(frames) {
+    for (auto& s : samples) {
+        s.reserve(frames);
+    }
+}
+
+void ABench::begin() {
+    int64_t now = clockNs(CLOCK_MONOTONIC);
+    if (!startNs) {
+        startNs = now;
+        processCpuStartNs = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+        threadCpuStartNs = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    }
+    frameStartNs = now;
+    lastMarkNs = now;
+    std::fill(std::begin(stageNs), std::end(stageNs), 0);
+}
+
+void ABench::mark(Stage stage) {
+    int64_t now = clockNs(CLOCK_MONOTONIC);
+    stageNs[stage] += now - lastMarkNs;
+    lastMarkNs = now;
+}
+
+void ABench::end(bool newImage) {
+    if (done()) {
+        return;
+    }
+    for (int i = 0; i < STAGES; i++) {
+        samples[i].push_back(stageNs[i]);
+    }
+    endNs = clockNs(CLOCK_MONOTONIC);
+    samples[STAGES].push_back(endNs - frameStartNs);
+    frames++;
+    newImages += newImage;
+    processCpuEndNs = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    threadCpuEndNs = clockNs(CLOCK_THREAD_CPUTIME_ID);
+}
+
+double ABench::fps() const {
+    return endNs > startNs ? frames * 1e9 / (endNs - startNs) : 0.0;
+}
+
+double ABench::cpuMsPerFrame() const {
+    return frames ? (processCpuEndNs - processCpuStartNs) / 1e6 / frames : 0.0;
+}
+
+bool ABench::writeJson(const char* path, const char* label) const {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        LOGE(LOG_TAG, "Failed to open %s", path);
+        return false;
+    }
+    double seconds = (endNs - startNs) / 1e9;
+    double threadCpuMs = frames ? (threadCpuEndNs - threadCpuStartNs) / 1e6 / frames : 0.0;
+    fprintf(f, "{\n  \"label\": \"%s\",\n  \"frames\": %d,\n  \"seconds\": %.3f,\n", label, frames, seconds);
+    fprintf(f, "  \"fps\": %.2f,\n  \"newImageFps\": %.2f,\n", fps(),
+            seconds > 0 ? newImages / seconds : 0.0);
+    // Render thread vs. everything else (decoder, extractor, driver threads)
+    fprintf(f, "  \"cpuMsPerFrame\": %.3f,\n  \"renderThreadCpuMsPerFrame\": %.3f,\n",
+            cpuMsPerFrame(), threadCpuMs);
+    fprintf(f, "  \"stages\": {");
+    for (int i = 0; i <= STAGES; i++) {
+        std::vector<int64_t> sorted = samples[i];
+        std::sort(sorted.begin(), sorted.end());
+        int64_t sum = 0;
+        for (int64_t v : sorted) {
+            sum += v;
+        }
+        fprintf(f, "%s\n    \"%s\": {\"meanUs\": %.1f, \"p50Us\": %.1f, \"p90Us\": %.1f, \"p99Us\": %.1f, \"maxUs\": %.1f}",
+                i ? "," : "", STAGE_NAMES[i], sorted.empty() ? 0.0 : sum / 1000.0 / sorted.size(),
+                percentileUs(sorted, 50), percentileUs(sorted, 90), percentileUs(sorted, 99),
+                sorted.empty() ? 0.0 : sorted.back() / 1000.0);
+    }
+    fprintf(f, "\n  }\n}\n");
+    bool ok = fclose(f) == 0;
+    LOGI(LOG_TAG, "%d frames in %.2f s: %.1f fps, %.3f ms CPU per frame -> %s",
+         frames, seconds, fps(), cpuMsPerFrame(), path);
+    return ok;
+}
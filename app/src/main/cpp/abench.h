@@ -0,0 +1,57 @@
+//
+// Headless benchmark statistics: per-stage frame cost and CPU time, written as JSON.
+//
+#ifndef ABENCH_H
+#define ABENCH_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Per frame: begin(), mark() after each stage (the time since the previous mark
+ * is charged to that stage), end(). Nothing allocates between begin() and end()
+ * once the frame count given to the constructor is reached.
+ */
+class ABench {
+public:
+    enum Stage {
+        ACQUIRE,    // waiting for and acquiring the decoded image
+        OVERLAY,    // building the overlay geometry
+        DRAW,       // GL command submission, including eglSwapBuffers
+        GPU,        // glFinish, the GPU work left after submission
+        STAGES
+    };
+
+    explicit ABench(int frames);
+
+    void begin();
+    void mark(Stage stage);
+    // newImage: the frame showed a freshly decoded picture
+    void end(bool newImage);
+
+    bool done() const { return frames >= target; }
+    int frameCount() const { return frames; }
+    double fps() const;
+    double cpuMsPerFrame() const;
+
+    // label names the run (device, build); returns false if the file can't be written.
+    bool writeJson(const char* path, const char* label) const;
+
+private:
+    int target;
+    int frames = 0;
+    int newImages = 0;
+    int64_t startNs = 0;
+    int64_t endNs = 0;
+    int64_t processCpuStartNs = 0;
+    int64_t processCpuEndNs = 0;
+    int64_t threadCpuStartNs = 0;
+    int64_t threadCpuEndNs = 0;
+    int64_t frameStartNs = 0;
+    int64_t lastMarkNs = 0;
+    int64_t stageNs[STAGES]{};
+    // Per-frame durations in ns, for percentiles
+    std::vector<int64_t> samples[STAGES + 1];
+};
+
+#endif //ABENCH_H
@@ -0,0 +1,211 @@
+//
+// Decoder enumeration and throughput probe.
+//
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <strings.h>
+#include <chrono>
+
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkImageReader.h>
+
+#include "acodecprobe.h"
+#include "util.h"
+#define LOG_TAG "acodecprobe"
+
+using namespace std::chrono;
+
+std::vector<CodecProfile> ACodecProbe::candidates(JavaVM* vm, const char* mime, const CodecRequirement& req) {
+    std::vector<CodecProfile> out;
+    JNIEnv* env = nullptr;
+    if (!vm || vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+        return out;
+    }
+    jclass listClass = env->FindClass("android/media/MediaCodecList");
+    jclass infoClass = env->FindClass("android/media/MediaCodecInfo");
+    jclass capsClass = env->FindClass("android/media/MediaCodecInfo$CodecCapabilities");
+    jclass videoClass = env->FindClass("android/media/MediaCodecInfo$VideoCapabilities");
+    jclass rangeClass = env->FindClass("android/util/Range");
+    jclass doubleClass = env->FindClass("java/lang/Double");
+    if (listClass && infoClass && capsClass && videoClass && rangeClass && doubleClass) {
+        jmethodID isEncoder = env->GetMethodID(infoClass, "isEncoder", "()Z");
+        jmethodID isAlias = env->GetMethodID(infoClass, "isAlias", "()Z");
+        jmethodID isHardware = env->GetMethodID(infoClass, "isHardwareAccelerated", "()Z");
+        jmethodID getName = env->GetMethodID(infoClass, "getName", "()Ljava/lang/String;");
+        jmethodID getTypes = env->GetMethodID(infoClass, "getSupportedTypes", "()[Ljava/lang/String;");
+        jmethodID getCaps = env->GetMethodID(infoClass, "getCapabilitiesForType",
+                "(Ljava/lang/String;)Landroid/media/MediaCodecInfo$CodecCapabilities;");
+        jmethodID getVideoCaps = env->GetMethodID(capsClass, "getVideoCapabilities",
+                "()Landroid/media/MediaCodecInfo$VideoCapabilities;");
+        jmethodID sizeAndRate = env->GetMethodID(videoClass, "areSizeAndRateSupported", "(IID)Z");
+        jmethodID sizeSupported = env->GetMethodID(videoClass, "isSizeSupported", "(II)Z");
+        jmethodID achievable = env->GetMethodID(videoClass, "getAchievableFrameRatesFor",
+                "(II)Landroid/util/Range;");
+        jmethodID getUpper = env->GetMethodID(rangeClass, "getUpper", "()Ljava/lang/Comparable;");
+        jmethodID doubleValue = env->GetMethodID(doubleClass, "doubleValue", "()D");
+        // MediaCodecList.ALL_CODECS, REGULAR_CODECS hides some vendor decoders
+        jobject list = env->NewObject(listClass, env->GetMethodID(listClass, "<init>", "(I)V"), 1);
+        auto infos = list ? (jobjectArray)env->CallObjectMethod(list,
+                env->GetMethodID(listClass, "getCodecInfos", "()[Landroid/media/MediaCodecInfo;")) : nullptr;
+        jstring jmime = env->NewStringUTF(mime);
+        jsize n = infos ? env->GetArrayLength(infos) : 0;
+        for (jsize i = 0; i < n; i++) {
+            jobject info = env->GetObjectArrayElement(infos, i);
+            if (env->CallBooleanMethod(info, isEncoder) || env->CallBooleanMethod(info, isAlias)) {
+                env->DeleteLocalRef(info);
+                continue;
+            }
+            bool handles = false;
+            auto types = (jobjectArray)env->CallObjectMethod(info, getTypes);
+            jsize typeCount = types ? env->GetArrayLength(types) : 0;
+            for (jsize t = 0; t < typeCount && !handles; t++) {
+                auto type = (jstring)env->GetObjectArrayElement(types, t);
+                const char* chars = env->GetStringUTFChars(type, nullptr);
+                handles = strcasecmp(chars, mime) == 0;
+                env->ReleaseStringUTFChars(type, chars);
+                env->DeleteLocalRef(type);
+            }
+            if (types) env->DeleteLocalRef(types);
+            if (!handles) {
+                env->DeleteLocalRef(info);
+                continue;
+            }
+
+            CodecProfile codec{};
+            auto name = (jstring)env->CallObjectMethod(info, getName);
+            const char* chars = env->GetStringUTFChars(name, nullptr);
+            codec.name = chars;
+            env->ReleaseStringUTFChars(name, chars);
+            env->DeleteLocalRef(name);
+            codec.hardware = env->CallBooleanMethod(info, isHardware);
+            codec.supported = true;
+            jobject caps = env->CallObjectMethod(info, getCaps, jmime);
+            jobject video = caps ? env->CallObjectMethod(caps, getVideoCaps) : nullptr;
+            if (video) {
+                codec.supported = req.fps > 0.0f
+                        ? env->CallBooleanMethod(video, sizeAndRate, req.width, req.height, (jdouble)req.fps)
+                        : env->CallBooleanMethod(video, sizeSupported, req.width, req.height);
+                // Only published for some (mostly hardware) decoders, throws for unsupported sizes
+                jobject range = codec.supported ? env->CallObjectMethod(video, achievable, req.width, req.height) : nullptr;
+                if (env->ExceptionCheck()) {
+                    env->ExceptionClear();
+                    range = nullptr;
+                }
+                if (range) {
+                    jobject upper = env->CallObjectMethod(range, getUpper);
+                    codec.declaredFps = upper ? (float)env->CallDoubleMethod(upper, doubleValue) : 0.0f;
+                    if (upper) env->DeleteLocalRef(upper);
+                    env->DeleteLocalRef(range);
+                }
+                env->DeleteLocalRef(video);
+            }
+            if (caps) env->DeleteLocalRef(caps);
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                codec.supported = false;
+            }
+            out.push_back(codec);
+            env->DeleteLocalRef(info);
+        }
+        env->DeleteLocalRef(jmime);
+        if (infos) env->DeleteLocalRef(infos);
+        if (list) env->DeleteLocalRef(list);
+    }
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+    }
+    for (jclass c : {listClass, infoClass, capsClass, videoClass, rangeClass, doubleClass}) {
+        if (c) env->DeleteLocalRef(c);
+    }
+    vm->DetachCurrentThread();
+    return out;
+}
+
+void ACodecProbe::measure(CodecProfile& codec, const char* file, size_t track, AMediaFormat* format,
+                          const CodecRequirement& req) {
+    codec.probed = true;
+    codec.probeOk = false;
+    codec.fps = 0.0f;
+    codec.latencyMs = 0.0f;
+
+    AMediaExtractor* extractor = AMediaExtractor_new();
+    AImageReader* reader = nullptr;
+    AMediaCodec* probe = nullptr;
+    ANativeWindow* window = nullptr;
+    int fd = open(file, O_RDONLY);
+    struct stat st;
+    bool ready = extractor && fd >= 0 && fstat(fd, &st) == 0
+            && AMediaExtractor_setDataSourceFd(extractor, fd, 0, st.st_size) == AMEDIA_OK
+            && AMediaExtractor_selectTrack(extractor, track) == AMEDIA_OK
+            // Surface output like playback, hardware decoders take a different path without one
+            && AImageReader_new(req.width, req.height, AIMAGE_FORMAT_YUV_420_888, 2, &reader) == AMEDIA_OK
+            && AImageReader_getWindow(reader, &window) == AMEDIA_OK
+            && (probe = AMediaCodec_createCodecByName(codec.name.c_str())) != nullptr
+            && AMediaCodec_configure(probe, format, window, nullptr, 0) == AMEDIA_OK
+            && AMediaCodec_start(probe) == AMEDIA_OK;
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    int queued = 0;
+    int decoded = 0;
+    bool inputDone = false;
+    auto start = steady_clock::now();
+    auto deadline = start + milliseconds(BUDGET_MS);
+    time_point<steady_clock> firstOutput, lastOutput;
+    while (ready && decoded < FRAMES && steady_clock::now() < deadline) {
+        if (!inputDone) {
+            ssize_t index = AMediaCodec_dequeueInputBuffer(probe, 0);
+            if (index >= 0) {
+                size_t capacity;
+                uint8_t* buffer = AMediaCodec_getInputBuffer(probe, index, &capacity);
+                ssize_t size = AMediaExtractor_readSampleData(extractor, buffer, capacity);
+                if (size < 0 || queued == FRAMES) {
+                    AMediaCodec_queueInputBuffer(probe, index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+                    inputDone = true;
+                } else {
+                    int64_t pts = AMediaExtractor_getSampleTime(extractor);
+                    AMediaCodec_queueInputBuffer(probe, index, 0, size, pts > 0 ? pts : 0, 0);
+                    AMediaExtractor_advance(extractor);
+                    queued++;
+                }
+            }
+        }
+        AMediaCodecBufferInfo info;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(probe, &info, 2000);
+        if (index >= 0) {
+            // Not rendered, only decode throughput counts
+            AMediaCodec_releaseOutputBuffer(probe, index, false);
+            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+                break;
+            }
+            lastOutput = steady_clock::now();
+            if (decoded++ == 0) {
+                firstOutput = lastOutput;
+            }
+        }
+    }
+
+    if (decoded > 0) {
+        codec.probeOk = true;
+        codec.latencyMs = duration_cast<microseconds>(firstOutput - start).count() / 1000.0f;
+        // Output to output once the pipeline is full, setup and first-frame latency excluded
+        auto span = duration_cast<microseconds>(lastOutput - firstOutput).count();
+        codec.fps = decoded > 1 && span > 0 ? (decoded - 1) * 1e6f / span : 0.0f;
+    }
+    LOGI(LOG_TAG, "Probe %s (%s): %d/%d frames, %.1f fps, first frame %.1f ms",
+         codec.name.c_str(), codec.hardware ? "hw" : "sw", decoded, queued, codec.fps, codec.latencyMs);
+
+    if (probe) {
+        AMediaCodec_stop(probe);
+        AMediaCodec_delete(probe);
+    }
+    if (reader) {
+        AImageReader_delete(reader);
+    }
+    if (extractor) {
+        AMediaExtractor_delete(extractor);
+    }
+}
@@ -0,0 +1,31 @@
+//
+// Decoder enumeration (MediaCodecList via JNI) and a short decode-throughput probe.
+//
+#ifndef ACODECPROBE_H
+#define ACODECPROBE_H
+
+#include <jni.h>
+#include <media/NdkMediaFormat.h>
+#include <vector>
+
+#include "acodecselect.h"
+
+class ACodecProbe {
+public:
+    // Samples decoded per probe, and the time it may take at most
+    static const int FRAMES = 30;
+    static const int BUDGET_MS = 500;
+
+    // Video decoders that handle mime, in platform preference order, aliases skipped
+    static std::vector<CodecProfile> candidates(JavaVM* vm, const char* mime, const CodecRequirement& req);
+
+    /**
+     * Decodes the first FRAMES samples of track in file with codec.name into a
+     * throwaway ImageReader, as fast as input can be queued, and fills in the
+     * probe fields. Blocking, up to BUDGET_MS plus codec setup.
+     */
+    static void measure(CodecProfile& codec, const char* file, size_t track, AMediaFormat* format,
+                        const CodecRequirement& req);
+};
+
+#endif //ACODECPROBE_H
@@ -0,0 +1,155 @@
+//
+// Decoder ranking and probe cache.
+//
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "acodecselect.h"
+#include "util.h"
+#define LOG_TAG "acodecselect"
+
+int ACodecSelect::sustains(const CodecProfile& codec, const CodecRequirement& req) {
+    float need = (req.fps > 0.0f ? req.fps : DEFAULT_FPS) * HEADROOM;
+    // A measurement beats what the codec claims
+    float have = codec.probed ? codec.fps : codec.declaredFps;
+    if (have <= 0.0f) {
+        return 0;
+    }
+    return have >= need ? 1 : -1;
+}
+
+std::vector<CodecProfile> ACodecSelect::rank(std::vector<CodecProfile> candidates, const CodecRequirement& req) {
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [](const CodecProfile& c) {
+        return !c.supported || (c.probed && !c.probeOk);
+    }), candidates.end());
+
+    // A lexicographic key, so the order is a strict weak one (std::stable_sort needs
+    // that; "latencies within the slack are equal" isn't transitive). Stable, so equal
+    // candidates keep the platform's preference order.
+    struct Key {
+        int sustains;
+        bool hardware;
+        long latencyBucket;
+        float fps;
+    };
+    auto keyOf = [&req](const CodecProfile& c) {
+        int s = sustains(c, req);
+        Key key{s, false, 0, c.probed ? c.fps : c.declaredFps};
+        if (s == 1) {
+            key.hardware = c.hardware;
+            // Unmeasured latency goes after every measured one
+            key.latencyBucket = c.probed ? (long)std::floor(c.latencyMs / LATENCY_SLACK_MS) : LONG_MAX;
+        } else if (s == 0) {
+            // No numbers to go by, platform order
+            key.fps = 0.0f;
+        }
+        return key;
+    };
+    std::stable_sort(candidates.begin(), candidates.end(), [&keyOf](const CodecProfile& a, const CodecProfile& b) {
+        Key ka = keyOf(a);
+        Key kb = keyOf(b);
+        if (ka.sustains != kb.sustains) {
+            return ka.sustains > kb.sustains;
+        }
+        if (ka.hardware != kb.hardware) {
+            return ka.hardware;
+        }
+        if (ka.latencyBucket != kb.latencyBucket) {
+            return ka.latencyBucket < kb.latencyBucket;
+        }
+        return ka.fps > kb.fps;
+    });
+    return candidates;
+}
+
+std::string ACodecProbeCache::keyFor(const std::string& name, const char* mime, const CodecRequirement& req) {
+    char size[32];
+    snprintf(size, sizeof(size), "%dx%d", req.width, req.height);
+    return name + "\t" + mime + "\t" + size;
+}
+
+bool ACodecProbeCache::load(const char* file, const char* build) {
+    path = file ? file : "";
+    fingerprint = build ? build : "";
+    entries.clear();
+    FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        // fingerprint \t name \t mime \t WxH \t ok \t fps \t latency
+        char* fields[7];
+        int n = 0;
+        for (char* p = line; n < 7 && p; n++) {
+            fields[n] = p;
+            p = strchr(p, '\t');
+            if (p) *p++ = '\0';
+        }
+        if (n < 7 || fingerprint != fields[0]) {
+            continue;
+        }
+        Entry e;
+        e.key = std::string(fields[1]) + "\t" + fields[2] + "\t" + fields[3];
+        e.ok = atoi(fields[4]) != 0;
+        e.fps = strtof(fields[5], nullptr);
+        e.latencyMs = strtof(fields[6], nullptr);
+        entries.push_back(e);
+    }
+    fclose(f);
+    return true;
+}
+
+bool ACodecProbeCache::save() const {
+    if (path.empty()) {
+        return false;
+    }
+    // Write then rename, so a crash never leaves a truncated file behind.
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        LOGW(LOG_TAG, "Failed to open %s", tmp.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (const auto& e : entries) {
+        ok = fprintf(f, "%s\t%s\t%d\t%.2f\t%.3f\n", fingerprint.c_str(), e.key.c_str(),
+                     e.ok ? 1 : 0, e.fps, e.latencyMs) > 0 && ok;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOGW(LOG_TAG, "Failed to write %s", path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ACodecProbeCache::lookup(CodecProfile& codec, const char* mime, const CodecRequirement& req) const {
+    std::string key = keyFor(codec.name, mime, req);
+    for (const auto& e : entries) {
+        if (e.key == key) {
+            codec.probed = true;
+            codec.probeOk = e.ok;
+            codec.fps = e.fps;
+            codec.latencyMs = e.latencyMs;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ACodecProbeCache::store(const CodecProfile& codec, const char* mime, const CodecRequirement& req) {
+    std::string key = keyFor(codec.name, mime, req);
+    auto it = std::find_if(entries.begin(), entries.end(), [&key](const Entry& e) { return e.key == key; });
+    if (it == entries.end()) {
+        it = entries.insert(entries.end(), Entry{key, false, 0.0f, 0.0f});
+    }
+    it->ok = codec.probeOk;
+    it->fps = codec.fps;
+    it->latencyMs = codec.latencyMs;
+}
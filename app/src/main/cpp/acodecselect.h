@@ -0,0 +1,78 @@
+//
+// Decoder ranking from declared capabilities and measured throughput, and the
+// on-disk cache of the measurements. Pure logic, no platform calls.
+//
+#ifndef ACODECSELECT_H
+#define ACODECSELECT_H
+
+#include <string>
+#include <vector>
+
+struct CodecRequirement {
+    int width;
+    int height;
+    float fps;          // content frame rate, 0 if unknown
+};
+
+struct CodecProfile {
+    std::string name;
+    bool hardware;      // MediaCodecInfo.isHardwareAccelerated()
+    bool supported;     // size and rate within VideoCapabilities
+    float declaredFps;  // upper achievable frame rate at the content size, 0 if not published
+    // Probe results, valid when probed
+    bool probed;
+    bool probeOk;       // created, configured and produced frames
+    float fps;          // decoded frames per second, input fed as fast as possible
+    float latencyMs;    // first input queued to first output
+};
+
+class ACodecSelect {
+public:
+    // Throughput over the content rate a decoder needs to count as sustaining it
+    static constexpr float HEADROOM = 1.25f;
+    // Latencies are compared in buckets this wide, the same bucket ranks as equal
+    static constexpr float LATENCY_SLACK_MS = 2.0f;
+    // Assumed content rate when the container doesn't say
+    static constexpr float DEFAULT_FPS = 30.0f;
+
+    /**
+     * Fallback chain, best first. Candidates that don't support the stream or
+     * failed their probe are left out. Decoders that sustain the content rate
+     * come first: hardware before software, then lower latency (LATENCY_SLACK_MS
+     * buckets, unmeasured last), then higher throughput. Then the ones without numbers, in platform order, then the
+     * ones too slow for the content, fastest first.
+     */
+    static std::vector<CodecProfile> rank(std::vector<CodecProfile> candidates, const CodecRequirement& req);
+
+    // 1 sustains the content rate, 0 unknown, -1 too slow
+    static int sustains(const CodecProfile& codec, const CodecRequirement& req);
+};
+
+/**
+ * Probe results keyed by build, codec, mime and stream size, one tab separated
+ * line each. Entries of another build (fingerprint) are dropped on load, a system
+ * update can change the decoders.
+ */
+class ACodecProbeCache {
+public:
+    bool load(const char* path, const char* fingerprint);
+    bool save() const;
+    // Copies the cached probe into codec; false on a miss
+    bool lookup(CodecProfile& codec, const char* mime, const CodecRequirement& req) const;
+    void store(const CodecProfile& codec, const char* mime, const CodecRequirement& req);
+
+private:
+    struct Entry {
+        std::string key;
+        bool ok;
+        float fps;
+        float latencyMs;
+    };
+    std::string path;
+    std::string fingerprint;
+    std::vector<Entry> entries;
+
+    static std::string keyFor(const std::string& name, const char* mime, const CodecRequirement& req);
+};
+
+#endif //ACODECSELECT_H
@@ -0,0 +1,111 @@
+//
+// Per-frame decode latency tracking.
+//
+#include "adecodelatency.h"
+
+static const int MASK = ADecodeLatency::SLOTS - 1;
+static_assert((ADecodeLatency::SLOTS & MASK) == 0, "SLOTS must be a power of two");
+
+int ADecodeLatency::home(int64_t ptsUs) {
+    // Fibonacci hashing, PTS are mostly multiples of the frame duration
+    return (int)(((uint64_t)ptsUs * 0x9E3779B97F4A7C15ULL) >> 58) & MASK;
+}
+
+int ADecodeLatency::find(int64_t ptsUs) const {
+    for (int i = home(ptsUs), n = 0; n < SLOTS && slots[i].used; i = (i + 1) & MASK, n++) {
+        if (slots[i].ptsUs == ptsUs) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ADecodeLatency::queued(int64_t ptsUs, int64_t nowNs) {
+    int i = find(ptsUs);
+    if (i < 0) {
+        if (used >= SLOTS * 3 / 4) {
+            expire(nowNs);
+            if (used >= SLOTS - 1) {
+                // Still full of frames younger than EXPIRE_NS, leave this one untracked
+                return;
+            }
+        }
+        i = home(ptsUs);
+        while (slots[i].used) {
+            i = (i + 1) & MASK;
+        }
+        used++;
+    }
+    // A repeated PTS restarts its clock
+    slots[i] = {ptsUs, nowNs, true};
+}
+
+bool ADecodeLatency::released(int64_t ptsUs, int64_t nowNs, int64_t* latencyUs) {
+    int i = find(ptsUs);
+    if (i < 0) {
+        unmatchedCount++;
+        return false;
+    }
+    int64_t us = (nowNs - slots[i].queuedNs) / 1000;
+    latency.record(us);
+    if (latencyUs) {
+        *latencyUs = us;
+    }
+    erase(i);
+    return true;
+}
+
+void ADecodeLatency::erase(int i) {
+    // Pull later entries of the same probe run back, so lookups never stop early
+    int j = i;
+    while (true) {
+        slots[i].used = false;
+        int k;
+        do {
+            j = (j + 1) & MASK;
+            if (!slots[j].used) {
+                used--;
+                return;
+            }
+            k = home(slots[j].ptsUs);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        slots[i] = slots[j];
+        i = j;
+    }
+}
+
+int ADecodeLatency::expire(int64_t nowNs, int64_t maxAgeNs) {
+    int n = 0;
+    for (int i = 0; i < SLOTS;) {
+        if (slots[i].used && nowNs - slots[i].queuedNs > maxAgeNs) {
+            // erase() may move another entry into i, look at it again
+            erase(i);
+            n++;
+        } else {
+            i++;
+        }
+    }
+    expiredCount += n;
+    return n;
+}
+
+void ADecodeLatency::clear() {
+    for (auto& slot : slots) {
+        slot.used = false;
+    }
+    used = 0;
+}
+
+void ADecodeLatency::shift(int64_t ns) {
+    for (auto& slot : slots) {
+        if (slot.used) {
+            slot.queuedNs += ns;
+        }
+    }
+}
+
+void ADecodeLatency::resetStats() {
+    latency.reset();
+    unmatchedCount = 0;
+    expiredCount = 0;
+}
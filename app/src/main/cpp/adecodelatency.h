@@ -0,0 +1,63 @@
+//
+// Per-frame decode latency: input queue time matched to output release by PTS.
+//
+#ifndef ADECODELATENCY_H
+#define ADECODELATENCY_H
+
+#include <cstdint>
+
+#include "ahistogram.h"
+
+/**
+ * Samples in flight live in a small open-addressed table (linear probing,
+ * backward-shift deletion) keyed by PTS, since outputs come back reordered
+ * (B-frames) and frames can be dropped by the codec. No allocations; queue
+ * and release have to be called from the same thread.
+ */
+class ADecodeLatency {
+public:
+    // Power of two, well above the number of frames any codec holds
+    static const int SLOTS = 64;
+    // Entries older than this are given up on once the table fills up
+    static const int64_t EXPIRE_NS = 1000000000;
+
+    ADecodeLatency() { clear(); resetStats(); }
+
+    // Input sample queued to the codec
+    void queued(int64_t ptsUs, int64_t nowNs);
+    // Output released; false when no queued sample had this PTS. latencyUs, if given,
+    // gets this frame's queue-to-release time
+    bool released(int64_t ptsUs, int64_t nowNs, int64_t* latencyUs = nullptr);
+    // After a codec flush, nothing in flight comes back
+    void clear();
+    // Moves what is in flight later by a pause, so it isn't counted as decode time
+    void shift(int64_t ns);
+    // Drops entries queued more than maxAgeNs ago (frames the codec dropped), returns how many
+    int expire(int64_t nowNs, int64_t maxAgeNs = EXPIRE_NS);
+
+    // Queue to release (us) of every matched frame
+    AHistogram& histogram() { return latency; }
+    int inFlight() const { return used; }
+    // Outputs without a matching input, inputs that never came out
+    uint32_t unmatched() const { return unmatchedCount; }
+    uint32_t expired() const { return expiredCount; }
+    void resetStats();
+
+private:
+    struct Slot {
+        int64_t ptsUs;
+        int64_t queuedNs;
+        bool used;
+    };
+    Slot slots[SLOTS];
+    int used;
+    uint32_t unmatchedCount;
+    uint32_t expiredCount;
+    AHistogram latency;
+
+    static int home(int64_t ptsUs);
+    int find(int64_t ptsUs) const;
+    void erase(int index);
+};
+
+#endif //ADECODELATENCY_H
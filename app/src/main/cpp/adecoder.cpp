@@ -2,13 +2,23 @@
 // Created by Ihor Ilkevych on 9/13/25.
 //
 #include "adecoder.h"
+#include "acodecprobe.h"
+#include "athreadpolicy.h"
 #include "util.h"
+#include <android/hardware_buffer.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <algorithm>
+#include <vector>
 
 #define LOG_TAG "adecoder"
 
+static int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 ADecoder::ADecoder() :
     extractor(nullptr),
     codec(nullptr),
@@ -19,36 +29,52 @@ ADecoder::~ADecoder() {
     terminate();
 }
 
-bool ADecoder::init() {
-    // Find the most recent MP4 file
-    const char* downloadDir = "/sdcard/Download";
-    DIR* dir = opendir(downloadDir);
+std::vector<std::string> ADecoder::findVideos(const char* dirPath) {
+    struct Video {
+        std::string path;
+        time_t mtime;
+    };
+    std::vector<Video> videos;
+    DIR* dir = opendir(dirPath);
     if (!dir) {
-        LOGE(LOG_TAG, "Failed to open directory: %s", downloadDir);
-        return false;
+        LOGE(LOG_TAG, "Failed to open directory: %s", dirPath);
+        return {};
     }
-    std::string filePath;
-    time_t maxTime = 0;
-
     struct dirent* entry;
     while (( entry = readdir(dir)) != nullptr) {
         std::string filename = entry->d_name;
         if (filename.length() >= 4 && filename.substr(filename.length() - 4) == ".mp4") {
-            filename.insert(0, std::string(downloadDir) + "/");
+            filename.insert(0, std::string(dirPath) + "/");
             // Get file modification time
             struct stat fileStat;
-            if (stat(filename.c_str(), &fileStat) == 0 && fileStat.st_mtime > maxTime) {
-                maxTime = fileStat.st_mtime;
-                filePath = filename;
+            if (stat(filename.c_str(), &fileStat) == 0) {
+                videos.push_back({filename, fileStat.st_mtime});
             }
         }
     }
     closedir(dir);
 
-    if (filePath.empty()) {
+    std::stable_sort(videos.begin(), videos.end(),
+                     [](const Video& a, const Video& b) { return a.mtime > b.mtime; });
+    std::vector<std::string> paths;
+    for (auto& v : videos) {
+        paths.push_back(std::move(v.path));
+    }
+    return paths;
+}
+
+bool ADecoder::init(JavaVM* vm, const char* cacheDir) {
+    return open() && start(vm, cacheDir);
+}
+
+bool ADecoder::open() {
+    // Find the most recent MP4 file
+    std::vector<std::string> videos = findVideos(DOWNLOAD_DIR);
+    if (videos.empty()) {
         LOGE(LOG_TAG, "No MP4 files found in Downloads folder");
         return false;
     }
+    filePath = videos.front();
 
     LOGI(LOG_TAG, "Initializing decoder from file: %s", filePath.c_str());
 
@@ -60,7 +86,7 @@ bool ADecoder::init() {
     }
 
     // Open file and use file descriptor
-    int fd = open(filePath.c_str(), O_RDONLY);
+    int fd = ::open(filePath.c_str(), O_RDONLY);
     if (fd < 0) {
         LOGE(LOG_TAG, "Failed to open file: %s, error: %s", filePath.c_str(), strerror(errno));
         return false;
@@ -116,6 +142,16 @@ bool ADecoder::init() {
         return false;
     }
 
+    // Stored as int32 by most extractors, float by some
+    int32_t fps;
+    if (!AMediaFormat_getFloat(videoFormat, AMEDIAFORMAT_KEY_FRAME_RATE, &contentFrameRate)) {
+        contentFrameRate = AMediaFormat_getInt32(videoFormat, AMEDIAFORMAT_KEY_FRAME_RATE, &fps) ? fps : 0.0f;
+    }
+
+    const char* mime;
+    AMediaFormat_getString(videoFormat, AMEDIAFORMAT_KEY_MIME, &mime);
+    sizePipeline(videoFormat, mime);
+
     // Get video dimensions
     int32_t width, height;
     if (!AMediaFormat_getInt32(videoFormat, AMEDIAFORMAT_KEY_WIDTH, &width) ||
@@ -125,8 +161,27 @@ bool ADecoder::init() {
         return false;
     }
 
+    updateVideoFormat(videoFormat);
+    trackFormat = videoFormat;
+    trackIndex = videoTrackIndex;
+    return true;
+}
+
+bool ADecoder::start(JavaVM* vm, const char* cacheDir) {
+    // Ours from here, deleted on every way out
+    AMediaFormat* videoFormat = trackFormat;
+    trackFormat = nullptr;
+    if (!videoFormat) {
+        return false;
+    }
+    const char* mime;
+    int32_t width, height;
+    AMediaFormat_getString(videoFormat, AMEDIAFORMAT_KEY_MIME, &mime);
+    AMediaFormat_getInt32(videoFormat, AMEDIAFORMAT_KEY_WIDTH, &width);
+    AMediaFormat_getInt32(videoFormat, AMEDIAFORMAT_KEY_HEIGHT, &height);
+
     // Create ImageReader
-    media_status_t imageReaderStatus = AImageReader_new(width, height, AIMAGE_FORMAT_YUV_420_888, MAX_IMAGES, &imageReader);
+    media_status_t imageReaderStatus = AImageReader_new(width, height, AIMAGE_FORMAT_YUV_420_888, APipeline::MAX_IMAGES, &imageReader);
     if (imageReaderStatus != AMEDIA_OK) {
         LOGE(LOG_TAG, "Failed to create ImageReader: %d", imageReaderStatus);
         AMediaFormat_delete(videoFormat);
@@ -136,37 +191,40 @@ bool ADecoder::init() {
 
     // Get ANativeWindow from ImageReader
     ANativeWindow* surface;
-    status = AImageReader_getWindow(imageReader, &surface);
+    media_status_t status = AImageReader_getWindow(imageReader, &surface);
     if (status != AMEDIA_OK) {
         LOGE(LOG_TAG, "Failed to get window from ImageReader: %d", status);
         AMediaFormat_delete(videoFormat);
         return false;
     }
+    readerWindow = surface;
 
-    // Create codec
-    const char* mime;
-    AMediaFormat_getString(videoFormat, AMEDIAFORMAT_KEY_MIME, &mime);
-    codec = AMediaCodec_createDecoderByType(mime);
-    if (!codec) {
-        LOGE(LOG_TAG, "Failed to create decoder for mime: %s", mime);
-        AMediaFormat_delete(videoFormat);
-        return false;
-    }
-
-    // Configure codec
-    status = AMediaCodec_configure(codec, videoFormat, surface, nullptr, 0);
-    if (status != AMEDIA_OK) {
-        LOGE(LOG_TAG, "Failed to configure codec: %d", status);
-        AMediaFormat_delete(videoFormat);
-        return false;
+    // Reverse playback and stepping keep decoded frames GPU-side, as many as the budget holds
+    int64_t frameBytes = (int64_t)width * height * 3 / 2 * (bitDepth > 8 ? 2 : 1);
+    int64_t budget = (int64_t)propertyInt("debug.aplayer.gopcache", APipeline::GOP_CACHE_BUDGET_MB) << 20;
+    int cacheFrames = (int)std::clamp<int64_t>(budget / frameBytes, APipeline::MIN_CACHED_FRAMES,
+                                               APipeline::MAX_CACHED_FRAMES);
+    // One more for the frame being inserted, one the renderer may hold after eviction.
+    // Holds only as long as decodeGop() frees each insert's eviction before the next acquire.
+    if (AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_YUV_420_888, AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
+                                  cacheFrames + 2, &cacheReader) == AMEDIA_OK
+        && AImageReader_getWindow(cacheReader, &cacheWindow) == AMEDIA_OK) {
+        frameCache.setCapacity(cacheFrames);
+        LOGI(LOG_TAG, "GOP cache: %d frames, %lld KiB each", cacheFrames, (long long)(frameBytes >> 10));
+    } else {
+        LOGW(LOG_TAG, "No GOP cache reader, reverse playback and stepping unavailable");
+        if (cacheReader) {
+            AImageReader_delete(cacheReader);
+            cacheReader = nullptr;
+        }
+        cacheWindow = nullptr;
     }
 
+    // Create, configure and start codec
+    codec = openCodec(mime, videoFormat, surface, filePath, trackIndex,
+                      {width, height, contentFrameRate}, vm, cacheDir);
     AMediaFormat_delete(videoFormat);
-
-    // Start codec
-    status = AMediaCodec_start(codec);
-    if (status != AMEDIA_OK) {
-        LOGE(LOG_TAG, "Failed to start codec: %d", status);
+    if (!codec) {
         return false;
     }
 
@@ -174,16 +232,161 @@ bool ADecoder::init() {
     run = true;
     extractorThread = std::thread(&ADecoder::extractorLoop, this);
 
-    LOGI(LOG_TAG, "ADecoder initialized successfully for %dx%d video", width, height);
+    LOGI(LOG_TAG, "ADecoder initialized successfully for %dx%d video at %.3f fps", width, height, contentFrameRate);
+    return true;
+}
+
+AMediaCodec* ADecoder::openCodec(const char* mime, AMediaFormat* format, ANativeWindow* surface,
+                                 const std::string& file, size_t track, const CodecRequirement& req,
+                                 JavaVM* vm, const char* cacheDir) {
+    std::vector<CodecProfile> chain = ACodecProbe::candidates(vm, mime, req);
+    // Probes are cached per build, only a new codec/size combination pays for one
+    if (!chain.empty() && propertyInt("debug.aplayer.codecprobe", 1)) {
+        char build[PROP_VALUE_MAX] = "";
+        __system_property_get("ro.build.fingerprint", build);
+        std::string cachePath = cacheDir ? std::string(cacheDir) + "/codecs.txt" : "";
+        ACodecProbeCache cache;
+        cache.load(cachePath.c_str(), build);
+        bool probed = false;
+        for (auto& candidate : chain) {
+            if (candidate.supported && !cache.lookup(candidate, mime, req)) {
+                ACodecProbe::measure(candidate, file.c_str(), track, format, req);
+                cache.store(candidate, mime, req);
+                probed = true;
+            }
+        }
+        if (probed) {
+            cache.save();
+        }
+    }
+    chain = ACodecSelect::rank(chain, req);
+
+    for (const auto& candidate : chain) {
+        AMediaCodec* c = startCodec(candidate.name.c_str(), mime, format, surface, req.fps);
+        if (c) {
+            LOGI(LOG_TAG, "Decoder %s (%s): %.1f fps measured, %.1f fps declared, first frame %.1f ms",
+                 candidate.name.c_str(), candidate.hardware ? "hw" : "sw",
+                 candidate.fps, candidate.declaredFps, candidate.latencyMs);
+            return c;
+        }
+        LOGW(LOG_TAG, "Decoder %s failed to start, trying the next one", candidate.name.c_str());
+    }
+
+    // No codec list (no JNI) or nothing on it started: whatever the platform picks
+    AMediaCodec* c = startCodec(nullptr, mime, format, surface, req.fps);
+    if (!c) {
+        LOGE(LOG_TAG, "Failed to start a decoder for mime: %s", mime);
+    }
+    return c;
+}
+
+void ADecoder::applyLatencyProfile(AMediaFormat* format, float fps) {
+    // Output each frame as soon as it is decoded (FEATURE_LowLatency decoders, others ignore it)
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_LOW_LATENCY, 1);
+    // 0 is realtime
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_PRIORITY, 0);
+    // Clock the codec for twice the content rate, a frame is ready well ahead of its vsync
+    AMediaFormat_setFloat(format, AMEDIAFORMAT_KEY_OPERATING_RATE, (fps > 0.0f ? fps : 30.0f) * 2.0f);
+}
+
+AMediaCodec* ADecoder::startCodec(const char* name, const char* mime, AMediaFormat* format,
+                                  ANativeWindow* surface, float fps) {
+    bool lowLatency = propertyInt("debug.aplayer.lowlatency", 1) != 0;
+    // Some codecs refuse an operating rate above what they can do; a failed configure
+    // leaves the codec unusable, so the untuned retry gets a fresh instance.
+    for (int attempt = lowLatency ? 0 : 1; attempt < 2; attempt++) {
+        AMediaCodec* c = name ? AMediaCodec_createCodecByName(name) : AMediaCodec_createDecoderByType(mime);
+        if (!c) {
+            return nullptr;
+        }
+        AMediaFormat* configured = AMediaFormat_new();
+        AMediaFormat_copy(configured, format);
+        if (attempt == 0) {
+            applyLatencyProfile(configured, fps);
+        }
+        media_status_t status = AMediaCodec_configure(c, configured, surface, nullptr, 0);
+        if (status == AMEDIA_OK) {
+            status = AMediaCodec_start(c);
+        }
+        AMediaFormat_delete(configured);
+        if (status == AMEDIA_OK) {
+            return c;
+        }
+        LOGW(LOG_TAG, "Codec %s did not start%s: %d", name ? name : mime,
+             attempt == 0 ? " with the low-latency profile" : "", status);
+        AMediaCodec_delete(c);
+    }
+    return nullptr;
+}
+
+bool ADecoder::takeDecodeLatency(AHistogram& out) {
+    if (!latencyPublished.exchange(false)) {
+        return false;
+    }
+    std::lock_guard lk(mtx);
+    out = latencySnapshot;
     return true;
 }
 
+void ADecoder::sizePipeline(AMediaFormat* format, const char* mime) {
+    streamSizing = {};
+    inputDepth = 0;
+    dequeueTimeoutUs = APipeline::dequeueTimeoutUs(contentFrameRate);
+
+    // AVC has the SPS in csd-0 and the PPS in csd-1, HEVC all of VPS/SPS/PPS in csd-0
+    std::vector<uint8_t> csd;
+    for (const char* key : {"csd-0", "csd-1"}) {
+        void* data;
+        size_t size;
+        if (AMediaFormat_getBuffer(format, key, &data, &size)) {
+            csd.insert(csd.end(), (uint8_t*)data, (uint8_t*)data + size);
+        }
+    }
+    StreamParams params{};
+    VideoCodec videoCodec = AParamSets::codecForMime(mime);
+    if (!AParamSets::parse(videoCodec, csd.data(), csd.size(), params)) {
+        LOGI(LOG_TAG, "No parameter sets for %s, default pipeline sizing", mime);
+        return;
+    }
+    streamSizing = AParamSets::sizing(params, contentFrameRate);
+    bitDepth = params.bitDepth;
+    inputDepth = streamSizing.queueDepth;
+    LOGI(LOG_TAG, "%s profile %d level %d, %dx%d %d-bit: reorder %d (%s), dpb %d -> output delay %.1f ms, "
+         "%d inputs in flight, samples up to %lld bytes",
+         videoCodec == VideoCodec::AVC ? "AVC" : "HEVC", params.profile, params.level,
+         params.width, params.height, params.bitDepth, params.maxNumReorderFrames,
+         params.reorderSignaled ? "signaled" : "inferred", params.maxDecFrameBuffering,
+         streamSizing.outputDelayMs, inputDepth, (long long)streamSizing.maxSampleBytes);
+
+    int32_t maxInputSize;
+    if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, &maxInputSize)) {
+        AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, (int32_t)streamSizing.maxSampleBytes);
+    }
+
+    int targetMs = propertyInt("debug.aplayer.latencytarget", 50);
+    if (streamSizing.outputDelayMs > targetMs) {
+        LOGW(LOG_TAG, "Stream reorders %d frames (B-frames), %.1f ms before the first output "
+             "exceeds the %d ms latency target", streamSizing.outputDelayFrames,
+             streamSizing.outputDelayMs, targetMs);
+    }
+    if (!params.reorderSignaled && streamSizing.dpbFrames > 0) {
+        LOGW(LOG_TAG, "Reorder depth not signaled (no VUI bitstream_restriction), decoders may "
+             "hold up to %d frames", streamSizing.dpbFrames);
+    }
+}
+
 void ADecoder::terminate() {
-    run = false;
+    {
+        std::lock_guard lk(ctlMtx);
+        run = false;
+    }
+    ctlCv.notify_all();
 
     if (extractorThread.joinable()) {
         extractorThread.join();
     }
+    pauseRequested = false;
+    resumedNs = 0;
 
     if (codec) {
         AMediaCodec_stop(codec);
@@ -191,39 +394,324 @@ void ADecoder::terminate() {
         codec = nullptr;
     }
 
+    // Cached frames go before their reader
+    std::vector<AImage*> frames;
+    frameCache.clear(frames);
+    frames.insert(frames.end(), deferredFrames.begin(), deferredFrames.end());
+    for (AImage* frame : frames) {
+        AImage_delete(frame);
+    }
+    deferredFrames.clear();
+    currentFrame = nullptr;
+    frameInUse = nullptr;
+    cachedMode = false;
+    gopIndex.clear();
+    if (cacheReader) {
+        AImageReader_delete(cacheReader);
+        cacheReader = nullptr;
+        cacheWindow = nullptr;
+    }
+
     if (imageReader) {
         AImageReader_delete(imageReader);
         imageReader = nullptr;
     }
 
+    if (trackFormat) {
+        AMediaFormat_delete(trackFormat);
+        trackFormat = nullptr;
+    }
     if (extractor) {
         AMediaExtractor_delete(extractor);
         extractor = nullptr;
     }
 }
 
+bool ADecoder::pollFormatChange(VideoFormat& format) {
+    if (!formatChanged.exchange(false)) {
+        return false;
+    }
+    std::lock_guard lk(mtx);
+    format = videoFormat;
+    return true;
+}
+
+void ADecoder::updateVideoFormat(AMediaFormat* format) {
+    VideoFormat f{};
+    if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &f.width) ||
+        !AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &f.height)) {
+        LOGW(LOG_TAG, "Format without dimensions, keeping previous geometry");
+        return;
+    }
+    // Crop rect is inclusive in MediaFormat
+    int32_t left, top, right, bottom;
+    if (AMediaFormat_getRect(format, AMEDIAFORMAT_KEY_DISPLAY_CROP, &left, &top, &right, &bottom)) {
+        f.cropLeft = left;
+        f.cropTop = top;
+        f.cropRight = right + 1;
+        f.cropBottom = bottom + 1;
+    } else {
+        f.cropRight = f.width;
+        f.cropBottom = f.height;
+    }
+    {
+        std::lock_guard lk(mtx);
+        videoFormat = f;
+    }
+    formatChanged = true;
+}
+
+int ADecoder::takeReleased(int64_t& lastReleaseNs) {
+    int n = 0;
+    int64_t t;
+    while (releases.pop(t)) {
+        lastReleaseNs = t;
+        n++;
+    }
+    if (int lost = releasesLost.exchange(0, std::memory_order_acquire)) {
+        n += lost;
+        lastReleaseNs = std::max(lastReleaseNs, lostReleaseNs.load(std::memory_order_relaxed));
+    }
+    return n;
+}
+
+void ADecoder::noteRelease() {
+    int64_t now = steadyNs();
+    if (!releases.push(now)) {
+        lostReleaseNs.store(now, std::memory_order_relaxed);
+        releasesLost.fetch_add(1, std::memory_order_release);
+    }
+}
+
 AImage* ADecoder::acquireLatestImage() {
     if (!imageReader || !codec) {
         return nullptr;
     }
+    TRACE_SCOPE("acquireLatestImage");
     AImage* image = nullptr;
     // wait until main() sends data
     std::unique_lock lk(mtx);
-    cv.wait(lk, [this]{ return available; });
+    cv.wait(lk, [this]{ return available || cachedMode || pauseRequested; });
+    if (cachedMode) {
+        // Drawn again every frame while the picture is held, the cache keeps it
+        available = false;
+        frameInUse = currentFrame;
+        return currentFrame;
+    }
+    if (!available) {
+        // Paused, what is on screen stays
+        return nullptr;
+    }
     AImageReader_acquireLatestImage(imageReader, &image);
     available = false;
     lk.unlock();
-//    LOGI(LOG_TAG, "return Image");
+//    LOGI_ASYNC(LOG_TAG, "return Image");
     return image;
 }
 
+void ADecoder::changeRate(float rate) {
+    int64_t now = steadyNs();
+    int64_t mediaUs = clock.started() ? clock.mediaUs(now) : std::max<int64_t>(AMediaExtractor_getSampleTime(extractor), 0);
+    clock.setRate(rate, now);
+    FeedMode mode = trickPlay.mode(rate);
+    if (mode != feedMode) {
+        // What's in the codec was picked for the other mode. Sync-only continues with
+        // the next sync sample ahead; back to every sample it decodes from the previous
+        // one and drops what's already late.
+        if (pendingIndex >= 0) {
+            releasePending(false);
+        }
+        AMediaCodec_flush(codec);
+        decodeLatency.clear();
+        AMediaExtractor_seekTo(extractor, mediaUs, mode == FeedMode::SYNC_ONLY
+                                                   ? AMEDIAEXTRACTOR_SEEK_NEXT_SYNC
+                                                   : AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+        feedMode = mode;
+    }
+    LOGI_ASYNC(LOG_TAG, "Playback rate %.2fx at %lld us, %s", rate, (long long)mediaUs,
+               feedMode == FeedMode::SYNC_ONLY ? "sync samples only" : "all samples");
+}
+
+void ADecoder::releasePending(bool render) {
+    TRACE_SCOPE("releaseOutput");
+    if (!render) {
+        AMediaCodec_releaseOutputBuffer(codec, pendingIndex, false);
+        pendingIndex = -1;
+        droppedCount++;
+        return;
+    }
+    std::lock_guard lk(mtx);
+    AMediaCodec_releaseOutputBuffer(codec, pendingIndex, true);
+    pendingIndex = -1;
+    playheadUs = pendingPtsUs;
+    available = true;
+    noteRelease();
+    shownCount++;
+    logResumed();
+}
+
+void ADecoder::logResumed() {
+    if (resumedNs) {
+        LOGI_ASYNC(LOG_TAG, "Resumed at %lld us, frame out %.1f ms after resume", (long long)playheadUs,
+                   (steadyNs() - resumedNs) / 1e6);
+        resumedNs = 0;
+    }
+}
+
+void ADecoder::releaseImage(AImage* image) {
+    if (!image) {
+        return;
+    }
+    std::lock_guard lk(mtx);
+    if (image == frameInUse) {
+        frameInUse = nullptr;
+        auto it = std::find(deferredFrames.begin(), deferredFrames.end(), image);
+        if (it != deferredFrames.end()) {
+            deferredFrames.erase(it);
+            AImage_delete(image);
+        }
+        return;
+    }
+    AImage_delete(image);
+}
+
+void ADecoder::freeFrames(std::vector<AImage*>& frames) {
+    for (AImage* frame : frames) {
+        if (frame == currentFrame) {
+            currentFrame = nullptr;
+        }
+        if (frame == frameInUse) {
+            deferredFrames.push_back(frame);
+        } else {
+            AImage_delete(frame);
+        }
+    }
+    frames.clear();
+}
+
+void ADecoder::setPlaybackRate(float rate) {
+    {
+        std::lock_guard lk(ctlMtx);
+        requestedRate = APlaybackClock::clampRate(rate);
+        holding = false;
+    }
+    ctlCv.notify_all();
+}
+
+void ADecoder::pause() {
+    {
+        std::lock_guard ctl(ctlMtx);
+        std::lock_guard lk(mtx);
+        pauseRequested = true;
+    }
+    // Out of a blocked acquireLatestImage(), there may be no next frame until resume
+    cv.notify_all();
+    // And the extractor out of a held picture or a reverse frame's wait, to park
+    ctlCv.notify_all();
+}
+
+void ADecoder::resume() {
+    {
+        std::lock_guard lk(ctlMtx);
+        pauseRequested = false;
+    }
+    ctlCv.notify_all();
+}
+
+int64_t ADecoder::park() {
+    int64_t startNs = steadyNs();
+    // The clock goes on from where it stood, a frame waiting for its time keeps its place
+    bool started = clock.started();
+    int64_t mediaUs = started ? clock.mediaUs(startNs) : playheadUs;
+    LOGI_ASYNC(LOG_TAG, "Paused at %lld us", (long long)mediaUs);
+    {
+        std::unique_lock lk(ctlMtx);
+        ctlCv.wait(lk, [this]{ return !pauseRequested || !run; });
+    }
+    int64_t now = steadyNs();
+    if (started) {
+        clock.start(mediaUs, now);
+    }
+    decodeLatency.shift(now - startNs);
+    resumedNs = now;
+    return now - startNs;
+}
+
+void ADecoder::step(int frames) {
+    {
+        std::lock_guard lk(ctlMtx);
+        holding = true;
+        pendingSteps += frames;
+    }
+    ctlCv.notify_all();
+}
+
 void ADecoder::extractorLoop() {
     LOGI(LOG_TAG, "Extractor loop started");
+    extractorTid = AThreadPolicy::tid();
+    // Keep the decode loop off the little cores by default, debug.aplayer.decoder.* overrides
+    ThreadPolicy policy;
+    policy.name = "extractor";
+    policy.cores = CoreSet::BIG;
+    policy.nice = -4;
+    AThreadPolicy::apply(ThreadPolicy::fromProperties("debug.aplayer.decoder", policy));
     auto startTime = std::chrono::high_resolution_clock::now();
+    int64_t publishNs = steadyNs();
+    int64_t lastOutputNs = publishNs;
+    int64_t stallNs = APipeline::stallTimeoutUs(dequeueTimeoutUs) * 1000;
+    clock.reset();
+    clock.setRate(1.0f, publishNs);
+    feedMode = FeedMode::ALL;
+    pendingIndex = -1;
+    trickPlay.setSyncOnlyRate(propertyInt("debug.aplayer.synconlyspeed",
+                                          (int)(ATrickPlay::DEFAULT_SYNC_ONLY_RATE * 100)) / 100.0f);
+    float contentFps = contentFrameRate > 0.0f ? contentFrameRate : 30.0f;
 
     while (run) {
+        if (pauseRequested) {
+            // Time stands still for the stall and stats windows as well
+            int64_t pausedNs = park();
+            lastOutputNs += pausedNs;
+            publishNs += pausedNs;
+            cacheStatsNs += pausedNs;
+            continue;
+        }
+        float rate = requestedRate;
+        bool cached = cacheWindow && (holding || rate < 0.0f);
+        if (cached && !cachedMode && !enterCachedMode()) {
+            LOGW_ASYNC(LOG_TAG, "Codec can't switch output surfaces, reverse playback and stepping unavailable");
+            cacheWindow = nullptr;
+            holding = false;
+            cached = false;
+        }
+        if (!cached && cachedMode) {
+            leaveCachedMode(fabsf(rate));
+        }
+        if (cached) {
+            cachedPass(rate);
+            continue;
+        }
+        rate = fabsf(rate);
+        if (rate != clock.rate()) {
+            changeRate(rate);
+        }
+
+        // Only as many inputs in flight as the stream needs, more just wait in the codec
+        bool feed = APipeline::feeds(inputDepth, decodeLatency.inFlight());
+        // A frame waiting for its time isn't a stall
+        if (!feed && pendingIndex < 0 && steadyNs() - lastOutputNs > stallNs) {
+            // Pipelined hardware decoders hold more than the bitstream needs; or frames
+            // the codec dropped are still counted
+            if (decodeLatency.expire(steadyNs()) == 0 && inputDepth < APipeline::MAX_INPUT_DEPTH) {
+                inputDepth++;
+                LOGI_ASYNC(LOG_TAG, "Codec stalled, input depth raised to %d", inputDepth);
+            }
+            lastOutputNs = steadyNs();
+            feed = true;
+        }
+
         // Check if we can get an input buffer
-        ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(codec, 10000); // 10ms timeout
+        ssize_t inputBufferIndex = feed ? AMediaCodec_dequeueInputBuffer(codec, dequeueTimeoutUs) : -1;
 
         if (inputBufferIndex >= 0) {
             // Get input buffer
@@ -234,38 +722,404 @@ void ADecoder::extractorLoop() {
             ssize_t sampleSize = AMediaExtractor_readSampleData(extractor, inputBuffer, inputBufferSize);
 
             if (sampleSize < 0) {
-                // End of stream - restart from beginning
+                // End of stream - restart from beginning, the clock with the first frame
+                if (pendingIndex >= 0) {
+                    releasePending(false);
+                }
                 AMediaCodec_flush(codec);
+                decodeLatency.clear();
+                clock.reset();
                 AMediaExtractor_seekTo(extractor, 0, AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC);
 //                // Sleep to slow down extraction
 //                std::this_thread::sleep_for(std::chrono::milliseconds(3000));
                 continue;
             } else {
-                // Reset presentation time and queue input buffer
-                AMediaCodec_queueInputBuffer(codec, inputBufferIndex, 0, sampleSize, 0, 0);
-                // Advance to next sample
-                AMediaExtractor_advance(extractor);
+                // Keep the sample time, it comes back as the AImage timestamp
+                int64_t sampleTime = AMediaExtractor_getSampleTime(extractor);
+                if (sampleTime < 0) sampleTime = 0;
+                AMediaCodec_queueInputBuffer(codec, inputBufferIndex, 0, sampleSize, sampleTime, 0);
+                int64_t now = steadyNs();
+                decodeLatency.queued(sampleTime, now);
+                fedCount++;
+                TRACE_INSTANT("queueInput");
+                if (feedMode == FeedMode::SYNC_ONLY) {
+                    // Skip ahead to the sync sample due when this one is decoded
+                    int64_t mediaUs = clock.started() ? clock.mediaUs(now) : sampleTime;
+                    AMediaExtractor_seekTo(extractor, trickPlay.nextSyncTarget(mediaUs, rate, sampleTime),
+                                           AMEDIAEXTRACTOR_SEEK_NEXT_SYNC);
+                } else {
+                    // Advance to next sample
+                    AMediaExtractor_advance(extractor);
+                }
+            }
+        }
+
+        // Dequeue output buffers to keep the decoder pipeline flowing; one at a time
+        // while a decoded frame waits for the clock
+        if (pendingIndex < 0) {
+            AMediaCodecBufferInfo bufferInfo;
+            ssize_t outputBufferIndex = AMediaCodec_dequeueOutputBuffer(codec, &bufferInfo, dequeueTimeoutUs);
+
+            if (outputBufferIndex >= 0) {
+                int64_t now = steadyNs();
+                lastOutputNs = now;
+                decodedCount++;
+                int64_t latencyUs;
+                if (decodeLatency.released(bufferInfo.presentationTimeUs, now, &latencyUs) &&
+                    feedMode == FeedMode::SYNC_ONLY) {
+                    trickPlay.measuredDecode(latencyUs);
+                }
+                if (bufferInfo.presentationTimeUs < skipBelowUs) {
+                    // Leading up to where reverse/stepping left off
+                    AMediaCodec_releaseOutputBuffer(codec, outputBufferIndex, false);
+                } else {
+                    skipBelowUs = INT64_MIN;
+                    if (!clock.started()) {
+                        clock.start(bufferInfo.presentationTimeUs, now);
+                    }
+                    pendingIndex = outputBufferIndex;
+                    pendingPtsUs = bufferInfo.presentationTimeUs;
+                }
+            } else if (outputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                AMediaFormat* format = AMediaCodec_getOutputFormat(codec);
+                LOGI_ASYNC(LOG_TAG, "Output format changed");
+                TRACE_INSTANT("outputFormatChanged");
+                if (format) {
+                    updateVideoFormat(format);
+                    AMediaFormat_delete(format);
+                }
+            } else if (outputBufferIndex != AMEDIACODEC_INFO_TRY_AGAIN_LATER &&
+                       outputBufferIndex != AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+                LOGW_ASYNC(LOG_TAG, "dequeueOutputBuffer error %zd", outputBufferIndex);
             }
         }
 
-        // Dequeue output buffers to keep the decoder pipeline flowing
-        AMediaCodecBufferInfo bufferInfo;
-        ssize_t outputBufferIndex = AMediaCodec_dequeueOutputBuffer(codec, &bufferInfo, 10000);
+        if (pendingIndex >= 0) {
+            int64_t now = steadyNs();
+            int64_t dueNs = clock.dueNs(pendingPtsUs);
+            switch (trickPlay.judge(dueNs, now, (int64_t)(1e9 / (contentFps * rate)), feedMode)) {
+                case OutputAction::RESYNC:
+                    // A seek, or a decoder that can't keep up at all
+                    clock.start(pendingPtsUs, now);
+                    releasePending(true);
+                    break;
+                case OutputAction::SHOW:
+                    releasePending(true);
+                    break;
+                case OutputAction::DROP:
+                    releasePending(false);
+                    break;
+                case OutputAction::WAIT:
+                    // The input dequeue waited already when there was something to feed
+                    if (inputBufferIndex < 0) {
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(
+                                std::min<int64_t>(dueNs - now, dequeueTimeoutUs * 1000)));
+                    }
+                    break;
+            }
+        }
 
-        if (outputBufferIndex >= 0) {
-//            LOGI(LOG_TAG, "Got output buffer, releasing");
+        int64_t now = steadyNs();
+        if (now - publishNs >= 1000000000) {
+            float seconds = (now - publishNs) / 1e9f;
+            LOGI_ASYNC(LOG_TAG, "Rate %.2fx (%s): fed %.1f, decoded %.1f, shown %.1f, dropped %.1f per second, "
+                       "decode load %.2fx of 1x", rate, feedMode == FeedMode::SYNC_ONLY ? "sync only" : "all",
+                       fedCount / seconds, decodedCount / seconds, shownCount / seconds, droppedCount / seconds,
+                       decodedCount / seconds / contentFps);
+            fedCount = decodedCount = shownCount = droppedCount = 0;
+            // Once a second the render thread gets a copy
             std::lock_guard lk(mtx);
-            AMediaCodec_releaseOutputBuffer(codec, outputBufferIndex, true);
-            available = true;
-        } else if (outputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            latencySnapshot = decodeLatency.histogram();
+            latencyPublished = true;
+            decodeLatency.resetStats();
+            publishNs = now;
+        }
+        cv.notify_one();
+    }
+
+    if (pendingIndex >= 0) {
+        releasePending(false);
+    }
+    LOGI(LOG_TAG, "Extractor loop finished");
+}
+
+bool ADecoder::enterCachedMode() {
+    if (pendingIndex >= 0) {
+        releasePending(false);
+    }
+    AMediaCodec_flush(codec);
+    decodeLatency.clear();
+    if (AMediaCodec_setOutputSurface(codec, cacheWindow) != AMEDIA_OK) {
+        AMediaExtractor_seekTo(extractor, playheadUs, AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+        skipBelowUs = playheadUs;
+        clock.reset();
+        return false;
+    }
+    clock.reset();
+    cacheHits = cacheMisses = 0;
+    fetchLatency.reset();
+    cacheStatsNs = steadyNs();
+    // The picture on screen again, from the cache, so there's something to hold
+    frameCache.setPlayhead(playheadUs, requestedRate < 0.0f ? -1 : 1);
+    int64_t syncUs;
+    AImage* frame = nullptr;
+    if (!decodeGop(playheadUs, false, syncUs) || !frameCache.find(playheadUs, frame)) {
+        LOGW_ASYNC(LOG_TAG, "Frame at %lld us not decoded again", (long long)playheadUs);
+    }
+    std::lock_guard lk(mtx);
+    cachedMode = true;
+    currentFrame = frame;
+    available = true;
+    cv.notify_one();
+    return true;
+}
+
+void ADecoder::leaveCachedMode(float rate) {
+    std::vector<AImage*> frames;
+    frameCache.clear(frames);
+    {
+        std::lock_guard lk(mtx);
+        cachedMode = false;
+        available = false;
+        freeFrames(frames);
+        currentFrame = nullptr;
+    }
+    // Flushed after every GOP, nothing in flight
+    AMediaCodec_setOutputSurface(codec, readerWindow);
+    decodeLatency.clear();
+    int64_t now = steadyNs();
+    clock.reset();
+    clock.setRate(rate, now);
+    // Forward from the frame on screen, decoding up to it unseen
+    feedMode = trickPlay.mode(rate);
+    AMediaExtractor_seekTo(extractor, playheadUs, feedMode == FeedMode::SYNC_ONLY
+                                                  ? AMEDIAEXTRACTOR_SEEK_NEXT_SYNC
+                                                  : AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+    skipBelowUs = feedMode == FeedMode::ALL ? playheadUs : INT64_MIN;
+    LOGI_ASYNC(LOG_TAG, "Forward at %.2fx from %lld us", rate, (long long)playheadUs);
+}
+
+void ADecoder::cachedPass(float rate) {
+    int64_t now = steadyNs();
+    if (now - cacheStatsNs >= 1000000000) {
+        uint32_t lookups = cacheHits + cacheMisses;
+        if (fetchLatency.count() > 0) {
+            LOGI_ASYNC(LOG_TAG, "%s: shown %.1f/s, fetch (us) p50 %lld p99 %lld max %lld",
+                       holding ? "Stepping" : "Reverse", shownCount * 1e9f / (now - cacheStatsNs),
+                       (long long)fetchLatency.percentile(50), (long long)fetchLatency.percentile(99),
+                       (long long)fetchLatency.max());
+            LOGI_ASYNC(LOG_TAG, "GOP cache hits %u/%u (%.0f%%), %d/%d frames, %d GOPs indexed",
+                       cacheHits, lookups, lookups ? cacheHits * 100.0f / lookups : 0.0f,
+                       frameCache.size(), frameCache.capacity(), gopIndex.size());
+        }
+        cacheHits = cacheMisses = 0;
+        fetchLatency.reset();
+        shownCount = 0;
+        cacheStatsNs = now;
+    }
+
+    if (holding) {
+        int n = pendingSteps.exchange(0);
+        if (n == 0) {
+            // Nothing until the next step or rate change, no wakeups while the picture is held
+            std::unique_lock lk(ctlMtx);
+            ctlCv.wait(lk, [this]{ return pendingSteps != 0 || !holding || pauseRequested || !run; });
+            return;
+        }
+        clock.reset();
+        int direction = n > 0 ? 1 : -1;
+        for (; n != 0 && run && !pauseRequested; n -= direction) {
+            int64_t start = steadyNs();
+            int64_t ptsUs;
+            AImage* frame;
+            bool hit;
+            if (!fetchNeighbor(playheadUs, direction, ptsUs, frame, hit)) {
+                if (pauseRequested) {
+                    break;
+                }
+                LOGI_ASYNC(LOG_TAG, "Step %+d: no frame %s %lld us", direction,
+                           direction > 0 ? "after" : "before", (long long)playheadUs);
+                break;
+            }
+            showCached(frame, ptsUs);
+            hit ? cacheHits++ : cacheMisses++;
+            int64_t us = (steadyNs() - start) / 1000;
+            fetchLatency.record(us);
+            LOGI_ASYNC(LOG_TAG, "Step %+d to %lld us in %.1f ms (%s)", direction, (long long)ptsUs,
+                       us / 1000.0f, hit ? "cached" : "decoded");
+        }
+        if (pauseRequested) {
+            // The steps left are taken after the resume
+            pendingSteps += n;
+        }
+        return;
+    }
+
+    // Reverse playback, paced by the clock running backwards
+    if (!clock.started()) {
+        clock.setRate(rate, now);
+        clock.start(playheadUs, now);
+    } else if (clock.rate() != rate) {
+        clock.setRate(rate, now);
+    }
+    int64_t ptsUs;
+    AImage* frame = nullptr;
+    bool found;
+    if (trickPlay.mode(rate) == FeedMode::SYNC_ONLY) {
+        // The sync sample due once it's decoded
+        frameCache.setPlayhead(playheadUs, -1);
+        found = decodeGop(trickPlay.nextSyncTarget(clock.mediaUs(now), rate, playheadUs), true, ptsUs)
+                && ptsUs < playheadUs && frameCache.find(ptsUs, frame);
+        if (!pauseRequested) {
+            // Not a decode cut short by a pause
+            trickPlay.measuredDecode((steadyNs() - now) / 1000);
+        }
+        cacheMisses++;
+    } else {
+        // The frame before the clock: ones overdue by more than a frame are skipped
+        bool hit;
+        int64_t fromUs = clock.mediaUs(now) + (int64_t)(1e6f / (contentFrameRate > 0.0f ? contentFrameRate : 30.0f));
+        found = fetchNeighbor(std::min(playheadUs, fromUs), -1, ptsUs, frame, hit);
+        hit ? cacheHits++ : cacheMisses++;
+    }
+    if (!found) {
+        if (pauseRequested) {
+            // Decoding gave way to the pause, the same frame is fetched after it
+            return;
+        }
+        LOGI_ASYNC(LOG_TAG, "Reverse reached the start at %lld us, holding", (long long)playheadUs);
+        holding = true;
+        return;
+    }
+    fetchLatency.record((steadyNs() - now) / 1000);
+
+    int64_t dueNs = clock.dueNs(ptsUs);
+    if (steadyNs() - dueNs > ATrickPlay::RESYNC_NS) {
+        // Decoding the GOP took too long, go on from here
+        clock.start(ptsUs, steadyNs());
+    } else {
+        waitUntil(dueNs, rate);
+        if (pauseRequested) {
+            // Stays cached; shown at its time once resumed, park() shifts the clock
+            return;
+        }
+    }
+    showCached(frame, ptsUs);
+}
+
+bool ADecoder::fetchNeighbor(int64_t fromUs, int direction, int64_t& ptsUs, AImage*& frame, bool& hit) {
+    return frameCache.fetch(gopIndex, fromUs, direction, [this](int64_t seekUs) {
+        int64_t syncUs;
+        return run && !pauseRequested && decodeGop(seekUs, false, syncUs);
+    }, ptsUs, frame, hit);
+}
+
+AImage* ADecoder::takeCacheImage() {
+    // The buffer reaches the reader shortly after the codec releases it
+    AImage* image = nullptr;
+    for (int i = 0; i < 100; i++) {
+        if (AImageReader_acquireNextImage(cacheReader, &image) == AMEDIA_OK) {
+            return image;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    LOGW_ASYNC(LOG_TAG, "Decoded frame didn't reach the cache reader");
+    return nullptr;
+}
+
+bool ADecoder::decodeGop(int64_t seekUs, bool syncOnly, int64_t& syncUs) {
+    TRACE_SCOPE("decodeGop");
+    int64_t start = steadyNs();
+    AMediaExtractor_seekTo(extractor, std::max<int64_t>(seekUs, 0), AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+    Gop gop{AMediaExtractor_getSampleTime(extractor), INT64_MAX, {}};
+    syncUs = gop.syncUs;
+    if (gop.syncUs < 0) {
+        return false;
+    }
+    std::vector<AImage*> evicted;
+    bool inputDone = false;
+    bool complete = false;
+    int decoded = 0;
+    // A pause cuts the GOP short: it isn't indexed and is decoded again after the resume
+    while (run && !pauseRequested && steadyNs() - start < GOP_DECODE_TIMEOUT_NS) {
+        if (!inputDone) {
+            ssize_t index = AMediaCodec_dequeueInputBuffer(codec, dequeueTimeoutUs);
+            if (index >= 0) {
+                size_t size;
+                uint8_t* buffer = AMediaCodec_getInputBuffer(codec, index, &size);
+                ssize_t sampleSize = AMediaExtractor_readSampleData(extractor, buffer, size);
+                int64_t sampleTime = AMediaExtractor_getSampleTime(extractor);
+                bool sync = AMediaExtractor_getSampleFlags(extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC;
+                if (sampleSize < 0 || (!gop.frames.empty() && (sync || syncOnly))) {
+                    // Next GOP reached, end of stream drains what the codec holds for reordering
+                    gop.endUs = sampleSize < 0 ? INT64_MAX : sampleTime;
+                    AMediaCodec_queueInputBuffer(codec, index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+                    inputDone = true;
+                } else {
+                    AMediaCodec_queueInputBuffer(codec, index, 0, sampleSize, sampleTime, 0);
+                    gop.frames.push_back(sampleTime);
+                    AMediaExtractor_advance(extractor);
+                }
+            }
+        }
+
+        AMediaCodecBufferInfo info;
+        ssize_t out = AMediaCodec_dequeueOutputBuffer(codec, &info, dequeueTimeoutUs);
+        if (out >= 0) {
+            bool eos = info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+            bool render = !eos || info.size > 0;
+            AMediaCodec_releaseOutputBuffer(codec, out, render);
+            AImage* image = render ? takeCacheImage() : nullptr;
+            if (image) {
+                int64_t timestampNs;
+                AImage_getTimestamp(image, &timestampNs);
+                frameCache.insert(timestampNs / 1000, image, evicted);
+                decoded++;
+                if (!evicted.empty()) {
+                    // Back to the reader at once, a GOP longer than the slack would starve it
+                    std::lock_guard lk(mtx);
+                    freeFrames(evicted);
+                }
+            }
+            if (eos) {
+                complete = true;
+                break;
+            }
+        } else if (out == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
             AMediaFormat* format = AMediaCodec_getOutputFormat(codec);
-            LOGI(LOG_TAG, "Output format changed");
             if (format) {
+                updateVideoFormat(format);
                 AMediaFormat_delete(format);
             }
         }
-        cv.notify_one();
     }
+    AMediaCodec_flush(codec);
+    // A sync sample alone says nothing about the frames in between
+    if (complete && !syncOnly) {
+        gopIndex.add(gop);
+    }
+    if (!complete && !pauseRequested) {
+        LOGW_ASYNC(LOG_TAG, "GOP at %lld us not drained", (long long)gop.syncUs);
+    }
+    LOGI_ASYNC(LOG_TAG, "Decoded %s at %lld us: %zu samples, %d frames in %.1f ms, %d cached",
+               syncOnly ? "sync sample" : "GOP", (long long)gop.syncUs, gop.frames.size(), decoded,
+               (steadyNs() - start) / 1e6f, frameCache.size());
+    return decoded > 0;
+}
 
-    LOGI(LOG_TAG, "Extractor loop finished");
+void ADecoder::showCached(AImage* frame, int64_t ptsUs) {
+    std::lock_guard lk(mtx);
+    currentFrame = frame;
+    playheadUs = ptsUs;
+    available = true;
+    noteRelease();
+    shownCount++;
+    logResumed();
+    cv.notify_one();
+}
+
+void ADecoder::waitUntil(int64_t dueNs, float rate) {
+    std::unique_lock lk(ctlMtx);
+    ctlCv.wait_until(lk, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(dueNs)),
+                     [&]{ return requestedRate != rate || holding || pauseRequested || !run; });
 }
@@ -14,30 +14,192 @@
 #include <semaphore>
 #include <mutex>
 #include <atomic>
+#include <string>
+#include <vector>
+#include <jni.h>
+
+#include "acodecselect.h"
+#include "adecodelatency.h"
+#include "aframecache.h"
+#include "agopindex.h"
+#include "aparamsets.h"
+#include "apipeline.h"
+#include "aplaybackclock.h"
+#include "atrickplay.h"
+#include "aviewport.h"
+#include "aring.h"
 
 class ADecoder {
 public:
+    // Where init() looks for videos
+    static constexpr const char* DOWNLOAD_DIR = "/sdcard/Download";
+
     ADecoder();
     ~ADecoder();
 
-    bool init();
+    // .mp4 files in dir, newest first
+    static std::vector<std::string> findVideos(const char* dir);
+
+    // vm enables decoder ranking (MediaCodecList), cacheDir keeps its probe results
+    bool init(JavaVM* vm = nullptr, const char* cacheDir = nullptr);
+    // init() in two steps, for a startup that overlaps them with other work:
+    // the newest video's extractor and track, then the readers, codec and thread
+    bool open();
+    bool start(JavaVM* vm = nullptr, const char* cacheDir = nullptr);
     void terminate();
+    // Blocks for the next frame while playing forward; while reversing or stepping
+    // it returns the frame on screen right away. Give it back with releaseImage().
     AImage* acquireLatestImage();
+    void releaseImage(AImage* image);
+    // Returns true (once) when the output geometry changed since the previous call.
+    bool pollFormatChange(VideoFormat& format);
+    // Number of frames the codec released since the previous call, lastReleaseNs
+    // gets the steady clock time of the newest one.
+    int takeReleased(int64_t& lastReleaseNs);
+    // The video init() opened
+    const std::string& path() const { return filePath; }
+    // Nominal frame rate of the track, 0 if the container doesn't say
+    float frameRate() const { return contentFrameRate; }
+    // Derived from the stream's parameter sets, zero when they couldn't be read
+    const StreamSizing& sizing() const { return streamSizing; }
+    // Kernel tid of the extractor thread, 0 before it runs
+    int threadId() const { return extractorTid; }
+    // Queue-to-release latency (us) of the frames decoded over the last second;
+    // false until a new second is complete.
+    bool takeDecodeLatency(AHistogram& out);
+    // Presentation rate, magnitude clamped to 0.25x..16x, negative plays backwards from
+    // decoded GOPs. The extractor applies it at its next pass; ends stepping.
+    void setPlaybackRate(float rate);
+    float playbackRate() const { return requestedRate; }
+    // Holds the picture and moves it by frames, negative back
+    void step(int frames);
+    bool stepping() const { return holding; }
+    // Parks the extractor thread without wakeups, keeping the codec, its output and
+    // the position; resume() goes on from the same frame. While paused
+    // acquireLatestImage() doesn't block.
+    void pause();
+    void resume();
+    bool paused() const { return pauseRequested; }
+    // init() succeeded and terminate() hasn't run since
+    bool initialized() const { return codec != nullptr; }
 
 private:
-    static const int MAX_IMAGES = 3;
-
     AMediaExtractor* extractor;
     AMediaCodec* codec;
     AImageReader* imageReader;
+    ANativeWindow* readerWindow = nullptr;
+    std::string filePath;
+    // Between open() and start()
+    AMediaFormat* trackFormat = nullptr;
+    int trackIndex = -1;
+    // Reverse playback and stepping: the codec renders into GPU-sampled buffers of
+    // cacheReader, frameCache holds them (extractor thread only)
+    AImageReader* cacheReader = nullptr;
+    ANativeWindow* cacheWindow = nullptr;
+    AFrameCache<AImage*> frameCache;
+    AGopIndex gopIndex;
+    int bitDepth = 8;
 
     std::thread extractorThread;
+    std::atomic<int> extractorTid = 0;
     bool run = false;
     std::mutex mtx;
     std::condition_variable cv;
     bool available = false;
+    VideoFormat videoFormat{};
+    float contentFrameRate = 0.0f;
+    StreamSizing streamSizing{};
+    // Inputs in flight the extractor keeps, 0 for as many as the codec takes
+    int inputDepth = 0;
+    int64_t dequeueTimeoutUs = APipeline::DEQUEUE_TIMEOUT_US;
+    std::atomic<bool> formatChanged = false;
+    // Release times for the render thread. A full ring (the render thread stalled
+    // for 32 releases) counts the release in releasesLost and keeps its time instead,
+    // so takeReleased() still accounts for every frame.
+    ARing<int64_t, 32> releases;
+    std::atomic<int> releasesLost = 0;
+    std::atomic<int64_t> lostReleaseNs = 0;
+    // Extractor thread only
+    ADecodeLatency decodeLatency;
+    // Published under mtx
+    AHistogram latencySnapshot;
+    std::atomic<bool> latencyPublished = false;
+    std::atomic<float> requestedRate = 1.0f;
+    std::atomic<bool> holding = false;
+    std::atomic<int> pendingSteps = 0;
+    // Set under both mtx and ctlMtx, so neither waiter misses it
+    std::atomic<bool> pauseRequested = false;
+    // Wakes the extractor out of a held picture or a reverse frame wait
+    std::mutex ctlMtx;
+    std::condition_variable ctlCv;
+    // Under mtx: frames come from the cache, currentFrame is on screen, frameInUse
+    // is with the renderer and evicted frames it still draws are freed on release
+    bool cachedMode = false;
+    AImage* currentFrame = nullptr;
+    AImage* frameInUse = nullptr;
+    std::vector<AImage*> deferredFrames;
+    // Extractor thread only: the clock releases are paced to, and the decoded
+    // frame (codec output index) waiting for its time
+    APlaybackClock clock;
+    ATrickPlay trickPlay;
+    FeedMode feedMode = FeedMode::ALL;
+    ssize_t pendingIndex = -1;
+    int64_t pendingPtsUs = 0;
+    // Per second: samples queued, frames decoded, shown and dropped late
+    uint32_t fedCount = 0;
+    uint32_t decodedCount = 0;
+    uint32_t shownCount = 0;
+    uint32_t droppedCount = 0;
+    // Extractor thread only: set on resume until the next frame goes out
+    int64_t resumedNs = 0;
+    // PTS last on screen, outputs before skipBelowUs are decoded but not shown
+    int64_t playheadUs = 0;
+    int64_t skipBelowUs = INT64_MIN;
+    // Request to frame on screen (us) per step / reverse frame, logged once a second
+    AHistogram fetchLatency;
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+    int64_t cacheStatsNs = 0;
+    // A GOP that doesn't drain by then is given up on
+    static constexpr int64_t GOP_DECODE_TIMEOUT_NS = 2000000000;
 
     void extractorLoop();
+    // Waits out a pause, returns how long it lasted
+    int64_t park();
+    // How soon the first frame after a resume went out, once
+    void logResumed();
+    void noteRelease();
+    // Re-anchors the clock; crossing the sync-only threshold flushes and re-seeks
+    void changeRate(float rate);
+    void releasePending(bool render);
+    // Switches the codec's output between the two readers
+    bool enterCachedMode();
+    void leaveCachedMode(float rate);
+    void cachedPass(float rate);
+    // Frame next to fromUs, from the cache or by decoding its GOP; hit tells which
+    bool fetchNeighbor(int64_t fromUs, int direction, int64_t& ptsUs, AImage*& frame, bool& hit);
+    // Decodes the GOP of the sync sample at or before seekUs into frameCache (only that
+    // sample when syncOnly) and records it in gopIndex; syncUs gets its time
+    bool decodeGop(int64_t seekUs, bool syncOnly, int64_t& syncUs);
+    AImage* takeCacheImage();
+    void showCached(AImage* frame, int64_t ptsUs);
+    // Under mtx: deletes, or defers the one the renderer holds
+    void freeFrames(std::vector<AImage*>& frames);
+    // Sleeps until dueNs unless the rate or hold changes or a pause comes first
+    void waitUntil(int64_t dueNs, float rate);
+    // Best decoder that configures and starts, down the ranked chain, else the platform default
+    AMediaCodec* openCodec(const char* mime, AMediaFormat* format, ANativeWindow* surface,
+                           const std::string& file, size_t track, const CodecRequirement& req,
+                           JavaVM* vm, const char* cacheDir);
+    // Creates (by name, else by type), configures and starts; the low-latency profile
+    // unless debug.aplayer.lowlatency=0, retried without it if the codec refuses
+    static AMediaCodec* startCodec(const char* name, const char* mime, AMediaFormat* format,
+                                   ANativeWindow* surface, float fps);
+    static void applyLatencyProfile(AMediaFormat* format, float fps);
+    void updateVideoFormat(AMediaFormat* format);
+    // Parses csd-0/csd-1 into streamSizing and sets the input depth, poll timeout and
+    // max input size from it; warns when the stream can't meet the latency target
+    void sizePipeline(AMediaFormat* format, const char* mime);
 };
 
 #endif //ADECODER_H
\ No newline at end of file
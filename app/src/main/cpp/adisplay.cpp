@@ -5,17 +5,23 @@
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#ifdef __ANDROID__
 #include <android/native_window.h>
 #include <android/hardware_buffer.h>
+#endif
+#include <chrono>
+#include <cstring>
 
 #include "adisplay.h"
 #include "util.h"
 #define LOG_TAG "adisplay"
 
+#ifdef __ANDROID__
 // EGL extension function pointers
 typedef EGLClientBuffer (EGLAPIENTRYP PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC) (const struct AHardwareBuffer *buffer);
 PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC eglGetNativeClientBufferANDROID = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC)
-        eglGetProcAddress("eglGetNativeClientBufferANDROID");;
+        eglGetProcAddress("eglGetNativeClientBufferANDROID");
+#endif
 
 // OpenGL extension function pointers
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)
@@ -24,19 +30,33 @@ PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = (PFNGLEGLIMAG
 auto gVertexShader =
         "attribute vec4 vPosition;\n"
         "attribute vec2 vTexCoord;\n"
+        "attribute vec4 vColor;\n"
         "varying vec2 texCoord;\n"
+        "varying vec4 color;\n"
         "void main() {\n"
         "  gl_Position = vPosition;\n"
         "  texCoord = vTexCoord;\n"
+        "  color = vColor;\n"
+        "}\n";
+
+auto gVideoVertexShader =
+        "attribute vec4 vPosition;\n"
+        "attribute vec2 vTexCoord;\n"
+        "uniform mat4 uTransform;\n"
+        "uniform mat4 uTexTransform;\n"
+        "varying vec2 texCoord;\n"
+        "void main() {\n"
+        "  gl_Position = uTransform * vPosition;\n"
+        "  texCoord = (uTexTransform * vec4(vTexCoord, 0.0, 1.0)).xy;\n"
         "}\n";
 
 auto gFragmentShader =
         "precision mediump float;\n"
         "varying vec2 texCoord;\n"
+        "varying vec4 color;\n"
         "uniform sampler2D uTexture;\n"
         "void main() {\n"
-        "  vec4 color = texture2D(uTexture, texCoord);\n"
-        "  gl_FragColor = vec4(1.0, 1.0, 1.0, color.r);\n"
+        "  gl_FragColor = vec4(color.rgb, color.a * texture2D(uTexture, texCoord).r);\n"
         "}\n";
 
 auto gVideoFragmentShader =
@@ -48,6 +68,40 @@ auto gVideoFragmentShader =
         "  gl_FragColor = texture2D(uTexture, texCoord);\n"
         "}\n";
 
+#ifndef __ANDROID__
+// 8-bit Y, U, V planes (BT.601 limited range); NV12 has U and V in one luminance-alpha texture
+auto gPlanarFragmentShader =
+        "precision mediump float;\n"
+        "varying vec2 texCoord;\n"
+        "uniform sampler2D uY;\n"
+        "uniform sampler2D uU;\n"
+        "uniform sampler2D uV;\n"
+        "uniform float uInterleaved;\n"
+        "void main() {\n"
+        "  float y = 1.164 * (texture2D(uY, texCoord).r - 0.0625);\n"
+        "  vec4 u = texture2D(uU, texCoord);\n"
+        "  vec2 uv = mix(vec2(u.r, texture2D(uV, texCoord).r), u.ra, uInterleaved) - 0.5;\n"
+        "  gl_FragColor = vec4(y + 1.596 * uv.y, y - 0.391 * uv.x - 0.813 * uv.y, y + 2.018 * uv.x, 1.0);\n"
+        "}\n";
+#endif
+
+// Unit quad (position + texcoord), placed on screen by the uTransform uniform
+const float gVideoVerts[] = {
+        -1.0f, -1.0f, 0.0f, 1.0f,  // Bottom-left
+        1.0f, -1.0f, 1.0f, 1.0f,  // Bottom-right
+        1.0f,  1.0f, 1.0f, 0.0f,  // Top-right
+        -1.0f,  1.0f, 0.0f, 0.0f   // Top-left
+};
+
+const EGLint pbufferAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_BLUE_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_RED_SIZE, 8,
+        EGL_NONE
+};
+
 const EGLint attribs[] = {
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
         EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
@@ -64,7 +118,7 @@ const EGLint contextAttribs[] = {
 
 static void checkGlError(const char* op) {
     for (GLint error = glGetError(); error; error = glGetError()) {
-        LOGI("after %s() glError (0x%x)\n", op, error);
+        LOGW_ASYNC(LOG_TAG, "after %s() glError (0x%x)", op, error);
     }
 }
 
@@ -131,14 +185,33 @@ GLuint createProgram(const char* pVertexSource, const char* pFragmentSource) {
     return program;
 }
 
-bool ADisplay::init(unsigned char* bitmap, ANativeWindow* window) {
-    // initialize OpenGL ES and EGL
-//    EGLint w, h;
-    // Create EGL image from hardware buffer
-    if (!eglGetNativeClientBufferANDROID || !glEGLImageTargetTexture2DOES) {
-        LOGE(LOG_TAG, "Required EGL/GL extensions not available");
+GLuint ADisplay::buildProgram(const char* vertexSource, const char* fragmentSource) {
+    GLuint program = programCache.load(vertexSource, fragmentSource);
+    if (!program) {
+        program = createProgram(vertexSource, fragmentSource);
+        programCache.store(program, vertexSource, fragmentSource);
+    }
+    if (program) {
+        glState.cacheLocations(program);
+    }
+    return program;
+}
+
+bool ADisplay::attribute(GLuint program, const char* name, GLuint& location) {
+    GLint found = glState.attribLocation(program, name);
+    // The draws shift 1 by it for AGLState::vertexAttribArrays()
+    if (found < 0 || found >= 32) {
+        LOGE(LOG_TAG, "Attribute %s of program %u is missing (%d)", name, program, found);
         return false;
     }
+    location = (GLuint)found;
+    return true;
+}
+
+#ifdef __ANDROID__
+bool ADisplay::init(unsigned char* bitmap, ANativeWindow* window, const char* cacheDir) {
+    // initialize OpenGL ES and EGL
+    auto initStart = std::chrono::steady_clock::now();
     EGLConfig config;
     EGLint numConfigs, format;
 
@@ -157,57 +230,252 @@ bool ADisplay::init(unsigned char* bitmap, ANativeWindow* window) {
 
     ANativeWindow_setBuffersGeometry(window, 0, 0, format);
     surface = eglCreateWindowSurface(display, config, window, nullptr);
+    if (!setup(config, bitmap, cacheDir)) {
+        return false;
+    }
+    timing.init(display, surface);
+    LOGI(LOG_TAG, "Display initialized in %lld us, program cache hits %d misses %d",
+         (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - initStart).count(),
+         programCache.hits(), programCache.misses());
+    return true;
+}
 
+bool ADisplay::attach(ANativeWindow* window) {
+    if (context == EGL_NO_CONTEXT) {
+        return false;
+    }
+    auto attachStart = std::chrono::steady_clock::now();
+    EGLint format;
+    eglGetConfigAttrib(display, eglConfig, EGL_NATIVE_VISUAL_ID, &format);
+    ANativeWindow_setBuffersGeometry(window, 0, 0, format);
+    surface = eglCreateWindowSurface(display, eglConfig, window, nullptr);
+    if (surface == EGL_NO_SURFACE || eglMakeCurrent(display, surface, surface, context) == EGL_FALSE) {
+        EGLint error = eglGetError();
+        LOGW(LOG_TAG, "Kept context unusable (%s 0x%x), initializing again",
+             error == EGL_CONTEXT_LOST ? "lost" : "error", error);
+        terminate();
+        return false;
+    }
+    timing.init(display, surface);
+    EGLint w, h;
+    eglQuerySurface(display, surface, EGL_WIDTH, &w);
+    eglQuerySurface(display, surface, EGL_HEIGHT, &h);
+    resize(w, h);
+    LOGI(LOG_TAG, "Display attached to a new %dx%d window in %lld us, context kept", w, h,
+         (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - attachStart).count());
+    return true;
+}
+#endif
+
+void ADisplay::uploadAtlas(const unsigned char* bitmap) {
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, gTextureId);
+//    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 512, 512, 0, GL_ALPHA, GL_UNSIGNED_BYTE, engine->font->bitmap);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, 1024, 1024, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, bitmap);
+}
+
+bool ADisplay::initOffscreen(unsigned char* bitmap, int32_t width, int32_t height, const char* cacheDir) {
+    EGLConfig config;
+    EGLint numConfigs;
+#ifdef __ANDROID__
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+#else
+    // Build hosts have no window system, Mesa's surfaceless platform works without
+    // one (and without a GPU, on llvmpipe).
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    display = getPlatformDisplay
+              ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+              : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+#endif
+    if (!eglInitialize(display, nullptr, nullptr)
+        || !eglChooseConfig(display, pbufferAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        LOGE(LOG_TAG, "No pbuffer capable EGL config");
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE) {
+        LOGE(LOG_TAG, "Could not create %dx%d pbuffer", width, height);
+        return false;
+    }
+    return setup(config, bitmap, cacheDir);
+}
+
+bool ADisplay::setup(EGLConfig config, unsigned char* bitmap, const char* cacheDir) {
+    EGLint w, h;
+#ifdef __ANDROID__
+    // Create EGL image from hardware buffer
+    if (!eglGetNativeClientBufferANDROID || !glEGLImageTargetTexture2DOES) {
+        LOGE(LOG_TAG, "Required EGL/GL extensions not available");
+        return false;
+    }
+#endif
     /* A version of OpenGL has not been specified here.  This will default to
      * OpenGL 1.0.  You will need to change this if you want to use the newer
      * features of OpenGL like shaders. */
     context = eglCreateContext(display, config, nullptr, contextAttribs);
+    eglConfig = config;
+    lost = false;
 
     if (eglMakeCurrent(display, surface, surface, context) == EGL_FALSE) {
         LOGW(LOG_TAG, "Unable to eglMakeCurrent");
     }
-//    eglQuerySurface(display, surface, EGL_WIDTH, &w);
-//    eglQuerySurface(display, surface, EGL_HEIGHT, &h);
-//
-//    LOGI(LOG_TAG, "setupGraphics(%d, %d)", w, h);
-    gProgram = createProgram(gVertexShader, gFragmentShader);
+    glState.reset();
+    programCache.init(cacheDir);
+    gProgram = buildProgram(gVertexShader, gFragmentShader);
     if (!gProgram) {
         LOGE(LOG_TAG, "Could not create gRrogram.");
         return false;
     }
-    gvPositionHandle = glGetAttribLocation(gProgram, "vPosition");
-    checkGlError("glGetAttribLocation");
+    if (!attribute(gProgram, "vPosition", gvPositionHandle)
+        || !attribute(gProgram, "vTexCoord", gTexCoordHandle)
+        || !attribute(gProgram, "vColor", gColorHandle)) {
+        return false;
+    }
     LOGI(LOG_TAG, "glGetAttribLocation(\"vPosition\") = %d\n", gvPositionHandle);
-    gTexCoordHandle  = glGetAttribLocation(gProgram, "vTexCoord");
-    checkGlError("glGetAttribLocation");
     LOGI(LOG_TAG, "glGetAttribLocation(\"vTexCoord\") = %d\n", gTexCoordHandle);
+    // Samplers always read unit 0, set once per program instead of per frame
+    glState.useProgram(gProgram);
+    glUniform1i(glState.uniformLocation(gProgram, "uTexture"), 0);
 
     glGenTextures(1, &gTextureId);
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
-//    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 512, 512, 0, GL_ALPHA, GL_UNSIGNED_BYTE, engine->font->bitmap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, 1024, 1024, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, bitmap);
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, gTextureId);
+    if (bitmap) {
+        uploadAtlas(bitmap);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    gVideoProgram = createProgram(gVertexShader, gVideoFragmentShader);
+    gVideoProgram = buildProgram(gVideoVertexShader, gVideoFragmentShader);
     if (!gVideoProgram) {
         LOGE(LOG_TAG, "Could not create gVideoProgram.");
         return false;
     }
 
-    gVideoPositionHandle = glGetAttribLocation(gVideoProgram, "vPosition");
-    gVideoTexCoordHandle = glGetAttribLocation(gVideoProgram, "vTexCoord");
+    if (!attribute(gVideoProgram, "vPosition", gVideoPositionHandle)
+        || !attribute(gVideoProgram, "vTexCoord", gVideoTexCoordHandle)) {
+        return false;
+    }
+    gVideoTransformHandle = glState.uniformLocation(gVideoProgram, "uTransform");
+    gVideoTexTransformHandle = glState.uniformLocation(gVideoProgram, "uTexTransform");
+    glState.useProgram(gVideoProgram);
+    glUniform1i(glState.uniformLocation(gVideoProgram, "uTexture"), 0);
     glGenTextures(1, &gVideoTextureId);
+#ifndef __ANDROID__
+    gPlanarProgram = buildProgram(gVideoVertexShader, gPlanarFragmentShader);
+    if (!gPlanarProgram) {
+        LOGE(LOG_TAG, "Could not create gPlanarProgram.");
+        return false;
+    }
+    if (!attribute(gPlanarProgram, "vPosition", gPlanarPositionHandle)
+        || !attribute(gPlanarProgram, "vTexCoord", gPlanarTexCoordHandle)) {
+        return false;
+    }
+    gPlanarTransformHandle = glState.uniformLocation(gPlanarProgram, "uTransform");
+    gPlanarTexTransformHandle = glState.uniformLocation(gPlanarProgram, "uTexTransform");
+    gPlanarInterleavedHandle = glState.uniformLocation(gPlanarProgram, "uInterleaved");
+    glState.useProgram(gPlanarProgram);
+    glUniform1i(glState.uniformLocation(gPlanarProgram, "uY"), 0);
+    glUniform1i(glState.uniformLocation(gPlanarProgram, "uU"), 1);
+    glUniform1i(glState.uniformLocation(gPlanarProgram, "uV"), 2);
+    glGenTextures(UPLOAD_RING * 3, &planeTextures[0][0]);
+    // Allocated by the first frame
+    planeWidth = planeHeight = 0;
+#endif
+    glState.endFrame();
+
+    // Fresh program, its uniforms have to be uploaded again.
+    viewport.invalidate();
+    eglQuerySurface(display, surface, EGL_WIDTH, &w);
+    eglQuerySurface(display, surface, EGL_HEIGHT, &h);
+    LOGI(LOG_TAG, "setupGraphics(%d, %d)", w, h);
+    resize(w, h);
     return true;
+}
 
-//    glViewport(0, 0, w, h);
-//    checkGlError("glViewport");
+void ADisplay::resize(int32_t width, int32_t height) {
+    glViewport(0, 0, width, height);
+    checkGlError("glViewport");
+    viewport.setWindowSize(width, height);
 }
 
+void ADisplay::setVideoFormat(const VideoFormat& format) {
+    LOGI(LOG_TAG, "Video format %dx%d crop [%d,%d %d,%d]", format.width, format.height,
+         format.cropLeft, format.cropTop, format.cropRight, format.cropBottom);
+    viewport.setVideoFormat(format);
+}
+
+void ADisplay::setScaleMode(ScaleMode mode) {
+    viewport.setScaleMode(mode);
+}
+
+#ifndef __ANDROID__
+void ADisplay::drawPlanes(const AImage* image) {
+    TRACE_SCOPE("video upload");
+    bool interleaved = image->format == AImage::NV12;
+    int32_t chromaWidth = (image->width + 1) / 2;
+    int32_t chromaHeight = (image->height + 1) / 2;
+    // GLES2 has no row length, the planes have to be packed, which file frames are
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool allocate = image->width != planeWidth || image->height != planeHeight || image->format != planeFormat;
+    if (allocate) {
+        planeWidth = image->width;
+        planeHeight = image->height;
+        planeFormat = image->format;
+    }
+    GLuint* textures = planeTextures[uploadSlot];
+    uploadSlot = (uploadSlot + 1) % UPLOAD_RING;
+    for (int plane = 0; plane < (interleaved ? 2 : 3); plane++) {
+        int32_t w = plane ? chromaWidth : image->width;
+        int32_t h = plane ? chromaHeight : image->height;
+        GLenum format = plane && interleaved ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+        glState.activeTexture(GL_TEXTURE0 + plane);
+        glState.bindTexture(GL_TEXTURE_2D, textures[plane]);
+        if (allocate) {
+            // Every slot of the ring at once, so the sizes never change mid-ring
+            for (auto& slot : planeTextures) {
+                glState.bindTexture(GL_TEXTURE_2D, slot[plane]);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            glState.bindTexture(GL_TEXTURE_2D, textures[plane]);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, image->planes[plane]);
+    }
+    if (interleaved) {
+        // uV is still sampled, mix() drops it
+        glState.activeTexture(GL_TEXTURE2);
+        glState.bindTexture(GL_TEXTURE_2D, textures[1]);
+    }
+    checkGlError("glTexSubImage2D");
+
+    glState.useProgram(gPlanarProgram);
+    if (viewport.update()) {
+        glUniformMatrix4fv(gPlanarTransformHandle, 1, GL_FALSE, viewport.positionMatrix());
+        glUniformMatrix4fv(gPlanarTexTransformHandle, 1, GL_FALSE, viewport.textureMatrix());
+    }
+    glUniform1f(gPlanarInterleavedHandle, interleaved ? 1.0f : 0.0f);
+    glState.vertexAttribArrays((1u << gPlanarPositionHandle) | (1u << gPlanarTexCoordHandle));
+    glVertexAttribPointer(gPlanarPositionHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), gVideoVerts);
+    glVertexAttribPointer(gPlanarTexCoordHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), gVideoVerts + 2);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    // The overlay samples unit 0 only
+    glState.activeTexture(GL_TEXTURE0);
+}
+#endif
+
 /**
  * Tear down the EGL context currently associated with the display.
  */
 void ADisplay::terminate() {
+    timing.terminate();
     if (display != EGL_NO_DISPLAY) {
         eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
                        EGL_NO_CONTEXT);
@@ -217,19 +485,48 @@ void ADisplay::terminate() {
         if (surface != EGL_NO_SURFACE) {
             eglDestroySurface(display, surface);
         }
+        if (parkingSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(display, parkingSurface);
+        }
         eglTerminate(display);
     }
     display = EGL_NO_DISPLAY;
     context = EGL_NO_CONTEXT;
     surface = EGL_NO_SURFACE;
+    parkingSurface = EGL_NO_SURFACE;
+    lost = false;
+}
+
+void ADisplay::releaseSurface() {
+    if (context == EGL_NO_CONTEXT || surface == EGL_NO_SURFACE) {
+        return;
+    }
+    timing.terminate();
+    bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    if (!surfaceless && parkingSurface == EGL_NO_SURFACE) {
+        // Only works if the window config supports pbuffers as well, most do
+        const EGLint size[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        parkingSurface = eglCreatePbufferSurface(display, eglConfig, size);
+    }
+    EGLSurface parked = surfaceless ? EGL_NO_SURFACE : parkingSurface;
+    if ((!surfaceless && parked == EGL_NO_SURFACE)
+        || eglMakeCurrent(display, parked, parked, context) == EGL_FALSE) {
+        LOGW(LOG_TAG, "Context can't be kept without a window (0x%x), tearing it down", eglGetError());
+        terminate();
+        return;
+    }
+    eglDestroySurface(display, surface);
+    surface = EGL_NO_SURFACE;
+    LOGI(LOG_TAG, "Window surface released, context kept %s", surfaceless ? "surfaceless" : "on a pbuffer");
 }
 
-void ADisplay::draw(vector<Vertex> verts, AImage* image) {
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Black background
-    checkGlError("glClearColor");
+void ADisplay::draw(const AOverlay& overlay, AImage* image, int64_t presentNs) {
+    TRACE_SCOPE("ADisplay::draw");
+    glState.clearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Black background
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
     checkGlError("glClear");
 
+#ifdef __ANDROID__
     // Draw video background using zero-copy EGL image
     if (image) {
         // Get AHardwareBuffer from AImage
@@ -249,55 +546,65 @@ void ADisplay::draw(vector<Vertex> verts, AImage* image) {
 
                 if (eglImage != EGL_NO_IMAGE) {
                     // Bind to texture using zero-copy
-                    glBindTexture(GL_TEXTURE_EXTERNAL_OES, gVideoTextureId);
+                    glState.activeTexture(GL_TEXTURE0);
+                    glState.bindTexture(GL_TEXTURE_EXTERNAL_OES, gVideoTextureId);
+                    TRACE_SCOPE("video quad");
                     glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, eglImage);
 
                     // Draw fullscreen quad with video texture using external texture shader
-                    glUseProgram(gVideoProgram);
-
-                    // Fullscreen quad vertices (position + texcoord)
-                    float videoVerts[] = {
-                        -1.0f, -1.0f, 0.0f, 1.0f,  // Bottom-left
-                        1.0f, -1.0f, 1.0f, 1.0f,  // Bottom-right
-                        1.0f,  1.0f, 1.0f, 0.0f,  // Top-right
-                        -1.0f,  1.0f, 0.0f, 0.0f   // Top-left
-                    };
+                    glState.useProgram(gVideoProgram);
 
-                    glActiveTexture(GL_TEXTURE0);
-                    glUniform1i(glGetUniformLocation(gVideoProgram, "uTexture"), 0);
+                    // Transform only changes with the window or the video format
+                    if (viewport.update()) {
+                        glUniformMatrix4fv(gVideoTransformHandle, 1, GL_FALSE, viewport.positionMatrix());
+                        glUniformMatrix4fv(gVideoTexTransformHandle, 1, GL_FALSE, viewport.textureMatrix());
+                    }
 
-                    glEnableVertexAttribArray(gVideoPositionHandle);
-                    glEnableVertexAttribArray(gVideoTexCoordHandle);
-                    glVertexAttribPointer(gVideoPositionHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), videoVerts);
-                    glVertexAttribPointer(gVideoTexCoordHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), videoVerts + 2);
+                    glState.vertexAttribArrays((1u << gVideoPositionHandle) | (1u << gVideoTexCoordHandle));
+                    glVertexAttribPointer(gVideoPositionHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), gVideoVerts);
+                    glVertexAttribPointer(gVideoTexCoordHandle, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), gVideoVerts + 2);
 
                     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 
-                    glDisableVertexAttribArray(gVideoPositionHandle);
-                    glDisableVertexAttribArray(gVideoTexCoordHandle);
-
                     // Cleanup EGL image
                     eglDestroyImage(display, eglImage);
                 }
             }
         }
     }
-
-    glUseProgram(gProgram);
-    checkGlError("glUseProgram");
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
-
-    glEnableVertexAttribArray(gvPositionHandle);
-    glEnableVertexAttribArray(gTexCoordHandle);
-    glVertexAttribPointer(gvPositionHandle, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), &verts[0].pos);
-    glVertexAttribPointer(gTexCoordHandle, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), &verts[0].uv);
-    glDrawArrays(GL_TRIANGLES, 0, verts.size());
-    glDisableVertexAttribArray(gvPositionHandle);
-    glDisableVertexAttribArray(gTexCoordHandle);
-    eglSwapBuffers(display, surface);
-
-}
\ No newline at end of file
+#else
+    if (image) {
+        drawPlanes(image);
+    }
+#endif
+
+    // The whole overlay is a single pre-sorted triangle stream
+    const auto& verts = overlay.vertices();
+    overlayDrawCalls = 0;
+    if (!verts.empty()) {
+        glState.useProgram(gProgram);
+        checkGlError("glUseProgram");
+
+        glState.enable(GL_BLEND);
+        glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glState.activeTexture(GL_TEXTURE0);
+        glState.bindTexture(GL_TEXTURE_2D, gTextureId);
+
+        glState.vertexAttribArrays((1u << gvPositionHandle) | (1u << gTexCoordHandle) | (1u << gColorHandle));
+        glVertexAttribPointer(gvPositionHandle, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), &verts[0].pos);
+        glVertexAttribPointer(gTexCoordHandle, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), &verts[0].uv);
+        glVertexAttribPointer(gColorHandle, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OverlayVertex), &verts[0].color);
+        glDrawArrays(GL_TRIANGLES, 0, verts.size());
+        overlayDrawCalls++;
+    }
+    {
+        TRACE_SCOPE("eglSwapBuffers");
+        timing.beforeSwap(presentNs);
+        if (eglSwapBuffers(display, surface) == EGL_FALSE && eglGetError() == EGL_CONTEXT_LOST) {
+            // Power management or a GPU reset, every GL object is gone
+            lost = true;
+        }
+    }
+    timing.afterSwap();
+    lastFrameStats = glState.endFrame();
+}
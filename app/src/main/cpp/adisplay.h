@@ -1,26 +1,108 @@
 //
 // Created by Ihor Ilkevych on 8/1/25.
 //
+#ifndef ADISPLAY_H
+#define ADISPLAY_H
+
+#include <EGL/egl.h>
 #include <GLES2/gl2.h>
 #include "afont.h"
+#ifdef __ANDROID__
 #include "adecoder.h"
+#else
+// Video frames come from files on the host (ARawSource), uploaded plane by plane
+#include "arawsource.h"
+#endif
+#include "aviewport.h"
+#include "aprogramcache.h"
+#include "aglstate.h"
+#include "aoverlay.h"
+#include "apresenttiming.h"
 using namespace std;
 
 class ADisplay{
 public:
-    bool init(unsigned char* bitmap, ANativeWindow* window);
+    // bitmap may be null in init() and initOffscreen(), the glyph atlas comes later
+    // from uploadAtlas() then (the font bakes while EGL initializes, AStartup)
+#ifdef __ANDROID__
+    bool init(unsigned char* bitmap, ANativeWindow* window, const char* cacheDir = nullptr);
+    // Puts the context kept by releaseSurface() on a new window: only the window surface
+    // is created, programs and textures stay. False if there is no context or it can't be
+    // made current (EGL_CONTEXT_LOST), everything is torn down then and init() is next.
+    bool attach(ANativeWindow* window);
+#endif
+    // Renders into a width x height pbuffer instead of a window (headless benchmark).
+    bool initOffscreen(unsigned char* bitmap, int32_t width, int32_t height, const char* cacheDir = nullptr);
+    // The 1024x1024 luminance atlas of AFont, on the thread the context is current on
+    void uploadAtlas(const unsigned char* bitmap);
     void terminate();
-    void draw(vector<Vertex> verts, AImage* image = nullptr);
+    // Destroys the window surface only. The context stays current without a surface
+    // (EGL_KHR_surfaceless_context) or on a 1x1 pbuffer, else it is terminated too.
+    void releaseSurface();
+    // A swap failed with EGL_CONTEXT_LOST: terminate() and init() again
+    bool contextLost() const { return lost; }
+    // presentNs: when the frame should reach the screen (CLOCK_MONOTONIC), 0 for as soon as possible
+    void draw(const AOverlay& overlay, AImage* image = nullptr, int64_t presentNs = 0);
+    void resize(int32_t width, int32_t height);
+    void setVideoFormat(const VideoFormat& format);
+    void setScaleMode(ScaleMode mode);
+    // Issued vs. elided state changes of the last drawn frame
+    AGLState::Stats glStats() const { return lastFrameStats; }
+    int overlayDraws() const { return overlayDrawCalls; }
+    // Target vs. actual present time of the window surface, no-op offscreen
+    APresentTiming& presentTiming() { return timing; }
 private:
-    EGLDisplay display;
-    EGLSurface surface;
-    EGLContext context;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLConfig eglConfig = nullptr;
+    // Keeps the context current between windows where surfaceless contexts aren't supported
+    EGLSurface parkingSurface = EGL_NO_SURFACE;
+    bool lost = false;
     GLuint gProgram;
     GLuint gvPositionHandle;
     GLuint gTexCoordHandle;
+    GLuint gColorHandle;
     GLuint gTextureId;
     GLuint gVideoProgram;
     GLuint gVideoPositionHandle;
     GLuint gVideoTexCoordHandle;
     GLuint gVideoTextureId;
+    GLint gVideoTransformHandle;
+    GLint gVideoTexTransformHandle;
+    AViewport viewport;
+    AProgramCache programCache;
+    AGLState glState;
+    AGLState::Stats lastFrameStats{};
+    int overlayDrawCalls = 0;
+    APresentTiming timing;
+
+#ifndef __ANDROID__
+    // Frames are uploaded into a ring of plane textures, so the upload of one doesn't
+    // wait for the GPU to be done drawing the one before
+    static constexpr int UPLOAD_RING = 3;
+    GLuint gPlanarProgram = 0;
+    GLuint gPlanarPositionHandle;
+    GLuint gPlanarTexCoordHandle;
+    GLint gPlanarTransformHandle;
+    GLint gPlanarTexTransformHandle;
+    GLint gPlanarInterleavedHandle;
+    GLuint planeTextures[UPLOAD_RING][3]{};
+    int uploadSlot = 0;
+    // What the ring's textures are allocated for
+    AImage::Format planeFormat = AImage::I420;
+    int32_t planeWidth = 0;
+    int32_t planeHeight = 0;
+
+    // Uploads image into the next ring slot and draws it
+    void drawPlanes(const AImage* image);
+#endif
+
+    GLuint buildProgram(const char* vertexSource, const char* fragmentSource);
+    // Location of an active attribute of a linked program, false (logged) if it has none
+    bool attribute(GLuint program, const char* name, GLuint& location);
+    // Context, programs and textures, once display and surface exist
+    bool setup(EGLConfig config, unsigned char* bitmap, const char* cacheDir);
 };
+
+#endif //ADISPLAY_H
@@ -6,15 +6,15 @@
 #include "util.h"
 #define LOG_TAG "afont"
 
-AFont::AFont():bitmap(nullptr) {
+AFont::AFont():bitmap(nullptr), whiteU(0.0f), whiteV(0.0f) {
     bitmap = (unsigned char*)malloc(1024*1024);
 }
 
 AFont::~AFont() {
     free(bitmap);
-    free(cdata);
 }
 
+#ifdef __ANDROID__
 bool AFont::init(AAssetManager* am) {
     // Load font from assets
     AAsset* asset = AAssetManager_open(am, "Roboto-Regular.ttf", AASSET_MODE_BUFFER);
@@ -26,8 +26,27 @@ bool AFont::init(AAssetManager* am) {
     auto* fontBuffer = (unsigned char*)malloc(fontSize);
     AAsset_read(asset, fontBuffer, fontSize);
     AAsset_close(asset);
-    stbtt_BakeFontBitmap(fontBuffer, 0, 96.0, bitmap, 1024, 1024, 32, 96, cdata);
+    bool ok = bake(fontBuffer);
     free(fontBuffer);
+    return ok;
+}
+#endif
+
+bool AFont::bake(const unsigned char* fontBuffer) {
+    int usedRows = stbtt_BakeFontBitmap(fontBuffer, 0, 96.0, bitmap, 1024, 1024, 32, 96, cdata);
+    if (usedRows == 0) {
+        LOGE(LOG_TAG, "Failed to bake font");
+        return false;
+    }
+    if (usedRows < 0 || usedRows > 1022) {
+        LOGW(LOG_TAG, "Font atlas is full, white texel overlaps glyphs");
+    }
+    // 2x2 opaque block in the bottom-right corner. Sampling its center reads
+    // pure white even with GL_LINEAR filtering.
+    bitmap[1022 * 1024 + 1022] = bitmap[1022 * 1024 + 1023] = 255;
+    bitmap[1023 * 1024 + 1022] = bitmap[1023 * 1024 + 1023] = 255;
+    whiteU = 1023.0f / 1024;
+    whiteV = 1023.0f / 1024;
     return true;
 }
 
@@ -1,11 +1,16 @@
 //
 // Created by Ihor Ilkevych on 8/1/25.
 //
+#ifndef AFONT_H
+#define AFONT_H
+
 #include <GLES2/gl2.h>
 #include <vector>
 
 #include "stb_truetype.h"
+#ifdef __ANDROID__
 #include <android/asset_manager.h>
+#endif
 #include "util.h"
 using namespace std;
 
@@ -20,9 +25,19 @@ public:
     ~AFont();
     unsigned char* bitmap;
 
+#ifdef __ANDROID__
     bool init(AAssetManager *am);
+#endif
+    // Bakes the 1024x1024 atlas from an in-memory TrueType file.
+    bool bake(const unsigned char* ttf);
+    const stbtt_bakedchar* glyphs() const { return cdata; }
     vector<Vertex> buildTextQuads(const char *text, float sx, float sy, float oy);
+    // Atlas coordinates of an opaque texel, for untextured overlay geometry
+    float whiteU;
+    float whiteV;
 
 private:
     stbtt_bakedchar cdata[96]{};
 };
+
+#endif //AFONT_H
@@ -0,0 +1,116 @@
+//
+// Decoded frames by PTS, bounded to a frame count, evicting away from the playhead.
+//
+#ifndef AFRAMECACHE_H
+#define AFRAMECACHE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "agopindex.h"
+
+/**
+ * Frames already passed in the playback direction go first (farthest first),
+ * then the ones farthest ahead. Frame is a handle the owner frees: evicted
+ * frames are handed back instead of destroyed. Not thread safe.
+ */
+template<typename Frame>
+class AFrameCache {
+public:
+    void setCapacity(int frames) { limit = frames > 1 ? frames : 1; }
+    int capacity() const { return limit; }
+    int size() const { return (int)frames.size(); }
+
+    // direction 1 forward, -1 reverse
+    void setPlayhead(int64_t ptsUs, int dir) {
+        playheadUs = ptsUs;
+        direction = dir < 0 ? -1 : 1;
+    }
+
+    // The frame itself is handed back when it would be the first to go
+    void insert(int64_t ptsUs, Frame frame, std::vector<Frame>& evicted) {
+        auto it = frames.find(ptsUs);
+        if (it != frames.end()) {
+            evicted.push_back(it->second);
+            it->second = frame;
+            return;
+        }
+        frames.emplace(ptsUs, frame);
+        while ((int)frames.size() > limit) {
+            auto victim = frames.begin();
+            for (auto i = frames.begin(); i != frames.end(); ++i) {
+                if (rank(i->first) > rank(victim->first)) {
+                    victim = i;
+                }
+            }
+            evicted.push_back(victim->second);
+            frames.erase(victim);
+        }
+    }
+
+    bool find(int64_t ptsUs, Frame& out) const {
+        auto it = frames.find(ptsUs);
+        if (it == frames.end()) {
+            return false;
+        }
+        out = it->second;
+        return true;
+    }
+
+    /**
+     * Frame next to fromUs in direction, decoding GOPs on a miss with decode(seekUs),
+     * which fills this cache and the index and returns false when nothing came out.
+     * Moves the playhead to fromUs. hit tells whether it was here already.
+     */
+    template<typename Decode>
+    bool fetch(const AGopIndex& index, int64_t fromUs, int dir, Decode&& decode,
+               int64_t& ptsUs, Frame& frame, bool& hit) {
+        hit = true;
+        setPlayhead(fromUs, dir);
+        // At most: the GOP of fromUs, then the one next to it, then a GOP that
+        // didn't fit in one pass
+        for (int attempt = 0; attempt < 3; attempt++) {
+            int64_t seekUs;
+            switch (index.neighbor(fromUs, dir, ptsUs, seekUs)) {
+                case NeighborResult::NONE:
+                    return false;
+                case NeighborResult::DECODE:
+                    hit = false;
+                    if (!decode(seekUs)) {
+                        return false;
+                    }
+                    break;
+                case NeighborResult::FOUND:
+                    if (find(ptsUs, frame)) {
+                        return true;
+                    }
+                    hit = false;
+                    // Not found after decoding its GOP: the codec didn't output it
+                    return decode(ptsUs) && find(ptsUs, frame);
+            }
+        }
+        return false;
+    }
+
+    void clear(std::vector<Frame>& evicted) {
+        for (auto& f : frames) {
+            evicted.push_back(f.second);
+        }
+        frames.clear();
+    }
+
+private:
+    std::map<int64_t, Frame> frames;
+    int limit = 1;
+    int64_t playheadUs = 0;
+    int direction = 1;
+
+    // Higher goes first: behind the playhead above everything ahead, then by distance
+    int64_t rank(int64_t ptsUs) const {
+        int64_t ahead = (ptsUs - playheadUs) * direction;
+        return ahead < 0 ? INT64_MAX / 2 - ahead : ahead;
+    }
+};
+
+#endif //AFRAMECACHE_H
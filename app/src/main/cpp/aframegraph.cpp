@@ -0,0 +1,67 @@
+//
+// On-screen frame-time graph: vsync interval, decode-to-present latency, drops.
+//
+#include <algorithm>
+
+#include "aframegraph.h"
+
+static const uint32_t BACKGROUND = 0x00000080;
+static const uint32_t GRID = 0xffffff40;
+static const uint32_t VSYNC = 0x40ff40ff;
+static const uint32_t LATENCY = 0xffd040ff;
+static const uint32_t DROPPED = 0xff3030c0;
+
+AFrameGraph::AFrameGraph() :
+    history{},
+    next(0),
+    count(0),
+    points{} {
+}
+
+void AFrameGraph::build(AOverlay& overlay, float x0, float y0, float x1, float y1, float rangeMs) {
+    FrameSample sample;
+    while (input.pop(sample)) {
+        history[next] = sample;
+        next = (next + 1) % HISTORY;
+        count = std::min(count + 1, HISTORY);
+    }
+
+    overlay.addRect(x0, y0, x1, y1, BACKGROUND, 0);
+    if (count == 0) {
+        return;
+    }
+
+    // Vsync intervals never beat the refresh period, so the shortest one in
+    // the window is a good estimate of it; anything 1.5x longer missed a vsync.
+    float period = rangeMs;
+    for (int i = 0; i < count; i++) {
+        float v = history[(next - count + i + HISTORY) % HISTORY].vsyncMs;
+        if (v > 0.0f) {
+            period = std::min(period, v);
+        }
+    }
+
+    float dx = (x1 - x0) / (HISTORY - 1);
+    float sy = (y1 - y0) / rangeMs;
+    for (float ms = period; ms < rangeMs; ms += period) {
+        overlay.addLine(x0, y0 + ms * sy, x1, y0 + ms * sy, 1.0f, GRID, 0);
+    }
+
+    // Newest sample at the right edge
+    float left = x1 - dx * (count - 1);
+    for (int i = 0; i < count; i++) {
+        const FrameSample& s = history[(next - count + i + HISTORY) % HISTORY];
+        if (s.skipped > 0 || s.vsyncMs > period * 1.5f) {
+            float x = left + dx * i;
+            overlay.addRect(x - dx * 0.5f, y0, x + dx * 0.5f, y1, DROPPED, 1);
+        }
+        points[i * 2] = left + dx * i;
+        points[i * 2 + 1] = y0 + std::min(s.vsyncMs, rangeMs) * sy;
+    }
+    overlay.addLineStrip(points, count, 2.0f, VSYNC, 2);
+    for (int i = 0; i < count; i++) {
+        const FrameSample& s = history[(next - count + i + HISTORY) % HISTORY];
+        points[i * 2 + 1] = y0 + std::min(s.latencyMs, rangeMs) * sy;
+    }
+    overlay.addLineStrip(points, count, 2.0f, LATENCY, 2);
+}
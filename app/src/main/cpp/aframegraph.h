@@ -0,0 +1,42 @@
+//
+// On-screen frame-time graph: vsync interval, decode-to-present latency, drops.
+//
+#ifndef AFRAMEGRAPH_H
+#define AFRAMEGRAPH_H
+
+#include <cstdint>
+
+#include "aring.h"
+#include "aoverlay.h"
+
+struct FrameSample {
+    float vsyncMs;      // interval since the previous Choreographer frame
+    float latencyMs;    // decoder output release to present, 0 without video
+    uint16_t skipped;   // decoded frames that were never shown
+};
+
+/**
+ * Samples come in through a lock-free ring, so any one thread can feed it.
+ * build() runs on the render thread: it drains the ring into a fixed history
+ * and emits the graph into the overlay batch. No allocations after construction.
+ */
+class AFrameGraph {
+public:
+    static const int HISTORY = 120;
+
+    AFrameGraph();
+
+    bool push(const FrameSample& sample) { return input.push(sample); }
+
+    // Graph covering [x0, x1] x [y0, y1] in clip space, 0..rangeMs vertically.
+    void build(AOverlay& overlay, float x0, float y0, float x1, float y1, float rangeMs = 50.0f);
+
+private:
+    ARing<FrameSample, 256> input;
+    FrameSample history[HISTORY];
+    int next;
+    int count;
+    float points[HISTORY * 2];
+};
+
+#endif //AFRAMEGRAPH_H
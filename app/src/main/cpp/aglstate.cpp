@@ -0,0 +1,210 @@
+//
+// Shadow copy of the GL state ADisplay touches, so redundant calls are skipped.
+//
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <cstring>
+
+#include "aglstate.h"
+#include "util.h"
+#define LOG_TAG "aglstate"
+
+// Sentinel that never matches a real object name or enum
+static const GLuint UNKNOWN = 0xffffffff;
+
+AGLState::AGLState() {
+    reset();
+}
+
+void AGLState::reset() {
+    program = UNKNOWN;
+    const GLenum tracked[MAX_CAPS] = {GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST};
+    for (int i = 0; i < MAX_CAPS; i++) {
+        caps[i] = tracked[i];
+        capStates[i] = -1;
+    }
+    blendSrc = UNKNOWN;
+    blendDst = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        textures2D[i] = UNKNOWN;
+        texturesExternal[i] = UNKNOWN;
+    }
+    clear[0] = clear[1] = clear[2] = clear[3] = -1.0f;
+    attribArrays = 0;
+    attribArraysKnown = false;
+    locations.clear();
+    frame = {};
+}
+
+bool AGLState::elide(bool same) {
+    if (same) {
+        frame.elided++;
+    } else {
+        frame.issued++;
+    }
+    return same;
+}
+
+void AGLState::useProgram(GLuint p) {
+    if (elide(p == program)) {
+        return;
+    }
+    program = p;
+    glUseProgram(p);
+}
+
+void AGLState::setCap(GLenum cap, bool on) {
+    for (int i = 0; i < MAX_CAPS; i++) {
+        if (caps[i] == cap) {
+            if (elide(capStates[i] == on)) {
+                return;
+            }
+            capStates[i] = on;
+            break;
+        }
+    }
+    if (on) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+}
+
+void AGLState::enable(GLenum cap) {
+    setCap(cap, true);
+}
+
+void AGLState::disable(GLenum cap) {
+    setCap(cap, false);
+}
+
+void AGLState::blendFunc(GLenum sfactor, GLenum dfactor) {
+    if (elide(sfactor == blendSrc && dfactor == blendDst)) {
+        return;
+    }
+    blendSrc = sfactor;
+    blendDst = dfactor;
+    glBlendFunc(sfactor, dfactor);
+}
+
+void AGLState::activeTexture(GLenum unit) {
+    if (elide(unit == activeUnit)) {
+        return;
+    }
+    activeUnit = unit;
+    glActiveTexture(unit);
+}
+
+void AGLState::bindTexture(GLenum target, GLuint texture) {
+    GLuint* bound = nullptr;
+    int unit = (int)(activeUnit - GL_TEXTURE0);
+    if (unit >= 0 && unit < MAX_TEXTURE_UNITS) {
+        if (target == GL_TEXTURE_2D) {
+            bound = &textures2D[unit];
+        } else if (target == GL_TEXTURE_EXTERNAL_OES) {
+            bound = &texturesExternal[unit];
+        }
+    }
+    if (bound && elide(*bound == texture)) {
+        return;
+    }
+    if (bound) {
+        *bound = texture;
+    } else {
+        frame.issued++;
+    }
+    glBindTexture(target, texture);
+}
+
+void AGLState::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    if (elide(clear[0] == r && clear[1] == g && clear[2] == b && clear[3] == a)) {
+        return;
+    }
+    clear[0] = r;
+    clear[1] = g;
+    clear[2] = b;
+    clear[3] = a;
+    glClearColor(r, g, b, a);
+}
+
+void AGLState::vertexAttribArrays(uint32_t mask) {
+    uint32_t changed = attribArraysKnown ? attribArrays ^ mask : 0xffffffff;
+    for (GLuint i = 0; i < 32; i++) {
+        uint32_t bit = 1u << i;
+        bool wanted = mask & bit;
+        if (!(changed & bit)) {
+            if (wanted) {
+                frame.elided++;
+            }
+            continue;
+        }
+        if (wanted) {
+            frame.issued++;
+            glEnableVertexAttribArray(i);
+        } else if (attribArraysKnown) {
+            frame.issued++;
+            glDisableVertexAttribArray(i);
+        } else if (i < 8) {
+            // State unknown after reset, only the low slots can be in use here.
+            frame.issued++;
+            glDisableVertexAttribArray(i);
+        }
+    }
+    attribArrays = mask;
+    attribArraysKnown = true;
+}
+
+void AGLState::cacheLocations(GLuint p) {
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(p, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(p, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(p, i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+        locations.push_back({p, false, glGetAttribLocation(p, name.data()), name.data()});
+    }
+
+    glGetProgramiv(p, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(p, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(p, i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+        GLint location = glGetUniformLocation(p, name.data());
+        // Arrays are reported as "name[0]", look them up by their plain name.
+        char* bracket = strchr(name.data(), '[');
+        if (bracket) {
+            *bracket = '\0';
+        }
+        locations.push_back({p, true, location, name.data()});
+    }
+}
+
+GLint AGLState::findLocation(GLuint p, const char* name, bool uniform) const {
+    for (const auto& l : locations) {
+        if (l.program == p && l.uniform == uniform && l.name == name) {
+            return l.location;
+        }
+    }
+    LOGW(LOG_TAG, "No active %s \"%s\" in program %u", uniform ? "uniform" : "attribute", name, p);
+    return -1;
+}
+
+GLint AGLState::attribLocation(GLuint p, const char* name) const {
+    return findLocation(p, name, false);
+}
+
+GLint AGLState::uniformLocation(GLuint p, const char* name) const {
+    return findLocation(p, name, true);
+}
+
+AGLState::Stats AGLState::endFrame() {
+    Stats stats = frame;
+    frame = {};
+    return stats;
+}
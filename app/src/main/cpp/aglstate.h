@@ -0,0 +1,72 @@
+//
+// Shadow copy of the GL state ADisplay touches, so redundant calls are skipped.
+//
+#ifndef AGLSTATE_H
+#define AGLSTATE_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AGLState {
+public:
+    struct Stats {
+        uint32_t issued;
+        uint32_t elided;
+    };
+
+    AGLState();
+
+    // Forget everything, e.g. after a new context was made current.
+    void reset();
+
+    void useProgram(GLuint program);
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+    void blendFunc(GLenum sfactor, GLenum dfactor);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint texture);
+    void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+    // Enables exactly the vertex attrib arrays whose bits are set in mask.
+    void vertexAttribArrays(uint32_t mask);
+
+    // Queries all active attributes and uniforms once, right after linking.
+    void cacheLocations(GLuint program);
+    GLint attribLocation(GLuint program, const char* name) const;
+    GLint uniformLocation(GLuint program, const char* name) const;
+
+    // Returns the counters of the finished frame and starts a new one.
+    Stats endFrame();
+
+private:
+    static const int MAX_TEXTURE_UNITS = 4;
+    static const int MAX_CAPS = 4;
+
+    struct Location {
+        GLuint program;
+        bool uniform;
+        GLint location;
+        std::string name;
+    };
+
+    GLuint program;
+    GLenum caps[MAX_CAPS];
+    int8_t capStates[MAX_CAPS];
+    GLenum blendSrc;
+    GLenum blendDst;
+    GLenum activeUnit;
+    GLuint textures2D[MAX_TEXTURE_UNITS];
+    GLuint texturesExternal[MAX_TEXTURE_UNITS];
+    GLfloat clear[4];
+    uint32_t attribArrays;
+    bool attribArraysKnown;
+    std::vector<Location> locations;
+    Stats frame;
+
+    bool elide(bool same);
+    void setCap(GLenum cap, bool on);
+    GLint findLocation(GLuint program, const char* name, bool uniform) const;
+};
+
+#endif //AGLSTATE_H
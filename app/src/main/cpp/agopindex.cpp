@@ -0,0 +1,75 @@
+//
+// GOP index for frame stepping and reverse playback.
+//
+#include "agopindex.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+void AGopIndex::add(Gop gop) {
+    std::sort(gop.frames.begin(), gop.frames.end());
+    int64_t syncUs = gop.syncUs;
+    gops[syncUs] = std::move(gop);
+    if ((int)gops.size() > MAX_GOPS) {
+        // Drop the end farther from the one just added
+        auto first = gops.begin();
+        auto last = std::prev(gops.end());
+        gops.erase(llabs(syncUs - first->first) > llabs(last->first - syncUs) ? first : last);
+    }
+}
+
+const Gop* AGopIndex::find(int64_t ptsUs) const {
+    auto it = gops.upper_bound(ptsUs);
+    if (it == gops.begin()) {
+        return nullptr;
+    }
+    --it;
+    return ptsUs < it->second.endUs ? &it->second : nullptr;
+}
+
+NeighborResult AGopIndex::neighbor(int64_t ptsUs, int direction, int64_t& neighborUs, int64_t& seekUs) const {
+    const Gop* gop = find(ptsUs);
+    if (!gop) {
+        seekUs = ptsUs;
+        return NeighborResult::DECODE;
+    }
+    const auto& frames = gop->frames;
+    if (direction > 0) {
+        auto it = std::upper_bound(frames.begin(), frames.end(), ptsUs);
+        if (it != frames.end()) {
+            neighborUs = *it;
+            return NeighborResult::FOUND;
+        }
+        if (gop->endUs == INT64_MAX) {
+            return NeighborResult::NONE;
+        }
+        auto next = gops.find(gop->endUs);
+        if (next == gops.end() || next->second.frames.empty()) {
+            seekUs = gop->endUs;
+            return NeighborResult::DECODE;
+        }
+        neighborUs = next->second.frames.front();
+        return NeighborResult::FOUND;
+    }
+
+    auto it = std::lower_bound(frames.begin(), frames.end(), ptsUs);
+    if (it != frames.begin()) {
+        neighborUs = *(it - 1);
+        return NeighborResult::FOUND;
+    }
+    if (gop->syncUs <= 0) {
+        return NeighborResult::NONE;
+    }
+    // The previous GOP ends where this one starts
+    auto prev = gops.find(gop->syncUs);
+    if (prev != gops.begin()) {
+        --prev;
+        if (prev->second.endUs == gop->syncUs && !prev->second.frames.empty()) {
+            neighborUs = prev->second.frames.back();
+            return NeighborResult::FOUND;
+        }
+    }
+    seekUs = gop->syncUs - 1;
+    return NeighborResult::DECODE;
+}
@@ -0,0 +1,48 @@
+//
+// Frame times of the GOPs decoded so far, to find the frame before/after a PTS
+// without decoding. Pure logic, no platform calls.
+//
+#ifndef AGOPINDEX_H
+#define AGOPINDEX_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct Gop {
+    int64_t syncUs;               // sync sample that starts it
+    int64_t endUs;                // next sync sample, INT64_MAX at the end of the stream
+    std::vector<int64_t> frames;  // presentation times, sorted
+};
+
+enum class NeighborResult {
+    FOUND,   // frame time in neighborUs
+    DECODE,  // the GOP holding it isn't known: decode from the sync sample before seekUs
+    NONE,    // start or end of the stream
+};
+
+class AGopIndex {
+public:
+    // Far GOPs are forgotten beyond this, ~2 KiB each at 60 frames
+    static constexpr int MAX_GOPS = 256;
+
+    // Replaces a GOP with the same sync sample
+    void add(Gop gop);
+    void clear() { gops.clear(); }
+    int size() const { return (int)gops.size(); }
+    // GOP whose [syncUs, endUs) holds ptsUs, null if not decoded yet. Leading
+    // pictures of open GOPs (before their sync sample) belong to the previous one.
+    const Gop* find(int64_t ptsUs) const;
+
+    /**
+     * Frame next to ptsUs in direction (1 forward, -1 back). ptsUs needn't be a
+     * frame time itself: forward gives the first frame after it, back the last
+     * frame before it.
+     */
+    NeighborResult neighbor(int64_t ptsUs, int direction, int64_t& neighborUs, int64_t& seekUs) const;
+
+private:
+    std::map<int64_t, Gop> gops;  // by syncUs
+};
+
+#endif //AGOPINDEX_H
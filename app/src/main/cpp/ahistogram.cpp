@@ -0,0 +1,64 @@
+//
+// Log-linear latency histogram.
+//
+#include "ahistogram.h"
+
+#include <cstring>
+
+int AHistogram::index(int64_t us) {
+    if (us < 2 * SUB_BUCKETS) {
+        return (int)us;
+    }
+    int msb = 63 - __builtin_clzll((uint64_t)us);
+    int shift = msb - 3;
+    int i = shift * SUB_BUCKETS + (int)(us >> shift);
+    return i < BUCKETS ? i : BUCKETS - 1;
+}
+
+int64_t AHistogram::upperBound(int index) {
+    if (index < 2 * SUB_BUCKETS) {
+        return index;
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    int64_t mantissa = index - shift * SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void AHistogram::record(int64_t us) {
+    if (total == 0 || us < lo) lo = us;
+    if (total == 0 || us > hi) hi = us;
+    sum += us;
+    total++;
+    if (us < 0) {
+        below++;
+        us = 0;
+    }
+    buckets[index(us)]++;
+}
+
+void AHistogram::reset() {
+    memset(buckets, 0, sizeof(buckets));
+    total = 0;
+    below = 0;
+    sum = 0;
+    lo = 0;
+    hi = 0;
+}
+
+int64_t AHistogram::percentile(float p) const {
+    if (total == 0) {
+        return 0;
+    }
+    // Rank of the sample, 1-based, rounded up
+    uint64_t rank = (uint64_t)(p / 100.0f * total + 0.999f);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            int64_t v = upperBound(i);
+            return v < hi ? v : hi;
+        }
+    }
+    return hi;
+}
@@ -0,0 +1,46 @@
+//
+// Log-linear latency histogram: fixed buckets, no allocations, approximate percentiles.
+//
+#ifndef AHISTOGRAM_H
+#define AHISTOGRAM_H
+
+#include <cstdint>
+
+/**
+ * Values are microseconds. Exact below 16 us, then 8 buckets per power of two
+ * (within 12.5%) up to ~30 s; larger values land in the last bucket. Negative
+ * values (e.g. a frame shown before its target) count as 0 but keep min() exact.
+ * Not thread safe, one writer and reads from the same thread.
+ */
+class AHistogram {
+public:
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKETS = 184;
+
+    AHistogram() { reset(); }
+
+    void record(int64_t us);
+    void reset();
+
+    uint32_t count() const { return total; }
+    // Values that were below zero
+    uint32_t negative() const { return below; }
+    int64_t min() const { return total ? lo : 0; }
+    int64_t max() const { return total ? hi : 0; }
+    int64_t mean() const { return total ? sum / total : 0; }
+    // Upper bound of the bucket holding the p-th percentile (0..100), clamped to max()
+    int64_t percentile(float p) const;
+
+private:
+    uint32_t buckets[BUCKETS];
+    uint32_t total;
+    uint32_t below;
+    int64_t sum;
+    int64_t lo;
+    int64_t hi;
+
+    static int index(int64_t us);
+    static int64_t upperBound(int index);
+};
+
+#endif //AHISTOGRAM_H
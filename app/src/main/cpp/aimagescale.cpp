@@ -0,0 +1,137 @@
+//
+// Thumbnail downscaling.
+//
+#include "aimagescale.h"
+
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool AImageScale::simd() {
+#if defined(__ARM_NEON) || defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AImageScale::halveScalar(const uint8_t* src, int width, int height, int srcStride,
+                              uint8_t* dst, int dstStride) {
+    int w = width / 2;
+    for (int y = 0; y < height / 2; y++) {
+        const uint8_t* r0 = src + (size_t)y * 2 * srcStride;
+        const uint8_t* r1 = r0 + srcStride;
+        uint8_t* d = dst + (size_t)y * dstStride;
+        for (int x = 0; x < w; x++) {
+            d[x] = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+        }
+    }
+}
+
+void AImageScale::halve(const uint8_t* src, int width, int height, int srcStride,
+                        uint8_t* dst, int dstStride) {
+#if defined(__ARM_NEON) || defined(__SSE2__)
+    int w = width / 2;
+    // 16 output pixels from 32 of each source row per step, the rest scalar
+    int vectorW = w & ~15;
+    for (int y = 0; y < height / 2; y++) {
+        const uint8_t* r0 = src + (size_t)y * 2 * srcStride;
+        const uint8_t* r1 = r0 + srcStride;
+        uint8_t* d = dst + (size_t)y * dstStride;
+        for (int x = 0; x < vectorW; x += 16) {
+#if defined(__ARM_NEON)
+            // Pairwise widening adds give the 2x2 sums, the rounding narrow the (sum + 2) >> 2
+            uint16x8_t lo = vpadalq_u8(vpaddlq_u8(vld1q_u8(r0 + 2 * x)), vld1q_u8(r1 + 2 * x));
+            uint16x8_t hi = vpadalq_u8(vpaddlq_u8(vld1q_u8(r0 + 2 * x + 16)), vld1q_u8(r1 + 2 * x + 16));
+            vst1q_u8(d + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+#else
+            const __m128i even = _mm_set1_epi16(0x00ff);
+            const __m128i two = _mm_set1_epi16(2);
+            auto pairs = [&even](__m128i v) {
+                return _mm_add_epi16(_mm_and_si128(v, even), _mm_srli_epi16(v, 8));
+            };
+            __m128i lo = _mm_add_epi16(pairs(_mm_loadu_si128((const __m128i*)(r0 + 2 * x))),
+                                       pairs(_mm_loadu_si128((const __m128i*)(r1 + 2 * x))));
+            __m128i hi = _mm_add_epi16(pairs(_mm_loadu_si128((const __m128i*)(r0 + 2 * x + 16))),
+                                       pairs(_mm_loadu_si128((const __m128i*)(r1 + 2 * x + 16))));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+            _mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(lo, hi));
+#endif
+        }
+        for (int x = vectorW; x < w; x++) {
+            d[x] = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+        }
+    }
+#else
+    halveScalar(src, width, height, srcStride, dst, dstStride);
+#endif
+}
+
+void AImageScale::scale(const PlaneView& src, uint8_t* dst, int dstWidth, int dstHeight,
+                        std::vector<uint8_t>& scratch) {
+    int w = src.width;
+    int h = src.height;
+    if (w <= 0 || h <= 0 || dstWidth <= 0 || dstHeight <= 0) {
+        return;
+    }
+    // Room for the source packed and its first halving, each halving after that fits
+    // in the space the one before last used
+    size_t packedSize = (size_t)w * h;
+    if (scratch.size() < packedSize + packedSize / 4 + 1) {
+        scratch.resize(packedSize + packedSize / 4 + 1);
+    }
+    uint8_t* bufA = scratch.data();
+    uint8_t* bufB = bufA + packedSize;
+
+    const uint8_t* cur = src.data;
+    int stride = src.rowStride;
+    if (src.pixelStride != 1) {
+        for (int y = 0; y < h; y++) {
+            const uint8_t* s = src.data + (size_t)y * src.rowStride;
+            uint8_t* d = bufA + (size_t)y * w;
+            for (int x = 0; x < w; x++) {
+                d[x] = s[(size_t)x * src.pixelStride];
+            }
+        }
+        cur = bufA;
+        stride = w;
+    }
+    while (w >= 2 * dstWidth && h >= 2 * dstHeight) {
+        uint8_t* out = cur == bufA ? bufB : bufA;
+        halve(cur, w, h, stride, out, w / 2);
+        w /= 2;
+        h /= 2;
+        stride = w;
+        cur = out;
+    }
+
+    // Bilinear over what is left (under 2x), 8-bit weights, pixel centers aligned
+    std::vector<int> x0(dstWidth);
+    std::vector<int> fx(dstWidth);
+    for (int x = 0; x < dstWidth; x++) {
+        int sx = (int)(((2 * x + 1) * (int64_t)w * 256) / (2 * dstWidth)) - 128;
+        sx = std::clamp(sx, 0, (w - 1) * 256);
+        x0[x] = sx >> 8;
+        fx[x] = sx & 255;
+    }
+    for (int y = 0; y < dstHeight; y++) {
+        int sy = (int)(((2 * y + 1) * (int64_t)h * 256) / (2 * dstHeight)) - 128;
+        sy = std::clamp(sy, 0, (h - 1) * 256);
+        const uint8_t* r0 = cur + (size_t)(sy >> 8) * stride;
+        const uint8_t* r1 = (sy >> 8) + 1 < h ? r0 + stride : r0;
+        int fy = sy & 255;
+        uint8_t* d = dst + (size_t)y * dstWidth;
+        for (int x = 0; x < dstWidth; x++) {
+            int i = x0[x];
+            int j = i + 1 < w ? i + 1 : i;
+            int top = r0[i] * (256 - fx[x]) + r0[j] * fx[x];
+            int bottom = r1[i] * (256 - fx[x]) + r1[j] * fx[x];
+            d[x] = (uint8_t)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+        }
+    }
+}
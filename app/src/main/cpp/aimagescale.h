@@ -0,0 +1,40 @@
+//
+// CPU downscaling of 8-bit image planes for thumbnails: 2x2 box halving (NEON or
+// SSE2 where the build has it) down to within 2x of the target, then bilinear.
+// Pure logic, no platform calls.
+//
+#ifndef AIMAGESCALE_H
+#define AIMAGESCALE_H
+
+#include <cstdint>
+#include <vector>
+
+struct PlaneView {
+    const uint8_t* data;
+    int width;
+    int height;
+    int rowStride;
+    int pixelStride = 1;    // 2 for the interleaved chroma of NV12/NV21
+};
+
+class AImageScale {
+public:
+    // Whether halve() has a vector path in this build
+    static bool simd();
+
+    // Rounded average of each 2x2 block into a (width/2)x(height/2) plane, an odd
+    // last row or column is dropped. Same results as halveScalar().
+    static void halve(const uint8_t* src, int width, int height, int srcStride,
+                      uint8_t* dst, int dstStride);
+    static void halveScalar(const uint8_t* src, int width, int height, int srcStride,
+                            uint8_t* dst, int dstStride);
+
+    /**
+     * src into a packed dstWidth x dstHeight plane. scratch is grown as needed and
+     * can be reused across calls. Upscaling works but is plain bilinear.
+     */
+    static void scale(const PlaneView& src, uint8_t* dst, int dstWidth, int dstHeight,
+                      std::vector<uint8_t>& scratch);
+};
+
+#endif //AIMAGESCALE_H
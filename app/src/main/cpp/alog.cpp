@@ -0,0 +1,378 @@
+//
+// Asynchronous logging: binary capture on the calling thread, formatting and
+// output on a background writer thread.
+//
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "alog.h"
+#include "aring.h"
+#include "athreadbuffers.h"
+#include "athreadpolicy.h"
+#include "util.h"
+#define LOG_TAG "alog"
+
+namespace {
+
+// While messages keep coming the writer batches them this long; with none it sleeps.
+constexpr auto DRAIN_PERIOD = std::chrono::milliseconds(20);
+
+// Rate limiting only needs ~ms resolution, the coarse clock skips the timer read.
+int64_t coarseNowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// One per thread. The owning thread is the only producer, the writer the only consumer.
+struct Buffer {
+    ARing<ALog::Record, ALog::THREAD_RECORDS> records;
+    std::atomic<uint32_t> dropped{0};
+};
+
+AThreadBuffers<Buffer> buffers;
+
+void output(int priority, const char* tag, const char* text) {
+#ifdef __ANDROID__
+    __android_log_write(priority, tag, text);
+#else
+    (void)priority;
+    fprintf(stderr, "%s: %s\n", tag, text);
+#endif
+}
+
+void drain() {
+    char text[1024];
+    buffers.forEach([&text](Buffer& b) {
+        while (const ALog::Record* r = b.records.peek()) {
+            size_t len = ALog::format(*r, text, sizeof(text));
+            if (r->suppressed) {
+                snprintf(text + len, sizeof(text) - len, " (%u similar suppressed)", r->suppressed);
+            }
+            output(r->priority, r->tag, text);
+            b.records.consume();
+        }
+        if (uint32_t dropped = b.dropped.exchange(0)) {
+            snprintf(text, sizeof(text), "Log buffer full, dropped %u messages", dropped);
+            output(ANDROID_LOG_WARN, LOG_TAG, text);
+        }
+    });
+}
+
+class Writer {
+public:
+    void start() {
+        std::call_once(started, [this] {
+            running = true;
+            thread = std::thread(&Writer::loop, this);
+        });
+    }
+
+    void flush() {
+        std::unique_lock lk(mutex);
+        if (!running) {
+            drain();
+            return;
+        }
+        uint64_t target = ++requested;
+        cv.notify_all();
+        cv.wait(lk, [&] { return completed >= target || !running; });
+    }
+
+    // Producer side, after a commit: a single load unless the writer sleeps. The
+    // fence pairs with the one in quiet(), so either the writer sees the record or
+    // the producer sees it asleep.
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false)) {
+            // Empty lock: the writer is either before its predicate check or waiting
+            { std::lock_guard lk(mutex); }
+            cv.notify_all();
+        }
+    }
+
+    void setIdle(bool value) {
+        {
+            std::lock_guard lk(mutex);
+            idle = value;
+        }
+        // One more pass either way: what came before goes out now
+        cv.notify_all();
+    }
+
+    ~Writer() {
+        {
+            std::lock_guard lk(mutex);
+            running = false;
+        }
+        cv.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        drain();
+    }
+
+private:
+    std::once_flag started;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running = false;
+    bool idle = false;
+    // Set while the writer waits with all rings empty, cleared by the producer that wakes it
+    std::atomic<bool> sleeping{false};
+    uint64_t requested = 0;
+    uint64_t completed = 0;
+
+    void loop() {
+        AThreadPolicy::setName("alog");
+        std::unique_lock lk(mutex);
+        while (running) {
+            if (idle) {
+                cv.wait(lk, [this] { return requested > completed || !running || !idle; });
+            } else if (!quiet()) {
+                // A burst still coming in, take it in one pass
+                cv.wait_for(lk, DRAIN_PERIOD, [this] { return requested > completed || !running || idle; });
+            } else {
+                cv.wait(lk, [this] {
+                    return requested > completed || !running || idle || !sleeping.load(std::memory_order_relaxed);
+                });
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+            uint64_t target = requested;
+            lk.unlock();
+            drain();
+            lk.lock();
+            completed = target;
+            cv.notify_all();
+        }
+    }
+
+    // True when every ring is empty, with sleeping set so the next commit wakes the writer
+    bool quiet() {
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool empty = true;
+        buffers.forEach([&empty](Buffer& b) {
+            empty = empty && !b.records.peek();
+        });
+        if (!empty) {
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+        return empty;
+    }
+};
+
+// Declared after buffers: destroyed first, so the final drain still sees them.
+Writer writer;
+
+// Integers at the width printf reads them at, bytes from convWidth(): (uint32_t)-1
+// with %d is -1, (uint16_t)-1 with %d is 65535 after the promotion to int.
+int64_t signedArg(const ALog::Record& r, int i, int bytes = 8) {
+    switch (r.types[i]) {
+        case ALog::SIGNED:
+        case ALog::UNSIGNED:
+            if (bytes < 8) {
+                int shift = 64 - 8 * bytes;
+                return (int64_t)(r.args[i].u << shift) >> shift;
+            }
+            return r.args[i].i;
+        case ALog::DOUBLE:
+            return (int64_t)r.args[i].d;
+        case ALog::POINTER:
+            return (int64_t)(uintptr_t)r.args[i].p;
+        default:
+            return 0;
+    }
+}
+
+uint64_t unsignedArg(const ALog::Record& r, int i, int bytes = 8) {
+    uint64_t v = (uint64_t)signedArg(r, i, bytes);
+    if ((r.types[i] == ALog::SIGNED || r.types[i] == ALog::UNSIGNED) && bytes < 8) {
+        // -1 as int with %x is ffffffff, not 16 f's
+        v &= (1ull << (8 * bytes)) - 1;
+    }
+    return v;
+}
+
+// Bytes an integer conversion reads: the length modifier's type, without one the
+// argument after the default promotions (an int64_t under a bare %d stays whole)
+int convWidth(const char* length, size_t n, int argBytes) {
+    if (n == 0) {
+        return std::max(argBytes, (int)sizeof(int));
+    }
+    switch (length[0]) {
+        case 'h':
+            return n == 2 ? 1 : 2;
+        case 'l':
+            return n == 2 ? 8 : (int)sizeof(long);
+        case 'z':
+            return (int)sizeof(size_t);
+        case 't':
+            return (int)sizeof(ptrdiff_t);
+        default:
+            // ll, q, j, L
+            return 8;
+    }
+}
+
+} // namespace
+
+bool ALog::Site::allow(uint32_t& suppressedOut) {
+    int64_t now = coarseNowNs();
+    int64_t start = windowStartNs.load(std::memory_order_relaxed);
+    if (now - start >= 1000000000 &&
+        windowStartNs.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    if (count.fetch_add(1, std::memory_order_relaxed) >= BURST) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressedOut = suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+ALog::Record* ALog::begin() {
+    writer.start();
+    Buffer& buffer = buffers.local();
+    Record* r = buffer.records.prepare();
+    if (!r) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return r;
+}
+
+void ALog::commit() {
+    buffers.local().records.commit();
+    writer.wake();
+}
+
+void ALog::flush() {
+    writer.flush();
+}
+
+void ALog::setIdle(bool idle) {
+    writer.setIdle(idle);
+}
+
+size_t ALog::format(const Record& r, char* out, size_t size) {
+    if (!size) {
+        return 0;
+    }
+    size_t len = 0;
+    int argi = 0;
+    auto append = [&](const char* s, size_t n) {
+        n = std::min(n, size - 1 - len);
+        memcpy(out + len, s, n);
+        len += n;
+    };
+    const char* p = r.fmt;
+    while (*p && len + 1 < size) {
+        if (*p != '%') {
+            const char* q = strchr(p, '%');
+            size_t n = q ? (size_t)(q - p) : strlen(p);
+            append(p, n);
+            p += n;
+            continue;
+        }
+        if (p[1] == '%') {
+            append("%", 1);
+            p += 2;
+            continue;
+        }
+        // Flags, width and precision are kept; arguments are already widened, so
+        // length modifiers are replaced with ll (integers) or dropped.
+        const char* start = p;
+        char spec[32] = "%";
+        size_t n = 1;
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q) && n < sizeof(spec) - 4) {
+            spec[n++] = *q++;
+        }
+        const char* length = q;
+        while (*q && strchr("hlLqjzt", *q)) {
+            q++;
+        }
+        char conv = *q;
+        if (!conv) {
+            append(start, q - start);
+            break;
+        }
+        p = q + 1;
+        if (argi >= r.argc) {
+            append(start, p - start);
+            continue;
+        }
+        int i = argi++;
+        int bytes = convWidth(length, q - length, r.sizes[i]);
+        int written;
+        char* dst = out + len;
+        size_t room = size - len;
+        switch (conv) {
+            case 'd':
+            case 'i':
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = 'd';
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec, (long long)signedArg(r, i, bytes));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conv;
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec, (unsigned long long)unsignedArg(r, i, bytes));
+                break;
+            case 'c':
+                spec[n++] = 'c';
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec, (int)signedArg(r, i, bytes));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                spec[n++] = conv;
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec,
+                                   r.types[i] == DOUBLE ? r.args[i].d : (double)signedArg(r, i));
+                break;
+            case 's':
+                spec[n++] = 's';
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec,
+                                   r.types[i] == STRING && r.args[i].str < r.stringBytes
+                                   ? r.strings + r.args[i].str : "(?)");
+                break;
+            case 'p':
+                spec[n++] = 'p';
+                spec[n] = '\0';
+                written = snprintf(dst, room, spec,
+                                   r.types[i] == POINTER ? r.args[i].p : (const void*)(uintptr_t)signedArg(r, i));
+                break;
+            default:
+                // Unsupported conversion, keep the raw spec
+                append(start, p - start);
+                continue;
+        }
+        if (written > 0) {
+            len += std::min((size_t)written, room - 1);
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
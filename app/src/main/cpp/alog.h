@@ -0,0 +1,160 @@
+//
+// Asynchronous logging for hot paths (render loop, decoder threads). Use the
+// LOGx_ASYNC macros from util.h; LOGx stays synchronous for init and fatal paths.
+//
+#ifndef ALOG_H
+#define ALOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * A call captures the format pointer and its arguments in binary form into a
+ * lock-free ring of the calling thread; a background thread formats and writes
+ * them. Format strings must be literals. String arguments are copied (truncated
+ * when a record runs out of room), so temporaries such as std::string::c_str()
+ * are safe. Conversions: d i u x X o c e E f F g G a A s p with flags, width,
+ * precision and length modifiers; '*' width and %n are not supported.
+ *
+ * The writer sleeps while all rings are empty; the first record into them wakes it,
+ * and it drains once per period while more keep coming. Logcat shows the writer
+ * thread and the time of writing, which trails the call by up to one drain period.
+ */
+class ALog {
+public:
+    static constexpr int MAX_ARGS = 8;
+    static constexpr int STRING_BYTES = 152;
+    // Ring size per thread, records past it are dropped until the writer drains
+    static constexpr int THREAD_RECORDS = 256;
+
+    enum ArgType : uint8_t {
+        SIGNED, UNSIGNED, DOUBLE, STRING, POINTER
+    };
+
+    union Arg {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void* p;
+        uint16_t str;   // offset into Record::strings
+    };
+
+    struct Record {
+        const char* tag;
+        const char* fmt;
+        uint32_t suppressed;    // calls the rate limit dropped before this one
+        uint8_t priority;
+        uint8_t argc;
+        uint8_t stringBytes;
+        ArgType types[MAX_ARGS];
+        uint8_t sizes[MAX_ARGS];
+        Arg args[MAX_ARGS];
+        char strings[STRING_BYTES];
+    };
+
+    /**
+     * Per call site rate limit: at most BURST messages per second, the rest are
+     * counted and reported with the next message that gets through.
+     */
+    class Site {
+    public:
+        static constexpr uint32_t BURST = 10;
+        bool allow(uint32_t& suppressedOut);
+    private:
+        std::atomic<int64_t> windowStartNs{0};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
+    template <typename... Args>
+    static void write(Site& site, int priority, const char* tag, const char* fmt, Args... args) {
+        uint32_t suppressed;
+        if (!site.allow(suppressed)) {
+            return;
+        }
+        Record* r = begin();
+        if (!r) {
+            return;
+        }
+        capture(*r, priority, tag, fmt, args...);
+        r->suppressed = suppressed;
+        commit();
+    }
+
+    // Fills r the way write() does, without a ring (tests, benchmarks)
+    template <typename... Args>
+    static void capture(Record& r, int priority, const char* tag, const char* fmt, Args... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+        r.tag = tag;
+        r.fmt = fmt;
+        r.suppressed = 0;
+        r.priority = (uint8_t)priority;
+        r.argc = 0;
+        r.stringBytes = 0;
+        (put(r, args), ...);
+    }
+
+    // Formats one record into out (always NUL-terminated); returns the length. Integers
+    // read as printf's would: char and short promoted to int, then taken at the width
+    // of the length modifier (%hx of -1 is ffff, %x is ffffffff).
+    static size_t format(const Record& r, char* out, size_t size);
+
+    // Blocks until everything logged so far is written.
+    static void flush();
+
+    // While idle logging doesn't wake the writer: what is logged meanwhile goes out
+    // at the next flush() or when idle ends.
+    static void setIdle(bool idle);
+
+private:
+    // Slot in the calling thread's ring, nullptr (counted as dropped) when full.
+    static Record* begin();
+    static void commit();
+
+    template <typename T>
+    static void put(Record& r, T v) {
+        if constexpr (std::is_enum_v<T>) {
+            put(r, (std::underlying_type_t<T>)v);
+            return;
+        }
+        int n = r.argc++;
+        r.sizes[n] = sizeof(T);
+        if constexpr (std::is_floating_point_v<T>) {
+            r.types[n] = DOUBLE;
+            r.args[n].d = v;
+        } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+            r.types[n] = STRING;
+            putString(r, n, v);
+        } else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+            r.types[n] = POINTER;
+            r.args[n].p = (const void*)v;
+        } else if constexpr (!std::is_enum_v<T>) {
+            static_assert(std::is_integral_v<T>, "unsupported log argument type");
+            if constexpr (std::is_signed_v<T>) {
+                r.types[n] = SIGNED;
+                r.args[n].i = v;
+            } else {
+                r.types[n] = UNSIGNED;
+                r.args[n].u = v;
+            }
+        }
+    }
+
+    static void putString(Record& r, int n, const char* s) {
+        if (!s) {
+            s = "(null)";
+        }
+        size_t room = STRING_BYTES - r.stringBytes;
+        size_t len = strnlen(s, room ? room - 1 : 0);
+        r.args[n].str = r.stringBytes;
+        if (room) {
+            memcpy(r.strings + r.stringBytes, s, len);
+            r.strings[r.stringBytes + len] = '\0';
+            r.stringBytes += len + 1;
+        }
+    }
+};
+
+#endif //ALOG_H
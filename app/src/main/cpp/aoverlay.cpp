@@ -0,0 +1,149 @@
+//
+// 2D overlay batcher: text, lines and solid rects merged into one vertex stream.
+//
+#include <algorithm>
+#include <cmath>
+
+#include "aoverlay.h"
+
+static void setColor(OverlayVertex& v, uint32_t rgba) {
+    v.color[0] = rgba >> 24;
+    v.color[1] = rgba >> 16;
+    v.color[2] = rgba >> 8;
+    v.color[3] = rgba;
+}
+
+AOverlay::AOverlay() :
+    start{},
+    end{},
+    whiteU(0.0f),
+    whiteV(0.0f),
+    pixelX(2.0f / 1920),
+    pixelY(2.0f / 1080),
+    items(0) {
+}
+
+void AOverlay::setWhiteTexel(float u, float v) {
+    whiteU = u;
+    whiteV = v;
+}
+
+void AOverlay::setPixelSize(float x, float y) {
+    pixelX = x;
+    pixelY = y;
+}
+
+size_t AOverlay::used() const {
+    size_t n = 0;
+    for (int i = 0; i < LAYERS; i++) {
+        n += end[i] - start[i] + spill[i].size();
+    }
+    return n;
+}
+
+void AOverlay::begin() {
+    // Regions as large as last frame's layers plus a few quads, so the digits of a
+    // timer or an fps counter growing doesn't spill
+    size_t next = 0;
+    for (int i = 0; i < LAYERS; i++) {
+        size_t last = end[i] - start[i] + spill[i].size();
+        start[i] = next;
+        end[i] = next;
+        next += last ? last + last / 8 + 24 : 0;
+        spill[i].clear();
+    }
+    start[LAYERS] = next;
+    // Only grows or shrinks when the regions do, otherwise no writes and no allocations
+    stream.resize(next);
+    items = 0;
+}
+
+OverlayVertex* AOverlay::append(int index, size_t count) {
+    if (index < 0) index = 0;
+    if (index >= LAYERS) index = LAYERS - 1;
+    items++;
+    if (spill[index].empty() && end[index] + count <= start[index + 1]) {
+        OverlayVertex* out = stream.data() + end[index];
+        end[index] += count;
+        return out;
+    }
+    size_t size = spill[index].size();
+    spill[index].resize(size + count);
+    return spill[index].data() + size;
+}
+
+// Two triangles through the corners xy[0..7] in fan order
+void AOverlay::quad(OverlayVertex* out, const float* xy, float u, float v, uint32_t rgba) {
+    static const int order[6] = {0, 1, 2, 0, 2, 3};
+    for (int i : order) {
+        *out = {{xy[i * 2], xy[i * 2 + 1]}, {u, v}, {}};
+        setColor(*out++, rgba);
+    }
+}
+
+void AOverlay::addText(const vector<Vertex>& quads, uint32_t rgba, int index) {
+    OverlayVertex* out = append(index, quads.size());
+    for (const auto& q : quads) {
+        *out = {{q.pos[0], q.pos[1]}, {q.uv[0], q.uv[1]}, {}};
+        setColor(*out++, rgba);
+    }
+}
+
+void AOverlay::addRect(float x0, float y0, float x1, float y1, uint32_t rgba, int index) {
+    const float xy[8] = {x0, y0, x1, y0, x1, y1, x0, y1};
+    quad(append(index, 6), xy, whiteU, whiteV, rgba);
+}
+
+void AOverlay::addLine(float x0, float y0, float x1, float y1, float width, uint32_t rgba, int index) {
+    const float points[4] = {x0, y0, x1, y1};
+    addLineStrip(points, 2, width, rgba, index);
+}
+
+void AOverlay::addLineStrip(const float* points, int count, float width, uint32_t rgba, int index) {
+    OverlayVertex* out = append(index, count > 1 ? (size_t)(count - 1) * 6 : 0);
+    // Extrude each segment by half the width along its normal, measured in pixels
+    // so the thickness doesn't depend on the window aspect ratio.
+    float half = width * 0.5f;
+    for (int i = 0; i + 1 < count; i++, out += 6) {
+        float x0 = points[i * 2], y0 = points[i * 2 + 1];
+        float x1 = points[i * 2 + 2], y1 = points[i * 2 + 3];
+        float dx = (x1 - x0) / pixelX;
+        float dy = (y1 - y0) / pixelY;
+        float length = sqrtf(dx * dx + dy * dy);
+        // A zero-length segment stays a zero-area quad
+        float nx = length > 0.0f ? -dy / length * half * pixelX : 0.0f;
+        float ny = length > 0.0f ? dx / length * half * pixelY : 0.0f;
+        const float xy[8] = {x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny, x0 - nx, y0 - ny};
+        quad(out, xy, whiteU, whiteV, rgba);
+    }
+}
+
+const vector<OverlayVertex>& AOverlay::finish() {
+    bool spilled = false;
+    for (const auto& s : spill) {
+        spilled = spilled || !s.empty();
+    }
+    if (!spilled) {
+        // Pad each region with zero-area triangles, nothing is rasterized for them
+        for (int i = 0; i < LAYERS; i++) {
+            std::fill(stream.begin() + end[i], stream.begin() + start[i + 1], OverlayVertex{});
+        }
+        return stream;
+    }
+    // A layer outgrew its region: lay the frame out tightly, begin() sizes the
+    // regions from it next time
+    vector<OverlayVertex> packed;
+    packed.reserve(used());
+    size_t next = 0;
+    for (int i = 0; i < LAYERS; i++) {
+        packed.insert(packed.end(), stream.begin() + start[i], stream.begin() + end[i]);
+        packed.insert(packed.end(), spill[i].begin(), spill[i].end());
+        start[i] = next;
+        next = packed.size();
+        end[i] = next;
+        spill[i].clear();
+    }
+    start[LAYERS] = next;
+    stream.swap(packed);
+    return stream;
+}
@@ -0,0 +1,77 @@
+//
+// 2D overlay batcher: text, lines and solid rects merged into one vertex stream.
+//
+#ifndef AOVERLAY_H
+#define AOVERLAY_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <vector>
+
+#include "afont.h"
+
+struct OverlayVertex {
+    GLfloat pos[2];
+    GLfloat uv[2];
+    GLubyte color[4];
+};
+
+/**
+ * Everything is drawn as triangles sampling the font atlas: glyphs use their
+ * baked quads, untextured geometry samples the atlas' white texel. With a
+ * single texture, program and blend mode the whole overlay is one draw call.
+ * Each layer writes straight into its own region of the stream, sized from the
+ * previous frame plus some headroom, so items come out ordered by layer (then
+ * submission order) without a merge. The unused rest of a region is degenerate
+ * triangles. Only a frame in which a layer outgrows its region is compacted.
+ * No GL calls here, ADisplay uploads the result.
+ */
+class AOverlay {
+public:
+    static const int LAYERS = 4;
+
+    struct Stats {
+        uint32_t items;      // what used to be one draw call each
+        uint32_t vertices;   // without the padding
+    };
+
+    AOverlay();
+
+    void setWhiteTexel(float u, float v);
+    // Size of one window pixel in clip space, used for line widths.
+    void setPixelSize(float x, float y);
+    float pixelWidth() const { return pixelX; }
+    float pixelHeight() const { return pixelY; }
+
+    void begin();
+    void addText(const vector<Vertex>& quads, uint32_t rgba, int layer = 1);
+    void addRect(float x0, float y0, float x1, float y1, uint32_t rgba, int layer = 0);
+    void addLine(float x0, float y0, float x1, float y1, float width, uint32_t rgba, int layer = 1);
+    // Connected segments through count points (x, y interleaved).
+    void addLineStrip(const float* points, int count, float width, uint32_t rgba, int layer = 1);
+    // Pads or compacts the regions, returns the stream ADisplay draws with GL_TRIANGLES.
+    const vector<OverlayVertex>& finish();
+
+    const vector<OverlayVertex>& vertices() const { return stream; }
+    Stats stats() const { return {items, (uint32_t)used()}; }
+
+private:
+    // Layer i owns stream[start[i], start[i + 1]), filled up to end[i]
+    vector<OverlayVertex> stream;
+    size_t start[LAYERS + 1];
+    size_t end[LAYERS];
+    // What didn't fit a layer's region this frame, in order after it
+    vector<OverlayVertex> spill[LAYERS];
+    float whiteU;
+    float whiteV;
+    float pixelX;
+    float pixelY;
+    uint32_t items;
+
+    // Room for count more vertices of a layer, counts the item
+    OverlayVertex* append(int index, size_t count);
+    size_t used() const;
+    static void quad(OverlayVertex* out, const float* xy, float u, float v, uint32_t rgba);
+};
+
+#endif //AOVERLAY_H
@@ -0,0 +1,427 @@
+//
+// H.264 (ITU-T H.264 7.3.2.1, E.1) and HEVC (ITU-T H.265 7.3.2.1-2) parameter set parsing.
+//
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "aparamsets.h"
+
+namespace {
+
+// Reads RBSP bits, dropping emulation prevention bytes (00 00 03) on the way
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    int bit() {
+        if (bits == 0) {
+            if (pos >= size) {
+                overrun = true;
+                return 0;
+            }
+            uint8_t b = data[pos++];
+            if (zeros >= 2 && b == 3) {
+                zeros = 0;
+                if (pos >= size) {
+                    overrun = true;
+                    return 0;
+                }
+                b = data[pos++];
+            }
+            zeros = b == 0 ? zeros + 1 : 0;
+            cache = b;
+            bits = 8;
+        }
+        return (cache >> --bits) & 1;
+    }
+
+    uint32_t u(int n) {
+        uint32_t v = 0;
+        while (n-- > 0) {
+            v = v << 1 | bit();
+        }
+        return v;
+    }
+
+    void skip(int n) {
+        while (n-- > 0) {
+            bit();
+        }
+    }
+
+    // Exp-Golomb
+    uint32_t ue() {
+        int leadingZeros = 0;
+        while (!bit()) {
+            if (overrun || ++leadingZeros > 31) {
+                overrun = true;
+                return 0;
+            }
+        }
+        return leadingZeros ? (1u << leadingZeros) - 1 + u(leadingZeros) : 0;
+    }
+
+    int32_t se() {
+        uint32_t k = ue();
+        return k & 1 ? (int32_t)((k + 1) / 2) : -(int32_t)(k / 2);
+    }
+
+    bool ok() const { return !overrun; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    int zeros = 0;
+    uint32_t cache = 0;
+    int bits = 0;
+    bool overrun = false;
+};
+
+void skipScalingList(BitReader& r, int count) {
+    int last = 8, next = 8;
+    for (int j = 0; j < count; j++) {
+        if (next != 0) {
+            next = (last + r.se() + 256) % 256;
+        }
+        last = next == 0 ? last : next;
+    }
+}
+
+void skipHrd(BitReader& r) {
+    uint32_t cpbCount = r.ue() + 1;
+    r.skip(8);  // bit_rate_scale, cpb_size_scale
+    for (uint32_t i = 0; i < cpbCount && i < 32 && r.ok(); i++) {
+        r.ue();
+        r.ue();
+        r.skip(1);
+    }
+    r.skip(20); // four 5-bit delay/offset lengths
+}
+
+void hevcProfileTierLevel(BitReader& r, int maxSubLayersMinus1, StreamParams& out) {
+    r.skip(3);  // general_profile_space, general_tier_flag
+    out.profile = (int)r.u(5);
+    r.skip(32); // compatibility flags
+    r.skip(48); // source flags, constraint flags, reserved
+    out.level = (int)r.u(8);
+    bool subProfile[8], subLevel[8];
+    for (int i = 0; i < maxSubLayersMinus1; i++) {
+        subProfile[i] = r.bit();
+        subLevel[i] = r.bit();
+    }
+    if (maxSubLayersMinus1 > 0) {
+        r.skip(2 * (8 - maxSubLayersMinus1));
+    }
+    for (int i = 0; i < maxSubLayersMinus1; i++) {
+        if (subProfile[i]) r.skip(88);
+        if (subLevel[i]) r.skip(8);
+    }
+}
+
+// Values of the highest sub-layer, the one a full-rate decode outputs
+void hevcOrdering(BitReader& r, int maxSubLayersMinus1, StreamParams& out) {
+    bool allLayers = r.bit();
+    for (int i = allLayers ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++) {
+        out.maxDecFrameBuffering = (int)r.ue() + 1;
+        out.maxNumReorderFrames = (int)r.ue();
+        uint32_t latencyIncreasePlus1 = r.ue();
+        out.maxLatencyPictures = latencyIncreasePlus1
+                ? out.maxNumReorderFrames + (int)latencyIncreasePlus1 - 1 : 0;
+    }
+    out.reorderSignaled = true;
+}
+
+// Next NAL unit in an Annex-B buffer, [begin, end) without the start code
+bool nextNal(const uint8_t* data, size_t size, size_t& pos, size_t& begin, size_t& end) {
+    while (pos + 3 <= size && !(data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1)) {
+        pos++;
+    }
+    if (pos + 3 > size) {
+        return false;
+    }
+    begin = pos + 3;
+    pos = begin;
+    while (pos + 3 <= size && !(data[pos] == 0 && data[pos + 1] == 0 && (data[pos + 2] == 1 || data[pos + 2] == 0))) {
+        pos++;
+    }
+    end = pos + 3 <= size ? pos : size;
+    return true;
+}
+
+} // namespace
+
+VideoCodec AParamSets::codecForMime(const char* mime) {
+    if (!mime) return VideoCodec::UNKNOWN;
+    if (strcmp(mime, "video/avc") == 0) return VideoCodec::AVC;
+    if (strcmp(mime, "video/hevc") == 0) return VideoCodec::HEVC;
+    return VideoCodec::UNKNOWN;
+}
+
+int AParamSets::avcMaxDpbFrames(int level, int widthMbs, int heightMbs) {
+    static const struct { int level; int maxDpbMbs; } limits[] = {
+            {9, 396}, {10, 396}, {11, 900}, {12, 2376}, {13, 2376}, {20, 2376},
+            {21, 4752}, {22, 8100}, {30, 8100}, {31, 18000}, {32, 20480},
+            {40, 32768}, {41, 32768}, {42, 34816}, {50, 110400}, {51, 184320},
+            {52, 184320}, {60, 696320}, {61, 696320}, {62, 696320}};
+    int maxDpbMbs = limits[std::size(limits) - 1].maxDpbMbs;
+    for (const auto& l : limits) {
+        if (l.level >= level) {
+            maxDpbMbs = l.maxDpbMbs;
+            break;
+        }
+    }
+    int picMbs = widthMbs * heightMbs;
+    return picMbs > 0 ? std::min(maxDpbMbs / picMbs, 16) : 16;
+}
+
+bool AParamSets::parseAvcSps(const uint8_t* nal, size_t size, StreamParams& out) {
+    if (size < 4 || (nal[0] & 0x1f) != 7) {
+        return false;
+    }
+    StreamParams p{};
+    p.codec = VideoCodec::AVC;
+    p.chromaFormat = 1;
+    p.bitDepth = 8;
+    BitReader r(nal + 1, size - 1);
+    p.profile = (int)r.u(8);
+    uint32_t constraints = r.u(8);
+    p.level = (int)r.u(8);
+    r.ue();     // seq_parameter_set_id
+    static const int highProfiles[] = {100, 110, 122, 244, 44, 83, 86, 118, 128, 138, 139, 134, 135};
+    if (std::find(std::begin(highProfiles), std::end(highProfiles), p.profile) != std::end(highProfiles)) {
+        p.chromaFormat = (int)r.ue();
+        if (p.chromaFormat == 3) {
+            r.skip(1);  // separate_colour_plane_flag
+        }
+        p.bitDepth = (int)r.ue() + 8;
+        r.ue();     // bit_depth_chroma_minus8
+        r.skip(1);  // qpprime_y_zero_transform_bypass_flag
+        if (r.bit()) {
+            for (int i = 0; i < (p.chromaFormat != 3 ? 8 : 12); i++) {
+                if (r.bit()) {
+                    skipScalingList(r, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    r.ue();     // log2_max_frame_num_minus4
+    uint32_t pocType = r.ue();
+    if (pocType == 0) {
+        r.ue();
+    } else if (pocType == 1) {
+        r.skip(1);
+        r.se();
+        r.se();
+        uint32_t cycle = r.ue();
+        for (uint32_t i = 0; i < cycle && i < 256 && r.ok(); i++) {
+            r.se();
+        }
+    }
+    r.ue();     // max_num_ref_frames
+    r.skip(1);  // gaps_in_frame_num_value_allowed_flag
+    int widthMbs = (int)r.ue() + 1;
+    int heightMapUnits = (int)r.ue() + 1;
+    bool frameMbsOnly = r.bit();
+    if (!frameMbsOnly) {
+        r.skip(1);
+    }
+    r.skip(1);  // direct_8x8_inference_flag
+    int heightMbs = (2 - frameMbsOnly) * heightMapUnits;
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    if (r.bit()) {
+        cropLeft = r.ue();
+        cropRight = r.ue();
+        cropTop = r.ue();
+        cropBottom = r.ue();
+    }
+    int cropUnitX = p.chromaFormat == 1 || p.chromaFormat == 2 ? 2 : 1;
+    int cropUnitY = (p.chromaFormat == 1 ? 2 : 1) * (2 - frameMbsOnly);
+    p.width = widthMbs * 16 - cropUnitX * (int)(cropLeft + cropRight);
+    p.height = heightMbs * 16 - cropUnitY * (int)(cropTop + cropBottom);
+
+    // Level 1b in Baseline/Main/Extended is level_idc 11 with constraint_set3_flag
+    bool constraintSet3 = constraints & 0x10;
+    if (p.level == 11 && constraintSet3 && (p.profile == 66 || p.profile == 77 || p.profile == 88)) {
+        p.level = 9;
+    }
+    // Inferred when the VUI doesn't say (E.2.1)
+    int maxDpbFrames = avcMaxDpbFrames(p.level, widthMbs, heightMbs);
+    p.maxDecFrameBuffering = maxDpbFrames;
+    p.maxNumReorderFrames = maxDpbFrames;
+    bool intraProfile = p.profile == 44 || p.profile == 86 || p.profile == 100
+            || p.profile == 110 || p.profile == 122 || p.profile == 244;
+    if (constraintSet3 && intraProfile) {
+        p.maxDecFrameBuffering = 0;
+        p.maxNumReorderFrames = 0;
+    }
+    // POC type 2 ties output order to decode order, nothing can be reordered
+    if (pocType == 2) {
+        p.maxNumReorderFrames = 0;
+    }
+
+    if (r.bit()) {  // vui_parameters_present_flag
+        if (r.bit() && r.u(8) == 255) {
+            r.skip(32); // sar_width, sar_height
+        }
+        if (r.bit()) {
+            r.skip(1);
+        }
+        if (r.bit()) {
+            r.skip(4);
+            if (r.bit()) {
+                r.skip(24);
+            }
+        }
+        if (r.bit()) {
+            r.ue();
+            r.ue();
+        }
+        if (r.bit()) {
+            uint32_t unitsInTick = r.u(32);
+            uint32_t timeScale = r.u(32);
+            r.skip(1);
+            if (unitsInTick) {
+                p.vuiFps = timeScale / (2.0f * unitsInTick);
+            }
+        }
+        bool nalHrd = r.bit();
+        if (nalHrd) skipHrd(r);
+        bool vclHrd = r.bit();
+        if (vclHrd) skipHrd(r);
+        if (nalHrd || vclHrd) {
+            r.skip(1);  // low_delay_hrd_flag
+        }
+        r.skip(1);  // pic_struct_present_flag
+        if (r.bit()) {  // bitstream_restriction_flag
+            r.skip(1);
+            p.maxBytesPerPicDenom = (int)r.ue();
+            r.ue();
+            r.ue();
+            r.ue();
+            p.maxNumReorderFrames = (int)r.ue();
+            p.maxDecFrameBuffering = (int)r.ue();
+            p.reorderSignaled = true;
+        }
+    }
+    if (!r.ok() || p.width <= 0 || p.height <= 0) {
+        return false;
+    }
+    out = p;
+    return true;
+}
+
+bool AParamSets::parseHevcVps(const uint8_t* nal, size_t size, StreamParams& out) {
+    if (size < 4 || ((nal[0] >> 1) & 0x3f) != 32) {
+        return false;
+    }
+    StreamParams p = out;
+    p.codec = VideoCodec::HEVC;
+    BitReader r(nal + 2, size - 2);
+    r.skip(12);     // vps id, base layer flags, vps_max_layers_minus1
+    int maxSubLayersMinus1 = (int)r.u(3);
+    r.skip(17);     // temporal id nesting, reserved 0xffff
+    hevcProfileTierLevel(r, maxSubLayersMinus1, p);
+    hevcOrdering(r, maxSubLayersMinus1, p);
+    if (!r.ok()) {
+        return false;
+    }
+    out = p;
+    return true;
+}
+
+bool AParamSets::parseHevcSps(const uint8_t* nal, size_t size, StreamParams& out) {
+    if (size < 4 || ((nal[0] >> 1) & 0x3f) != 33) {
+        return false;
+    }
+    StreamParams p{};
+    p.codec = VideoCodec::HEVC;
+    BitReader r(nal + 2, size - 2);
+    r.skip(4);      // sps_video_parameter_set_id
+    int maxSubLayersMinus1 = (int)r.u(3);
+    r.skip(1);
+    hevcProfileTierLevel(r, maxSubLayersMinus1, p);
+    r.ue();         // sps_seq_parameter_set_id
+    p.chromaFormat = (int)r.ue();
+    if (p.chromaFormat == 3) {
+        r.skip(1);
+    }
+    p.width = (int)r.ue();
+    p.height = (int)r.ue();
+    if (r.bit()) {  // conformance_window_flag
+        int subWidth = p.chromaFormat == 1 || p.chromaFormat == 2 ? 2 : 1;
+        int subHeight = p.chromaFormat == 1 ? 2 : 1;
+        uint32_t left = r.ue(), right = r.ue(), top = r.ue(), bottom = r.ue();
+        p.width -= subWidth * (int)(left + right);
+        p.height -= subHeight * (int)(top + bottom);
+    }
+    p.bitDepth = (int)r.ue() + 8;
+    r.ue();         // bit_depth_chroma_minus8
+    r.ue();         // log2_max_pic_order_cnt_lsb_minus4
+    hevcOrdering(r, maxSubLayersMinus1, p);
+    if (!r.ok() || p.width <= 0 || p.height <= 0) {
+        return false;
+    }
+    out = p;
+    return true;
+}
+
+bool AParamSets::parse(VideoCodec codec, const uint8_t* data, size_t size, StreamParams& out) {
+    if (!data || size < 4 || codec == VideoCodec::UNKNOWN) {
+        return false;
+    }
+    StreamParams vps{};
+    bool haveVps = false;
+    size_t pos = 0, begin, end;
+    bool annexB = nextNal(data, size, pos, begin, end);
+    if (!annexB) {
+        begin = 0;
+        end = size;
+    }
+    do {
+        const uint8_t* nal = data + begin;
+        size_t length = end - begin;
+        if (codec == VideoCodec::AVC) {
+            if (parseAvcSps(nal, length, out)) {
+                return true;
+            }
+        } else if (parseHevcSps(nal, length, out)) {
+            return true;
+        } else if (!haveVps) {
+            haveVps = parseHevcVps(nal, length, vps);
+        }
+    } while (annexB && nextNal(data, size, pos, begin, end));
+    if (haveVps) {
+        out = vps;
+        return true;
+    }
+    return false;
+}
+
+StreamSizing AParamSets::sizing(const StreamParams& params, float fps) {
+    StreamSizing s{};
+    if (fps <= 0.0f) {
+        fps = params.vuiFps > 0.0f ? params.vuiFps : 30.0f;
+    }
+    s.outputDelayFrames = params.maxNumReorderFrames;
+    s.outputDelayMs = s.outputDelayFrames * 1000.0f / fps;
+    s.dpbFrames = std::max(params.maxDecFrameBuffering, params.maxNumReorderFrames);
+    // One being decoded and one waiting behind it, on top of the reorder window
+    s.queueDepth = s.outputDelayFrames + 2;
+
+    // Uncompressed picture size (AVC RawMbBits per macroblock), which bounds a coded one
+    int width = (params.width + 15) & ~15;
+    int height = (params.height + 15) & ~15;
+    int64_t samples = (int64_t)width * height;
+    static const int chromaQuarters[] = {0, 2, 4, 8};    // both chroma planes, in luma quarters
+    int chroma = params.chromaFormat >= 0 && params.chromaFormat <= 3 ? chromaQuarters[params.chromaFormat] : 2;
+    int bitDepth = params.bitDepth > 0 ? params.bitDepth : 8;
+    s.maxSampleBytes = (samples * (4 + chroma) / 4) * bitDepth / 8;
+    if (params.codec == VideoCodec::AVC && params.maxBytesPerPicDenom > 0) {
+        s.maxSampleBytes /= params.maxBytesPerPicDenom;
+    }
+    // Slice headers and SEI on top
+    s.maxSampleBytes += 4096;
+    return s;
+}
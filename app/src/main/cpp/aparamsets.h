@@ -0,0 +1,63 @@
+//
+// H.264 SPS and HEVC VPS/SPS parsing, and the pipeline sizing that follows from
+// them (output delay, frames in flight, largest sample). Pure logic, no platform calls.
+//
+#ifndef APARAMSETS_H
+#define APARAMSETS_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class VideoCodec { UNKNOWN, AVC, HEVC };
+
+struct StreamParams {
+    VideoCodec codec;
+    int profile;
+    int level;              // level_idc: 31 is 3.1 for AVC, 93 is 3.1 for HEVC (30 x level)
+    int width;
+    int height;
+    int chromaFormat;       // 0 mono, 1 4:2:0, 2 4:2:2, 3 4:4:4
+    int bitDepth;
+    // Pictures the decoder may hold before the first output, and DPB size
+    int maxNumReorderFrames;
+    int maxDecFrameBuffering;
+    // HEVC SpsMaxLatencyPictures, 0 when not limited
+    int maxLatencyPictures;
+    // Signaled (VUI bitstream_restriction / HEVC sub-layer ordering), else inferred
+    bool reorderSignaled;
+    // AVC VUI max_bytes_per_pic_denom, 0 if absent
+    int maxBytesPerPicDenom;
+    float vuiFps;           // AVC VUI timing, 0 if absent
+};
+
+struct StreamSizing {
+    int outputDelayFrames;  // frames queued before the first comes out (reordering)
+    float outputDelayMs;    // same at the content rate
+    int dpbFrames;          // worst case for decoders that wait for a full DPB
+    int queueDepth;         // inputs in flight that keep the decoder busy without piling up
+    int64_t maxSampleBytes; // upper bound of one coded picture
+};
+
+class AParamSets {
+public:
+    /**
+     * Parses the parameter sets in data: Annex-B (start codes, as in csd-0/csd-1 or an
+     * elementary stream) or a single NAL unit without one. Stops at the first SPS;
+     * for HEVC a VPS before it fills the ordering fields when the SPS can't be read.
+     */
+    static bool parse(VideoCodec codec, const uint8_t* data, size_t size, StreamParams& out);
+
+    // Single NAL units, header included, emulation prevention bytes still in
+    static bool parseAvcSps(const uint8_t* nal, size_t size, StreamParams& out);
+    static bool parseHevcSps(const uint8_t* nal, size_t size, StreamParams& out);
+    static bool parseHevcVps(const uint8_t* nal, size_t size, StreamParams& out);
+
+    static StreamSizing sizing(const StreamParams& params, float fps);
+
+    // AVC MaxDpbFrames for level_idc (9 for level 1b) and picture size in macroblocks (Table A-1)
+    static int avcMaxDpbFrames(int level, int widthMbs, int heightMbs);
+
+    static VideoCodec codecForMime(const char* mime);
+};
+
+#endif //APARAMSETS_H
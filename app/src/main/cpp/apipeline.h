@@ -0,0 +1,44 @@
+//
+// Scheduling parameters of the decode -> display pipeline. ADecoder runs on them
+// and the host pipeline simulator (tools/apipesim) models them.
+//
+#ifndef APIPELINE_H
+#define APIPELINE_H
+
+#include <cstdint>
+
+struct APipeline {
+    // Images the AImageReader lets the renderer hold at once (maxImages)
+    static constexpr int MAX_IMAGES = 3;
+    // AMediaCodec_dequeueInputBuffer / dequeueOutputBuffer timeout in extractorLoop,
+    // the upper bound once the frame rate is known
+    static constexpr int64_t DEQUEUE_TIMEOUT_US = 10000;
+    static constexpr int64_t MIN_DEQUEUE_TIMEOUT_US = 1000;
+    // Inputs in flight the extractor may raise its limit to when the codec stalls
+    static constexpr int MAX_INPUT_DEPTH = 16;
+    // Decoded frames kept for reverse playback and stepping, debug.aplayer.gopcache (MiB)
+    // overrides the budget; the count stays well inside a BufferQueue's 64 slots
+    static constexpr int GOP_CACHE_BUDGET_MB = 192;
+    static constexpr int MIN_CACHED_FRAMES = 4;
+    static constexpr int MAX_CACHED_FRAMES = 48;
+
+    // A quarter frame, so waiting on one side never costs the other a whole frame
+    static int64_t dequeueTimeoutUs(float fps) {
+        if (fps <= 0.0f) {
+            return DEQUEUE_TIMEOUT_US;
+        }
+        auto us = (int64_t)(250000.0f / fps);
+        return us < MIN_DEQUEUE_TIMEOUT_US ? MIN_DEQUEUE_TIMEOUT_US
+                                           : us > DEQUEUE_TIMEOUT_US ? DEQUEUE_TIMEOUT_US : us;
+    }
+    // The extractor feeds while fewer than inputDepth samples are in the codec, 0 is no limit
+    static bool feeds(int inputDepth, int inFlight) {
+        return inputDepth == 0 || inFlight < inputDepth;
+    }
+    // Two frames without output while holding back input means the codec wants more
+    static int64_t stallTimeoutUs(int64_t dequeueTimeoutUs) {
+        return dequeueTimeoutUs * 8 > 20000 ? dequeueTimeoutUs * 8 : 20000;
+    }
+};
+
+#endif //APIPELINE_H
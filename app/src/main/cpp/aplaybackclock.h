@@ -0,0 +1,62 @@
+//
+// Presentation clock: maps stream PTS to steady clock time at a playback rate.
+//
+#ifndef APLAYBACKCLOCK_H
+#define APLAYBACKCLOCK_H
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * Anchored at the first frame shown (or after a loop/flush), rate changes
+ * re-anchor at the current media time so it never jumps. Negative rates run
+ * backwards. Not thread safe, owned by the thread that releases frames.
+ */
+class APlaybackClock {
+public:
+    static constexpr float MIN_RATE = 0.25f;
+    static constexpr float MAX_RATE = 16.0f;
+
+    // Magnitude to MIN_RATE..MAX_RATE, keeping the direction
+    static float clampRate(float rate) {
+        float m = fabsf(rate);
+        m = m < MIN_RATE ? MIN_RATE : m > MAX_RATE ? MAX_RATE : m;
+        return rate < 0.0f ? -m : m;
+    }
+
+    // ptsUs is on screen at nowNs
+    void start(int64_t ptsUs, int64_t nowNs) {
+        anchorPtsUs = ptsUs;
+        anchorNs = nowNs;
+        running = true;
+    }
+    // Re-anchors at the next start()
+    void reset() { running = false; }
+    bool started() const { return running; }
+
+    void setRate(float r, int64_t nowNs) {
+        if (running) {
+            anchorPtsUs = mediaUs(nowNs);
+            anchorNs = nowNs;
+        }
+        speed = clampRate(r);
+    }
+    float rate() const { return speed; }
+
+    // Stream time at nowNs
+    int64_t mediaUs(int64_t nowNs) const {
+        return anchorPtsUs + (int64_t)((nowNs - anchorNs) / 1000.0 * speed);
+    }
+    // Steady clock time at which ptsUs is due on screen
+    int64_t dueNs(int64_t ptsUs) const {
+        return anchorNs + (int64_t)((ptsUs - anchorPtsUs) * 1000.0 / speed);
+    }
+
+private:
+    int64_t anchorPtsUs = 0;
+    int64_t anchorNs = 0;
+    float speed = 1.0f;
+    bool running = false;
+};
+
+#endif //APLAYBACKCLOCK_H
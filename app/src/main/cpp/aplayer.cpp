@@ -20,10 +20,18 @@
 #include <GLES2/gl2ext.h>
 #include <android/choreographer.h>
 #include <android_native_app_glue.h>
+#include <jni.h>
 
 #include "util.h"
+#include "abench.h"
 #include "adisplay.h"
 #include "adecoder.h"
+#include "astartup.h"
+#include "athumbnailer.h"
+#include "arefreshrate.h"
+#include "athreadpolicy.h"
+#include "aframegraph.h"
+#include "atimecode.h"
 
 #define LOG_TAG "native-activity"
 
@@ -37,13 +45,44 @@ struct Engine {
 
     float scaleX;
     float scaleY;
+    // Set when the window is (re)created, cleared once the first frame is out.
+    time_point<high_resolution_clock> initStart;
 
     AFont* font;
     ADisplay* display;
     ADecoder* decoder;
+    // Thumbnail strips of the Download videos, made once playback is up; debug.aplayer.thumbs=0 disables
+    AThumbnailer* thumbnailer;
+    AOverlay overlay;
+    // Block-coded render time and PTS in the corner, debug.aplayer.timecode=1
+    bool timecode;
+    // Headless benchmark, frames driven by the main loop instead of Choreographer
+    ABench* bench;
+    bool benchmarking;
+    // Per-thread scheduling stats once per second, debug.aplayer.threadstats=1
+    bool threadStats;
+    // Initial playback rate, keys change it from there
+    int speedPercent;
+    // Set by the first decoder init; later ones keep the rate the keys left behind
+    bool speedApplied;
+    // TERM_WINDOW only drops the window surface, debug.aplayer.keepcontext=0 tears EGL down
+    bool keepContext;
+    // Font, EGL and decoder come up side by side, debug.aplayer.parallelstart=0 runs them in turn
+    bool parallelStart;
+    // What the last INIT_WINDOW found still set up
+    bool displayKept;
+    bool decoderKept;
+    // Decoder parked and log writer idle: from TERM_WINDOW to the next INIT_WINDOW, and
+    // while paused from the keys
+    bool parked;
+    // Paused from the keys; outlives the window, play and the step keys clear it
+    bool userPaused;
+    std::vector<ThreadSample> parkedThreads;
+    time_point<steady_clock> parkedAt;
 
-    /// Resumes ticking the application.
+    /// Resumes ticking the application, and the decoder where Pause() parked it.
     void Resume() {
+        WakeUp();
         // Checked to make sure we don't double schedule Choreographer.
         if (!running_) {
             running_ = true;
@@ -54,8 +93,117 @@ struct Engine {
     /// Pauses ticking the application.
     ///
     /// When paused, sensor and input events will still be processed, but the
-    /// update and render parts of the loop will not run.
-    void Pause() { running_ = false; }
+    /// update and render parts of the loop will not run, and the decoder is parked:
+    /// nothing in the process wakes up until Resume().
+    void Pause() {
+        running_ = false;
+        Park();
+    }
+
+    /// Parks the decoder where it is and quiets the log writer, for while nothing is
+    /// shown. Reports the wakeups of the whole process over the park on WakeUp().
+    void Park() {
+        if (parked) {
+            return;
+        }
+        if (decoder) {
+            decoder->pause();
+        }
+        ALog::setIdle(true);
+        parkedThreads = AThreadPolicy::sampleProcess();
+        parkedAt = steady_clock::now();
+        parked = true;
+    }
+
+    /// Undoes Park(), the decoder goes on from the frame it stopped at.
+    void WakeUp() {
+        if (!parked) {
+            return;
+        }
+        AThreadPolicy::logWakeups("Parked", parkedThreads,
+                                  duration_cast<nanoseconds>(steady_clock::now() - parkedAt).count());
+        parked = false;
+        ALog::setIdle(false);
+        if (decoder) {
+            decoder->resume();
+        }
+    }
+
+    /// Display, font and decoder from nothing. The atlas bake, the extractor and the codec
+    /// run on threads of their own while EGL comes up on this one; only the atlas upload
+    /// waits for the bake, and the codec for its extractor. False without a display, the
+    /// decoder is deleted if it didn't come up.
+    bool ColdStart() {
+        ANativeActivity* activity = app->activity;
+        AStartup startup;
+        int fontStep = startup.add("font", {}, [this, activity] {
+            return font->init(activity->assetManager);
+        });
+        int eglStep = startup.add("egl", {}, [this, activity] {
+            return bench ? display->initOffscreen(nullptr, ANativeWindow_getWidth(app->window),
+                                                  ANativeWindow_getHeight(app->window), activity->internalDataPath)
+                         : display->init(nullptr, app->window, activity->internalDataPath);
+        }, true);
+        int atlasStep = startup.add("atlas", {fontStep, eglStep}, [this] {
+            display->uploadAtlas(font->bitmap);
+            return true;
+        }, true);
+        if (decoder != nullptr && !decoder->initialized()) {
+            int openStep = startup.add("extractor", {}, [this] { return decoder->open(); });
+            startup.add("codec", {openStep}, [this, activity] {
+                return decoder->start(activity->vm, activity->internalDataPath);
+            });
+        }
+        startup.run(parallelStart);
+        startup.logTimeline();
+        if (decoder != nullptr && !decoder->initialized()) {
+            LOGW(LOG_TAG, "Failed to initialize decoder");
+            delete decoder;
+            decoder = nullptr;
+        }
+        if (!startup.succeeded(atlasStep)) {
+            // The codec may be running already, hold it until there is a display
+            Park();
+            return false;
+        }
+        return true;
+    }
+
+    /// Recomputes everything that depends on the window size.
+    void Resize(int32_t width, int32_t height) {
+        // Base scale factors for 1920x1080, scale inversely to maintain same text size
+        scaleX = 1920.0f / width * 0.0042f;
+        scaleY = 1080.0f / height * 0.0063f;
+        overlay.setPixelSize(2.0f / width, 2.0f / height);
+        if (display != nullptr) {
+            display->resize(width, height);
+        }
+    }
+
+    /// One unthrottled frame of the headless benchmark.
+    void BenchTick() {
+        bench->begin();
+        bool newImage = RenderFrame(0, 0);
+        // Wait for the GPU, a pbuffer swap doesn't
+        glFinish();
+        bench->mark(ABench::GPU);
+        bench->end(newImage);
+        if (bench->done()) {
+            benchmarking = false;
+            char model[PROP_VALUE_MAX] = "android";
+            __system_property_get("ro.product.model", model);
+            bench->writeJson((string(app->activity->internalDataPath) + "/bench.json").c_str(), model);
+            ANativeActivity_finish(app->activity);
+        }
+    }
+
+    /// One frame while paused from the keys, so a new window isn't left blank: the frame
+    /// the decoder released before the pause if there is one, the overlay on black otherwise.
+    void DrawPaused() {
+        if (display != nullptr) {
+            RenderFrame(0, 0);
+        }
+    }
 
 private:
     bool running_;
@@ -63,19 +211,34 @@ private:
     int fc = 0;
     time_point<high_resolution_clock> ft = high_resolution_clock::now();
     vector<Vertex> fv;
+    AFrameGraph graph;
+    int64_t lastFrameTimeNanos = 0;
+    ThreadStats renderStats;
+    ThreadStats decoderStats;
+    AHistogram decodeLatency;
 
     void ScheduleNextTick() {
         AChoreographer_postVsyncCallback(AChoreographer_getInstance(),
                                            Tick, this);
     }
 
-    static void Tick(const AChoreographerFrameCallbackData*, void* data) {
+    static void Tick(const AChoreographerFrameCallbackData* frameData, void* data) {
         CHECK_NOT_NULL(LOG_TAG, data);
+        TRACE_SCOPE("Tick");
         auto engine = reinterpret_cast<Engine*>(data);
-        engine->DoTick();
+        int64_t frameTimeNanos = 0;
+        int64_t presentNanos = 0;
+        if (frameData) {
+            frameTimeNanos = AChoreographerFrameCallbackData_getFrameTimeNanos(frameData);
+            // The timeline the system expects us to make, its present time is the swap target
+            size_t timeline = AChoreographerFrameCallbackData_getPreferredFrameTimelineIndex(frameData);
+            presentNanos = AChoreographerFrameCallbackData_getFrameTimelineExpectedPresentationTimeNanos(
+                    frameData, timeline);
+        }
+        engine->DoTick(frameTimeNanos, presentNanos);
     }
 
-    void DoTick() {
+    void DoTick(int64_t frameTimeNanos, int64_t presentNanos) {
         if (!running_) {
             return;
         }
@@ -90,33 +253,317 @@ private:
             // No display.
             return;
         }
+        TRACE_SCOPE("DoTick");
+        RenderFrame(frameTimeNanos, presentNanos);
+    }
+
+    /// Queues the playing video first, then the rest newest first.
+    void StartThumbnails() {
+        if (!thumbnailer || !decoder || bench
+            || !thumbnailer->start(app->activity->vm, app->activity->internalDataPath)) {
+            return;
+        }
+        thumbnailer->request(decoder->path());
+        for (const auto& path : ADecoder::findVideos(ADecoder::DOWNLOAD_DIR)) {
+            thumbnailer->request(path);
+        }
+    }
+
+    /// Decodes, builds the overlay and draws one frame; returns whether it had a new image.
+    /// presentNanos is the Choreographer's expected present time, 0 when unknown.
+    bool RenderFrame(int64_t frameTimeNanos, int64_t presentNanos) {
+        VideoFormat format;
+        if (decoder && decoder->pollFormatChange(format)) {
+            display->setVideoFormat(format);
+        }
+        AImage* image = decoder ? decoder->acquireLatestImage() : nullptr;
+        int64_t releaseNs = 0;
+        int released = decoder ? decoder->takeReleased(releaseNs) : 0;
+        // Taken after the (blocking) acquire, so the timer is as close to the swap as possible
         auto now = high_resolution_clock::now();
+        if (bench) bench->mark(ABench::ACQUIRE);
+        // The timer shows when the frame is meant to be on screen; the swap is paced to
+        // that time. Both clocks are CLOCK_MONOTONIC (high_resolution_clock is steady_clock in libc++).
+        auto shown = presentNanos > 0
+                     ? time_point<high_resolution_clock>(nanoseconds(presentNanos)) : now;
 
         // Calculate text scale based on window size to keep text size constant
-        auto v = font->buildTextQuads(
-                to_string(duration_cast<milliseconds>(now - start).count() % 100000).c_str(),
-                scaleX, scaleY, 0.0f);
+        overlay.begin();
+        overlay.addText(font->buildTextQuads(
+                to_string(duration_cast<milliseconds>(shown - start).count() % 100000).c_str(),
+                scaleX, scaleY, 0.0f), 0xffffffff);
         fc++;
         auto e = duration_cast<milliseconds>(now - ft).count();
         if(e > 1000){
             auto fps = fc * 1000.0f / e;
             fc = 0;
             ft = now;
-            fv = font->buildTextQuads((to_string((int)fps) + " fps").c_str(),
-                                      scaleX * 0.5f, scaleY * 0.5f, -0.4f);
-//            LOGI(LOG_TAG, "fps: %f", fps);
+            string label = to_string((int)fps) + " fps";
+            float rate = decoder ? decoder->playbackRate() : 1.0f;
+            if (decoder && decoder->stepping()) {
+                label += " step";
+            } else if (rate != 1.0f) {
+                char speed[16];
+                snprintf(speed, sizeof(speed), " %gx", rate);
+                label += speed;
+            }
+            fv = font->buildTextQuads(label.c_str(), scaleX * 0.5f, scaleY * 0.5f, -0.4f);
+//            LOGI_ASYNC(LOG_TAG, "fps: %f", fps);
+            auto gl = display->glStats();
+            LOGI_ASYNC(LOG_TAG, "GL state changes per frame: %u issued, %u elided", gl.issued, gl.elided);
+            auto ov = overlay.stats();
+            LOGI_ASYNC(LOG_TAG, "Overlay per frame: %u items, %u vertices, %d draw calls",
+                       ov.items, ov.vertices, display->overlayDraws());
+            auto& timing = display->presentTiming();
+            if (timing.enabled()) {
+                auto& err = timing.error();
+                auto& lat = timing.latency();
+                LOGI_ASYNC(LOG_TAG, "Present vs. target (us): p50 %lld p99 %lld max %lld, early %u, lost %u",
+                           (long long)err.percentile(50), (long long)err.percentile(99),
+                           (long long)err.max(), err.negative(), timing.lost());
+                LOGI_ASYNC(LOG_TAG, "Swap to present (us): p50 %lld p99 %lld max %lld",
+                           (long long)lat.percentile(50), (long long)lat.percentile(99), (long long)lat.max());
+                timing.resetStats();
+            }
+            if (decoder && decoder->takeDecodeLatency(decodeLatency)) {
+                LOGI_ASYNC(LOG_TAG, "Decode latency (us) of %u frames: p50 %lld p90 %lld p99 %lld max %lld",
+                           decodeLatency.count(), (long long)decodeLatency.percentile(50),
+                           (long long)decodeLatency.percentile(90), (long long)decodeLatency.percentile(99),
+                           (long long)decodeLatency.max());
+            }
+            if (threadStats) {
+                AThreadPolicy::logStats("render", AThreadPolicy::tid(), renderStats);
+                AThreadPolicy::logStats("extractor", decoder ? decoder->threadId() : 0, decoderStats);
+            }
+        }
+        overlay.addText(fv, 0xffffffff);
+        graph.build(overlay, -0.95f, -0.95f, -0.35f, -0.55f);
+        if (timecode) {
+            int64_t ptsNs = 0;
+            if (image) {
+                AImage_getTimestamp(image, &ptsNs);
+            }
+            ATimecode::build(overlay, {
+                    (uint32_t)duration_cast<microseconds>(now.time_since_epoch()).count(),
+                    (uint32_t)(ptsNs / 1000)});
+        }
+        overlay.finish();
+        if (bench) bench->mark(ABench::OVERLAY);
+        display->draw(overlay, image, presentNanos);
+        if (bench) bench->mark(ABench::DRAW);
+        if (display->contextLost() && !bench) {
+            // Textures and programs went with it; the atlas is still baked
+            LOGW(LOG_TAG, "EGL context lost, initializing the display again");
+            display->terminate();
+            if (!display->init(font->bitmap, app->window, app->activity->internalDataPath)) {
+                LOGE(LOG_TAG, "Display init failed after context loss");
+                Pause();
+            }
+        }
+
+        FrameSample sample{};
+        if (lastFrameTimeNanos && frameTimeNanos) {
+            sample.vsyncMs = (frameTimeNanos - lastFrameTimeNanos) / 1e6f;
+        }
+        lastFrameTimeNanos = frameTimeNanos;
+        if (image && released > 0) {
+            // Up to the present time the swap was paced to, the end of the swap without one
+            int64_t shownNs = presentNanos > 0 ? presentNanos
+                    : duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+            sample.latencyMs = (shownNs - releaseNs) / 1e6f;
+            sample.skipped = released - 1;
+        }
+        graph.push(sample);
+        if (initStart != time_point<high_resolution_clock>()) {
+            LOGI(LOG_TAG, "Time to first frame: %lld ms (display %s, decoder %s)",
+                 (long long)duration_cast<milliseconds>(high_resolution_clock::now() - initStart).count(),
+                 displayKept ? "kept" : "new", decoderKept ? "kept" : "new");
+            initStart = {};
+            StartThumbnails();
         }
-        v.insert(v.end(), fv.begin(), fv.end());
-        AImage* image = decoder ? decoder->acquireLatestImage() : nullptr;
-        display->draw(v, image);
 
         if (image) {
-            AImage_delete(image);
+            decoder->releaseImage(image);
         }
+        return image != nullptr;
     }
-
 };
 
+/**
+ * Refresh rates of the display modes at the current resolution, via JNI
+ * (Activity.getDisplay().getSupportedModes()). Returns how many went into out.
+ */
+static int supportedRefreshRates(ANativeActivity* activity, float* out, int max) {
+    JNIEnv* env = nullptr;
+    if (activity->vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+        return 0;
+    }
+    int count = 0;
+    jclass activityClass = env->GetObjectClass(activity->clazz);
+    jobject display = env->CallObjectMethod(activity->clazz,
+            env->GetMethodID(activityClass, "getDisplay", "()Landroid/view/Display;"));
+    if (display) {
+        jclass displayClass = env->GetObjectClass(display);
+        jobject current = env->CallObjectMethod(display,
+                env->GetMethodID(displayClass, "getMode", "()Landroid/view/Display$Mode;"));
+        auto modes = (jobjectArray)env->CallObjectMethod(display,
+                env->GetMethodID(displayClass, "getSupportedModes", "()[Landroid/view/Display$Mode;"));
+        if (current && modes) {
+            jclass modeClass = env->GetObjectClass(current);
+            jmethodID getWidth = env->GetMethodID(modeClass, "getPhysicalWidth", "()I");
+            jmethodID getHeight = env->GetMethodID(modeClass, "getPhysicalHeight", "()I");
+            jmethodID getRate = env->GetMethodID(modeClass, "getRefreshRate", "()F");
+            jint width = env->CallIntMethod(current, getWidth);
+            jint height = env->CallIntMethod(current, getHeight);
+            jsize n = env->GetArrayLength(modes);
+            for (jsize i = 0; i < n && count < max; i++) {
+                jobject mode = env->GetObjectArrayElement(modes, i);
+                if (env->CallIntMethod(mode, getWidth) == width && env->CallIntMethod(mode, getHeight) == height) {
+                    out[count++] = env->CallFloatMethod(mode, getRate);
+                }
+                env->DeleteLocalRef(mode);
+            }
+            env->DeleteLocalRef(modeClass);
+        }
+        if (modes) env->DeleteLocalRef(modes);
+        if (current) env->DeleteLocalRef(current);
+        env->DeleteLocalRef(displayClass);
+        env->DeleteLocalRef(display);
+    }
+    env->DeleteLocalRef(activityClass);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        count = 0;
+    }
+    activity->vm->DetachCurrentThread();
+    return count;
+}
+
+/**
+ * Asks for the display mode that fits the content frame rate best (integer
+ * multiple, lowest rate), debug.aplayer.refreshmatch=0 leaves the mode alone.
+ */
+static void matchRefreshRate(android_app* app, float contentFps) {
+    if (contentFps <= 0.0f || !propertyInt("debug.aplayer.refreshmatch", 1)) {
+        return;
+    }
+    float modes[32];
+    int count = supportedRefreshRates(app->activity, modes, 32);
+    RefreshChoice choice = ARefreshRate::select(contentFps, modes, count,
+                                                (float)propertyInt("debug.aplayer.refreshmin", 0));
+    if (choice.hz <= 0.0f) {
+        LOGW(LOG_TAG, "No display modes to match %.3f fps", contentFps);
+        return;
+    }
+    int cadence[4];
+    ARefreshRate::cadence(contentFps, choice.hz, cadence, 4);
+    LOGI(LOG_TAG, "%.3f fps content on %.2f Hz (of %d modes): cadence %d:%d:%d:%d, judder %.2f ms",
+         contentFps, choice.hz, count, cadence[0], cadence[1], cadence[2], cadence[3], choice.judderMs);
+    // Start of playback, a non-seamless mode switch is acceptable here
+    int32_t status = ANativeWindow_setFrameRateWithChangeStrategy(
+            app->window, choice.hz, ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE,
+            ANATIVEWINDOW_CHANGE_FRAME_RATE_ALWAYS);
+    if (status != 0) {
+        LOGW(LOG_TAG, "ANativeWindow_setFrameRate(%.2f) failed: %d", choice.hz, status);
+    }
+}
+
+/**
+ * Integer extra of the launching intent, e.g. adb shell am start ... --ei bench 1000
+ */
+static int intentIntExtra(ANativeActivity* activity, const char* name, int defaultValue) {
+    JNIEnv* env = nullptr;
+    if (activity->vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+        return defaultValue;
+    }
+    int value = defaultValue;
+    jclass activityClass = env->GetObjectClass(activity->clazz);
+    jobject intent = env->CallObjectMethod(activity->clazz,
+            env->GetMethodID(activityClass, "getIntent", "()Landroid/content/Intent;"));
+    if (intent) {
+        jclass intentClass = env->GetObjectClass(intent);
+        jstring key = env->NewStringUTF(name);
+        value = env->CallIntMethod(intent,
+                env->GetMethodID(intentClass, "getIntExtra", "(Ljava/lang/String;I)I"), key, defaultValue);
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(intentClass);
+        env->DeleteLocalRef(intent);
+    }
+    env->DeleteLocalRef(activityClass);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        value = defaultValue;
+    }
+    activity->vm->DetachCurrentThread();
+    return value;
+}
+
+/**
+ * D-pad / media keys control the playback rate: right doubles it, left halves it,
+ * fast forward and rewind pick the direction (then double), center goes back to 1x.
+ * Play/pause pauses (the decoder parks, the picture stays) and resumes at the same
+ * rate. Up/down (or the media step keys) hold the picture and step it.
+ */
+static int32_t engine_handle_input(android_app* app, AInputEvent* event) {
+    auto* engine = (Engine*)app->userData;
+    // Nothing to resume into without a window
+    if (!engine->decoder || engine->app->window == nullptr || AInputEvent_getType(event) != AINPUT_EVENT_TYPE_KEY
+        || AKeyEvent_getAction(event) != AKEY_EVENT_ACTION_DOWN) {
+        return 0;
+    }
+    float rate = engine->decoder->playbackRate();
+    switch (AKeyEvent_getKeyCode(event)) {
+        case AKEYCODE_DPAD_RIGHT:
+            rate *= 2.0f;
+            break;
+        case AKEYCODE_DPAD_LEFT:
+            rate *= 0.5f;
+            break;
+        case AKEYCODE_MEDIA_FAST_FORWARD:
+            rate = rate < 0.0f ? 1.0f : rate * 2.0f;
+            break;
+        case AKEYCODE_MEDIA_REWIND:
+            rate = rate > 0.0f ? -1.0f : rate * 2.0f;
+            break;
+        case AKEYCODE_DPAD_CENTER:
+            rate = 1.0f;
+            break;
+        case AKEYCODE_MEDIA_PLAY_PAUSE:
+            engine->userPaused = !engine->userPaused;
+            if (engine->userPaused) {
+                engine->Pause();
+            } else {
+                engine->Resume();
+            }
+            return 1;
+        case AKEYCODE_MEDIA_PLAY:
+            engine->userPaused = false;
+            engine->Resume();
+            return 1;
+        case AKEYCODE_MEDIA_PAUSE:
+            engine->userPaused = true;
+            engine->Pause();
+            return 1;
+        case AKEYCODE_DPAD_DOWN:
+        case AKEYCODE_MEDIA_STEP_FORWARD:
+            // Stepping holds the picture by itself, the decoder has to run for it
+            engine->userPaused = false;
+            engine->Resume();
+            engine->decoder->step(1);
+            return 1;
+        case AKEYCODE_DPAD_UP:
+        case AKEYCODE_MEDIA_STEP_BACKWARD:
+            engine->userPaused = false;
+            engine->Resume();
+            engine->decoder->step(-1);
+            return 1;
+        default:
+            return 0;
+    }
+    engine->decoder->setPlaybackRate(rate);
+    return 1;
+}
+
 /**
  * Process the next main command.
  */
@@ -125,29 +572,82 @@ static void engine_handle_cmd(android_app* app, int32_t cmd) {
     switch (cmd) {
         case APP_CMD_INIT_WINDOW:
             // The window is being shown, get it ready.
+            engine->initStart = high_resolution_clock::now();
+#ifdef APLAYER_TRACE
+            if (propertyInt("debug.aplayer.trace", 0)) {
+                ATrace::start((string(engine->app->activity->internalDataPath) + "/trace.json").c_str());
+            }
+#endif
+            // Back from the background the context may still be there, with the atlas and
+            // programs in it; the font was baked for it already
+            engine->displayKept = engine->app->window != nullptr && engine->display != nullptr
+                                  && !engine->bench && engine->display->attach(engine->app->window);
+            // Back from the background: the decoder kept its codec and position
+            engine->decoderKept = engine->decoder && engine->decoder->initialized();
             if (engine->app->window != nullptr
                 && engine->font != nullptr
-                && engine->font->init(engine->app->activity->assetManager)
                 && engine->display != nullptr
-                && engine->display->init(engine->font->bitmap, engine->app->window)) {
-                if(engine->decoder != nullptr
-                    && !engine->decoder->init()){
+                && (engine->displayKept || engine->ColdStart())) {
+                engine->overlay.setWhiteTexel(engine->font->whiteU, engine->font->whiteV);
+                engine->timecode = propertyInt("debug.aplayer.timecode", 0) != 0;
+                engine->threadStats = propertyInt("debug.aplayer.threadstats", 0) != 0;
+                // Paused from the keys before it went away: the decoder stays where it is
+                if (!engine->userPaused) {
+                    engine->WakeUp();
+                }
+                // A kept display with a new decoder, ColdStart() did both otherwise
+                if(engine->decoder != nullptr && !engine->decoder->initialized()
+                    && !engine->decoder->init(engine->app->activity->vm,
+                                              engine->app->activity->internalDataPath)){
                     LOGW(LOG_TAG, "Failed to initialize decoder");
                     delete engine->decoder;
                     engine->decoder = nullptr;
                 }
-                // Base scale factors for 1920x1080, scale inversely to maintain same text size
-                engine->scaleX = 1920.0f / ANativeWindow_getWidth(engine->app->window) * 0.0042f;
-                engine->scaleY = 1080.0f / ANativeWindow_getHeight(engine->app->window) * 0.0063f;
+                engine->Resize(ANativeWindow_getWidth(engine->app->window),
+                               ANativeWindow_getHeight(engine->app->window));
 
-                engine->Resume();
+                if (engine->decoder && !engine->speedApplied) {
+                    engine->decoder->setPlaybackRate(engine->speedPercent / 100.0f);
+                    engine->speedApplied = true;
+                }
+                if (engine->bench) {
+                    engine->benchmarking = !engine->bench->done();
+                } else {
+                    if (engine->decoder) {
+                        matchRefreshRate(engine->app, engine->decoder->frameRate());
+                    }
+                    if (engine->userPaused) {
+                        // No ticks until play
+                        engine->DrawPaused();
+                        engine->Pause();
+                    } else {
+                        engine->Resume();
+                    }
+                }
+            }
+            break;
+        case APP_CMD_WINDOW_RESIZED:
+        case APP_CMD_CONFIG_CHANGED:
+            if (engine->app->window != nullptr) {
+                engine->Resize(ANativeWindow_getWidth(engine->app->window),
+                               ANativeWindow_getHeight(engine->app->window));
             }
             break;
         case APP_CMD_TERM_WINDOW:
             // The window is being hidden or closed, clean it up.
-            engine->display->terminate();
-            engine->decoder->terminate();
+#ifdef APLAYER_TRACE
+            ATrace::stop();
+#endif
+            if (engine->thumbnailer) {
+                engine->thumbnailer->stop();
+            }
+            if (engine->keepContext && !engine->bench) {
+                engine->display->releaseSurface();
+            } else {
+                engine->display->terminate();
+            }
             engine->Pause();
+            engine->benchmarking = false;
         default:
             break;
     }
@@ -163,16 +663,35 @@ void android_main(android_app* state) {
 
     state->userData = &engine;
     state->onAppCmd = engine_handle_cmd;
+    state->onInputEvent = engine_handle_input;
+    ThreadPolicy renderPolicy;
+    renderPolicy.name = "render";
+    AThreadPolicy::apply(ThreadPolicy::fromProperties("debug.aplayer.render", renderPolicy));
     engine.app = state;
     engine.font = new AFont();
     engine.display = new ADisplay();
     engine.decoder = new ADecoder();
+    engine.keepContext = propertyInt("debug.aplayer.keepcontext", 1) != 0;
+    engine.parallelStart = propertyInt("debug.aplayer.parallelstart", 1) != 0;
+    if (propertyInt("debug.aplayer.thumbs", 1)) {
+        engine.thumbnailer = new AThumbnailer();
+    }
+    // Headless benchmark: am start ... --ei bench <frames>, or debug.aplayer.bench=<frames>
+    int benchFrames = intentIntExtra(state->activity, "bench", propertyInt("debug.aplayer.bench", 0));
+    if (benchFrames > 0) {
+        LOGI(LOG_TAG, "Benchmark mode, %d frames", benchFrames);
+        engine.bench = new ABench(benchFrames);
+    }
+    // Playback rate in percent, negative plays backwards: am start ... --ei speed 800,
+    // or debug.aplayer.speed=800
+    engine.speedPercent = intentIntExtra(state->activity, "speed", propertyInt("debug.aplayer.speed", 100));
 
     while (!state->destroyRequested) {
         // Our input, sensor, and update/render logic is all driven by callbacks, so
-        // we don't need to use the non-blocking poll.
+        // we don't need to use the non-blocking poll. The benchmark renders between
+        // polls as fast as it can.
         android_poll_source* source = nullptr;
-        auto result = ALooper_pollOnce(-1, nullptr, nullptr,
+        auto result = ALooper_pollOnce(engine.benchmarking ? 0 : -1, nullptr, nullptr,
                                        reinterpret_cast<void**>(&source));
         if (result == ALOOPER_POLL_ERROR) {
             fatal(LOG_TAG, "ALooper_pollOnce returned an error");
@@ -181,9 +700,14 @@ void android_main(android_app* state) {
         if (source != nullptr) {
             source->process(state, source);
         }
+        if (engine.benchmarking) {
+            engine.BenchTick();
+        }
     }
 
     // Cleanup
+    delete engine.thumbnailer;
+    delete engine.bench;
     delete engine.decoder;
     delete engine.display;
     delete engine.font;
@@ -0,0 +1,130 @@
+//
+// Presentation timing: target present time per swap, actual present time readback.
+//
+#include "apresenttiming.h"
+#include "util.h"
+
+#include <ctime>
+
+#define LOG_TAG "apresenttiming"
+
+#ifdef __ANDROID__
+static PFNEGLPRESENTATIONTIMEANDROIDPROC eglPresentationTimeANDROID;
+static PFNEGLGETNEXTFRAMEIDANDROIDPROC eglGetNextFrameIdANDROID;
+static PFNEGLGETFRAMETIMESTAMPSANDROIDPROC eglGetFrameTimestampsANDROID;
+static PFNEGLGETFRAMETIMESTAMPSUPPORTEDANDROIDPROC eglGetFrameTimestampSupportedANDROID;
+
+static int64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#endif
+
+bool APresentTiming::init(EGLDisplay d, EGLSurface s) {
+    terminate();
+#ifdef __ANDROID__
+    const char* extensions = eglQueryString(d, EGL_EXTENSIONS);
+    if (!hasExtension(extensions, "EGL_ANDROID_presentation_time")
+        || !hasExtension(extensions, "EGL_ANDROID_get_frame_timestamps")) {
+        LOGW(LOG_TAG, "Presentation time extensions not available, swapping unpaced");
+        return false;
+    }
+    eglPresentationTimeANDROID = (PFNEGLPRESENTATIONTIMEANDROIDPROC)
+            eglGetProcAddress("eglPresentationTimeANDROID");
+    eglGetNextFrameIdANDROID = (PFNEGLGETNEXTFRAMEIDANDROIDPROC)
+            eglGetProcAddress("eglGetNextFrameIdANDROID");
+    eglGetFrameTimestampsANDROID = (PFNEGLGETFRAMETIMESTAMPSANDROIDPROC)
+            eglGetProcAddress("eglGetFrameTimestampsANDROID");
+    eglGetFrameTimestampSupportedANDROID = (PFNEGLGETFRAMETIMESTAMPSUPPORTEDANDROIDPROC)
+            eglGetProcAddress("eglGetFrameTimestampSupportedANDROID");
+    if (!eglPresentationTimeANDROID || !eglGetNextFrameIdANDROID || !eglGetFrameTimestampsANDROID
+        || !eglGetFrameTimestampSupportedANDROID) {
+        LOGW(LOG_TAG, "Presentation time entry points missing");
+        return false;
+    }
+    if (!eglGetFrameTimestampSupportedANDROID(d, s, EGL_DISPLAY_PRESENT_TIME_ANDROID)
+        || !eglSurfaceAttrib(d, s, EGL_TIMESTAMPS_ANDROID, EGL_TRUE)) {
+        LOGW(LOG_TAG, "Display present time not supported on this surface");
+        return false;
+    }
+    display = d;
+    surface = s;
+    active = true;
+    LOGI(LOG_TAG, "Presentation timing enabled");
+    return true;
+#else
+    (void)d;
+    (void)s;
+    return false;
+#endif
+}
+
+void APresentTiming::terminate() {
+    active = false;
+    hasId = false;
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+    head = tail = 0;
+}
+
+void APresentTiming::resetStats() {
+    presentError.reset();
+    swapToPresent.reset();
+    dropped = 0;
+}
+
+void APresentTiming::beforeSwap(int64_t targetNs) {
+    if (!active) {
+        return;
+    }
+#ifdef __ANDROID__
+    if (targetNs > 0) {
+        eglPresentationTimeANDROID(display, surface, targetNs);
+    }
+    current.targetNs = targetNs;
+    current.swapNs = monotonicNs();
+    hasId = eglGetNextFrameIdANDROID(display, surface, &current.id) == EGL_TRUE;
+#else
+    (void)targetNs;
+#endif
+}
+
+void APresentTiming::afterSwap() {
+    if (!active) {
+        return;
+    }
+#ifdef __ANDROID__
+    if (hasId) {
+        if (head - tail == PENDING) {
+            // Oldest one never got an answer
+            tail++;
+            dropped++;
+        }
+        frames[head++ % PENDING] = current;
+        hasId = false;
+    }
+    // Frames are presented in order, stop at the first one still pending
+    const EGLint names[] = {EGL_DISPLAY_PRESENT_TIME_ANDROID};
+    while (tail != head) {
+        const Frame& f = frames[tail % PENDING];
+        EGLnsecsANDROID presentNs = EGL_TIMESTAMP_INVALID_ANDROID;
+        if (!eglGetFrameTimestampsANDROID(display, surface, f.id, 1, names, &presentNs)) {
+            // Frame id aged out of the driver's history
+            presentNs = EGL_TIMESTAMP_INVALID_ANDROID;
+        }
+        if (presentNs == EGL_TIMESTAMP_PENDING_ANDROID) {
+            break;
+        }
+        if (presentNs == EGL_TIMESTAMP_INVALID_ANDROID) {
+            dropped++;
+        } else {
+            if (f.targetNs > 0) {
+                presentError.record((presentNs - f.targetNs) / 1000);
+            }
+            swapToPresent.record((presentNs - f.swapNs) / 1000);
+        }
+        tail++;
+    }
+#endif
+}
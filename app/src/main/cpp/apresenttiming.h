@@ -0,0 +1,64 @@
+//
+// Target present time per swap (EGL_ANDROID_presentation_time) and the actual
+// present time read back later (EGL_ANDROID_get_frame_timestamps).
+//
+#ifndef APRESENTTIMING_H
+#define APRESENTTIMING_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdint>
+
+#include "ahistogram.h"
+
+/**
+ * Wraps eglSwapBuffers of one window surface. Present times arrive a few frames
+ * after the swap, so swaps are kept in a small ring and collected in order on the
+ * following swaps. All calls come from the render thread.
+ *
+ * Without the extensions (host builds, pbuffers, old drivers) init() returns false
+ * and every call is a no-op.
+ */
+class APresentTiming {
+public:
+    // Frames in flight before an unanswered one is given up on
+    static const int PENDING = 8;
+
+    bool init(EGLDisplay display, EGLSurface surface);
+    void terminate();
+    bool enabled() const { return active; }
+
+    // Right before eglSwapBuffers. targetNs is CLOCK_MONOTONIC, 0 for "as soon as possible".
+    void beforeSwap(int64_t targetNs);
+    // Right after eglSwapBuffers, collects the frames that have been presented by now.
+    void afterSwap();
+
+    // Actual minus target present time (us), frames that had a target
+    AHistogram& error() { return presentError; }
+    // eglSwapBuffers to actual present (us), every frame
+    AHistogram& latency() { return swapToPresent; }
+    // Frames the compositor dropped or never reported
+    uint32_t lost() const { return dropped; }
+    void resetStats();
+
+private:
+    struct Frame {
+        EGLuint64KHR id;
+        int64_t targetNs;
+        int64_t swapNs;
+    };
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    bool active = false;
+    bool hasId = false;
+    Frame current{};
+    Frame frames[PENDING]{};
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t dropped = 0;
+    AHistogram presentError;
+    AHistogram swapToPresent;
+};
+
+#endif //APRESENTTIMING_H
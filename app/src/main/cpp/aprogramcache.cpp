@@ -0,0 +1,176 @@
+//
+// On-disk cache of linked GL program binaries (GL_OES_get_program_binary).
+//
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "aprogramcache.h"
+#include "util.h"
+#define LOG_TAG "aprogramcache"
+
+static PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+static PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
+
+static const uint32_t MAGIC = 0x31425041; // "APB1"
+
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t driverHash;
+    uint64_t sourceHash;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+AProgramCache::AProgramCache() :
+    driverHash(0),
+    supported(false),
+    hitCount(0),
+    missCount(0) {
+}
+
+uint64_t AProgramCache::hash(const char* data, size_t size, uint64_t seed) {
+    // FNV-1a, stable across runs and builds
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= (uint8_t)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool AProgramCache::init(const char* path) {
+    supported = false;
+    hitCount = 0;
+    missCount = 0;
+    if (!path || !*path) {
+        return false;
+    }
+    dir = path;
+
+    if (!hasExtension((const char*)glGetString(GL_EXTENSIONS), "GL_OES_get_program_binary")) {
+        LOGI(LOG_TAG, "GL_OES_get_program_binary not supported");
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    glGetProgramBinaryOES = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+    glProgramBinaryOES = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+    if (formats <= 0 || !glGetProgramBinaryOES || !glProgramBinaryOES) {
+        LOGI(LOG_TAG, "No program binary formats available");
+        return false;
+    }
+
+    // Binaries are only valid for the exact driver build that produced them.
+    driverHash = 14695981039346656037ULL;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        auto value = (const char*)glGetString(name);
+        if (value) {
+            driverHash = hash(value, strlen(value), driverHash);
+        }
+    }
+    supported = true;
+    return true;
+}
+
+uint64_t AProgramCache::sourceHash(const char* vertexSource, const char* fragmentSource) {
+    return hash(fragmentSource, strlen(fragmentSource), hash(vertexSource, strlen(vertexSource)));
+}
+
+std::string AProgramCache::pathFor(uint64_t sourceHash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/prog_%016llx.bin", (unsigned long long)sourceHash);
+    return dir + name;
+}
+
+GLuint AProgramCache::load(const char* vertexSource, const char* fragmentSource) {
+    if (!supported) {
+        return 0;
+    }
+    GLuint program = loadBinary(sourceHash(vertexSource, fragmentSource));
+    if (program) {
+        hitCount++;
+    } else {
+        missCount++;
+    }
+    return program;
+}
+
+GLuint AProgramCache::loadBinary(uint64_t sourceHash) {
+    std::string path = pathFor(sourceHash);
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return 0;
+    }
+    BinaryHeader header{};
+    std::vector<char> binary;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1
+            && header.magic == MAGIC
+            && header.driverHash == driverHash
+            && header.sourceHash == sourceHash
+            && header.length > 0;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+    }
+    fclose(f);
+    if (!ok) {
+        LOGI(LOG_TAG, "Stale program binary %s", path.c_str());
+        remove(path.c_str());
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinaryOES(program, header.format, binary.data(), (GLint)binary.size());
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (linkStatus != GL_TRUE) {
+        // Driver rejected it (e.g. updated without changing its version string).
+        LOGI(LOG_TAG, "Program binary rejected %s", path.c_str());
+        glDeleteProgram(program);
+        remove(path.c_str());
+        return 0;
+    }
+    return program;
+}
+
+void AProgramCache::store(GLuint program, const char* vertexSource, const char* fragmentSource) {
+    if (!supported || !program) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    BinaryHeader header{MAGIC, 0, driverHash, 0, 0, 0};
+    GLsizei written = 0;
+    glGetProgramBinaryOES(program, length, &written, &header.format, binary.data());
+    if (written <= 0) {
+        LOGW(LOG_TAG, "glGetProgramBinaryOES returned nothing");
+        return;
+    }
+    header.length = written;
+    header.sourceHash = sourceHash(vertexSource, fragmentSource);
+
+    // Write then rename, so a crash never leaves a truncated binary behind.
+    std::string path = pathFor(header.sourceHash);
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        LOGW(LOG_TAG, "Failed to open %s", tmp.c_str());
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+            && fwrite(binary.data(), 1, written, f) == (size_t)written;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOGW(LOG_TAG, "Failed to write %s", path.c_str());
+        remove(tmp.c_str());
+    }
+}
@@ -0,0 +1,41 @@
+//
+// On-disk cache of linked GL program binaries (GL_OES_get_program_binary).
+//
+#ifndef APROGRAMCACHE_H
+#define APROGRAMCACHE_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <string>
+
+class AProgramCache {
+public:
+    AProgramCache();
+
+    // Must be called with a current context. Returns false if the driver can't
+    // hand out program binaries, in which case load() always misses.
+    bool init(const char* dir);
+
+    // Returns a linked program or 0 when there is no usable binary for these
+    // sources (missing, written by another driver, or rejected on load).
+    GLuint load(const char* vertexSource, const char* fragmentSource);
+    void store(GLuint program, const char* vertexSource, const char* fragmentSource);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+    static uint64_t hash(const char* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+private:
+    std::string dir;
+    uint64_t driverHash;
+    bool supported;
+    int hitCount;
+    int missCount;
+
+    static uint64_t sourceHash(const char* vertexSource, const char* fragmentSource);
+    std::string pathFor(uint64_t sourceHash) const;
+    GLuint loadBinary(uint64_t sourceHash);
+};
+
+#endif //APROGRAMCACHE_H
@@ -0,0 +1,237 @@
+//
+// Uncompressed video file source for the host.
+//
+#include "arawsource.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#define LOG_TAG "arawsource"
+
+namespace {
+
+const char Y4M_MAGIC[] = "YUV4MPEG2 ";
+const char Y4M_FRAME[] = "FRAME";
+// Far longer than any header or frame line we have seen, guards the scans
+const size_t MAX_LINE = 1024;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+bool ARawSource::open(const char* path, int32_t width, int32_t height, AImage::Format format, float fps) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE(LOG_TAG, "Failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        LOGE(LOG_TAG, "%s is empty", path);
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        LOGE(LOG_TAG, "Failed to map %s: %s", path, strerror(errno));
+        return false;
+    }
+    map = (const uint8_t*)mapped;
+    mapSize = (size_t)st.st_size;
+    // Frames are read front to back, let the kernel read ahead
+    madvise(mapped, mapSize, MADV_SEQUENTIAL);
+
+    float headerFps = 0;
+    if (mapSize > sizeof(Y4M_MAGIC) - 1 && memcmp(map, Y4M_MAGIC, sizeof(Y4M_MAGIC) - 1) == 0) {
+        if (!parseY4m(headerFps)) {
+            LOGE(LOG_TAG, "%s: not an 8-bit 4:2:0 Y4M file", path);
+            close();
+            return false;
+        }
+    } else {
+        if (width <= 0 || height <= 0) {
+            LOGE(LOG_TAG, "%s: raw video needs its size", path);
+            close();
+            return false;
+        }
+        this->width = width;
+        this->height = height;
+        this->format = format;
+        frameBytes = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        for (size_t offset = 0; offset + frameBytes <= mapSize; offset += frameBytes) {
+            offsets.push_back(offset);
+        }
+        if (mapSize % frameBytes) {
+            LOGW(LOG_TAG, "%s: %zu bytes at the end are not a whole frame", path, mapSize % frameBytes);
+        }
+    }
+    if (offsets.empty()) {
+        LOGE(LOG_TAG, "%s: no complete frame", path);
+        close();
+        return false;
+    }
+    this->fps = fps > 0 ? fps : headerFps > 0 ? headerFps : 30.0f;
+    formatPending = true;
+    LOGI(LOG_TAG, "%s: %d frames %dx%d %s at %.3f fps", path, frameCount(), this->width, this->height,
+         this->format == AImage::NV12 ? "NV12" : "I420", this->fps);
+    return true;
+}
+
+bool ARawSource::parseY4m(float& headerFps) {
+    const char* text = (const char*)map;
+    const char* end = (const char*)memchr(text, '\n', mapSize < MAX_LINE ? mapSize : MAX_LINE);
+    if (!end) {
+        return false;
+    }
+    bool planar420 = true;
+    for (const char* p = text + sizeof(Y4M_MAGIC) - 1; p < end;) {
+        const char* next = (const char*)memchr(p, ' ', end - p);
+        if (!next) {
+            next = end;
+        }
+        std::string token(p, next);
+        if (token[0] == 'W') {
+            width = atoi(token.c_str() + 1);
+        } else if (token[0] == 'H') {
+            height = atoi(token.c_str() + 1);
+        } else if (token[0] == 'F') {
+            int num = 0, den = 0;
+            if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0) {
+                headerFps = (float)num / den;
+            }
+        } else if (token[0] == 'C') {
+            // 8-bit 4:2:0, only the chroma siting differs; not C420p10 and the like
+            planar420 = token == "C420" || token == "C420jpeg" || token == "C420mpeg2" || token == "C420paldv";
+        }
+        p = next + 1;
+    }
+    if (!planar420 || width <= 0 || height <= 0) {
+        return false;
+    }
+    format = AImage::I420;
+    frameBytes = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+
+    size_t pos = end - text + 1;
+    while (pos + sizeof(Y4M_FRAME) - 1 <= mapSize && memcmp(map + pos, Y4M_FRAME, sizeof(Y4M_FRAME) - 1) == 0) {
+        size_t left = mapSize - pos;
+        const uint8_t* line = (const uint8_t*)memchr(map + pos, '\n', left < MAX_LINE ? left : MAX_LINE);
+        if (!line) {
+            break;
+        }
+        size_t offset = line - map + 1;
+        if (offset + frameBytes > mapSize) {
+            LOGW(LOG_TAG, "Last frame is truncated, dropped");
+            break;
+        }
+        offsets.push_back(offset);
+        pos = offset + frameBytes;
+    }
+    return true;
+}
+
+void ARawSource::close() {
+    if (map) {
+        munmap((void*)map, mapSize);
+    }
+    map = nullptr;
+    mapSize = 0;
+    width = height = 0;
+    frameBytes = 0;
+    offsets.clear();
+    for (auto& image : images) {
+        image = {};
+    }
+    formatPending = false;
+    served = 0;
+    startNs = 0;
+    droppedFrames = 0;
+}
+
+AImage* ARawSource::acquireLatestImage() {
+    if (offsets.empty()) {
+        return nullptr;
+    }
+    AImage* image = nullptr;
+    for (auto& candidate : images) {
+        if (!candidate.acquired) {
+            image = &candidate;
+            break;
+        }
+    }
+    if (!image) {
+        LOGW(LOG_TAG, "All %d images are held, release one first", MAX_IMAGES);
+        return nullptr;
+    }
+
+    int64_t next = served;
+    if (realtime) {
+        int64_t now = nowNs();
+        if (!startNs) {
+            startNs = now;
+        }
+        int64_t dueNs = startNs + (int64_t)(next * 1e9 / fps);
+        if (now < dueNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(dueNs - now));
+        } else {
+            // Late: the newest frame that is due, like AImageReader_acquireLatestImage
+            int64_t latest = (int64_t)((now - startNs) * (double)fps / 1e9);
+            if (latest > next) {
+                droppedFrames += (int)(latest - next);
+                next = latest;
+            }
+        }
+    }
+    served = next + 1;
+
+    int index = (int)(next % frameCount());
+    const uint8_t* y = map + offsets[index];
+    size_t chromaBytes = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    image->format = format;
+    image->width = width;
+    image->height = height;
+    image->planes[0] = y;
+    image->planes[1] = y + (size_t)width * height;
+    image->planes[2] = format == AImage::I420 ? image->planes[1] + chromaBytes : nullptr;
+    image->ptsUs = (int64_t)(next * 1e6 / fps);
+    image->index = index;
+    image->acquired = true;
+
+    // Fault the next frame in while this one is drawn
+    long page = sysconf(_SC_PAGESIZE);
+    size_t from = offsets[(index + 1) % frameCount()] & ~(size_t)(page - 1);
+    size_t length = frameBytes + page;
+    madvise((void*)(map + from), from + length > mapSize ? mapSize - from : length, MADV_WILLNEED);
+    return image;
+}
+
+void ARawSource::releaseImage(AImage* image) {
+    if (image) {
+        image->acquired = false;
+    }
+}
+
+bool ARawSource::pollFormatChange(VideoFormat& out) {
+    if (!formatPending) {
+        return false;
+    }
+    formatPending = false;
+    out = {width, height, 0, 0, width, height};
+    return true;
+}
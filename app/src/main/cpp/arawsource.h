@@ -0,0 +1,82 @@
+//
+// Uncompressed video files (Y4M, raw I420 or NV12) as a frame source for the
+// host, where there is no MediaCodec: the same acquire/release calls as
+// ADecoder, frames straight out of an mmap. Linux only, not in the app build.
+//
+#ifndef ARAWSOURCE_H
+#define ARAWSOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "aviewport.h"
+
+// The host's AImage (ADisplay takes it where Android has the NDK's): one frame,
+// its planes pointing into the source's mapping
+struct AImage {
+    enum Format { I420, NV12 };
+    Format format;
+    int32_t width;
+    int32_t height;
+    // Y, U, V; NV12 has Y and the interleaved UV plane only. Rows are tightly
+    // packed, as both file formats store them.
+    const uint8_t* planes[3];
+    int64_t ptsUs;
+    int32_t index;       // frame number in the file
+    bool acquired;
+};
+
+/**
+ * A .y4m file describes itself (8-bit 4:2:0 only, any chroma siting); other files are
+ * taken as headerless frames of the size and format given. Playback loops.
+ * Up to MAX_IMAGES frames can be held at a time, like an AImageReader.
+ */
+class ARawSource {
+public:
+    static constexpr int MAX_IMAGES = 3;
+
+    ~ARawSource() { close(); }
+
+    // fps 0 takes the rate from the Y4M header, 30 without one
+    bool open(const char* path, int32_t width = 0, int32_t height = 0,
+              AImage::Format format = AImage::I420, float fps = 0);
+    void close();
+    // realtime: frames are due at the frame rate from the first acquire, acquireLatestImage()
+    // sleeps until the next one and skips those it's late for. Otherwise each call gets
+    // the next frame at once (benchmarks).
+    void setRealtime(bool on) { realtime = on; }
+    // Null when all MAX_IMAGES are held. Give it back with releaseImage().
+    AImage* acquireLatestImage();
+    void releaseImage(AImage* image);
+    // Returns true (once) after open(), the frames never change size
+    bool pollFormatChange(VideoFormat& format);
+
+    float frameRate() const { return fps; }
+    int frameCount() const { return (int)offsets.size(); }
+    // Frames realtime playback skipped because it was late
+    int dropped() const { return droppedFrames; }
+
+private:
+    const uint8_t* map = nullptr;
+    size_t mapSize = 0;
+    AImage::Format format = AImage::I420;
+    int32_t width = 0;
+    int32_t height = 0;
+    float fps = 0;
+    size_t frameBytes = 0;
+    // Start of each frame's pixels in the mapping
+    std::vector<size_t> offsets;
+    AImage images[MAX_IMAGES]{};
+    bool realtime = false;
+    bool formatPending = false;
+    // Frames handed out so far, the next one's number modulo frameCount()
+    int64_t served = 0;
+    int64_t startNs = 0;
+    int droppedFrames = 0;
+
+    // Header and frame offsets of a Y4M file, false if it isn't an 8-bit 4:2:0 one
+    bool parseY4m(float& headerFps);
+};
+
+#endif //ARAWSOURCE_H
@@ -0,0 +1,73 @@
+//
+// Display refresh rate selection and cadence.
+//
+#include <algorithm>
+#include <cmath>
+
+#include "arefreshrate.h"
+
+namespace {
+
+// Vsync (counted from the one showing frame 0) that first shows frame n: the
+// nearest one, so a rate a hair off an integer multiple (23.976 at 72 Hz) only
+// slips once the error adds up to half a vsync.
+long firstVsync(double contentFps, double hz, long n) {
+    return (long)std::floor(n * hz / contentFps + 0.5);
+}
+
+} // namespace
+
+int ARefreshRate::multiple(float contentFps, float hz) {
+    if (contentFps <= 0.0f || hz <= 0.0f) {
+        return 0;
+    }
+    float ratio = hz / contentFps;
+    int n = (int)std::lround(ratio);
+    return n >= 1 && std::fabs(ratio - n) <= TOLERANCE * n ? n : 0;
+}
+
+void ARefreshRate::cadence(float contentFps, float hz, int* out, int count) {
+    for (int n = 0; n < count; n++) {
+        out[n] = (int)(firstVsync(contentFps, hz, n + 1) - firstVsync(contentFps, hz, n));
+    }
+}
+
+float ARefreshRate::judderMs(float contentFps, float hz) {
+    if (contentFps <= 0.0f || hz <= 0.0f || multiple(contentFps, hz)) {
+        return 0.0f;
+    }
+    // Five seconds covers the pattern of every common rate pair
+    long frames = (long)(contentFps * 5);
+    double lo = 0.0, hi = 0.0;
+    for (long n = 0; n < frames; n++) {
+        double error = firstVsync(contentFps, hz, n) / (double)hz - n / (double)contentFps;
+        lo = std::min(lo, error);
+        hi = std::max(hi, error);
+    }
+    return (float)((hi - lo) * 1000.0);
+}
+
+RefreshChoice ARefreshRate::select(float contentFps, const float* modes, int count, float minHz) {
+    RefreshChoice best{0.0f, 0, 0.0f};
+    // Integer multiples first, the lowest one that isn't below minHz
+    for (int i = 0; i < count; i++) {
+        int m = multiple(contentFps, modes[i]);
+        if (m && modes[i] >= minHz && (!best.multiple || modes[i] < best.hz)) {
+            best = {modes[i], m, 0.0f};
+        }
+    }
+    if (best.multiple) {
+        return best;
+    }
+    for (int i = 0; i < count; i++) {
+        if (modes[i] < minHz && count > 1) {
+            continue;
+        }
+        float judder = judderMs(contentFps, modes[i]);
+        if (best.hz == 0.0f || judder < best.judderMs - 0.01f
+            || (std::fabs(judder - best.judderMs) <= 0.01f && modes[i] > best.hz)) {
+            best = {modes[i], multiple(contentFps, modes[i]), judder};
+        }
+    }
+    return best;
+}
@@ -0,0 +1,37 @@
+//
+// Display refresh rate selection for a content frame rate, and the resulting
+// cadence. Pure logic, no platform calls.
+//
+#ifndef AREFRESHRATE_H
+#define AREFRESHRATE_H
+
+struct RefreshChoice {
+    float hz;           // 0 when there was nothing to choose from
+    int multiple;       // vsyncs per content frame, 0 if not an integer multiple
+    float judderMs;     // peak-to-peak presentation error, 0 for integer multiples
+};
+
+class ARefreshRate {
+public:
+    // Relative slack for integer multiples, so 23.976 fps matches 120 Hz
+    static constexpr float TOLERANCE = 0.005f;
+
+    /**
+     * The lowest mode that is an integer multiple of the content rate and at
+     * least minHz (lower refresh, less power, no judder). Without one, the mode
+     * with the least judder, the higher one on ties.
+     */
+    static RefreshChoice select(float contentFps, const float* modes, int count, float minHz = 0.0f);
+
+    // hz / contentFps if that is an integer within TOLERANCE, else 0
+    static int multiple(float contentFps, float hz);
+
+    // Vsyncs each of the first count frames stays on screen:
+    // 24 fps at 60 Hz is 3,2,3,2 (3:2 pulldown), 30 fps at 60 Hz is 2,2,2,2
+    static void cadence(float contentFps, float hz, int* out, int count);
+
+    // Spread of (shown at - due at) over a few seconds of content, in ms
+    static float judderMs(float contentFps, float hz);
+};
+
+#endif //AREFRESHRATE_H
@@ -0,0 +1,76 @@
+//
+// Fixed-size lock-free single-producer/single-consumer ring buffer.
+//
+#ifndef ARING_H
+#define ARING_H
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t N>
+class ARing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ARing size must be a power of two");
+public:
+    // Producer side. Returns false (and drops the item) when the ring is full.
+    bool push(const T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool pop(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Zero-copy producer side: fill the slot returned by prepare() (nullptr when
+    // full) in place, then publish it with commit().
+    T* prepare() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return nullptr;
+        }
+        return &items[h & (N - 1)];
+    }
+
+    void commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Zero-copy consumer side: peek() returns the oldest item (nullptr when empty),
+    // valid until consume().
+    const T* peek() const {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &items[t & (N - 1)];
+    }
+
+    void consume() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Approximate when called concurrently with push/pop.
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Separate cache lines, producer and consumer don't invalidate each other.
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    T items[N];
+};
+
+#endif //ARING_H
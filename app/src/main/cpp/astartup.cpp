@@ -0,0 +1,111 @@
+//
+// Cold start task graph.
+//
+#include "astartup.h"
+#include "athreadpolicy.h"
+#include "atrace.h"
+#include "util.h"
+
+#include <thread>
+
+#define LOG_TAG "astartup"
+
+int AStartup::add(const char* name, std::initializer_list<int> deps, Step step, bool onCaller) {
+    Node node;
+    node.name = name;
+    node.deps = deps;
+    node.step = std::move(step);
+    node.onCaller = onCaller;
+    nodes.push_back(std::move(node));
+    return (int)nodes.size() - 1;
+}
+
+void AStartup::execute(int i) {
+    Node& node = nodes[i];
+    bool ready;
+    {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [&] {
+            for (int dep : node.deps) {
+                if (nodes[dep].state == State::PENDING) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        ready = true;
+        for (int dep : node.deps) {
+            ready = ready && nodes[dep].state == State::DONE;
+        }
+    }
+    int64_t begin = ATrace::now();
+    bool ok = ready && node.step();
+    int64_t end = ATrace::now();
+    if (ready) {
+#ifdef APLAYER_TRACE
+        if (ATrace::enabled()) {
+            ATrace::complete(node.name, begin, end);
+        }
+#endif
+    } else {
+        LOGW(LOG_TAG, "Skipping %s, a step it needs failed", node.name);
+    }
+    {
+        std::lock_guard lock(mtx);
+        node.startNs = begin;
+        node.endNs = end;
+        node.tid = AThreadPolicy::tid();
+        node.state = !ready ? State::SKIPPED : ok ? State::DONE : State::FAILED;
+    }
+    cv.notify_all();
+}
+
+bool AStartup::run(bool parallel) {
+    startNs = ATrace::now();
+    if (!parallel) {
+        for (int i = 0; i < (int)nodes.size(); i++) {
+            execute(i);
+        }
+    } else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < (int)nodes.size(); i++) {
+            if (!nodes[i].onCaller) {
+                threads.emplace_back([this, i] {
+                    AThreadPolicy::setName(nodes[i].name);
+                    execute(i);
+                });
+            }
+        }
+        for (int i = 0; i < (int)nodes.size(); i++) {
+            if (nodes[i].onCaller) {
+                execute(i);
+            }
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+    endNs = ATrace::now();
+    bool all = true;
+    for (const auto& node : nodes) {
+        all = all && node.state == State::DONE;
+    }
+    return all;
+}
+
+bool AStartup::succeeded(int id) const {
+    return id >= 0 && id < (int)nodes.size() && nodes[id].state == State::DONE;
+}
+
+void AStartup::logTimeline() const {
+    int64_t sumNs = 0;
+    for (const auto& node : nodes) {
+        sumNs += node.endNs - node.startNs;
+    }
+    LOGI(LOG_TAG, "Startup took %.1f ms, %.1f ms of steps", wallNs() / 1e6, sumNs / 1e6);
+    for (const auto& node : nodes) {
+        const char* state = node.state == State::DONE ? "" : node.state == State::FAILED ? " FAILED" : " skipped";
+        LOGI(LOG_TAG, "  %-10s %7.1f .. %7.1f ms  tid %d%s", node.name, (node.startNs - startNs) / 1e6,
+             (node.endNs - startNs) / 1e6, node.tid, state);
+    }
+}
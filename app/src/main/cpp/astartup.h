@@ -0,0 +1,59 @@
+//
+// Cold start as a small task graph: each step runs as soon as the steps it needs
+// are done, on a thread of its own or on the caller's, and leaves a timeline.
+// Pure logic, no platform calls.
+//
+#ifndef ASTARTUP_H
+#define ASTARTUP_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+/**
+ * Steps on the caller run in the order they were added (EGL and GL have to stay on
+ * the thread that renders), every other one gets a thread that waits for its
+ * dependencies. A step whose dependency failed is skipped, as are its dependents.
+ */
+class AStartup {
+public:
+    using Step = std::function<bool()>;
+
+    // deps are ids returned by earlier add() calls. Names must be string literals.
+    int add(const char* name, std::initializer_list<int> deps, Step step, bool onCaller = false);
+    // All steps, or in the order added on the caller when !parallel (the A/B baseline),
+    // each a trace event on the thread it ran on. False if any failed or was skipped.
+    bool run(bool parallel = true);
+    bool succeeded(int id) const;
+    // Start and end of each step from the start of run(), the wall time against the
+    // sum of the steps (what a serial start costs)
+    void logTimeline() const;
+    int64_t wallNs() const { return endNs - startNs; }
+
+private:
+    enum class State { PENDING, DONE, FAILED, SKIPPED };
+    struct Node {
+        const char* name;
+        std::vector<int> deps;
+        Step step;
+        bool onCaller;
+        State state = State::PENDING;
+        int64_t startNs = 0;
+        int64_t endNs = 0;
+        int tid = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::mutex mtx;
+    std::condition_variable cv;
+    int64_t startNs = 0;
+    int64_t endNs = 0;
+
+    // Waits for the dependencies of nodes[i], then runs or skips it
+    void execute(int i);
+};
+
+#endif //ASTARTUP_H
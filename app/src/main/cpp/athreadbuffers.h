@@ -0,0 +1,73 @@
+//
+// Registry of per-thread buffers, e.g. lock-free rings drained by a background thread.
+//
+#ifndef ATHREADBUFFERS_H
+#define ATHREADBUFFERS_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * local() hands each thread its own T, created on first use. When a thread
+ * exits its T is kept (so a consumer can still drain it) and handed to the next
+ * new thread. The thread_local lives in local(), so use one instance per T.
+ */
+template <typename T>
+class AThreadBuffers {
+public:
+    // reused is set when the buffer previously belonged to an exited thread.
+    T& local(bool* reused = nullptr) {
+        static thread_local Holder holder;
+        if (!holder.slot) {
+            holder.slot = claim(reused);
+        } else if (reused) {
+            *reused = false;
+        }
+        return holder.slot->buffer;
+    }
+
+    // Visits all buffers, live or not, under the registry lock.
+    template <typename F>
+    void forEach(F&& f) {
+        std::lock_guard lk(mutex);
+        for (auto& slot : slots) {
+            f(slot->buffer);
+        }
+    }
+
+private:
+    struct Slot {
+        T buffer;
+        std::atomic<bool> inUse{true};
+    };
+
+    struct Holder {
+        Slot* slot = nullptr;
+        ~Holder() {
+            if (slot) {
+                slot->inUse = false;
+            }
+        }
+    };
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Slot>> slots;
+
+    Slot* claim(bool* reused) {
+        std::lock_guard lk(mutex);
+        for (auto& slot : slots) {
+            bool expected = false;
+            if (slot->inUse.compare_exchange_strong(expected, true)) {
+                if (reused) *reused = true;
+                return slot.get();
+            }
+        }
+        if (reused) *reused = false;
+        slots.push_back(std::make_unique<Slot>());
+        return slots.back().get();
+    }
+};
+
+#endif //ATHREADBUFFERS_H
@@ -0,0 +1,292 @@
+//
+// Thread placement and priority, per-thread scheduling stats.
+//
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "athreadpolicy.h"
+#include "util.h"
+#define LOG_TAG "athreadpolicy"
+
+namespace {
+
+const int MAX_CPUS = 64;
+
+long readLong(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long value = -1;
+    if (fscanf(f, "%ld", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+    return value;
+}
+
+} // namespace
+
+ThreadPolicy ThreadPolicy::fromProperties(const char* prefix, ThreadPolicy defaults) {
+    std::string p(prefix);
+    ThreadPolicy policy = defaults;
+    int cores = propertyInt((p + ".cores").c_str(), (int)defaults.cores);
+    if (cores >= (int)CoreSet::ANY && cores <= (int)CoreSet::LITTLE) {
+        policy.cores = (CoreSet)cores;
+    }
+    policy.nice = propertyInt((p + ".nice").c_str(), defaults.nice);
+    policy.fifoPriority = propertyInt((p + ".fifo").c_str(), defaults.fifoPriority);
+    return policy;
+}
+
+int AThreadPolicy::tid() {
+    static thread_local int cached = (int)syscall(SYS_gettid);
+    return cached;
+}
+
+bool AThreadPolicy::apply(const ThreadPolicy& policy) {
+    bool ok = true;
+    if (policy.name) {
+        ok &= setName(policy.name);
+    }
+    if (policy.cores != CoreSet::ANY) {
+        ok &= setAffinity(policy.cores);
+    }
+    bool fifo = policy.fifoPriority > 0 && setFifo(policy.fifoPriority);
+    if (!fifo && policy.nice != ThreadPolicy::KEEP_NICE) {
+        ok &= setNice(policy.nice);
+    }
+    ok &= fifo || policy.fifoPriority <= 0;
+    LOGI(LOG_TAG, "Thread %s (%d): cores %d, nice %d, fifo %d%s", policy.name ? policy.name : "?", tid(),
+         (int)policy.cores, getpriority(PRIO_PROCESS, tid()), fifo ? policy.fifoPriority : 0,
+         ok ? "" : " (partly refused)");
+    return ok;
+}
+
+bool AThreadPolicy::setName(const char* name) {
+    char truncated[16];
+    snprintf(truncated, sizeof(truncated), "%s", name);
+    int err = pthread_setname_np(pthread_self(), truncated);
+    if (err) {
+        LOGW(LOG_TAG, "pthread_setname_np(%s): %s", truncated, strerror(err));
+        return false;
+    }
+    TRACE_THREAD_NAME(name);
+    return true;
+}
+
+uint64_t AThreadPolicy::coreMask(CoreSet cores) {
+    long maxFreq[MAX_CPUS];
+    long top = 0;
+    int count = 0;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        maxFreq[cpu] = readLong(path);
+        if (maxFreq[cpu] > 0) {
+            count = cpu + 1;
+            top = std::max(top, maxFreq[cpu]);
+        }
+    }
+    uint64_t mask = 0;
+    if (!count) {
+        // No cpufreq (VMs, some hosts): every online core is both big and little
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        return online <= 0 ? 0 : online >= MAX_CPUS ? ~0ull : (1ull << online) - 1;
+    }
+    for (int cpu = 0; cpu < count; cpu++) {
+        bool big = maxFreq[cpu] == top;
+        if (maxFreq[cpu] > 0 && (cores == CoreSet::ANY || (cores == CoreSet::BIG) == big)) {
+            mask |= 1ull << cpu;
+        }
+    }
+    if (!mask && cores == CoreSet::LITTLE) {
+        // Symmetric system
+        return coreMask(CoreSet::ANY);
+    }
+    return mask;
+}
+
+bool AThreadPolicy::setAffinity(CoreSet cores) {
+    uint64_t mask = coreMask(cores);
+    if (!mask) {
+        LOGW(LOG_TAG, "No cpus for core set %d", (int)cores);
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (mask & (1ull << cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (sched_setaffinity(tid(), sizeof(set), &set) != 0) {
+        LOGW(LOG_TAG, "sched_setaffinity(0x%llx): %s", (unsigned long long)mask, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool AThreadPolicy::setNice(int nice) {
+    // Per thread on Linux: PRIO_PROCESS with a tid
+    if (setpriority(PRIO_PROCESS, tid(), nice) != 0) {
+        LOGW(LOG_TAG, "setpriority(%d): %s", nice, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool AThreadPolicy::setFifo(int priority) {
+    sched_param param{};
+    param.sched_priority = priority;
+    // Apps usually don't have CAP_SYS_NICE or an RLIMIT_RTPRIO, expect EPERM
+    if (sched_setscheduler(tid(), SCHED_FIFO, &param) != 0) {
+        LOGW(LOG_TAG, "SCHED_FIFO %d refused: %s", priority, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool AThreadPolicy::readStats(int tid, ThreadStats& out) {
+    char path[64];
+    out = ThreadStats{};
+    // cpu time, run queue wait, timeslices (all since thread start)
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    long long cpuNs, delayNs, slices;
+    bool ok = fscanf(f, "%lld %lld %lld", &cpuNs, &delayNs, &slices) == 3;
+    fclose(f);
+    if (!ok) {
+        return false;
+    }
+    out.cpuNs = cpuNs;
+    out.runDelayNs = delayNs;
+    out.timeslices = slices;
+
+    // Field 39 of stat is the last cpu; the command name (field 2) may contain spaces
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    if ((f = fopen(path, "r"))) {
+        char line[1024];
+        if (fgets(line, sizeof(line), f)) {
+            const char* p = strrchr(line, ')');
+            for (int field = 2; p && field < 39; field++) {
+                p = strchr(p + 1, ' ');
+            }
+            if (p) {
+                out.cpu = atoi(p + 1);
+            }
+        }
+        fclose(f);
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    if ((f = fopen(path, "r"))) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            long long v;
+            if (sscanf(line, "nonvoluntary_ctxt_switches: %lld", &v) == 1) {
+                out.involuntarySwitches = v;
+            }
+        }
+        fclose(f);
+    }
+
+    // Needs CONFIG_SCHED_DEBUG, not readable on every device
+    snprintf(path, sizeof(path), "/proc/self/task/%d/sched", tid);
+    if ((f = fopen(path, "r"))) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            long long v;
+            if (sscanf(line, "se.nr_migrations : %lld", &v) == 1) {
+                out.migrations = v;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return true;
+}
+
+void AThreadPolicy::logStats(const char* name, int tid, ThreadStats& previous) {
+    ThreadStats now;
+    if (!tid || !readStats(tid, now)) {
+        return;
+    }
+    int64_t slices = now.timeslices - previous.timeslices;
+    // Run queue wait per switch-in: how long a wakeup waits for a cpu on average
+    double wakeupUs = slices > 0 ? (now.runDelayNs - previous.runDelayNs) / 1000.0 / slices : 0.0;
+    LOGI_ASYNC(LOG_TAG, "%s: cpu %d, %.1f ms cpu, wakeup latency %.1f us, %lld migrations, %lld preempted",
+               name, now.cpu, (now.cpuNs - previous.cpuNs) / 1e6, wakeupUs,
+               now.migrations >= 0 && previous.migrations >= 0
+               ? (long long)(now.migrations - previous.migrations) : -1LL,
+               (long long)(now.involuntarySwitches - previous.involuntarySwitches));
+    previous = now;
+}
+
+std::vector<ThreadSample> AThreadPolicy::sampleProcess() {
+    std::vector<ThreadSample> out;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return out;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        int tid = atoi(entry->d_name);
+        ThreadStats stats;
+        if (tid <= 0 || !readStats(tid, stats)) {
+            continue;
+        }
+        ThreadSample sample{tid, "", stats.timeslices};
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+        if (FILE* f = fopen(path, "r")) {
+            if (fgets(sample.name, sizeof(sample.name), f)) {
+                sample.name[strcspn(sample.name, "\n")] = '\0';
+            }
+            fclose(f);
+        }
+        out.push_back(sample);
+    }
+    closedir(dir);
+    return out;
+}
+
+float AThreadPolicy::logWakeups(const char* what, const std::vector<ThreadSample>& before, int64_t spanNs) {
+    if (spanNs <= 0) {
+        return 0.0f;
+    }
+    std::vector<ThreadSample> now = sampleProcess();
+    std::vector<ThreadSample> woken;
+    int64_t total = 0;
+    for (const auto& t : now) {
+        auto it = std::find_if(before.begin(), before.end(), [&t](const ThreadSample& b) { return b.tid == t.tid; });
+        if (it != before.end() && t.timeslices > it->timeslices) {
+            woken.push_back(t);
+            woken.back().timeslices -= it->timeslices;
+            total += woken.back().timeslices;
+        }
+    }
+    std::sort(woken.begin(), woken.end(),
+              [](const ThreadSample& a, const ThreadSample& b) { return a.timeslices > b.timeslices; });
+    std::string top;
+    for (size_t i = 0; i < woken.size() && i < 4; i++) {
+        char item[48];
+        snprintf(item, sizeof(item), "%s%s %.2f", i ? ", " : "", woken[i].name, woken[i].timeslices * 1e9 / spanNs);
+        top += item;
+    }
+    float perSecond = (float)(total * 1e9 / spanNs);
+    LOGI(LOG_TAG, "%s %.1f s: %.2f wakeups/s over %zu threads%s%s%s", what, spanNs / 1e9, perSecond,
+         before.size(), top.empty() ? "" : " (", top.c_str(), top.empty() ? "" : ")");
+    return perSecond;
+}
@@ -0,0 +1,73 @@
+//
+// Thread placement and priority: names, core affinity (big/little), nice and
+// SCHED_FIFO, plus per-thread scheduling stats from /proc. Linux only, works on
+// the host as well as on device.
+//
+#ifndef ATHREADPOLICY_H
+#define ATHREADPOLICY_H
+
+#include <cstdint>
+#include <vector>
+
+enum class CoreSet {
+    ANY,
+    BIG,        // cores with the highest cpuinfo_max_freq
+    LITTLE,     // all others (all cores if they are the same)
+};
+
+struct ThreadPolicy {
+    static constexpr int KEEP_NICE = INT32_MIN;
+
+    const char* name = nullptr;     // at most 15 characters show up
+    CoreSet cores = CoreSet::ANY;
+    int nice = KEEP_NICE;
+    int fifoPriority = 0;           // 1..99 asks for SCHED_FIFO, falls back to nice
+
+    // Overrides from <prefix>.cores (0 any, 1 big, 2 little), <prefix>.nice and
+    // <prefix>.fifo, e.g. debug.aplayer.decoder.cores
+    static ThreadPolicy fromProperties(const char* prefix, ThreadPolicy defaults);
+};
+
+struct ThreadStats {
+    int64_t cpuNs = 0;          // time on cpu
+    int64_t runDelayNs = 0;     // time runnable but waiting for a cpu
+    int64_t timeslices = 0;     // times it was switched in
+    int64_t migrations = -1;    // -1 where /proc/<tid>/sched isn't readable
+    int64_t involuntarySwitches = 0;
+    int cpu = -1;               // last cpu it ran on
+};
+
+// Switch-ins of one thread of this process so far, see sampleProcess()
+struct ThreadSample {
+    int tid;
+    char name[16];
+    int64_t timeslices;
+};
+
+class AThreadPolicy {
+public:
+    static int tid();
+
+    // Applies to the calling thread. Returns false if any part was refused, the
+    // rest is still applied.
+    static bool apply(const ThreadPolicy& policy);
+    static bool setName(const char* name);
+    static bool setAffinity(CoreSet cores);
+    static bool setNice(int nice);
+    static bool setFifo(int priority);
+
+    // CPUs of the set as a bit mask, 0 if it can't be determined
+    static uint64_t coreMask(CoreSet cores);
+
+    static bool readStats(int tid, ThreadStats& out);
+    // Logs the change since previous (asynchronously) and stores the new sample in it.
+    static void logStats(const char* name, int tid, ThreadStats& previous);
+
+    // Every thread of this process, to count wakeups over a span (e.g. while paused)
+    static std::vector<ThreadSample> sampleProcess();
+    // Logs the switch-ins per second since before, in total and of the busiest threads,
+    // and returns the total. Threads started or gone in between are left out.
+    static float logWakeups(const char* what, const std::vector<ThreadSample>& before, int64_t spanNs);
+};
+
+#endif //ATHREADPOLICY_H
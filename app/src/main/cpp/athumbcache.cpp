@@ -0,0 +1,167 @@
+//
+// Thumbnail strip cache files.
+//
+#include "athumbcache.h"
+#include "util.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define LOG_TAG "athumbcache"
+
+namespace {
+
+// Host byte order, the files never leave the device
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    int64_t mtimeNs;
+    int64_t size;
+    uint32_t pathLength;
+    uint16_t width;
+    uint16_t height;
+    uint32_t count;
+    uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 40, "FileHeader must stay packed");
+
+const char MAGIC[4] = {'A', 'T', 'H', 'M'};
+// Far above any strip we make, guards the allocations against a corrupt header
+const uint32_t MAX_PATH_LENGTH = 4096;
+const uint32_t MAX_COUNT = 1024;
+
+}
+
+std::string AThumbCache::fileFor(const std::string& path) const {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : path) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.thm", (unsigned long long)hash);
+    return dir + name;
+}
+
+bool AThumbCache::read(const char* file, ThumbSource& source, Thumbnails& out) {
+    FILE* f = fopen(file, "rb");
+    if (!f) {
+        return false;
+    }
+    FileHeader h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1
+              && memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == VERSION
+              && h.pathLength <= MAX_PATH_LENGTH && h.count <= MAX_COUNT
+              && h.width > 0 && h.height > 0 && h.width % 2 == 0 && h.height % 2 == 0;
+    if (ok) {
+        source.path.resize(h.pathLength);
+        source.mtimeNs = h.mtimeNs;
+        source.size = h.size;
+        out.width = h.width;
+        out.height = h.height;
+        out.ptsUs.resize(h.count);
+        out.pixels.resize(out.frameBytes() * h.count);
+        ok = fread(source.path.data(), 1, h.pathLength, f) == h.pathLength
+             && fread(out.ptsUs.data(), sizeof(int64_t), h.count, f) == h.count
+             && fread(out.pixels.data(), 1, out.pixels.size(), f) == out.pixels.size()
+             // Nothing may follow: a longer file isn't one we wrote
+             && fgetc(f) == EOF;
+    }
+    fclose(f);
+    return ok;
+}
+
+bool AThumbCache::load(const ThumbSource& source, Thumbnails& out) const {
+    std::string file = fileFor(source.path);
+    ThumbSource stored;
+    Thumbnails thumbs;
+    if (!read(file.c_str(), stored, thumbs)) {
+        return false;
+    }
+    // A hash collision or an edited video reads as a miss
+    if (stored.path != source.path || stored.mtimeNs != source.mtimeNs || stored.size != source.size) {
+        return false;
+    }
+    // Touched, so trim() goes by last use
+    utimensat(AT_FDCWD, file.c_str(), nullptr, 0);
+    out = std::move(thumbs);
+    return true;
+}
+
+bool AThumbCache::save(const ThumbSource& source, const Thumbnails& thumbs) const {
+    if (thumbs.width <= 0 || thumbs.width > UINT16_MAX || thumbs.height <= 0 || thumbs.height > UINT16_MAX
+        || source.path.size() > MAX_PATH_LENGTH || thumbs.ptsUs.size() > MAX_COUNT
+        || thumbs.pixels.size() != thumbs.frameBytes() * thumbs.ptsUs.size()) {
+        LOGW(LOG_TAG, "Not caching thumbnails of %s: bad geometry", source.path.c_str());
+        return false;
+    }
+    std::string path = fileFor(source.path);
+    // Write then rename, so a crash never leaves a truncated file behind.
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        LOGW(LOG_TAG, "Failed to open %s", tmp.c_str());
+        return false;
+    }
+    FileHeader h{};
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.mtimeNs = source.mtimeNs;
+    h.size = source.size;
+    h.pathLength = (uint32_t)source.path.size();
+    h.width = (uint16_t)thumbs.width;
+    h.height = (uint16_t)thumbs.height;
+    h.count = (uint32_t)thumbs.ptsUs.size();
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+              && fwrite(source.path.data(), 1, source.path.size(), f) == source.path.size()
+              && fwrite(thumbs.ptsUs.data(), sizeof(int64_t), h.count, f) == h.count
+              && fwrite(thumbs.pixels.data(), 1, thumbs.pixels.size(), f) == thumbs.pixels.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOGW(LOG_TAG, "Failed to write %s", path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+int AThumbCache::trim(int64_t maxBytes) const {
+    struct Entry {
+        std::string path;
+        int64_t mtimeNs;
+        int64_t size;
+    };
+    std::vector<Entry> files;
+    int64_t total = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return 0;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        struct stat st;
+        std::string path = dir + "/" + name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".thm") == 0 && stat(path.c_str(), &st) == 0) {
+            files.push_back({path, st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec, st.st_size});
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+
+    std::sort(files.begin(), files.end(), [](const Entry& a, const Entry& b) { return a.mtimeNs < b.mtimeNs; });
+    int removed = 0;
+    for (const auto& f : files) {
+        if (total <= maxBytes) {
+            break;
+        }
+        if (remove(f.path.c_str()) == 0) {
+            total -= f.size;
+            removed++;
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,58 @@
+//
+// On-disk thumbnail strips, one file per video keyed by its path and valid while
+// the video's mtime and size match. Pure logic, no platform calls.
+//
+#ifndef ATHUMBCACHE_H
+#define ATHUMBCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Evenly spaced I420 thumbnails of one video, for the file browser and the scrub bar
+struct Thumbnails {
+    int width = 0;                  // even
+    int height = 0;                 // even
+    std::vector<int64_t> ptsUs;     // sync sample each one was decoded from
+    std::vector<uint8_t> pixels;    // frameBytes() per thumbnail, in ptsUs order
+
+    size_t frameBytes() const { return (size_t)width * height * 3 / 2; }
+    int count() const { return (int)ptsUs.size(); }
+    const uint8_t* frame(int i) const { return pixels.data() + frameBytes() * i; }
+};
+
+// Identifies the version of the video the thumbnails were made from
+struct ThumbSource {
+    std::string path;
+    int64_t mtimeNs = 0;
+    int64_t size = 0;
+};
+
+/**
+ * <dir>/<fnv-1a of the path>.thm: header, the path, the PTS list, then the pixels.
+ * Files are replaced whole (write then rename), load() touches them and trim()
+ * bounds the directory by last use.
+ */
+class AThumbCache {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    // dir must exist
+    explicit AThumbCache(std::string dir) : dir(std::move(dir)) {}
+
+    std::string fileFor(const std::string& path) const;
+    // False when absent, unreadable or made from another version of the video
+    bool load(const ThumbSource& source, Thumbnails& out) const;
+    bool save(const ThumbSource& source, const Thumbnails& thumbs) const;
+    // Deletes the least recently used .thm files until the rest fit in maxBytes,
+    // returns how many went
+    int trim(int64_t maxBytes) const;
+
+    // Any cache file, whatever video it belongs to (tools/athumbs)
+    static bool read(const char* file, ThumbSource& source, Thumbnails& out);
+
+private:
+    std::string dir;
+};
+
+#endif //ATHUMBCACHE_H
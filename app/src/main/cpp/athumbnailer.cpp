@@ -0,0 +1,336 @@
+//
+// Background thumbnail strips.
+//
+#include "athumbnailer.h"
+#include "acodecprobe.h"
+#include "aimagescale.h"
+#include "athreadpolicy.h"
+#include "util.h"
+#include <android/hardware_buffer.h>
+#include <media/NdkImageReader.h>
+#include <media/NdkMediaExtractor.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#define LOG_TAG "athumbnailer"
+
+static int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Feeds the sample at the extractor's position followed by end of stream and waits
+// for its picture in reader. Null when none came by deadlineNs.
+static AImage* decodeOne(AMediaCodec* codec, AMediaExtractor* extractor, AImageReader* reader,
+                         int64_t deadlineNs) {
+    bool sampleQueued = false;
+    bool inputDone = false;
+    bool rendered = false;
+    while (!rendered && steadyNs() < deadlineNs) {
+        if (!inputDone) {
+            ssize_t index = AMediaCodec_dequeueInputBuffer(codec, 10000);
+            if (index >= 0) {
+                if (!sampleQueued) {
+                    size_t capacity;
+                    uint8_t* buffer = AMediaCodec_getInputBuffer(codec, index, &capacity);
+                    ssize_t size = AMediaExtractor_readSampleData(extractor, buffer, capacity);
+                    if (size < 0) {
+                        AMediaCodec_queueInputBuffer(codec, index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+                        return nullptr;
+                    }
+                    int64_t pts = AMediaExtractor_getSampleTime(extractor);
+                    AMediaCodec_queueInputBuffer(codec, index, 0, size, pts > 0 ? pts : 0, 0);
+                    sampleQueued = true;
+                } else {
+                    // Makes the codec give the picture back now instead of waiting for more input
+                    AMediaCodec_queueInputBuffer(codec, index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+                    inputDone = true;
+                }
+            }
+        }
+        AMediaCodecBufferInfo info;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(codec, &info, 10000);
+        if (index >= 0) {
+            bool eos = (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+            // Some codecs hand the last picture over with the end of stream flag
+            rendered = info.size > 0 || !eos;
+            AMediaCodec_releaseOutputBuffer(codec, index, rendered);
+            if (eos && !rendered) {
+                return nullptr;
+            }
+        }
+    }
+    // The rendered buffer reaches the reader asynchronously
+    while (rendered && steadyNs() < deadlineNs) {
+        AImage* image = nullptr;
+        if (AImageReader_acquireLatestImage(reader, &image) == AMEDIA_OK && image) {
+            return image;
+        }
+        usleep(1000);
+    }
+    return nullptr;
+}
+
+// Crops image to its visible part and scales it into one I420 thumbnail of out
+static bool scaleImage(AImage* image, int width, int height, uint8_t* out, std::vector<uint8_t>& scratch) {
+    AImageCropRect crop;
+    if (AImage_getCropRect(image, &crop) != AMEDIA_OK) {
+        return false;
+    }
+    uint8_t* dst = out;
+    for (int plane = 0; plane < 3; plane++) {
+        // Chroma is subsampled 2x2 in YUV_420_888
+        int shift = plane == 0 ? 0 : 1;
+        uint8_t* data;
+        int length;
+        int32_t rowStride, pixelStride;
+        if (AImage_getPlaneData(image, plane, &data, &length) != AMEDIA_OK
+            || AImage_getPlaneRowStride(image, plane, &rowStride) != AMEDIA_OK
+            || AImage_getPlanePixelStride(image, plane, &pixelStride) != AMEDIA_OK) {
+            return false;
+        }
+        PlaneView view{data + (size_t)(crop.top >> shift) * rowStride + (size_t)(crop.left >> shift) * pixelStride,
+                       (crop.right - crop.left) >> shift, (crop.bottom - crop.top) >> shift,
+                       rowStride, pixelStride};
+        AImageScale::scale(view, dst, width >> shift, height >> shift, scratch);
+        dst += (size_t)(width >> shift) * (height >> shift);
+    }
+    return true;
+}
+
+AThumbnailer::~AThumbnailer() {
+    stop();
+}
+
+bool AThumbnailer::start(JavaVM* javaVm, const char* cacheDir) {
+    std::lock_guard lk(mtx);
+    if (run) {
+        return true;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    dir = std::string(cacheDir) + "/thumbs";
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        LOGW(LOG_TAG, "Failed to create %s: %s", dir.c_str(), strerror(errno));
+        return false;
+    }
+    vm = javaVm;
+    count = std::clamp(propertyInt("debug.aplayer.thumbs.count", DEFAULT_COUNT), 1, 256);
+    width = std::clamp(propertyInt("debug.aplayer.thumbs.width", DEFAULT_WIDTH), 16, 1024) & ~1;
+    run = true;
+    worker = std::thread(&AThumbnailer::workerLoop, this);
+    return true;
+}
+
+void AThumbnailer::stop() {
+    {
+        std::lock_guard lk(mtx);
+        run = false;
+        queue.clear();
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void AThumbnailer::request(const std::string& path) {
+    {
+        std::lock_guard lk(mtx);
+        if (done.count(path) || std::find(queue.begin(), queue.end(), path) != queue.end()) {
+            return;
+        }
+        queue.push_back(path);
+    }
+    cv.notify_one();
+}
+
+std::shared_ptr<const Thumbnails> AThumbnailer::find(const std::string& path) {
+    std::lock_guard lk(mtx);
+    auto it = done.find(path);
+    return it != done.end() ? it->second : nullptr;
+}
+
+void AThumbnailer::workerLoop() {
+    // Playback comes first: the lowest priority on the little cores, debug.aplayer.thumbs.* overrides
+    ThreadPolicy policy;
+    policy.name = "thumbnailer";
+    policy.cores = CoreSet::LITTLE;
+    policy.nice = 19;
+    AThreadPolicy::apply(ThreadPolicy::fromProperties("debug.aplayer.thumbs", policy));
+    AThumbCache cache(dir);
+
+    std::unique_lock lk(mtx);
+    while (true) {
+        cv.wait(lk, [this] { return !run || !queue.empty(); });
+        if (!run) {
+            break;
+        }
+        std::string path = queue.front();
+        queue.pop_front();
+        lk.unlock();
+
+        auto thumbs = std::make_shared<Thumbnails>();
+        struct stat st;
+        bool ok = stat(path.c_str(), &st) == 0;
+        ThumbSource source{path, ok ? st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec : 0,
+                           ok ? (int64_t)st.st_size : 0};
+        int64_t startNs = steadyNs();
+        bool cached = ok && cache.load(source, *thumbs) && thumbs->width == width;
+        if (!cached && ok && (ok = generate(source, *thumbs))) {
+            // A strip cut short by stop() comes back empty, so it's never saved
+            cache.save(source, *thumbs);
+            cache.trim(CACHE_BYTES);
+        }
+
+        lk.lock();
+        if (!run) {
+            // Stopped part way, none of it is kept
+            break;
+        }
+        if (ok) {
+            LOGI(LOG_TAG, "Thumbnails of %s: %d at %dx%d, %s in %lld ms", path.c_str(), thumbs->count(),
+                 thumbs->width, thumbs->height, cached ? "read" : "decoded",
+                 (long long)((steadyNs() - startNs) / 1000000));
+        } else {
+            LOGW(LOG_TAG, "No thumbnails for %s", path.c_str());
+        }
+        // Failures are remembered too, so request() doesn't retry them
+        done[path] = ok ? std::move(thumbs) : nullptr;
+    }
+}
+
+AMediaCodec* AThumbnailer::openCodec(const char* mime, AMediaFormat* format, ANativeWindow* surface,
+                                     const CodecRequirement& req) {
+    std::vector<CodecProfile> candidates;
+    if (vm) {
+        candidates = ACodecProbe::candidates(vm, mime, req);
+    }
+    std::string name;
+    for (const auto& candidate : candidates) {
+        if (!candidate.hardware && candidate.supported) {
+            name = candidate.name;
+            break;
+        }
+    }
+    AMediaCodec* c = name.empty() ? AMediaCodec_createDecoderByType(mime)
+                                  : AMediaCodec_createCodecByName(name.c_str());
+    if (!c) {
+        return nullptr;
+    }
+    AMediaFormat* configured = AMediaFormat_new();
+    AMediaFormat_copy(configured, format);
+    // Best effort, the codec may starve it to keep realtime sessions on time
+    AMediaFormat_setInt32(configured, AMEDIAFORMAT_KEY_PRIORITY, 1);
+    media_status_t status = AMediaCodec_configure(c, configured, surface, nullptr, 0);
+    if (status == AMEDIA_OK) {
+        status = AMediaCodec_start(c);
+    }
+    AMediaFormat_delete(configured);
+    if (status != AMEDIA_OK) {
+        LOGW(LOG_TAG, "Codec %s did not start: %d", name.empty() ? mime : name.c_str(), status);
+        AMediaCodec_delete(c);
+        return nullptr;
+    }
+    return c;
+}
+
+bool AThumbnailer::generate(const ThumbSource& source, Thumbnails& out) {
+    AMediaExtractor* extractor = AMediaExtractor_new();
+    AMediaFormat* format = nullptr;
+    AImageReader* reader = nullptr;
+    ANativeWindow* window = nullptr;
+    AMediaCodec* codec = nullptr;
+    const char* mime = nullptr;
+    int32_t videoWidth = 0, videoHeight = 0;
+    int64_t durationUs = 0;
+
+    int fd = open(source.path.c_str(), O_RDONLY);
+    bool ready = extractor && fd >= 0
+            && AMediaExtractor_setDataSourceFd(extractor, fd, 0, source.size) == AMEDIA_OK;
+    if (fd >= 0) {
+        close(fd);
+    }
+    for (size_t i = 0; ready && !mime && i < AMediaExtractor_getTrackCount(extractor); i++) {
+        AMediaFormat* f = AMediaExtractor_getTrackFormat(extractor, i);
+        if (AMediaFormat_getString(f, AMEDIAFORMAT_KEY_MIME, &mime) && strncmp(mime, "video/", 6) == 0) {
+            format = f;
+            ready = AMediaExtractor_selectTrack(extractor, i) == AMEDIA_OK;
+        } else {
+            mime = nullptr;
+            AMediaFormat_delete(f);
+        }
+    }
+    ready = ready && format
+            && AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &videoWidth)
+            && AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &videoHeight)
+            && videoWidth > 0 && videoHeight > 0;
+    if (ready && !AMediaFormat_getInt64(format, AMEDIAFORMAT_KEY_DURATION, &durationUs)) {
+        durationUs = 0;
+    }
+    // CPU readable, scaled here rather than sampled by the GPU
+    ready = ready
+            && AImageReader_newWithUsage(videoWidth, videoHeight, AIMAGE_FORMAT_YUV_420_888,
+                                         AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, 2, &reader) == AMEDIA_OK
+            && AImageReader_getWindow(reader, &window) == AMEDIA_OK
+            && (codec = openCodec(mime, format, window, {videoWidth, videoHeight, 0.0f})) != nullptr;
+
+    out = {};
+    if (ready) {
+        out.width = std::min(width, videoWidth & ~1);
+        out.height = std::max(2, (int)((int64_t)out.width * videoHeight / videoWidth + 1) & ~1);
+    }
+    std::vector<uint8_t> frame(out.frameBytes());
+    int64_t lastSyncUs = -1;
+    for (int i = 0; ready && i < count; i++) {
+        {
+            std::lock_guard lk(mtx);
+            if (!run) {
+                out.ptsUs.clear();
+                break;
+            }
+        }
+        // Middle of each of count equal spans, snapped back to its sync sample
+        AMediaExtractor_seekTo(extractor, durationUs * (2 * i + 1) / (2 * count),
+                               AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+        int64_t syncUs = AMediaExtractor_getSampleTime(extractor);
+        if (syncUs < 0 || syncUs == lastSyncUs) {
+            // Long GOPs give fewer thumbnails rather than repeats
+            continue;
+        }
+        lastSyncUs = syncUs;
+        AImage* image = decodeOne(codec, extractor, reader, steadyNs() + DECODE_TIMEOUT_NS);
+        AMediaCodec_flush(codec);
+        if (!image) {
+            LOGW(LOG_TAG, "No picture from the sync sample at %lld us of %s", (long long)syncUs,
+                 source.path.c_str());
+            break;
+        }
+        if (scaleImage(image, out.width, out.height, frame.data(), scratch)) {
+            out.ptsUs.push_back(syncUs);
+            out.pixels.insert(out.pixels.end(), frame.begin(), frame.end());
+        }
+        AImage_delete(image);
+    }
+
+    if (codec) {
+        AMediaCodec_stop(codec);
+        AMediaCodec_delete(codec);
+    }
+    if (reader) {
+        AImageReader_delete(reader);
+    }
+    if (format) {
+        AMediaFormat_delete(format);
+    }
+    if (extractor) {
+        AMediaExtractor_delete(extractor);
+    }
+    return !out.ptsUs.empty();
+}
@@ -0,0 +1,71 @@
+//
+// Background thumbnail strips: a worker of its own with a separate, best-effort
+// decoder that decodes sync samples only, scales them on the CPU and keeps the
+// result in AThumbCache.
+//
+#ifndef ATHUMBNAILER_H
+#define ATHUMBNAILER_H
+
+#include <android/native_window.h>
+#include <jni.h>
+#include <media/NdkMediaCodec.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "acodecselect.h"
+#include "athumbcache.h"
+
+class AThumbnailer {
+public:
+    // Per video, debug.aplayer.thumbs.count and debug.aplayer.thumbs.width override
+    static constexpr int DEFAULT_COUNT = 24;
+    static constexpr int DEFAULT_WIDTH = 160;
+    // The cache directory is trimmed to this after each new strip
+    static constexpr int64_t CACHE_BYTES = 64ll << 20;
+    // A sync sample that doesn't come out by then ends the video's strip
+    static constexpr int64_t DECODE_TIMEOUT_NS = 2000000000;
+
+    ~AThumbnailer();
+
+    // Starts the worker (lowest priority, little cores unless debug.aplayer.thumbs.*
+    // says otherwise). vm lets it pick a software decoder, strips go to <cacheDir>/thumbs.
+    bool start(JavaVM* vm, const char* cacheDir);
+    // Finishes the thumbnail in progress; queued videos are dropped
+    void stop();
+    // Queued behind earlier requests, ignored when already done or queued
+    void request(const std::string& path);
+    // The strip of path once it's done, null while pending or if it failed
+    std::shared_ptr<const Thumbnails> find(const std::string& path);
+
+private:
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    // Under mtx
+    bool run = false;
+    std::deque<std::string> queue;
+    std::map<std::string, std::shared_ptr<const Thumbnails>> done;
+    // Worker only, set before it starts
+    JavaVM* vm = nullptr;
+    std::string dir;
+    int count = DEFAULT_COUNT;
+    int width = DEFAULT_WIDTH;
+    std::vector<uint8_t> scratch;
+
+    void workerLoop();
+    // Decodes the strip of source.path into out, false if nothing came out
+    bool generate(const ThumbSource& source, Thumbnails& out);
+    // Configured and started: a software decoder if the platform lists one, so
+    // hardware instances stay with playback, the default decoder otherwise
+    AMediaCodec* openCodec(const char* mime, AMediaFormat* format, ANativeWindow* surface,
+                           const CodecRequirement& req);
+};
+
+#endif //ATHUMBNAILER_H
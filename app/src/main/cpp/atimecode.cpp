@@ -0,0 +1,72 @@
+//
+// Machine-readable latency marker: render time and video PTS as a block code.
+//
+#include "atimecode.h"
+#include "aoverlay.h"
+
+static_assert(ATimecode::BITS == 72, "payload is two 32 bit values and a CRC-8");
+
+static void packPayload(const Timecode& tc, uint8_t bytes[9]) {
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = tc.renderUs >> (24 - i * 8);
+        bytes[4 + i] = tc.ptsUs >> (24 - i * 8);
+    }
+    bytes[8] = ATimecode::crc8(bytes, 8);
+}
+
+uint8_t ATimecode::crc8(const uint8_t* data, size_t size) {
+    // CRC-8/SMBUS, polynomial x^8 + x^2 + x + 1
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void ATimecode::encode(const Timecode& tc, uint8_t bits[BITS]) {
+    uint8_t bytes[9];
+    packPayload(tc, bytes);
+    for (int i = 0; i < BITS; i++) {
+        bits[i] = (bytes[i / 8] >> (7 - i % 8)) & 1;
+    }
+}
+
+bool ATimecode::decode(const uint8_t bits[BITS], Timecode& tc) {
+    uint8_t bytes[9] = {};
+    for (int i = 0; i < BITS; i++) {
+        bytes[i / 8] |= (bits[i] & 1) << (7 - i % 8);
+    }
+    if (crc8(bytes, 8) != bytes[8]) {
+        return false;
+    }
+    tc.renderUs = (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+    tc.ptsUs = (uint32_t)bytes[4] << 24 | bytes[5] << 16 | bytes[6] << 8 | bytes[7];
+    return true;
+}
+
+void ATimecode::build(AOverlay& overlay, const Timecode& tc, int cellPixels) {
+    uint8_t bits[BITS];
+    encode(tc, bits);
+
+    // Cells in clip space, anchored to the bottom-right corner so the quiet
+    // zone touches the window edges.
+    float cw = overlay.pixelWidth() * cellPixels;
+    float ch = overlay.pixelHeight() * cellPixels;
+    float x0 = 1.0f - cw * (COLS + 1);
+    float y0 = -1.0f + ch * (ROWS + 1);
+    const int layer = AOverlay::LAYERS - 1;
+
+    overlay.addRect(x0 - cw, y0 + ch, 1.0f, -1.0f, 0x000000ff, layer);
+    overlay.addRect(x0, y0, x0 + cw * COLS, y0 - ch * ROWS, 0xffffffff, layer);
+    overlay.addRect(x0 + cw, y0 - ch, x0 + cw * (COLS - 1), y0 - ch * (ROWS - 1), 0x000000ff, layer);
+    for (int i = 0; i < BITS; i++) {
+        if (bits[i]) {
+            float x = x0 + cw * (1 + i % DATA_COLS);
+            float y = y0 - ch * (1 + i / DATA_COLS);
+            overlay.addRect(x, y, x + cw, y - ch, 0xffffffff, layer);
+        }
+    }
+}
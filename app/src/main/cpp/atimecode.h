@@ -0,0 +1,40 @@
+//
+// Machine-readable latency marker: render time and video PTS as a block code.
+//
+#ifndef ATIMECODE_H
+#define ATIMECODE_H
+
+#include <cstddef>
+#include <cstdint>
+
+class AOverlay;
+
+struct Timecode {
+    uint32_t renderUs;  // steady clock, wraps every ~71 minutes
+    uint32_t ptsUs;     // presentation time of the shown video frame
+};
+
+/**
+ * COLS x ROWS grid of square cells: a one cell white ring around
+ * DATA_COLS x DATA_ROWS data cells (white = 1, row-major, MSB first),
+ * surrounded by a one cell black quiet zone. Payload is renderUs, ptsUs
+ * and a CRC-8 of both. Shared by the app (encoder) and the host reader.
+ */
+class ATimecode {
+public:
+    static const int COLS = 14;
+    static const int ROWS = 8;
+    static const int DATA_COLS = COLS - 2;
+    static const int DATA_ROWS = ROWS - 2;
+    static const int BITS = DATA_COLS * DATA_ROWS;
+
+    static void encode(const Timecode& tc, uint8_t bits[BITS]);
+    // False if the CRC doesn't match.
+    static bool decode(const uint8_t bits[BITS], Timecode& tc);
+    static uint8_t crc8(const uint8_t* data, size_t size);
+
+    // Emits the code into the bottom-right corner of the window.
+    static void build(AOverlay& overlay, const Timecode& tc, int cellPixels = 16);
+};
+
+#endif //ATIMECODE_H
@@ -0,0 +1,194 @@
+//
+// Frame timeline tracing exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// Use the TRACE_* macros from util.h, they compile to nothing without APLAYER_TRACE.
+//
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "atrace.h"
+#include "aring.h"
+#include "athreadbuffers.h"
+#include "util.h"
+#define LOG_TAG "atrace"
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t startNs;
+    int64_t value;      // duration for 'X', counter value for 'C'
+    int32_t tid;
+    char phase;
+};
+
+/**
+ * One per thread. The owning thread is the only producer, the flush thread the
+ * only consumer.
+ */
+struct Buffer {
+    ARing<Event, 4096> events;
+    std::atomic<uint32_t> dropped{0};
+    // Owner thread's name, written once per trace file by the flush thread
+    std::atomic<const char*> threadName{nullptr};
+    std::atomic<int32_t> tid{0};
+    std::atomic<bool> named{false};
+};
+
+AThreadBuffers<Buffer> buffers;
+
+std::atomic<bool> recording{false};
+std::mutex flushMutex;
+std::condition_variable flushCv;
+std::thread flushThread;
+FILE* file = nullptr;
+bool firstEvent = true;
+
+Buffer& current() {
+    static thread_local int32_t tid = 0;
+    bool reused;
+    Buffer& buffer = buffers.local(&reused);
+    if (!tid || reused) {
+        // First event of this thread, possibly in a buffer an exited thread left behind
+        tid = (int32_t)syscall(SYS_gettid);
+        buffer.tid = tid;
+        if (reused) {
+            buffer.threadName = nullptr;
+            buffer.named = false;
+        }
+    }
+    return buffer;
+}
+
+void record(const char* name, int64_t startNs, int64_t value, char phase) {
+    Buffer& buffer = current();
+    if (!buffer.events.push({name, startNs, value, buffer.tid.load(std::memory_order_relaxed), phase})) {
+        buffer.dropped++;
+    }
+}
+
+void writeEvent(const Event& e, int pid) {
+    fprintf(file, firstEvent ? "\n" : ",\n");
+    firstEvent = false;
+    switch (e.phase) {
+        case 'X':
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    e.name, pid, e.tid, e.startNs / 1000.0, e.value / 1000.0);
+            break;
+        case 'C':
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                    e.name, pid, e.tid, e.startNs / 1000.0, (long long)e.value);
+            break;
+        default:
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+                    e.name, pid, e.tid, e.startNs / 1000.0);
+            break;
+    }
+}
+
+// Called with flushMutex held
+void drain() {
+    int pid = getpid();
+    buffers.forEach([pid](Buffer& b) {
+        const char* name = b.threadName;
+        if (name && !b.named) {
+            fprintf(file, firstEvent ? "\n" : ",\n");
+            firstEvent = false;
+            fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    pid, b.tid.load(), name);
+            b.named = true;
+        }
+        Event e;
+        while (b.events.pop(e)) {
+            writeEvent(e, pid);
+        }
+        if (uint32_t dropped = b.dropped.exchange(0)) {
+            LOGW(LOG_TAG, "Trace buffer full, dropped %u events", dropped);
+        }
+    });
+    fflush(file);
+}
+
+void flushLoop() {
+    std::unique_lock lk(flushMutex);
+    while (recording) {
+        flushCv.wait_for(lk, std::chrono::milliseconds(500));
+        drain();
+    }
+}
+
+} // namespace
+
+int64_t ATrace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ATrace::enabled() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+bool ATrace::start(const char* path) {
+    std::lock_guard lk(flushMutex);
+    if (recording) {
+        return true;
+    }
+    file = fopen(path, "w");
+    if (!file) {
+        LOGE(LOG_TAG, "Failed to open trace file %s", path);
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    firstEvent = true;
+    buffers.forEach([](Buffer& b) { b.named = false; });
+    recording = true;
+    flushThread = std::thread(flushLoop);
+    LOGI(LOG_TAG, "Tracing to %s", path);
+    return true;
+}
+
+void ATrace::stop() {
+    {
+        std::lock_guard lk(flushMutex);
+        if (!recording) {
+            return;
+        }
+        recording = false;
+    }
+    flushCv.notify_one();
+    flushThread.join();
+    std::lock_guard lk(flushMutex);
+    drain();
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    file = nullptr;
+}
+
+void ATrace::complete(const char* name, int64_t startNs, int64_t endNs) {
+    if (enabled()) {
+        record(name, startNs, endNs - startNs, 'X');
+    }
+}
+
+void ATrace::instant(const char* name) {
+    if (enabled()) {
+        record(name, now(), 0, 'i');
+    }
+}
+
+void ATrace::counter(const char* name, int64_t value) {
+    if (enabled()) {
+        record(name, now(), value, 'C');
+    }
+}
+
+void ATrace::setThreadName(const char* name) {
+    // Kept with the buffer even when not tracing, so names show up in later traces.
+    Buffer& buffer = current();
+    buffer.named = false;
+    buffer.threadName = name;
+}
@@ -0,0 +1,42 @@
+//
+// Frame timeline tracing exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// Use the TRACE_* macros from util.h, they compile to nothing without APLAYER_TRACE.
+//
+#ifndef ATRACE_H
+#define ATRACE_H
+
+#include <cstdint>
+
+class ATrace {
+public:
+    // Starts recording and a background thread that drains the per-thread
+    // buffers into path every few hundred milliseconds.
+    static bool start(const char* path);
+    // Drains the remaining events and closes the JSON file.
+    static void stop();
+    static bool enabled();
+
+    // Names must be string literals (or otherwise outlive the trace).
+    static void complete(const char* name, int64_t startNs, int64_t endNs);
+    static void instant(const char* name);
+    static void counter(const char* name, int64_t value);
+    static void setThreadName(const char* name);
+
+    static int64_t now();
+};
+
+class ATraceScope {
+public:
+    explicit ATraceScope(const char* name) : name(name), startNs(ATrace::enabled() ? ATrace::now() : 0) {}
+    ~ATraceScope() {
+        if (startNs) {
+            ATrace::complete(name, startNs, ATrace::now());
+        }
+    }
+
+private:
+    const char* name;
+    int64_t startNs;
+};
+
+#endif //ATRACE_H
@@ -0,0 +1,34 @@
+//
+// Trick play policy.
+//
+#include "atrickplay.h"
+
+int64_t ATrickPlay::nextSyncTarget(int64_t mediaUs, float rate, int64_t lastFedUs) const {
+    int64_t target = mediaUs + (int64_t)(lead * rate);
+    if (rate < 0.0f) {
+        return target < lastFedUs ? target : lastFedUs - 1;
+    }
+    return target > lastFedUs ? target : lastFedUs + 1;
+}
+
+void ATrickPlay::measuredDecode(int64_t us) {
+    if (us > 0) {
+        // EWMA, 1/4 weight for the newest
+        lead += (us - lead) / 4;
+    }
+}
+
+OutputAction ATrickPlay::judge(int64_t dueNs, int64_t nowNs, int64_t frameNs, FeedMode mode) {
+    if (dueNs - nowNs > RESYNC_NS || nowNs - dueNs > RESYNC_NS) {
+        return OutputAction::RESYNC;
+    }
+    if (nowNs < dueNs) {
+        return OutputAction::WAIT;
+    }
+    if (mode == FeedMode::ALL && nowNs - dueNs > frameNs && dropRun < MAX_DROP_RUN) {
+        dropRun++;
+        return OutputAction::DROP;
+    }
+    dropRun = 0;
+    return OutputAction::SHOW;
+}
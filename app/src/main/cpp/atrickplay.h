@@ -0,0 +1,65 @@
+//
+// Trick play policy: which samples to feed and which decoded frames to show
+// at a playback rate. Pure logic, no platform calls.
+//
+#ifndef ATRICKPLAY_H
+#define ATRICKPLAY_H
+
+#include <cmath>
+#include <cstdint>
+
+enum class FeedMode {
+    ALL,        // every sample, late frames dropped after decoding
+    SYNC_ONLY,  // sync samples only, seeking ahead of the clock
+};
+
+enum class OutputAction {
+    SHOW,
+    WAIT,
+    DROP,
+    RESYNC,  // too far from the clock either way, restart it at this frame and show it
+};
+
+class ATrickPlay {
+public:
+    // Rates above this switch to sync samples, debug.aplayer.synconlyspeed (percent) overrides
+    static constexpr float DEFAULT_SYNC_ONLY_RATE = 4.0f;
+    // Decode time of a sync sample until one was measured
+    static constexpr int64_t DEFAULT_LEAD_US = 30000;
+    // Frames further than this from the clock restart it: a loop, a seek, or a
+    // decoder that can't keep up at all
+    static constexpr int64_t RESYNC_NS = 1000000000;
+    // Late frames dropped in a row before one is shown anyway, so a decoder that
+    // can't sustain the rate still updates the screen
+    static constexpr int MAX_DROP_RUN = 8;
+
+    void setSyncOnlyRate(float rate) { syncOnlyRate = rate; }
+    FeedMode mode(float rate) const {
+        return fabsf(rate) > syncOnlyRate ? FeedMode::SYNC_ONLY : FeedMode::ALL;
+    }
+
+    /**
+     * Sync-only feed: media time to seek the next sync sample from (at or after,
+     * at or before when the rate is negative). That is where the clock will be
+     * once the sample is decoded, and always past the sample fed last so the
+     * feed moves on.
+     */
+    int64_t nextSyncTarget(int64_t mediaUs, float rate, int64_t lastFedUs) const;
+    // Queue-to-output time of a sync sample, smooths the lead
+    void measuredDecode(int64_t us);
+    int64_t leadUs() const { return lead; }
+
+    /**
+     * What to do with a decoded frame due at dueNs. frameNs is the wall time one
+     * content frame lasts at the current rate; a frame later than that is dropped
+     * when every sample is fed (the next one is already due), shown otherwise.
+     */
+    OutputAction judge(int64_t dueNs, int64_t nowNs, int64_t frameNs, FeedMode mode);
+
+private:
+    float syncOnlyRate = DEFAULT_SYNC_ONLY_RATE;
+    int64_t lead = DEFAULT_LEAD_US;
+    int dropRun = 0;
+};
+
+#endif //ATRICKPLAY_H
@@ -0,0 +1,102 @@
+//
+// Video placement: maps the decoded picture (and its codec crop rect) onto the window.
+//
+#include "aviewport.h"
+#include <algorithm>
+
+static void setScaleTranslate(float* m, float sx, float sy, float tx, float ty) {
+    std::fill(m, m + 16, 0.0f);
+    m[0] = sx;
+    m[5] = sy;
+    m[10] = 1.0f;
+    m[12] = tx;
+    m[13] = ty;
+    m[15] = 1.0f;
+}
+
+AViewport::AViewport() :
+    windowWidth(0),
+    windowHeight(0),
+    format{},
+    mode(ScaleMode::Fit),
+    dirty(true) {
+    setScaleTranslate(position, 1.0f, 1.0f, 0.0f, 0.0f);
+    setScaleTranslate(texture, 1.0f, 1.0f, 0.0f, 0.0f);
+}
+
+void AViewport::setWindowSize(int32_t width, int32_t height) {
+    if (width != windowWidth || height != windowHeight) {
+        windowWidth = width;
+        windowHeight = height;
+        dirty = true;
+    }
+}
+
+void AViewport::setVideoFormat(const VideoFormat& f) {
+    if (f.width != format.width || f.height != format.height ||
+        f.cropLeft != format.cropLeft || f.cropTop != format.cropTop ||
+        f.cropRight != format.cropRight || f.cropBottom != format.cropBottom) {
+        format = f;
+        dirty = true;
+    }
+}
+
+void AViewport::setScaleMode(ScaleMode m) {
+    if (m != mode) {
+        mode = m;
+        dirty = true;
+    }
+}
+
+bool AViewport::update() {
+    if (!dirty) {
+        return false;
+    }
+    dirty = false;
+
+    int32_t cropWidth = format.cropRight - format.cropLeft;
+    int32_t cropHeight = format.cropBottom - format.cropTop;
+    if (windowWidth <= 0 || windowHeight <= 0 || format.width <= 0 || format.height <= 0 ||
+        cropWidth <= 0 || cropHeight <= 0) {
+        // Nothing sensible to fit yet, keep the old fullscreen stretch.
+        setScaleTranslate(position, 1.0f, 1.0f, 0.0f, 0.0f);
+        setScaleTranslate(texture, 1.0f, 1.0f, 0.0f, 0.0f);
+        return true;
+    }
+
+    // Texture space: select the crop rect out of the whole decoded buffer.
+    setScaleTranslate(texture,
+                      (float)cropWidth / format.width, (float)cropHeight / format.height,
+                      (float)format.cropLeft / format.width, (float)format.cropTop / format.height);
+
+    // Clip space: the unit quad spans the whole window, scale it down to the picture size.
+    float fx = (float)windowWidth / cropWidth;
+    float fy = (float)windowHeight / cropHeight;
+    float scale;
+    switch (mode) {
+        case ScaleMode::Fit:
+            scale = std::min(fx, fy);
+            break;
+        case ScaleMode::Fill:
+            scale = std::max(fx, fy);
+            break;
+        case ScaleMode::Original:
+            scale = 1.0f;
+            break;
+        case ScaleMode::Stretch:
+        default:
+            setScaleTranslate(position, 1.0f, 1.0f, 0.0f, 0.0f);
+            return true;
+    }
+    float sx = cropWidth * scale / windowWidth;
+    float sy = cropHeight * scale / windowHeight;
+    float tx = 0.0f, ty = 0.0f;
+    if (mode == ScaleMode::Original) {
+        // Centering an odd pixel difference lands the quad edges on half pixels,
+        // shift by half a pixel so every source pixel maps onto exactly one window pixel.
+        if ((windowWidth - cropWidth) & 1) tx = 1.0f / windowWidth;
+        if ((windowHeight - cropHeight) & 1) ty = 1.0f / windowHeight;
+    }
+    setScaleTranslate(position, sx, sy, tx, ty);
+    return true;
+}
@@ -0,0 +1,62 @@
+//
+// Video placement: maps the decoded picture (and its codec crop rect) onto the window.
+//
+#ifndef AVIEWPORT_H
+#define AVIEWPORT_H
+
+#include <cstdint>
+
+enum class ScaleMode {
+    Fit,      // letterbox or pillarbox, whole picture visible
+    Fill,     // crop the picture to cover the whole window
+    Original, // 1:1 source pixels, centered
+    Stretch   // ignore aspect ratio
+};
+
+/**
+ * Decoded buffer geometry as reported by the codec output format.
+ * The crop rect is in buffer pixels, right/bottom exclusive.
+ */
+struct VideoFormat {
+    int32_t width;
+    int32_t height;
+    int32_t cropLeft;
+    int32_t cropTop;
+    int32_t cropRight;
+    int32_t cropBottom;
+};
+
+/**
+ * Pure math, no GL calls: computes the column-major 4x4 matrices the video
+ * shader applies to the unit quad and to its texture coordinates.
+ * Matrices are only recomputed when one of the inputs changes.
+ */
+class AViewport {
+public:
+    AViewport();
+
+    void setWindowSize(int32_t width, int32_t height);
+    void setVideoFormat(const VideoFormat& format);
+    void setScaleMode(ScaleMode mode);
+    // Forces the next update() to report a change, e.g. after the program was re-linked.
+    void invalidate() { dirty = true; }
+
+    // Recomputes the matrices if any input changed since the last call.
+    // Returns true when the caller has to re-upload them.
+    bool update();
+
+    const float* positionMatrix() const { return position; }
+    const float* textureMatrix() const { return texture; }
+
+private:
+    int32_t windowWidth;
+    int32_t windowHeight;
+    VideoFormat format;
+    ScaleMode mode;
+    bool dirty;
+
+    float position[16];
+    float texture[16];
+};
+
+#endif //AVIEWPORT_H
@@ -4,16 +4,75 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __ANDROID__
 #include <android/log.h>
 #include <android/set_abort_message.h>
-#include <cstdlib>
+#include <sys/system_properties.h>
 
 #define _LOG(priority, tag, fmt, ...) \
   ((void)__android_log_print((priority), (tag), (fmt)__VA_OPT__(, ) __VA_ARGS__))
+#else
+// Host builds (tools, benchmarks) log to stderr.
+#define ANDROID_LOG_VERBOSE 2
+#define ANDROID_LOG_DEBUG 3
+#define ANDROID_LOG_INFO 4
+#define ANDROID_LOG_WARN 5
+#define ANDROID_LOG_ERROR 6
+#define android_set_abort_message(msg) ((void)(msg))
+
+#define _LOG(priority, tag, fmt, ...) \
+  ((void)(priority), (void)fprintf(stderr, "%s: ", (tag)), \
+   (void)fprintf(stderr, (fmt)__VA_OPT__(, ) __VA_ARGS__), (void)fputc('\n', stderr))
+#endif
+
+// Messages below this level are compiled out (-DAPLAYER_LOG_LEVEL=ANDROID_LOG_WARN).
+#ifndef APLAYER_LOG_LEVEL
+#define APLAYER_LOG_LEVEL ANDROID_LOG_INFO
+#endif
+
+#define _LOG_FILTERED(priority, tag, fmt, ...) \
+  ((priority) >= APLAYER_LOG_LEVEL ? _LOG(priority, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__) : (void)0)
+
+#define LOGE(tag, fmt, ...) _LOG_FILTERED(ANDROID_LOG_ERROR, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+#define LOGW(tag, fmt, ...) _LOG_FILTERED(ANDROID_LOG_WARN, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+#define LOGI(tag, fmt, ...) _LOG_FILTERED(ANDROID_LOG_INFO, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+
+// Asynchronous variants for per-frame paths (alog.h): no formatting or syscall on
+// the calling thread, at most ALog::Site::BURST messages per second per call site.
+// Format strings must be literals.
+#include "alog.h"
+#define _LOG_ASYNC(priority, tag, fmt, ...)                                             \
+  do {                                                                                  \
+    if constexpr ((priority) >= APLAYER_LOG_LEVEL) {                                    \
+      static ALog::Site _logSite;                                                       \
+      ALog::write(_logSite, (priority), (tag), (fmt)__VA_OPT__(, ) __VA_ARGS__);        \
+    }                                                                                   \
+  } while (false)
+
+#define LOGE_ASYNC(tag, fmt, ...) _LOG_ASYNC(ANDROID_LOG_ERROR, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+#define LOGW_ASYNC(tag, fmt, ...) _LOG_ASYNC(ANDROID_LOG_WARN, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+#define LOGI_ASYNC(tag, fmt, ...) _LOG_ASYNC(ANDROID_LOG_INFO, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
 
-#define LOGE(tag, fmt, ...) _LOG(ANDROID_LOG_ERROR, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
-#define LOGW(tag, fmt, ...) _LOG(ANDROID_LOG_WARN, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
-#define LOGI(tag, fmt, ...) _LOG(ANDROID_LOG_INFO, tag, (fmt)__VA_OPT__(, ) __VA_ARGS__)
+// Timeline tracing (atrace.h), compiled in with -DAPLAYER_TRACE. Names must be literals.
+#ifdef APLAYER_TRACE
+#include "atrace.h"
+#define _TRACE_CONCAT2(a, b) a##b
+#define _TRACE_CONCAT(a, b) _TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) ATraceScope _TRACE_CONCAT(_traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) ATrace::instant(name)
+#define TRACE_COUNTER(name, value) ATrace::counter((name), (value))
+#define TRACE_THREAD_NAME(name) ATrace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
 
 [[noreturn]] __attribute__((__format__(__printf__, 2, 3))) static void fatal(
         const char* tag, const char* fmt, ...) {
@@ -31,6 +90,39 @@
     std::abort();
 }
 
+/**
+ * Integer debug switch: a system property on device (adb shell setprop name value),
+ * an environment variable of the same name on the host.
+ */
+static inline int propertyInt(const char* name, int defaultValue) {
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX];
+    if (__system_property_get(name, value) <= 0) {
+        return defaultValue;
+    }
+#else
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return defaultValue;
+    }
+#endif
+    return atoi(value);
+}
+
+/**
+ * Whether a space-separated extension list (EGL_EXTENSIONS, GL_EXTENSIONS) has name as a
+ * whole token: a bare strstr() also matches it as the prefix of a longer name.
+ */
+static inline bool hasExtension(const char* extensions, const char* name) {
+    size_t len = strlen(name);
+    for (const char* p = extensions; p && (p = strstr(p, name)); p += len) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
 #define CHECK_NOT_NULL(tag, value)                                           \
   do {                                                                  \
     if ((value) == nullptr) {                                           \
@@ -0,0 +1,202 @@
+//
+// Reads the on-screen millisecond timer back from captured frames by
+// template matching against the glyphs of the app's own baked font atlas.
+//
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "adigits.h"
+
+uint32_t sad(const uint8_t* a, const uint8_t* b, int n) {
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    return (uint32_t)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#else
+    uint32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += abs(a[i] - b[i]);
+    }
+    return sum;
+#endif
+}
+
+void binarize(const uint8_t* src, uint8_t* dst, int n, uint8_t threshold) {
+    int i = 0;
+#if defined(__SSE2__)
+    // No unsigned byte compare in SSE2: flip the sign bit and compare signed.
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_xor_si128(_mm_set1_epi8((char)threshold), bias);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), bias);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_cmpgt_epi8(v, t));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = src[i] > threshold ? 255 : 0;
+    }
+}
+
+// Otsu's threshold over the roi histogram
+static uint8_t otsu(const uint8_t* luma, int stride, Rect roi) {
+    uint32_t histogram[256] = {};
+    for (int y = roi.y; y < roi.y + roi.h; y++) {
+        const uint8_t* row = luma + (size_t)y * stride + roi.x;
+        for (int x = 0; x < roi.w; x++) {
+            histogram[row[x]]++;
+        }
+    }
+    double total = (double)roi.w * roi.h;
+    double sum = 0;
+    for (int i = 0; i < 256; i++) {
+        sum += (double)i * histogram[i];
+    }
+    double sumBackground = 0, weightBackground = 0, best = 0;
+    int threshold = 127;
+    for (int i = 0; i < 256; i++) {
+        weightBackground += histogram[i];
+        if (weightBackground == 0) continue;
+        double weightForeground = total - weightBackground;
+        if (weightForeground == 0) break;
+        sumBackground += (double)i * histogram[i];
+        double meanBackground = sumBackground / weightBackground;
+        double meanForeground = (sum - sumBackground) / weightForeground;
+        double between = weightBackground * weightForeground *
+                (meanBackground - meanForeground) * (meanBackground - meanForeground);
+        if (between > best) {
+            best = between;
+            threshold = i;
+        }
+    }
+    return (uint8_t)threshold;
+}
+
+// Nearest-neighbour resample of a w x h box into a TW x TH template
+static void resample(const uint8_t* src, int stride, int w, int h, uint8_t* dst) {
+    for (int y = 0; y < ADigitReader::TH; y++) {
+        const uint8_t* row = src + (size_t)(y * h / ADigitReader::TH) * stride;
+        for (int x = 0; x < ADigitReader::TW; x++) {
+            dst[y * ADigitReader::TW + x] = row[x * w / ADigitReader::TW];
+        }
+    }
+}
+
+ADigitReader::ADigitReader() :
+    templates{},
+    aspects{},
+    mask(nullptr),
+    maskSize(0) {
+}
+
+ADigitReader::~ADigitReader() {
+    free(mask);
+}
+
+void ADigitReader::init(const AFont& font) {
+    const stbtt_bakedchar* glyphs = font.glyphs();
+    for (int d = 0; d < 10; d++) {
+        const stbtt_bakedchar& g = glyphs['0' + d - 32];
+        int w = g.x1 - g.x0;
+        int h = g.y1 - g.y0;
+        uint8_t glyph[TW * TH];
+        resample(font.bitmap + g.y0 * 1024 + g.x0, 1024, w, h, glyph);
+        binarize(glyph, templates[d], TW * TH, 127);
+        aspects[d] = (float)w / h;
+    }
+}
+
+int ADigitReader::match(int x0, int y0, int x1, int y1, int width) const {
+    uint8_t candidate[TW * TH];
+    resample(mask + y0 * width + x0, width, x1 - x0, y1 - y0, candidate);
+    float aspect = (float)(x1 - x0) / (y1 - y0);
+    int best = -1;
+    float bestScore = 0;
+    for (int d = 0; d < 10; d++) {
+        // Fraction of mismatching pixels, plus a penalty for the wrong shape:
+        // stretched to the template size a '1' alone looks like a solid bar.
+        float score = sad(candidate, templates[d], TW * TH) / (255.0f * TW * TH)
+                + fabsf(logf(aspect / aspects[d])) * 0.25f;
+        if (best < 0 || score < bestScore) {
+            best = d;
+            bestScore = score;
+        }
+    }
+    return bestScore < 0.3f ? best : -1;
+}
+
+int64_t ADigitReader::read(const uint8_t* luma, int stride, Rect roi) {
+    if (roi.w <= 0 || roi.h <= 0) {
+        return -1;
+    }
+    if (maskSize < roi.w * roi.h) {
+        maskSize = roi.w * roi.h;
+        mask = (uint8_t*)realloc(mask, maskSize);
+    }
+    uint8_t threshold = otsu(luma, stride, roi);
+    for (int y = 0; y < roi.h; y++) {
+        binarize(luma + (size_t)(roi.y + y) * stride + roi.x, mask + y * roi.w, roi.w, threshold);
+    }
+
+    // The text row is the tallest run of rows containing foreground
+    int bandStart = 0, bandEnd = 0, runStart = -1;
+    for (int y = 0; y <= roi.h; y++) {
+        bool any = false;
+        if (y < roi.h) {
+            const uint8_t* row = mask + y * roi.w;
+            any = memchr(row, 255, roi.w) != nullptr;
+        }
+        if (any && runStart < 0) {
+            runStart = y;
+        } else if (!any && runStart >= 0) {
+            if (y - runStart > bandEnd - bandStart) {
+                bandStart = runStart;
+                bandEnd = y;
+            }
+            runStart = -1;
+        }
+    }
+    if (bandEnd - bandStart < 8) {
+        return -1;
+    }
+
+    // Glyphs are separated by empty columns
+    int64_t value = 0;
+    int digits = 0;
+    int glyphStart = -1;
+    for (int x = 0; x <= roi.w; x++) {
+        bool any = false;
+        for (int y = bandStart; x < roi.w && y < bandEnd && !any; y++) {
+            any = mask[y * roi.w + x] != 0;
+        }
+        if (any && glyphStart < 0) {
+            glyphStart = x;
+        } else if (!any && glyphStart >= 0) {
+            // Tight vertical extent of this glyph
+            int top = bandEnd, bottom = bandStart;
+            for (int y = bandStart; y < bandEnd; y++) {
+                if (memchr(mask + y * roi.w + glyphStart, 255, x - glyphStart)) {
+                    if (y < top) top = y;
+                    bottom = y + 1;
+                }
+            }
+            // Ignore specks, a real glyph spans most of the text row
+            if ((bottom - top) * 2 >= bandEnd - bandStart) {
+                int d = match(glyphStart, top, x, bottom, roi.w);
+                if (d < 0 || ++digits > MAX_DIGITS) {
+                    return -1;
+                }
+                value = value * 10 + d;
+            }
+            glyphStart = -1;
+        }
+    }
+    return digits > 0 ? value : -1;
+}
@@ -0,0 +1,51 @@
+//
+// Reads the on-screen millisecond timer back from captured frames by
+// template matching against the glyphs of the app's own baked font atlas.
+//
+#ifndef ADIGITS_H
+#define ADIGITS_H
+
+#include <cstdint>
+
+#include "afont.h"
+
+struct Rect {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+class ADigitReader {
+public:
+    // Normalized glyph size every candidate is resampled to before matching
+    static const int TW = 16;
+    static const int TH = 32;
+    static const int MAX_DIGITS = 8;
+
+    ADigitReader();
+    ~ADigitReader();
+
+    // Builds the '0'..'9' templates from a baked atlas.
+    void init(const AFont& font);
+
+    // Decodes the single row of digits inside roi of an 8-bit luma plane.
+    // Returns the value, or -1 when nothing digit-like was found or a glyph
+    // didn't match any template well enough.
+    int64_t read(const uint8_t* luma, int stride, Rect roi);
+
+private:
+    uint8_t templates[10][TW * TH];
+    float aspects[10];
+    uint8_t* mask;
+    int maskSize;
+
+    int match(int x0, int y0, int x1, int y1, int width) const;
+};
+
+// Sum of absolute differences of two n-byte buffers, n a multiple of 16.
+uint32_t sad(const uint8_t* a, const uint8_t* b, int n);
+// dst[i] = src[i] > threshold ? 255 : 0
+void binarize(const uint8_t* src, uint8_t* dst, int n, uint8_t threshold);
+
+#endif //ADIGITS_H
@@ -0,0 +1,208 @@
+//
+// Headless benchmark: the overlay and draw half of aplayer's frame pipeline,
+// unthrottled, against an offscreen pbuffer on Mesa's surfaceless EGL.
+// Writes the same JSON as the on-device benchmark (adb shell am start ... --ei bench N).
+//
+//   aheadless --frames 2000 --size 1920x1080 --json bench.json
+//
+// There is no video decoder on the host: without --video the acquire stage stays
+// empty, with it frames come from an uncompressed file and are uploaded each frame.
+//
+//   aheadless --video clip.y4m --frames 2000
+//   aheadless --video clip.nv12 --video-size 1920x1080 --nv12 --realtime
+//
+#include <GLES2/gl2.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "abench.h"
+#include "adisplay.h"
+#include "afont.h"
+#include "aframegraph.h"
+#include "aoverlay.h"
+#include "arawsource.h"
+#include "astartup.h"
+#include "atimecode.h"
+#include "util.h"
+#define LOG_TAG "aheadless"
+
+#ifndef AHEADLESS_DEFAULT_FONT
+#define AHEADLESS_DEFAULT_FONT "Roboto-Regular.ttf"
+#endif
+
+using namespace std::chrono;
+
+static void usage() {
+    fprintf(stderr,
+            "usage: aheadless [options]\n"
+            "  --frames N       frames to render (default: 1000)\n"
+            "  --size WxH       pbuffer size (default: 1920x1080)\n"
+            "  --timecode       also draw the block-coded timecode\n"
+            "  --font path      TrueType file to bake (default: %s)\n"
+            "  --cache dir      program binary cache directory\n"
+            "  --serial-start   bake the font before EGL init instead of alongside it\n"
+            "  --video path     draw the frames of a .y4m, or raw I420 file (loops)\n"
+            "  --video-size WxH size of a raw --video\n"
+            "  --nv12           a raw --video is NV12\n"
+            "  --realtime       show --video frames at its frame rate instead of one per frame\n"
+            "  --label text     run label in the JSON (default: host)\n"
+            "  --json path      results (default: bench.json)\n", AHEADLESS_DEFAULT_FONT);
+}
+
+int main(int argc, char** argv) {
+    int frames = 1000;
+    int width = 1920, height = 1080;
+    bool timecode = false;
+    const char* fontPath = AHEADLESS_DEFAULT_FONT;
+    const char* cacheDir = nullptr;
+    const char* label = "host";
+    const char* jsonPath = "bench.json";
+    bool parallelStart = true;
+    const char* videoPath = nullptr;
+    int videoWidth = 0, videoHeight = 0;
+    AImage::Format videoFormat = AImage::I420;
+    bool realtime = false;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && more) {
+            frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--size") && more) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                usage();
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--timecode")) {
+            timecode = true;
+        } else if (!strcmp(argv[i], "--font") && more) {
+            fontPath = argv[++i];
+        } else if (!strcmp(argv[i], "--cache") && more) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--serial-start")) {
+            parallelStart = false;
+        } else if (!strcmp(argv[i], "--video") && more) {
+            videoPath = argv[++i];
+        } else if (!strcmp(argv[i], "--video-size") && more) {
+            if (sscanf(argv[++i], "%dx%d", &videoWidth, &videoHeight) != 2) {
+                usage();
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--nv12")) {
+            videoFormat = AImage::NV12;
+        } else if (!strcmp(argv[i], "--realtime")) {
+            realtime = true;
+        } else if (!strcmp(argv[i], "--label") && more) {
+            label = argv[++i];
+        } else if (!strcmp(argv[i], "--json") && more) {
+            jsonPath = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames <= 0 || width <= 0 || height <= 0) {
+        usage();
+        return 2;
+    }
+
+    FILE* ttf = fopen(fontPath, "rb");
+    if (!ttf) {
+        LOGE(LOG_TAG, "Failed to open font %s", fontPath);
+        return 1;
+    }
+    std::vector<unsigned char> ttfData;
+    unsigned char buf[65536];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), ttf)) > 0;) {
+        ttfData.insert(ttfData.end(), buf, buf + n);
+    }
+    fclose(ttf);
+    // Same steps as Engine::ColdStart, the file source standing in for the decoder
+    AFont font;
+    ADisplay display;
+    ARawSource source;
+    source.setRealtime(realtime);
+    AStartup startup;
+    if (videoPath) {
+        startup.add("video", {}, [&] { return source.open(videoPath, videoWidth, videoHeight, videoFormat); });
+    }
+    int fontStep = startup.add("font", {}, [&] { return font.bake(ttfData.data()); });
+    int eglStep = startup.add("egl", {}, [&] { return display.initOffscreen(nullptr, width, height, cacheDir); },
+                              true);
+    startup.add("atlas", {fontStep, eglStep}, [&] {
+        display.uploadAtlas(font.bitmap);
+        return true;
+    }, true);
+    bool started = startup.run(parallelStart);
+    startup.logTimeline();
+    if (!started) {
+        return 1;
+    }
+    LOGI(LOG_TAG, "GL renderer: %s", (const char*)glGetString(GL_RENDERER));
+
+    // Same layout as Engine::RenderFrame
+    float scaleX = 1920.0f / width * 0.0042f;
+    float scaleY = 1080.0f / height * 0.0063f;
+    AOverlay overlay;
+    overlay.setWhiteTexel(font.whiteU, font.whiteV);
+    overlay.setPixelSize(2.0f / width, 2.0f / height);
+    AFrameGraph graph;
+    ABench bench(frames);
+    auto start = high_resolution_clock::now();
+    auto ft = start;
+    int fc = 0;
+    std::vector<Vertex> fv;
+    int64_t lastNs = 0;
+
+    while (!bench.done()) {
+        bench.begin();
+        AImage* image = videoPath ? source.acquireLatestImage() : nullptr;
+        VideoFormat format;
+        if (source.pollFormatChange(format)) {
+            display.setVideoFormat(format);
+        }
+        auto now = high_resolution_clock::now();
+        bench.mark(ABench::ACQUIRE);
+        overlay.begin();
+        overlay.addText(font.buildTextQuads(
+                std::to_string(duration_cast<milliseconds>(now - start).count() % 100000).c_str(),
+                scaleX, scaleY, 0.0f), 0xffffffff);
+        fc++;
+        auto e = duration_cast<milliseconds>(now - ft).count();
+        if (e > 1000) {
+            fv = font.buildTextQuads((std::to_string(fc * 1000 / (int)e) + " fps").c_str(),
+                                     scaleX * 0.5f, scaleY * 0.5f, -0.4f);
+            fc = 0;
+            ft = now;
+        }
+        overlay.addText(fv, 0xffffffff);
+        graph.build(overlay, -0.95f, -0.95f, -0.35f, -0.55f);
+        if (timecode) {
+            ATimecode::build(overlay, {
+                    (uint32_t)duration_cast<microseconds>(now.time_since_epoch()).count(), 0});
+        }
+        overlay.finish();
+        bench.mark(ABench::OVERLAY);
+        display.draw(overlay, image);
+        source.releaseImage(image);
+        bench.mark(ABench::DRAW);
+        glFinish();
+        bench.mark(ABench::GPU);
+        bench.end(image != nullptr);
+
+        int64_t nowNs = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        FrameSample sample{};
+        if (lastNs) {
+            sample.vsyncMs = (nowNs - lastNs) / 1e6f;
+        }
+        lastNs = nowNs;
+        graph.push(sample);
+    }
+    if (source.dropped()) {
+        LOGI(LOG_TAG, "Dropped %d video frames", source.dropped());
+    }
+    display.terminate();
+    return bench.writeJson(jsonPath, label) ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+//
+// Offline glass-to-glass latency analyzer.
+//
+// Decodes the millisecond timer aplayer draws in the middle of the screen (or,
+// with --timecode, the block code from debug.aplayer.timecode=1) from a screen
+// recording or camera capture and reports per-frame latency and jitter.
+//
+//   ffmpeg -i capture.mp4 -f yuv4mpegpipe -pix_fmt gray - | alatency -
+//   alatency --fps 240 --roi 600,300,700,200 frame_0001.pgm frame_0002.pgm ...
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "adigits.h"
+#include "atimecodereader.h"
+#include "util.h"
+#define LOG_TAG "alatency"
+
+#ifndef ALATENCY_DEFAULT_FONT
+#define ALATENCY_DEFAULT_FONT "Roboto-Regular.ttf"
+#endif
+
+// The app's timer wraps at 100 s, the timecode at 2^32 us
+static const int64_t TIMER_MODULO_US = 100000 * 1000LL;
+static const int64_t TIMECODE_MODULO_US = 1LL << 32;
+
+struct Frame {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> luma;
+};
+
+/**
+ * YUV4MPEG2 stream, only the luma plane is kept.
+ */
+class Y4MReader {
+public:
+    bool open(const char* path) {
+        file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+        if (!file) {
+            LOGE(LOG_TAG, "Failed to open %s", path);
+            return false;
+        }
+        char header[256];
+        if (!fgets(header, sizeof(header), file) || strncmp(header, "YUV4MPEG2", 9) != 0) {
+            LOGE(LOG_TAG, "%s is not a YUV4MPEG2 stream", path);
+            return false;
+        }
+        int fpsNum = 0, fpsDen = 1;
+        std::string chroma = "420";
+        for (char* tok = strtok(header + 9, " \n"); tok; tok = strtok(nullptr, " \n")) {
+            switch (tok[0]) {
+                case 'W': width = atoi(tok + 1); break;
+                case 'H': height = atoi(tok + 1); break;
+                case 'F': sscanf(tok + 1, "%d:%d", &fpsNum, &fpsDen); break;
+                case 'C': chroma = tok + 1; break;
+            }
+        }
+        if (fpsNum > 0 && fpsDen > 0) {
+            fps = (double)fpsNum / fpsDen;
+        }
+        int cw = (width + 1) / 2, ch = (height + 1) / 2;
+        if (chroma.rfind("mono", 0) == 0) {
+            chromaSize = 0;
+        } else if (chroma.rfind("444", 0) == 0) {
+            chromaSize = 2 * width * height;
+        } else if (chroma.rfind("422", 0) == 0) {
+            chromaSize = 2 * cw * height;
+        } else {
+            chromaSize = 2 * cw * ch;
+        }
+        return width > 0 && height > 0;
+    }
+
+    bool read(Frame& frame) {
+        char tag[256];
+        if (!fgets(tag, sizeof(tag), file) || strncmp(tag, "FRAME", 5) != 0) {
+            return false;
+        }
+        frame.width = width;
+        frame.height = height;
+        frame.luma.resize((size_t)width * height);
+        if (fread(frame.luma.data(), 1, frame.luma.size(), file) != frame.luma.size()) {
+            return false;
+        }
+        // Skip chroma
+        char skip[4096];
+        for (size_t left = chromaSize; left > 0;) {
+            size_t n = fread(skip, 1, std::min(left, sizeof(skip)), file);
+            if (n == 0) return false;
+            left -= n;
+        }
+        return true;
+    }
+
+    double fps = 0;
+
+private:
+    FILE* file = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t chromaSize = 0;
+};
+
+// Binary PGM (P5), 8 bit
+static bool readPgm(const char* path, Frame& frame) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    int maxValue = 0;
+    bool ok = fscanf(f, "P5 %d %d %d", &frame.width, &frame.height, &maxValue) == 3
+            && maxValue == 255 && fgetc(f) != EOF;
+    if (ok) {
+        frame.luma.resize((size_t)frame.width * frame.height);
+        ok = fread(frame.luma.data(), 1, frame.luma.size(), f) == frame.luma.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool parseRect(const char* s, Rect& r) {
+    return sscanf(s, "%d,%d,%d,%d", &r.x, &r.y, &r.w, &r.h) == 4;
+}
+
+static Rect clampRect(Rect r, int width, int height) {
+    r.x = std::clamp(r.x, 0, width);
+    r.y = std::clamp(r.y, 0, height);
+    r.w = std::clamp(r.w, 0, width - r.x);
+    r.h = std::clamp(r.h, 0, height - r.y);
+    return r;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100.0 * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void summarize(const char* name, const std::vector<double>& v) {
+    if (v.empty()) {
+        printf("%-16s n/a\n", name);
+        return;
+    }
+    double mean = 0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    double var = 0;
+    for (double x : v) var += (x - mean) * (x - mean);
+    printf("%-16s mean %8.2f  stddev %7.2f  min %8.2f  p50 %8.2f  p95 %8.2f  p99 %8.2f  max %8.2f ms\n",
+           name, mean, sqrt(var / v.size()), *std::min_element(v.begin(), v.end()),
+           percentile(v, 50), percentile(v, 95), percentile(v, 99), *std::max_element(v.begin(), v.end()));
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: alatency [options] capture.y4m|-|frame.pgm...\n"
+            "  --fps N          capture frame rate (default: from Y4M header, else 30)\n"
+            "  --roi x,y,w,h    region of the app timer (default: middle band of the frame)\n"
+            "  --ref-roi x,y,w,h  region of a reference timer; latency = ref - app\n"
+            "  --timecode       read the block code instead of the digits\n"
+            "                   (default roi: bottom-right corner of the frame)\n"
+            "  --font path      TrueType file the app bakes (default: %s)\n"
+            "  --csv path       per-frame results\n", ALATENCY_DEFAULT_FONT);
+}
+
+int main(int argc, char** argv) {
+    const char* fontPath = ALATENCY_DEFAULT_FONT;
+    const char* csvPath = nullptr;
+    double fps = 0;
+    Rect roi{}, refRoi{};
+    bool hasRoi = false, hasRef = false, useTimecode = false;
+    std::vector<const char*> inputs;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--fps") && more) {
+            fps = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--roi") && more) {
+            hasRoi = parseRect(argv[++i], roi);
+        } else if (!strcmp(argv[i], "--ref-roi") && more) {
+            hasRef = parseRect(argv[++i], refRoi);
+        } else if (!strcmp(argv[i], "--timecode")) {
+            useTimecode = true;
+        } else if (!strcmp(argv[i], "--font") && more) {
+            fontPath = argv[++i];
+        } else if (!strcmp(argv[i], "--csv") && more) {
+            csvPath = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage();
+            return 2;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        usage();
+        return 2;
+    }
+
+    FILE* ttf = fopen(fontPath, "rb");
+    if (!ttf) {
+        LOGE(LOG_TAG, "Failed to open font %s", fontPath);
+        return 1;
+    }
+    std::vector<unsigned char> ttfData;
+    unsigned char buf[65536];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), ttf)) > 0;) {
+        ttfData.insert(ttfData.end(), buf, buf + n);
+    }
+    fclose(ttf);
+    AFont font;
+    if (!font.bake(ttfData.data())) {
+        return 1;
+    }
+    ADigitReader reader;
+    reader.init(font);
+    ATimecodeReader timecodeReader;
+    const int64_t modulo = useTimecode ? TIMECODE_MODULO_US : TIMER_MODULO_US;
+    // Reads one clock from the frame, in microseconds
+    auto readClock = [&](const Frame& frame, Rect r, int64_t& us, int64_t& ptsUs) {
+        r = clampRect(r, frame.width, frame.height);
+        if (useTimecode) {
+            Timecode tc;
+            if (!timecodeReader.read(frame.luma.data(), frame.width, r, tc)) {
+                return false;
+            }
+            us = tc.renderUs;
+            ptsUs = tc.ptsUs;
+            return true;
+        }
+        int64_t ms = reader.read(frame.luma.data(), frame.width, r);
+        us = ms * 1000;
+        ptsUs = -1;
+        return ms >= 0;
+    };
+
+    Y4MReader y4m;
+    bool stream = inputs.size() == 1 && (!strcmp(inputs[0], "-") || strstr(inputs[0], ".y4m"));
+    if (stream && !y4m.open(inputs[0])) {
+        return 1;
+    }
+    if (fps <= 0) {
+        fps = y4m.fps > 0 ? y4m.fps : 30.0;
+    }
+
+    FILE* csv = csvPath ? fopen(csvPath, "w") : nullptr;
+    if (csv) {
+        fprintf(csv, hasRef ? "frame,capture_ms,timer_ms,pts_ms,ref_ms,latency_ms\n"
+                            : "frame,capture_ms,timer_ms,pts_ms,offset_ms\n");
+    }
+
+    // Without a reference the timer is compared against the capture clock, so
+    // only the variation (jitter) is meaningful, not the absolute value.
+    std::vector<double> latency, steps;
+    std::vector<int64_t> timerValues, ptsValues;
+    std::vector<double> captureTimes;
+    std::vector<int> frameIndices;
+    int64_t lastTimer = -1, unwrap = 0;
+    int frames = 0, failed = 0, repeated = 0;
+    Frame frame;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t next = 0;; frames++) {
+        if (stream ? !y4m.read(frame) : (next >= inputs.size() || !readPgm(inputs[next++], frame))) {
+            break;
+        }
+        Rect r = hasRoi ? roi : useTimecode
+                ? Rect{frame.width * 3 / 4, frame.height * 3 / 4, frame.width / 4, frame.height / 4}
+                : Rect{0, frame.height / 5, frame.width, frame.height * 3 / 10};
+        int64_t timer, pts, ref = 0, refPts;
+        double captureMs = frames * 1000.0 / fps;
+        if (!readClock(frame, r, timer, pts) || (hasRef && !readClock(frame, refRoi, ref, refPts))) {
+            failed++;
+            continue;
+        }
+        int64_t raw = timer;
+        if (lastTimer >= 0) {
+            if (timer + unwrap < lastTimer - modulo / 2) {
+                unwrap += modulo;
+            }
+            timer += unwrap;
+            if (timer == lastTimer) {
+                repeated++;
+            } else {
+                steps.push_back((timer - lastTimer) / 1000.0);
+            }
+        }
+        lastTimer = timer;
+        if (hasRef) {
+            double d = ((ref - raw) % modulo + modulo) % modulo / 1000.0;
+            latency.push_back(d);
+            if (csv) fprintf(csv, "%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", frames, captureMs, timer / 1000.0,
+                             pts / 1000.0, ref / 1000.0, d);
+        } else {
+            timerValues.push_back(timer);
+            ptsValues.push_back(pts);
+            captureTimes.push_back(captureMs);
+            frameIndices.push_back(frames);
+        }
+    }
+    if (!hasRef && !timerValues.empty()) {
+        double minOffset = timerValues[0] / 1000.0 - captureTimes[0];
+        for (size_t i = 0; i < timerValues.size(); i++) {
+            minOffset = std::min(minOffset, timerValues[i] / 1000.0 - captureTimes[i]);
+        }
+        for (size_t i = 0; i < timerValues.size(); i++) {
+            double offset = timerValues[i] / 1000.0 - captureTimes[i] - minOffset;
+            latency.push_back(offset);
+            if (csv) fprintf(csv, "%d,%.3f,%.3f,%.3f,%.3f\n", frameIndices[i], captureTimes[i],
+                             timerValues[i] / 1000.0, ptsValues[i] / 1000.0, offset);
+        }
+    }
+    if (csv) {
+        fclose(csv);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("frames %d  decoded %d  failed %d  repeated %d  capture %.2f fps\n",
+           frames, frames - failed, failed, repeated, fps);
+    summarize(hasRef ? "latency" : "relative offset", latency);
+    summarize("timer step", steps);
+    printf("processed in %.2f s, %.1f fps, %.1fx real time\n", seconds, frames / seconds,
+           seconds > 0 ? frames / fps / seconds : 0.0);
+    return failed == frames ? 1 : 0;
+}
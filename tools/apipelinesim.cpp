@@ -0,0 +1,321 @@
+//
+// Discrete-event model of aplayer's decode -> display pipeline.
+//
+#include <algorithm>
+#include <cmath>
+
+#include "apipelinesim.h"
+
+namespace {
+
+double percentile(std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    return (double)sorted[std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()))];
+}
+
+} // namespace
+
+APipelineSim::APipelineSim(const SimConfig& config)
+        : cfg(config),
+          rng(config.seed),
+          period((int64_t)llround(1e6 / config.refreshHz)),
+          timeoutUs(config.dequeueTimeoutUs > 0 ? config.dequeueTimeoutUs
+                                                 : APipeline::dequeueTimeoutUs((float)config.contentFps)),
+          stallUs(APipeline::stallTimeoutUs(timeoutUs)),
+          slots(config.maxImages + config.codecBuffers, Slot::FREE),
+          slotFrame(slots.size(), -1),
+          slotRelease(slots.size(), 0),
+          inputDepth(config.inputDepth) {
+}
+
+void APipelineSim::at(int64_t time, std::function<void()> action) {
+    events.push({time, seq++, std::move(action)});
+}
+
+int64_t APipelineSim::ptsUs(int frame) const {
+    return (int64_t)(frame * 1e6 / cfg.contentFps);
+}
+
+int64_t APipelineSim::sample(const SimDuration& d) {
+    if (d.stddevUs <= 0.0) {
+        return std::max<int64_t>(1, (int64_t)d.meanUs);
+    }
+    double sigma2 = std::log(1.0 + d.stddevUs * d.stddevUs / (d.meanUs * d.meanUs));
+    std::lognormal_distribution<double> dist(std::log(d.meanUs) - sigma2 / 2, std::sqrt(sigma2));
+    return std::max<int64_t>(1, (int64_t)dist(rng));
+}
+
+/**
+ * One pass of ADecoder::extractorLoop from the current step: dequeue an input
+ * buffer (waiting up to the timeout) while the input depth allows, read and
+ * queue a sample, dequeue an output buffer (same timeout) unless a frame waits
+ * for its time, then show, drop or keep waiting for that one.
+ */
+void APipelineSim::extractorStep() {
+    switch (extractor) {
+        case Extractor::INPUT: {
+            fed = false;
+            bool feed = APipeline::feeds(inputDepth, inFlight);
+            // The codec never drops a frame here, so nothing expires and a stall raises the depth
+            if (!feed && pendingSlot < 0 && now - lastOutput > stallUs) {
+                if (inputDepth < APipeline::MAX_INPUT_DEPTH) {
+                    inputDepth++;
+                }
+                lastOutput = now;
+                feed = true;
+            }
+            if (!feed) {
+                extractor = Extractor::OUTPUT;
+                extractorStep();
+                return;
+            }
+            if (inputsInUse < cfg.codecInputs) {
+                inputsInUse++;
+                extractor = Extractor::READING;
+                at(now + sample(cfg.readUs), [this] {
+                    pendingInputs.push_back(nextSample++);
+                    inFlight++;
+                    fed = true;
+                    extractor = Extractor::OUTPUT;
+                    codecKick();
+                    extractorStep();
+                });
+                return;
+            }
+            break;
+        }
+        case Extractor::OUTPUT:
+            if (pendingSlot < 0 && !readyOrder.empty()) {
+                dequeueOutput();
+            }
+            if (pendingSlot >= 0) {
+                extractor = Extractor::JUDGE;
+                extractorStep();
+                return;
+            }
+            break;
+        case Extractor::JUDGE:
+            judgePending();
+            return;
+        case Extractor::READING:
+            return;
+    }
+    // Block in dequeue until the codec has something or the timeout expires
+    uint64_t wait = ++waitGeneration;
+    extractorWait = wait;
+    at(now + timeoutUs, [this, wait] {
+        if (extractorWait != wait) {
+            return;
+        }
+        extractorWait = 0;
+        result.extractorTimeouts++;
+        extractor = extractor == Extractor::INPUT ? Extractor::OUTPUT : Extractor::JUDGE;
+        extractorStep();
+    });
+}
+
+// The codec freed an input buffer or finished an output, a blocked dequeue returns.
+void APipelineSim::extractorWake() {
+    if (!extractorWait) {
+        return;
+    }
+    if ((extractor == Extractor::INPUT && inputsInUse < cfg.codecInputs)
+        || (extractor == Extractor::OUTPUT && !readyOrder.empty())) {
+        extractorWait = 0;
+        at(now, [this] { extractorStep(); });
+    }
+}
+
+// dequeueOutputBuffer returned a frame, the clock starts with the first one.
+void APipelineSim::dequeueOutput() {
+    pendingSlot = readyOrder.front();
+    readyOrder.pop_front();
+    inFlight--;
+    lastOutput = now;
+    if (!clock.started()) {
+        clock.start(ptsUs(slotFrame[pendingSlot]), now * 1000);
+    }
+}
+
+// ADecoder's output judgement on the frame waiting for its time, then the next pass.
+void APipelineSim::judgePending() {
+    extractor = Extractor::INPUT;
+    int64_t next = now;
+    if (pendingSlot >= 0) {
+        int64_t pts = ptsUs(slotFrame[pendingSlot]);
+        int64_t dueNs = clock.dueNs(pts);
+        switch (trickPlay.judge(dueNs, now * 1000, (int64_t)(1e9 / cfg.contentFps), FeedMode::ALL)) {
+            case OutputAction::RESYNC:
+                clock.start(pts, now * 1000);
+                releaseOutput(true);
+                break;
+            case OutputAction::SHOW:
+                releaseOutput(true);
+                break;
+            case OutputAction::DROP:
+                releaseOutput(false);
+                break;
+            case OutputAction::WAIT:
+                // The input dequeue waited already when there was something to feed
+                if (!fed) {
+                    next = now + std::min((dueNs - now * 1000 + 999) / 1000, timeoutUs);
+                }
+                break;
+        }
+    }
+    at(next, [this] { extractorStep(); });
+}
+
+// Decodes the next queued sample once a surface buffer is free, one at a time.
+void APipelineSim::codecKick() {
+    if (decoding || pendingInputs.empty()) {
+        return;
+    }
+    auto free = std::find(slots.begin(), slots.end(), Slot::FREE);
+    if (free == slots.end()) {
+        return;
+    }
+    int slot = (int)(free - slots.begin());
+    int frame = pendingInputs.front();
+    pendingInputs.pop_front();
+    inputsInUse--;
+    slots[slot] = Slot::DECODING;
+    slotFrame[slot] = frame;
+    decoding = true;
+    extractorWake();
+    at(now + sample(frame % cfg.gop == 0 ? cfg.keyDecodeUs : cfg.decodeUs), [this, slot] {
+        slots[slot] = Slot::READY;
+        readyOrder.push_back(slot);
+        decoding = false;
+        result.decoded++;
+        extractorWake();
+        codecKick();
+    });
+}
+
+// releaseOutputBuffer: rendered, the frame goes to the ImageReader queue.
+void APipelineSim::releaseOutput(bool render) {
+    int slot = pendingSlot;
+    pendingSlot = -1;
+    if (!render) {
+        slots[slot] = Slot::FREE;
+        result.late++;
+        codecKick();
+        return;
+    }
+    slots[slot] = Slot::QUEUED;
+    slotRelease[slot] = now;
+    queuedOrder.push_back(slot);
+    released++;
+    available = true;
+    if (acquireBlocked) {
+        acquireBlocked = false;
+        at(now, [this] { acquireAndDraw(); });
+    }
+}
+
+void APipelineSim::onVsync() {
+    result.vsyncs++;
+    // The last swap that completed before this vsync is what the display shows
+    if (lastDrawnFrame >= 0) {
+        if (lastDrawnFrame == lastShownFrame) {
+            result.repeats++;
+        } else {
+            result.shown++;
+            latencies.push_back(now - lastDrawnRelease);
+            if (firstShownFrame < 0) {
+                firstShownFrame = lastDrawnFrame;
+                firstShownTime = now;
+            }
+            lastShownFrame = lastDrawnFrame;
+            lastShownTime = now;
+        }
+    }
+    if (renderBusy) {
+        // Choreographer coalesces vsyncs, the callback runs once the thread is free
+        if (pendingTick) {
+            result.missedTicks++;
+        }
+        pendingTick = true;
+    } else {
+        tick();
+    }
+    at(now + period, [this] { onVsync(); });
+}
+
+void APipelineSim::tick() {
+    renderBusy = true;
+    result.ticks++;
+    tickStart = now;
+    if (cfg.acquire == AcquirePolicy::BLOCK && !available) {
+        acquireBlocked = true;
+        return;
+    }
+    acquireAndDraw();
+}
+
+/**
+ * acquireLatestImage (older queued frames go back to the codec), then the rest
+ * of DoTick. The image is deleted once the frame is drawn.
+ */
+void APipelineSim::acquireAndDraw() {
+    acquireWaitTotal += now - tickStart;
+    int slot = -1;
+    if (!queuedOrder.empty()) {
+        slot = queuedOrder.back();
+        queuedOrder.pop_back();
+        for (int older : queuedOrder) {
+            slots[older] = Slot::FREE;
+        }
+        queuedOrder.clear();
+        slots[slot] = Slot::ACQUIRED;
+        codecKick();
+    }
+    available = false;
+    at(now + sample(cfg.drawUs), [this, slot] {
+        if (slot >= 0) {
+            lastDrawnFrame = slotFrame[slot];
+            lastDrawnRelease = slotRelease[slot];
+            slots[slot] = Slot::FREE;
+            codecKick();
+        }
+        renderBusy = false;
+        if (pendingTick) {
+            pendingTick = false;
+            tick();
+        }
+    });
+}
+
+SimResult APipelineSim::run() {
+    int64_t end = (int64_t)(cfg.seconds * 1e6);
+    at(0, [this] { extractorStep(); });
+    at(period, [this] { onVsync(); });
+    while (!events.empty() && events.top().time <= end) {
+        Event e = events.top();
+        events.pop();
+        now = e.time;
+        e.action();
+    }
+    // Frames still queued or on their way to the screen aren't drops
+    int onTheWay = (int)queuedOrder.size()
+                   + (int)std::count(slots.begin(), slots.end(), Slot::ACQUIRED)
+                   + (lastDrawnFrame != lastShownFrame ? 1 : 0);
+    result.dropped = std::max(0, released - result.shown - onTheWay) + result.late;
+    result.inputDepth = inputDepth;
+    if (lastShownTime > firstShownTime) {
+        result.speed = (lastShownFrame - firstShownFrame) / cfg.contentFps
+                       / ((lastShownTime - firstShownTime) / 1e6);
+    }
+    if (result.ticks) {
+        result.acquireWaitUs = (double)acquireWaitTotal / result.ticks;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    result.latencyP50Us = percentile(latencies, 50);
+    result.latencyP90Us = percentile(latencies, 90);
+    result.latencyP99Us = percentile(latencies, 99);
+    result.latencyMaxUs = latencies.empty() ? 0.0 : (double)latencies.back();
+    return result;
+}
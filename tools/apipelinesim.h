@@ -0,0 +1,158 @@
+//
+// Discrete-event model of aplayer's decode -> display pipeline: the extractor
+// thread loop, the codec, the ImageReader buffer queue and the vsync-driven
+// render thread. Feeding, timeouts and frame pacing are ADecoder's own
+// (APipeline, APlaybackClock, ATrickPlay), only the threads are simulated.
+//
+#ifndef APIPELINESIM_H
+#define APIPELINESIM_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "apipeline.h"
+#include "aplaybackclock.h"
+#include "atrickplay.h"
+
+// Log-normal duration in microseconds with the given mean and standard deviation
+struct SimDuration {
+    double meanUs;
+    double stddevUs;
+};
+
+enum class AcquirePolicy {
+    BLOCK,      // what Engine does today: wait in acquireLatestImage for a new frame
+    LATEST,     // take the newest frame if there is one, otherwise redraw the previous
+};
+
+struct SimConfig {
+    double refreshHz = 60.0;
+    double contentFps = 30.0;
+    double seconds = 10.0;
+    int gop = 30;                   // key frame interval
+    int maxImages = APipeline::MAX_IMAGES;
+    int codecBuffers = 2;           // surface buffers the codec holds beyond maxImages
+    int codecInputs = 4;            // input buffers
+    int64_t dequeueTimeoutUs = 0;   // 0: APipeline::dequeueTimeoutUs(contentFps), as ADecoder
+    int inputDepth = 0;             // samples in the codec, StreamSizing::queueDepth; 0 is no limit
+    SimDuration readUs{300, 200};       // AMediaExtractor_readSampleData
+    SimDuration decodeUs{4000, 1500};   // non-key frames
+    SimDuration keyDecodeUs{12000, 3000};
+    SimDuration drawUs{2500, 800};      // DoTick after the acquire, up to eglSwapBuffers
+    AcquirePolicy acquire = AcquirePolicy::BLOCK;
+    uint32_t seed = 1;
+};
+
+struct SimResult {
+    int vsyncs = 0;
+    int ticks = 0;              // Choreographer callbacks that ran
+    int missedTicks = 0;        // vsyncs without a callback, the render thread was busy
+    int decoded = 0;
+    int shown = 0;              // content frames that reached the screen
+    int dropped = 0;            // decoded, never on screen
+    int late = 0;               // of those, released without rendering, late for the clock
+    int repeats = 0;            // vsyncs that showed the same frame as the one before
+    double speed = 0.0;         // content time shown per wall time, 1.0 is real time
+    double acquireWaitUs = 0.0; // mean time a tick blocked in acquire
+    int extractorTimeouts = 0;  // dequeue calls that waited the full timeout
+    int inputDepth = 0;         // at the end, after the stall raises
+    // Codec output release to first vsync showing it
+    double latencyP50Us = 0.0;
+    double latencyP90Us = 0.0;
+    double latencyP99Us = 0.0;
+    double latencyMaxUs = 0.0;
+};
+
+/**
+ * Single run of the model, deterministic for a given config (seed included).
+ * Times are in microseconds from the start of playback.
+ */
+class APipelineSim {
+public:
+    explicit APipelineSim(const SimConfig& config);
+    SimResult run();
+
+private:
+    enum class Slot : uint8_t { FREE, DECODING, READY, QUEUED, ACQUIRED };
+
+    struct Event {
+        int64_t time;
+        uint64_t seq;
+        std::function<void()> action;
+        bool operator>(const Event& o) const { return time != o.time ? time > o.time : seq > o.seq; }
+    };
+
+    // Steps of one ADecoder::extractorLoop pass
+    enum class Extractor { INPUT, READING, OUTPUT, JUDGE };
+
+    SimConfig cfg;
+    std::mt19937 rng;
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events;
+    uint64_t seq = 0;
+    int64_t now = 0;
+    int64_t period;
+    int64_t timeoutUs;
+    int64_t stallUs;
+
+    // Surface buffers shared by codec and ImageReader
+    std::vector<Slot> slots;
+    std::vector<int> slotFrame;         // content frame in the buffer
+    std::vector<int64_t> slotRelease;   // when the codec released it
+    std::deque<int> readyOrder;         // decoded, waiting for dequeueOutputBuffer
+    std::deque<int> queuedOrder;        // released, waiting for acquire
+
+    // Codec
+    int inputsInUse = 0;                // dequeued by the extractor or waiting for decode
+    std::deque<int> pendingInputs;      // content frame numbers
+    bool decoding = false;
+    int nextSample = 0;
+
+    // Extractor thread
+    Extractor extractor = Extractor::INPUT;
+    uint64_t extractorWait = 0;         // generation of the pending timeout, 0 if not waiting
+    uint64_t waitGeneration = 0;
+    int inputDepth;
+    int inFlight = 0;                   // queued, not dequeued as output yet
+    int64_t lastOutput = 0;
+    bool fed = false;                   // this pass queued a sample
+    int pendingSlot = -1;               // dequeued, waiting for its time
+    APlaybackClock clock;
+    ATrickPlay trickPlay;
+
+    // Render thread
+    bool available = false;             // the cv flag set on release, cleared on acquire
+    bool renderBusy = false;
+    bool acquireBlocked = false;
+    int64_t tickStart = 0;
+    int64_t acquireWaitTotal = 0;
+    int lastDrawnFrame = -1;            // frame in the last completed swap
+    int64_t lastDrawnRelease = 0;
+    bool pendingTick = false;           // vsync arrived while busy, Choreographer runs it late
+    int lastShownFrame = -1;
+    int firstShownFrame = -1;
+    int64_t firstShownTime = 0;
+    int64_t lastShownTime = 0;
+    int released = 0;
+    std::vector<int64_t> latencies;
+    SimResult result;
+
+    void at(int64_t time, std::function<void()> action);
+    int64_t sample(const SimDuration& d);
+    int64_t ptsUs(int frame) const;
+
+    void extractorStep();
+    void extractorWake();
+    void codecKick();
+    void dequeueOutput();
+    void judgePending();
+    void releaseOutput(bool render);
+    void onVsync();
+    void tick();
+    void acquireAndDraw();
+};
+
+#endif //APIPELINESIM_H
@@ -0,0 +1,109 @@
+//
+// Pipeline simulator: predicts frame drops, repeats and latency of aplayer's
+// decode -> display pipeline for a content and device profile, per refresh rate.
+//
+//   apipesim --fps 30 --decode 4000,1500 --refresh 60,72,90,120
+//   apipesim --fps 60 --decode 14000,4000 --acquire latest
+//
+// Durations are in microseconds, given as mean,stddev (log-normal).
+//
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "apipelinesim.h"
+#include "util.h"
+#define LOG_TAG "apipesim"
+
+static void usage() {
+    SimConfig d;
+    fprintf(stderr,
+            "usage: apipesim [options]\n"
+            "  --refresh list   display refresh rates in Hz (default: 60,72,90,120)\n"
+            "  --fps N          content frame rate (default: %.0f)\n"
+            "  --seconds N      simulated time per run (default: %.0f)\n"
+            "  --gop N          key frame interval (default: %d)\n"
+            "  --read m,s       sample read time (default: %.0f,%.0f)\n"
+            "  --decode m,s     decode time (default: %.0f,%.0f)\n"
+            "  --key-decode m,s key frame decode time (default: %.0f,%.0f)\n"
+            "  --draw m,s       render time after the acquire (default: %.0f,%.0f)\n"
+            "  --max-images N   ImageReader maxImages (default: %d)\n"
+            "  --codec-buffers N  surface buffers held by the codec (default: %d)\n"
+            "  --timeout us     dequeue timeout (default: a quarter frame, %lld..%lld)\n"
+            "  --input-depth N  samples in the codec at once, astreaminfo's queue depth (default: no limit)\n"
+            "  --acquire block|latest  render thread policy (default: block)\n"
+            "  --seed N         random seed (default: %u)\n",
+            d.contentFps, d.seconds, d.gop, d.readUs.meanUs, d.readUs.stddevUs,
+            d.decodeUs.meanUs, d.decodeUs.stddevUs, d.keyDecodeUs.meanUs, d.keyDecodeUs.stddevUs,
+            d.drawUs.meanUs, d.drawUs.stddevUs, d.maxImages, d.codecBuffers,
+            (long long)APipeline::MIN_DEQUEUE_TIMEOUT_US, (long long)APipeline::DEQUEUE_TIMEOUT_US, d.seed);
+}
+
+static bool parseDuration(const char* s, SimDuration& d) {
+    return sscanf(s, "%lf,%lf", &d.meanUs, &d.stddevUs) == 2 && d.meanUs > 0 && d.stddevUs >= 0;
+}
+
+int main(int argc, char** argv) {
+    SimConfig cfg;
+    std::vector<double> rates = {60, 72, 90, 120};
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        bool ok = true;
+        if (!strcmp(argv[i], "--refresh") && more) {
+            rates.clear();
+            for (char* tok = strtok(argv[++i], ","); tok; tok = strtok(nullptr, ",")) {
+                rates.push_back(atof(tok));
+                ok = ok && rates.back() > 0;
+            }
+        } else if (!strcmp(argv[i], "--fps") && more) {
+            ok = (cfg.contentFps = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--seconds") && more) {
+            ok = (cfg.seconds = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--gop") && more) {
+            ok = (cfg.gop = atoi(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--read") && more) {
+            ok = parseDuration(argv[++i], cfg.readUs);
+        } else if (!strcmp(argv[i], "--decode") && more) {
+            ok = parseDuration(argv[++i], cfg.decodeUs);
+        } else if (!strcmp(argv[i], "--key-decode") && more) {
+            ok = parseDuration(argv[++i], cfg.keyDecodeUs);
+        } else if (!strcmp(argv[i], "--draw") && more) {
+            ok = parseDuration(argv[++i], cfg.drawUs);
+        } else if (!strcmp(argv[i], "--max-images") && more) {
+            ok = (cfg.maxImages = atoi(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--codec-buffers") && more) {
+            ok = (cfg.codecBuffers = atoi(argv[++i])) >= 0;
+        } else if (!strcmp(argv[i], "--timeout") && more) {
+            ok = (cfg.dequeueTimeoutUs = atoll(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--input-depth") && more) {
+            cfg.inputDepth = atoi(argv[++i]);
+            ok = cfg.inputDepth >= 0 && cfg.inputDepth <= APipeline::MAX_INPUT_DEPTH;
+        } else if (!strcmp(argv[i], "--acquire") && more) {
+            const char* policy = argv[++i];
+            ok = !strcmp(policy, "block") || !strcmp(policy, "latest");
+            cfg.acquire = !strcmp(policy, "latest") ? AcquirePolicy::LATEST : AcquirePolicy::BLOCK;
+        } else if (!strcmp(argv[i], "--seed") && more) {
+            cfg.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage();
+            return 2;
+        }
+    }
+
+    printf("%6s %6s %6s %7s %6s %6s %6s %7s %6s %8s %8s %8s %8s %8s %5s\n",
+           "Hz", "ticks", "missed", "decoded", "shown", "drop", "late", "repeat", "speed",
+           "lat50ms", "lat99ms", "latmax", "acq ms", "timeouts", "depth");
+    for (double hz : rates) {
+        cfg.refreshHz = hz;
+        SimResult r = APipelineSim(cfg).run();
+        printf("%6.0f %6d %6d %7d %6d %6d %6d %7d %6.3f %8.2f %8.2f %8.2f %8.2f %8d %5d\n",
+               hz, r.ticks, r.missedTicks, r.decoded, r.shown, r.dropped, r.late, r.repeats, r.speed,
+               r.latencyP50Us / 1000, r.latencyP99Us / 1000, r.latencyMaxUs / 1000,
+               r.acquireWaitUs / 1000, r.extractorTimeouts, r.inputDepth);
+    }
+    return 0;
+}
@@ -0,0 +1,458 @@
+//
+// Microbenchmarks for the render loop hot paths, thumbnail scaling and the capture-side
+// timecode reader (Google Benchmark).
+//
+//   aplayer_bench --benchmark_out=after.json --benchmark_out_format=json
+//   compare.py benchmarks before.json after.json    (from Google Benchmark's tools/)
+//
+// Every benchmark reports allocs/iter: heap allocations (malloc, new) per iteration.
+//
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "afont.h"
+#include "aframegraph.h"
+#include "aimagescale.h"
+#include "aoverlay.h"
+#include "aring.h"
+#include "atimecode.h"
+#include "atimecodereader.h"
+#include "util.h"
+#define LOG_TAG "aplayer_bench"
+
+#ifndef APLAYER_BENCH_FONT
+#define APLAYER_BENCH_FONT "Roboto-Regular.ttf"
+#endif
+
+static std::atomic<uint64_t> allocations{0};
+
+// Counts every heap allocation, operator new and the C code (stb_truetype) alike,
+// by interposing glibc's malloc family.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+    __libc_free(p);
+}
+}
+
+namespace {
+
+/**
+ * Counts allocations from construction to report(), which sets the allocs/iter counter.
+ */
+class AllocCounter {
+public:
+    AllocCounter() : start(allocations.load(std::memory_order_relaxed)) {}
+
+    void report(benchmark::State& state) const {
+        state.counters["allocs/iter"] = benchmark::Counter(
+                (double)(allocations.load(std::memory_order_relaxed) - start),
+                benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    uint64_t start;
+};
+
+const std::vector<unsigned char>& fontFile() {
+    static std::vector<unsigned char> data = [] {
+        std::vector<unsigned char> out;
+        FILE* f = fopen(APLAYER_BENCH_FONT, "rb");
+        if (!f) {
+            fatal(LOG_TAG, "Failed to open font %s", APLAYER_BENCH_FONT);
+        }
+        unsigned char buf[65536];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+            out.insert(out.end(), buf, buf + n);
+        }
+        fclose(f);
+        return out;
+    }();
+    return data;
+}
+
+AFont& font() {
+    static AFont* font = [] {
+        auto* f = new AFont();
+        if (!f->bake(fontFile().data())) {
+            fatal(LOG_TAG, "Failed to bake font");
+        }
+        return f;
+    }();
+    return *font;
+}
+
+// Scale factors Engine::Resize uses for a 1920x1080 window
+const float SCALE_X = 0.0042f;
+const float SCALE_Y = 0.0063f;
+
+void BM_BuildTextQuads(benchmark::State& state) {
+    std::string text(state.range(0), '0');
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = '0' + i % 10;
+    }
+    AFont& f = font();
+    AllocCounter allocs;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.buildTextQuads(text.c_str(), SCALE_X, SCALE_Y, 0.0f));
+    }
+    allocs.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BuildTextQuads)->Arg(1)->Arg(5)->Arg(16)->Arg(64);
+
+// The TrueType rasterization part of AFont::init
+void BM_AtlasBake(benchmark::State& state) {
+    const unsigned char* ttf = fontFile().data();
+    AllocCounter allocs;
+    for (auto _ : state) {
+        AFont f;
+        benchmark::DoNotOptimize(f.bake(ttf));
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_AtlasBake)->Unit(benchmark::kMillisecond);
+
+// The millisecond timer text, as Engine::RenderFrame formats it
+void BM_TimerText(benchmark::State& state) {
+    int64_t ms = 1234567;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        std::string s = std::to_string(ms++ % 100000);
+        benchmark::DoNotOptimize(s.c_str());
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_TimerText);
+
+// The once-per-second fps text
+void BM_FpsText(benchmark::State& state) {
+    float fps = 119.7f;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        std::string s = std::to_string((int)fps) + " fps";
+        benchmark::DoNotOptimize(s.c_str());
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_FpsText);
+
+// Overlay assembly of one frame: timer, fps, frame graph, optionally the timecode.
+// Also reports what ADisplay gets to draw from it.
+void BM_OverlayFrame(benchmark::State& state) {
+    bool timecode = state.range(0) != 0;
+    AFont& f = font();
+    AOverlay overlay;
+    overlay.setWhiteTexel(f.whiteU, f.whiteV);
+    overlay.setPixelSize(2.0f / 1920, 2.0f / 1080);
+    AFrameGraph graph;
+    std::vector<Vertex> fps = f.buildTextQuads("120 fps", SCALE_X * 0.5f, SCALE_Y * 0.5f, -0.4f);
+    int64_t ms = 0;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        overlay.begin();
+        overlay.addText(f.buildTextQuads(std::to_string(ms++ % 100000).c_str(), SCALE_X, SCALE_Y, 0.0f),
+                        0xffffffff);
+        overlay.addText(fps, 0xffffffff);
+        graph.push({8.3f, 20.0f + ms % 7, 0});
+        graph.build(overlay, -0.95f, -0.95f, -0.35f, -0.55f);
+        if (timecode) {
+            ATimecode::build(overlay, {(uint32_t)ms * 1000, (uint32_t)ms * 997});
+        }
+        benchmark::DoNotOptimize(overlay.finish().data());
+    }
+    allocs.report(state);
+    auto stats = overlay.stats();
+    state.counters["items"] = stats.items;
+    state.counters["vertices"] = stats.vertices;
+    // The overlay is one glDrawArrays regardless of items
+    state.counters["drawCalls"] = 1;
+}
+BENCHMARK(BM_OverlayFrame)->ArgName("timecode")->Arg(0)->Arg(1);
+
+// The frame-time graph alone with a full history, a sample in and the graph out per
+// frame as RenderFrame does. Budget: well under 0.1 ms.
+void BM_FrameGraph(benchmark::State& state) {
+    AFont& f = font();
+    AOverlay overlay;
+    overlay.setWhiteTexel(f.whiteU, f.whiteV);
+    overlay.setPixelSize(2.0f / 1920, 2.0f / 1080);
+    AFrameGraph graph;
+    int n = 0;
+    for (int i = 0; i < AFrameGraph::HISTORY; i++) {
+        graph.push({16.7f, 30.0f, 0});
+    }
+    AllocCounter allocs;
+    for (auto _ : state) {
+        n++;
+        // A missed vsync and a skipped frame now and then, so markers are drawn
+        graph.push({n % 50 ? 16.7f : 33.3f, 28.0f + n % 5, (uint16_t)(n % 70 == 0)});
+        overlay.begin();
+        graph.build(overlay, -0.95f, -0.95f, -0.35f, -0.55f);
+        benchmark::DoNotOptimize(overlay.finish().data());
+    }
+    allocs.report(state);
+    state.counters["vertices"] = overlay.stats().vertices;
+}
+BENCHMARK(BM_FrameGraph)->Unit(benchmark::kMicrosecond);
+
+// Overlay assembly by complexity: rects, lines and labels over all layers, submitted
+// out of layer order. Still one draw call; vertices are what ADisplay gets to draw,
+// padding included.
+void BM_OverlayItems(benchmark::State& state) {
+    int count = (int)state.range(0);
+    AFont& f = font();
+    AOverlay overlay;
+    overlay.setWhiteTexel(f.whiteU, f.whiteV);
+    overlay.setPixelSize(2.0f / 1920, 2.0f / 1080);
+    std::vector<Vertex> label = f.buildTextQuads("42", SCALE_X * 0.25f, SCALE_Y * 0.25f, 0.0f);
+    AllocCounter allocs;
+    for (auto _ : state) {
+        overlay.begin();
+        for (int i = 0; i < count; i++) {
+            int layer = (i * 3) % AOverlay::LAYERS;
+            float x = (i % 64) / 32.0f - 1.0f;
+            float y = (i / 64 % 64) / 32.0f - 1.0f;
+            switch (i % 3) {
+                case 0:
+                    overlay.addRect(x, y, x + 0.02f, y + 0.02f, 0x20202080, layer);
+                    break;
+                case 1:
+                    overlay.addLine(x, y, x + 0.03f, y + 0.01f, 2.0f, 0xff0000ff, layer);
+                    break;
+                default:
+                    overlay.addText(label, 0xffffffff, layer);
+                    break;
+            }
+        }
+        benchmark::DoNotOptimize(overlay.finish().data());
+    }
+    allocs.report(state);
+    state.counters["items"] = overlay.stats().items;
+    state.counters["vertices"] = (double)overlay.vertices().size();
+    state.counters["drawCalls"] = overlay.vertices().empty() ? 0 : 1;
+    state.SetComplexityN(count);
+}
+BENCHMARK(BM_OverlayItems)->RangeMultiplier(4)->Range(16, 4096)->Complexity();
+
+/**
+ * Round trip of the ADecoder handoff: extractorLoop sets available under the
+ * mutex and notifies, acquireLatestImage waits for it. The producer waits for
+ * the consumer before the next frame, so one iteration is one wakeup each way.
+ */
+void BM_FrameHandoff(benchmark::State& state) {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable consumed;
+    bool available = false;
+    bool run = true;
+    std::thread producer([&] {
+        std::unique_lock lk(mtx);
+        while (run) {
+            available = true;
+            cv.notify_one();
+            consumed.wait(lk, [&] { return !available || !run; });
+        }
+    });
+    AllocCounter allocs;
+    for (auto _ : state) {
+        std::unique_lock lk(mtx);
+        cv.wait(lk, [&] { return available; });
+        available = false;
+        consumed.notify_one();
+    }
+    allocs.report(state);
+    {
+        std::lock_guard lk(mtx);
+        run = false;
+    }
+    consumed.notify_one();
+    producer.join();
+}
+BENCHMARK(BM_FrameHandoff)->UseRealTime();
+
+// Release timestamps through ARing, as ADecoder hands them to the render thread
+void BM_ReleaseRing(benchmark::State& state) {
+    ARing<int64_t, 32> ring;
+    int64_t v = 0;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        ring.push(v++);
+        int64_t out;
+        ring.pop(out);
+        benchmark::DoNotOptimize(out);
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_ReleaseRing);
+
+// Per-frame log line, asynchronous (alog.h). The writer's output goes to /dev/null.
+void BM_LogAsync(benchmark::State& state) {
+    // One ring's worth between drains, so every timed call takes the enqueue path
+    // and none the full-ring drop
+    const size_t SITES = ALog::THREAD_RECORDS;
+    auto sites = std::make_unique<ALog::Site[]>(SITES);
+    fflush(stderr);
+    int savedStderr = dup(STDERR_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+    size_t i = 0;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        // A fresh site each call so the rate limit never kicks in
+        ALog::write(sites[i % SITES], ANDROID_LOG_INFO, LOG_TAG, "frame %d took %.2f ms on %s",
+                    (int)i, 1.5, "render");
+        i++;
+        if (i % SITES == 0) {
+            // The ring is full now: drain it and start over with unused sites
+            state.PauseTiming();
+            ALog::flush();
+            sites = std::make_unique<ALog::Site[]>(SITES);
+            state.ResumeTiming();
+        }
+    }
+    allocs.report(state);
+    ALog::flush();
+    fflush(stderr);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+    close(devNull);
+}
+BENCHMARK(BM_LogAsync);
+
+// What formatting the same line synchronously costs, without the logd write
+void BM_LogFormatSync(benchmark::State& state) {
+    char buf[256];
+    int i = 0;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        snprintf(buf, sizeof(buf), "frame %d took %.2f ms on %s", i++, 1.5, "render");
+        benchmark::DoNotOptimize(buf);
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_LogFormatSync);
+
+// A 1080p luma plane with some texture, row stride padded like a codec's
+std::vector<uint8_t> testPlane(int width, int height, int stride) {
+    std::vector<uint8_t> plane((size_t)stride * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            plane[(size_t)y * stride + x] = (uint8_t)(x * 7 + y * 13 + (x * y >> 5));
+        }
+    }
+    return plane;
+}
+
+// One 2x2 halving of a 1080p plane, arg 1 the vector path (AImageScale::simd()), 0 scalar
+void BM_HalvePlane(benchmark::State& state) {
+    const int W = 1920, H = 1080, STRIDE = 2048;
+    auto src = testPlane(W, H, STRIDE);
+    std::vector<uint8_t> dst((size_t)W / 2 * H / 2);
+    bool vector = state.range(0) != 0;
+    AllocCounter allocs;
+    for (auto _ : state) {
+        if (vector) {
+            AImageScale::halve(src.data(), W, H, STRIDE, dst.data(), W / 2);
+        } else {
+            AImageScale::halveScalar(src.data(), W, H, STRIDE, dst.data(), W / 2);
+        }
+        benchmark::DoNotOptimize(dst.data());
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * W * H);
+    state.SetLabel(vector && !AImageScale::simd() ? "no SIMD in this build" : "");
+}
+BENCHMARK(BM_HalvePlane)->ArgName("simd")->Arg(0)->Arg(1);
+
+// One 160x90 thumbnail from a 1080p NV12 picture, as AThumbnailer scales them
+void BM_ScaleThumbnail(benchmark::State& state) {
+    const int W = 1920, H = 1080, STRIDE = 2048;
+    auto luma = testPlane(W, H, STRIDE);
+    auto chroma = testPlane(W, H / 2, STRIDE);
+    std::vector<uint8_t> thumb(160 * 90 * 3 / 2);
+    std::vector<uint8_t> scratch;
+    AImageScale::scale({luma.data(), W, H, STRIDE}, thumb.data(), 160, 90, scratch);
+    AllocCounter allocs;
+    for (auto _ : state) {
+        AImageScale::scale({luma.data(), W, H, STRIDE}, thumb.data(), 160, 90, scratch);
+        AImageScale::scale({chroma.data(), W / 2, H / 2, STRIDE, 2}, thumb.data() + 160 * 90, 80, 45, scratch);
+        AImageScale::scale({chroma.data() + 1, W / 2, H / 2, STRIDE, 2}, thumb.data() + 160 * 90 * 5 / 4,
+                           80, 45, scratch);
+        benchmark::DoNotOptimize(thumb.data());
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_ScaleThumbnail)->Unit(benchmark::kMicrosecond);
+
+// Reading the timecode out of a captured 1080p frame, cells of range(0) pixels in the
+// bottom-right corner as the app draws them. alatency runs it on every frame.
+void BM_TimecodeRead(benchmark::State& state) {
+    const int W = 1920, H = 1080;
+    const int cell = (int)state.range(0);
+    std::vector<uint8_t> luma((size_t)W * H, 16);
+    uint8_t bits[ATimecode::BITS];
+    ATimecode::encode({123456789, 33366}, bits);
+    // Quiet zone (already black), ring, data cells
+    int x0 = W - (ATimecode::COLS + 1) * cell, y0 = H - (ATimecode::ROWS + 1) * cell;
+    for (int r = 0; r < ATimecode::ROWS; r++) {
+        for (int c = 0; c < ATimecode::COLS; c++) {
+            bool ring = r == 0 || c == 0 || r == ATimecode::ROWS - 1 || c == ATimecode::COLS - 1;
+            if (ring || bits[(r - 1) * ATimecode::DATA_COLS + c - 1]) {
+                for (int y = 0; y < cell; y++) {
+                    memset(&luma[(size_t)(y0 + r * cell + y) * W + x0 + c * cell], 235, cell);
+                }
+            }
+        }
+    }
+    int rw = (ATimecode::COLS + 2) * cell + 8, rh = (ATimecode::ROWS + 2) * cell + 8;
+    Rect roi{W - rw, H - rh, rw, rh};
+    ATimecodeReader reader;
+    Timecode tc{};
+    if (!reader.read(luma.data(), W, roi, tc) || tc.renderUs != 123456789) {
+        state.SkipWithError("timecode not read back");
+        return;
+    }
+    AllocCounter allocs;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reader.read(luma.data(), W, roi, tc));
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_TimecodeRead)->ArgName("cell")->Arg(4)->Arg(16)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,105 @@
+//
+// Parameter sets of an H.264/HEVC elementary stream (Annex-B) and the decoder
+// pipeline sizing aplayer derives from them.
+//
+//   astreaminfo clip.h264
+//   astreaminfo --codec hevc --fps 59.94 --target 33 clip.bin
+//
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+
+#include "aparamsets.h"
+
+static void usage() {
+    fprintf(stderr,
+            "usage: astreaminfo [options] stream\n"
+            "  --codec avc|hevc  stream type (default: from the extension, .h264/.264/.avc or .h265/.265/.hevc)\n"
+            "  --fps N           content frame rate (default: from the VUI, else 30)\n"
+            "  --target ms       latency target to check the output delay against (default: 50)\n");
+}
+
+static VideoCodec codecForPath(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (!ext) return VideoCodec::UNKNOWN;
+    for (const char* e : {".h264", ".264", ".avc", ".jsv"}) {
+        if (!strcasecmp(ext, e)) return VideoCodec::AVC;
+    }
+    for (const char* e : {".h265", ".265", ".hevc", ".bit"}) {
+        if (!strcasecmp(ext, e)) return VideoCodec::HEVC;
+    }
+    return VideoCodec::UNKNOWN;
+}
+
+int main(int argc, char** argv) {
+    VideoCodec codec = VideoCodec::UNKNOWN;
+    float fps = 0.0f;
+    float targetMs = 50.0f;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--codec") && more) {
+            i++;
+            codec = !strcmp(argv[i], "avc") ? VideoCodec::AVC
+                    : !strcmp(argv[i], "hevc") ? VideoCodec::HEVC : VideoCodec::UNKNOWN;
+        } else if (!strcmp(argv[i], "--fps") && more) {
+            fps = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--target") && more) {
+            targetMs = (float)atof(argv[++i]);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!path) {
+        usage();
+        return 2;
+    }
+    if (codec == VideoCodec::UNKNOWN) {
+        codec = codecForPath(path);
+    }
+    if (codec == VideoCodec::UNKNOWN) {
+        fprintf(stderr, "astreaminfo: can't tell the codec of %s, use --codec\n", path);
+        return 2;
+    }
+
+    // Parameter sets come first, the head of the stream is enough
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> data(1 << 20);
+    data.resize(fread(data.data(), 1, data.size(), f));
+    fclose(f);
+
+    StreamParams p{};
+    if (!AParamSets::parse(codec, data.data(), data.size(), p)) {
+        fprintf(stderr, "astreaminfo: no readable %s in %s\n", codec == VideoCodec::AVC ? "SPS" : "SPS/VPS", path);
+        return 1;
+    }
+    StreamSizing s = AParamSets::sizing(p, fps);
+    printf("codec          %s\n", codec == VideoCodec::AVC ? "avc" : "hevc");
+    printf("profile/level  %d / %d\n", p.profile, p.level);
+    printf("size           %dx%d, chroma_format %d, %d-bit\n", p.width, p.height, p.chromaFormat, p.bitDepth);
+    if (p.vuiFps > 0.0f) {
+        printf("vui fps        %.3f\n", p.vuiFps);
+    }
+    printf("reorder        %d (%s)\n", p.maxNumReorderFrames, p.reorderSignaled ? "signaled" : "inferred");
+    printf("dpb            %d\n", p.maxDecFrameBuffering);
+    if (p.maxLatencyPictures > 0) {
+        printf("max latency    %d pictures\n", p.maxLatencyPictures);
+    }
+    printf("output delay   %d frames, %.1f ms\n", s.outputDelayFrames, s.outputDelayMs);
+    printf("queue depth    %d\n", s.queueDepth);
+    printf("max sample     %lld bytes\n", (long long)s.maxSampleBytes);
+    if (s.outputDelayMs > targetMs) {
+        printf("warning        output delay exceeds the %.0f ms target\n", targetMs);
+        return 3;
+    }
+    return 0;
+}
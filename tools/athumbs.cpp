@@ -0,0 +1,102 @@
+//
+// Thumbnail strip cache files (AThumbCache): what a strip holds, and a contact
+// sheet of it.
+//
+//   adb pull /data/data/com.i8i.aplayer/files/thumbs
+//   athumbs thumbs/0123456789abcdef.thm --sheet strip.ppm
+//
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "athumbcache.h"
+
+static void usage() {
+    fprintf(stderr,
+            "usage: athumbs [options] file.thm...\n"
+            "  --sheet out.ppm   writes the thumbnails of the (single) file side by side, 8 per row\n");
+}
+
+static uint8_t clamp255(int v) {
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// BT.601 limited range, what most of the videos are
+static bool writeSheet(const char* out, const Thumbnails& t) {
+    const int PER_ROW = 8;
+    int columns = t.count() < PER_ROW ? t.count() : PER_ROW;
+    int rows = (t.count() + PER_ROW - 1) / PER_ROW;
+    int sheetW = columns * t.width;
+    int sheetH = rows * t.height;
+    std::vector<uint8_t> rgb((size_t)sheetW * sheetH * 3);
+    for (int i = 0; i < t.count(); i++) {
+        const uint8_t* y = t.frame(i);
+        const uint8_t* u = y + t.width * t.height;
+        const uint8_t* v = u + t.width * t.height / 4;
+        int ox = (i % PER_ROW) * t.width;
+        int oy = (i / PER_ROW) * t.height;
+        for (int row = 0; row < t.height; row++) {
+            for (int col = 0; col < t.width; col++) {
+                int c = 298 * (y[row * t.width + col] - 16);
+                int d = u[(row / 2) * (t.width / 2) + col / 2] - 128;
+                int e = v[(row / 2) * (t.width / 2) + col / 2] - 128;
+                uint8_t* p = &rgb[((size_t)(oy + row) * sheetW + ox + col) * 3];
+                p[0] = clamp255((c + 409 * e + 128) >> 8);
+                p[1] = clamp255((c - 100 * d - 208 * e + 128) >> 8);
+                p[2] = clamp255((c + 516 * d + 128) >> 8);
+            }
+        }
+    }
+    FILE* f = fopen(out, "wb");
+    if (!f) {
+        perror(out);
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", sheetW, sheetH);
+    bool ok = fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    const char* sheet = nullptr;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--sheet") && i + 1 < argc) {
+            sheet = argv[++i];
+        } else if (argv[i][0] != '-') {
+            files.push_back(argv[i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (files.empty() || (sheet && files.size() != 1)) {
+        usage();
+        return 2;
+    }
+
+    int rc = 0;
+    for (const char* file : files) {
+        ThumbSource source;
+        Thumbnails thumbs;
+        if (!AThumbCache::read(file, source, thumbs)) {
+            fprintf(stderr, "athumbs: %s is not a version %u thumbnail file\n", file, AThumbCache::VERSION);
+            rc = 1;
+            continue;
+        }
+        printf("%s: %s\n", file, source.path.c_str());
+        printf("  video mtime %lld.%09lld, %lld bytes\n", (long long)(source.mtimeNs / 1000000000),
+               (long long)(source.mtimeNs % 1000000000), (long long)source.size);
+        printf("  %d thumbnails %dx%d, %zu bytes of pixels\n", thumbs.count(), thumbs.width, thumbs.height,
+               thumbs.pixels.size());
+        printf("  pts (ms):");
+        for (int64_t pts : thumbs.ptsUs) {
+            printf(" %lld", (long long)(pts / 1000));
+        }
+        printf("\n");
+        if (sheet && thumbs.count() > 0 && !writeSheet(sheet, thumbs)) {
+            rc = 1;
+        }
+    }
+    return rc;
+}
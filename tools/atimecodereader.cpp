@@ -0,0 +1,97 @@
+//
+// Host-side reader for the ATimecode block code in captured frames.
+//
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "atimecodereader.h"
+
+ATimecodeReader::ATimecodeReader() :
+    mask(nullptr),
+    maskSize(0) {
+}
+
+ATimecodeReader::~ATimecodeReader() {
+    free(mask);
+}
+
+bool ATimecodeReader::read(const uint8_t* luma, int stride, Rect roi, Timecode& tc) {
+    if (roi.w < ATimecode::COLS * 2 || roi.h < ATimecode::ROWS * 2) {
+        return false;
+    }
+    if (maskSize < roi.w * roi.h) {
+        maskSize = roi.w * roi.h;
+        mask = (uint8_t*)realloc(mask, maskSize);
+    }
+
+    // The code is pure black and white, a midpoint threshold is enough.
+    uint8_t lo = 255, hi = 0;
+    for (int y = 0; y < roi.h; y += 2) {
+        const uint8_t* row = luma + (size_t)(roi.y + y) * stride + roi.x;
+        for (int x = 0; x < roi.w; x += 2) {
+            lo = std::min(lo, row[x]);
+            hi = std::max(hi, row[x]);
+        }
+    }
+    if (hi - lo < 64) {
+        return false;
+    }
+    uint8_t threshold = (lo + hi) / 2;
+
+    // Bounding box of the bright pixels is the white ring
+    int left = roi.w, right = -1, top = -1, bottom = -1;
+    for (int y = 0; y < roi.h; y++) {
+        uint8_t* m = mask + y * roi.w;
+        binarize(luma + (size_t)(roi.y + y) * stride + roi.x, m, roi.w, threshold);
+        auto first = (uint8_t*)memchr(m, 255, roi.w);
+        if (!first) {
+            continue;
+        }
+        auto last = (uint8_t*)memrchr(m, 255, roi.w);
+        left = std::min(left, (int)(first - m));
+        right = std::max(right, (int)(last - m));
+        if (top < 0) top = y;
+        bottom = y;
+    }
+    if (right < 0) {
+        return false;
+    }
+    float cw = (right - left + 1) / (float)ATimecode::COLS;
+    float ch = (bottom - top + 1) / (float)ATimecode::ROWS;
+    if (cw < 2.0f || ch < 2.0f) {
+        return false;
+    }
+
+    // Majority of the 3x3 pixels around a cell center. Cells under 3 pixels have no
+    // such window inside them, the center pixel alone decides. The window is kept
+    // inside the roi either way.
+    int radius = cw >= 3.0f && ch >= 3.0f ? 1 : 0;
+    int majority = (2 * radius + 1) * (2 * radius + 1) / 2 + 1;
+    auto cell = [&](int col, int row) {
+        int cx = left + (int)((col + 0.5f) * cw);
+        int cy = top + (int)((row + 0.5f) * ch);
+        int votes = 0;
+        for (int dy = -radius; dy <= radius; dy++) {
+            int y = std::clamp(cy + dy, 0, roi.h - 1);
+            for (int dx = -radius; dx <= radius; dx++) {
+                votes += mask[y * roi.w + std::clamp(cx + dx, 0, roi.w - 1)] != 0;
+            }
+        }
+        return votes >= majority ? 1 : 0;
+    };
+
+    // The ring must be white, otherwise the box isn't the code.
+    for (int c = 0; c < ATimecode::COLS; c++) {
+        if (!cell(c, 0) || !cell(c, ATimecode::ROWS - 1)) return false;
+    }
+    for (int r = 1; r < ATimecode::ROWS - 1; r++) {
+        if (!cell(0, r) || !cell(ATimecode::COLS - 1, r)) return false;
+    }
+
+    uint8_t bits[ATimecode::BITS];
+    for (int i = 0; i < ATimecode::BITS; i++) {
+        bits[i] = cell(1 + i % ATimecode::DATA_COLS, 1 + i / ATimecode::DATA_COLS);
+    }
+    return ATimecode::decode(bits, tc);
+}
@@ -0,0 +1,27 @@
+//
+// Host-side reader for the ATimecode block code in captured frames.
+//
+#ifndef ATIMECODEREADER_H
+#define ATIMECODEREADER_H
+
+#include <cstdint>
+
+#include "adigits.h"
+#include "atimecode.h"
+
+class ATimecodeReader {
+public:
+    ATimecodeReader();
+    ~ATimecodeReader();
+
+    // Finds the code inside roi of an 8-bit luma plane. The roi should only
+    // contain the code and its quiet zone (plus dark surroundings); the screen
+    // corner the app draws it into works for screen recordings.
+    bool read(const uint8_t* luma, int stride, Rect roi, Timecode& tc);
+
+private:
+    uint8_t* mask;
+    int maskSize;
+};
+
+#endif //ATIMECODEREADER_H
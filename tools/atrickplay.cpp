@@ -0,0 +1,340 @@
+//
+// Trick play check: runs aplayer's playback clock and sample selection over a
+// synthetic stream index at each playback rate, with a serial decoder of fixed
+// cost. Reports the decode load per rate and verifies the frames it shows.
+// Negative rates play backwards through the GOP index and frame cache, and
+// report the cache hit rate and the time to fetch each frame.
+//
+//   atrickplay --fps 30 --gop 60 --decode 4000 --key-decode 9000
+//   atrickplay --fps 60 --gop 120 --sync-only 2 --speeds 1,2,4,16
+//   atrickplay --gop 120 --cache 32 --speeds -1,-2,-8
+//
+// Exits with 1 when a rate doesn't hold: media time off the requested rate by
+// more than 10%, a shown frame going against the direction of play, or a
+// non-sync frame shown while feeding sync samples only.
+//
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "aframecache.h"
+#include "agopindex.h"
+#include "ahistogram.h"
+#include "aplaybackclock.h"
+#include "atrickplay.h"
+
+struct Index {
+    float fps;
+    int gop;
+    int frames;
+
+    int64_t ptsUs(int i) const { return (int64_t)(i * 1e6 / fps); }
+    bool sync(int i) const { return i % gop == 0; }
+    // Last frame at or before us
+    int frameAt(int64_t us) const {
+        int i = (int)(us * (double)fps / 1e6);
+        while (i + 1 < frames && ptsUs(i + 1) <= us) i++;
+        while (i > 0 && ptsUs(i) > us) i--;
+        return i;
+    }
+    // First sync sample at or after ptsUs (AMEDIAEXTRACTOR_SEEK_NEXT_SYNC), frames when none
+    int nextSync(int64_t ptsUs) const {
+        int i = (int)ceil(ptsUs * (double)fps / 1e6);
+        i = (i + gop - 1) / gop * gop;
+        return i < frames ? i : frames;
+    }
+};
+
+struct Result {
+    FeedMode mode;
+    int fed = 0;
+    int shown = 0;
+    int dropped = 0;
+    int resyncs = 0;
+    int64_t busyNs = 0;
+    int64_t mediaUs = 0;      // media time covered by shown frames, loops included
+    int64_t maxGapNs = 0;     // longest wall time between two shown frames
+    int maxStep = 0;          // most frames skipped between two shown frames
+    bool backwards = false;
+    bool nonSync = false;
+    // Reverse only
+    int hits = 0;
+    int misses = 0;
+    AHistogram fetchUs;
+};
+
+static Result run(const Index& index, float rate, float syncOnlyRate, double seconds,
+                  int64_t decodeNs, int64_t keyDecodeNs) {
+    APlaybackClock clock;
+    ATrickPlay trickPlay;
+    trickPlay.setSyncOnlyRate(syncOnlyRate);
+    clock.setRate(rate, 0);
+    Result r;
+    r.mode = trickPlay.mode(rate);
+    int64_t frameNs = (int64_t)(1e9 / (index.fps * rate));
+    int64_t endNs = (int64_t)(seconds * 1e9);
+    int64_t now = 0;
+    int64_t lastShownNs = -1;
+    int lastShown = -1;
+    int next = 0;
+
+    while (now < endNs) {
+        if (next >= index.frames) {
+            // End of stream, loop with the clock restarting at the first frame
+            next = 0;
+            lastShown = -1;
+            clock.reset();
+        }
+        // Decode the next sample, the decoder doesn't take another while one waits
+        int i = next;
+        int64_t cost = index.sync(i) ? keyDecodeNs : decodeNs;
+        now += cost;
+        r.busyNs += cost;
+        r.fed++;
+        if (r.mode == FeedMode::SYNC_ONLY) {
+            trickPlay.measuredDecode(cost / 1000);
+            int64_t mediaUs = clock.started() ? clock.mediaUs(now) : index.ptsUs(i);
+            next = index.nextSync(trickPlay.nextSyncTarget(mediaUs, rate, index.ptsUs(i)));
+        } else {
+            next = i + 1;
+        }
+
+        if (!clock.started()) {
+            clock.start(index.ptsUs(i), now);
+        }
+        int64_t dueNs = clock.dueNs(index.ptsUs(i));
+        OutputAction action = trickPlay.judge(dueNs, now, frameNs, r.mode);
+        if (action == OutputAction::WAIT) {
+            now = dueNs;
+            action = OutputAction::SHOW;
+        } else if (action == OutputAction::RESYNC) {
+            clock.start(index.ptsUs(i), now);
+            r.resyncs++;
+            action = OutputAction::SHOW;
+        }
+        if (action == OutputAction::DROP) {
+            r.dropped++;
+            continue;
+        }
+        r.shown++;
+        if (r.mode == FeedMode::SYNC_ONLY && !index.sync(i)) {
+            r.nonSync = true;
+        }
+        if (lastShown >= 0) {
+            if (i <= lastShown) {
+                r.backwards = true;
+            } else {
+                r.mediaUs += index.ptsUs(i) - index.ptsUs(lastShown);
+                r.maxStep = i - lastShown > r.maxStep ? i - lastShown : r.maxStep;
+            }
+        }
+        if (lastShownNs >= 0 && now - lastShownNs > r.maxGapNs) {
+            r.maxGapNs = now - lastShownNs;
+        }
+        lastShown = i;
+        lastShownNs = now;
+    }
+    return r;
+}
+
+// Same selection as ADecoder::cachedPass: the frame before the clock from the
+// cache, decoding its GOP on a miss; sync samples only above the threshold
+static Result runReverse(const Index& index, float rate, float syncOnlyRate, double seconds,
+                         int64_t decodeNs, int64_t keyDecodeNs, int cacheFrames) {
+    APlaybackClock clock;
+    ATrickPlay trickPlay;
+    trickPlay.setSyncOnlyRate(syncOnlyRate);
+    AGopIndex gops;
+    AFrameCache<int> cache;
+    cache.setCapacity(cacheFrames);
+    Result r;
+    r.mode = trickPlay.mode(rate);
+    int64_t endNs = (int64_t)(seconds * 1e9);
+    int64_t now = 0;
+    int64_t lastShownNs = -1;
+    int lastShown = index.frames - 1;
+    int64_t playheadUs = index.ptsUs(lastShown);
+    clock.setRate(rate, 0);
+    clock.start(playheadUs, 0);
+    std::vector<int> evicted;
+
+    // Decoder model of ADecoder::decodeGop
+    auto decodeGop = [&](int64_t seekUs, bool syncOnly) {
+        int s = index.frameAt(seekUs < 0 ? 0 : seekUs) / index.gop * index.gop;
+        int n = syncOnly ? 1 : std::min(index.gop, index.frames - s);
+        int64_t cost = keyDecodeNs + (n - 1) * decodeNs;
+        now += cost;
+        r.busyNs += cost;
+        r.fed += n;
+        Gop gop{index.ptsUs(s), s + index.gop < index.frames ? index.ptsUs(s + index.gop) : INT64_MAX, {}};
+        for (int i = s; i < s + n; i++) {
+            cache.insert(index.ptsUs(i), i, evicted);
+            gop.frames.push_back(index.ptsUs(i));
+        }
+        if (!syncOnly) {
+            gops.add(gop);
+        }
+        return s;
+    };
+
+    while (now < endNs) {
+        int64_t start = now;
+        int64_t ptsUs;
+        int frame;
+        bool hit = false;
+        bool found;
+        if (r.mode == FeedMode::SYNC_ONLY) {
+            cache.setPlayhead(playheadUs, -1);
+            frame = decodeGop(trickPlay.nextSyncTarget(clock.mediaUs(now), rate, playheadUs), true);
+            ptsUs = index.ptsUs(frame);
+            found = ptsUs < playheadUs;
+            trickPlay.measuredDecode((now - start) / 1000);
+        } else {
+            // The frame before the clock: ones overdue by more than a frame are skipped
+            int64_t fromUs = std::min(playheadUs, clock.mediaUs(now) + index.ptsUs(1));
+            found = cache.fetch(gops, fromUs, -1, [&](int64_t seekUs) {
+                decodeGop(seekUs, false);
+                return true;
+            }, ptsUs, frame, hit);
+        }
+        if (!found) {
+            // Start of the stream, the player holds the picture there
+            break;
+        }
+        hit ? r.hits++ : r.misses++;
+        r.fetchUs.record((now - start) / 1000);
+
+        int64_t dueNs = clock.dueNs(ptsUs);
+        if (now - dueNs > ATrickPlay::RESYNC_NS) {
+            clock.start(ptsUs, now);
+            r.resyncs++;
+        } else if (now < dueNs) {
+            now = dueNs;
+        }
+        r.shown++;
+        if (r.mode == FeedMode::SYNC_ONLY && !index.sync(frame)) {
+            r.nonSync = true;
+        }
+        if (frame >= lastShown) {
+            r.backwards = true;
+        } else {
+            r.mediaUs -= index.ptsUs(lastShown) - ptsUs;
+            if (r.mode == FeedMode::ALL) {
+                // Skipped for being overdue
+                r.dropped += lastShown - frame - 1;
+            }
+            r.maxStep = lastShown - frame > r.maxStep ? lastShown - frame : r.maxStep;
+        }
+        if (lastShownNs >= 0 && now - lastShownNs > r.maxGapNs) {
+            r.maxGapNs = now - lastShownNs;
+        }
+        lastShown = frame;
+        lastShownNs = now;
+        playheadUs = ptsUs;
+    }
+    return r;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: atrickplay [options]\n"
+            "  --fps N           content frame rate (default: 30)\n"
+            "  --gop N           sync sample interval in frames (default: 60)\n"
+            "  --duration s      stream length (default: 600)\n"
+            "  --seconds s       wall time per rate (default: 20)\n"
+            "  --decode us       decode time of a frame (default: 4000)\n"
+            "  --key-decode us   decode time of a sync frame (default: 9000)\n"
+            "  --sync-only N     rates above this feed sync samples only (default: %.0f)\n"
+            "  --cache N         frames the reverse GOP cache holds (default: 32)\n"
+            "  --speeds list     playback rates, negative plays backwards\n"
+            "                    (default: -8,-2,-1,0.25,0.5,1,2,4,8,16)\n",
+            ATrickPlay::DEFAULT_SYNC_ONLY_RATE);
+}
+
+int main(int argc, char** argv) {
+    float fps = 30.0f;
+    int gop = 60;
+    double duration = 600.0;
+    double seconds = 20.0;
+    double decodeUs = 4000.0;
+    double keyDecodeUs = 9000.0;
+    float syncOnlyRate = ATrickPlay::DEFAULT_SYNC_ONLY_RATE;
+    int cacheFrames = 32;
+    std::vector<float> speeds = {-8.0f, -2.0f, -1.0f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f};
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        bool ok = true;
+        if (!strcmp(argv[i], "--fps") && more) {
+            ok = (fps = (float)atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--gop") && more) {
+            ok = (gop = atoi(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--duration") && more) {
+            ok = (duration = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--seconds") && more) {
+            ok = (seconds = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--decode") && more) {
+            ok = (decodeUs = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--key-decode") && more) {
+            ok = (keyDecodeUs = atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--sync-only") && more) {
+            ok = (syncOnlyRate = (float)atof(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--cache") && more) {
+            ok = (cacheFrames = atoi(argv[++i])) > 0;
+        } else if (!strcmp(argv[i], "--speeds") && more) {
+            speeds.clear();
+            for (char* tok = strtok(argv[++i], ","); tok; tok = strtok(nullptr, ",")) {
+                speeds.push_back(APlaybackClock::clampRate((float)atof(tok)));
+            }
+            ok = !speeds.empty();
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage();
+            return 2;
+        }
+    }
+
+    Index index{fps, gop, (int)(duration * fps)};
+    printf("%.3f fps, sync every %d frames, decode %.0f/%.0f us, sync only above %gx\n\n",
+           fps, gop, decodeUs, keyDecodeUs, syncOnlyRate);
+    printf("  rate  mode       fed/s  load  busy  shown/s drop/s  media/s  max step  max gap  check\n");
+    int rc = 0;
+    std::vector<std::pair<float, Result>> reverse;
+    for (float rate : speeds) {
+        Result r = rate < 0.0f
+                   ? runReverse(index, rate, syncOnlyRate, seconds, (int64_t)(decodeUs * 1000),
+                                (int64_t)(keyDecodeUs * 1000), cacheFrames)
+                   : run(index, rate, syncOnlyRate, seconds, (int64_t)(decodeUs * 1000),
+                         (int64_t)(keyDecodeUs * 1000));
+        // Shown frames bound the media time, 10% covers a partial GOP at either end
+        double mediaRate = r.mediaUs / 1e6 / seconds;
+        bool rateOk = fabs(mediaRate - rate) <= fabs(rate) * 0.1;
+        bool ok = rateOk && !r.backwards && !r.nonSync;
+        // Decoding never idles: the decoder, not the clock, sets the pace
+        bool bound = r.busyNs >= seconds * 0.99e9;
+        rc |= !ok;
+        printf("%6gx %-9s %6.1f %5.2fx %4.0f%% %7.1f %6.1f %7.2fx %9d %6.0fms  %s%s%s%s%s\n",
+               rate, r.mode == FeedMode::SYNC_ONLY ? "sync-only" : "all",
+               r.fed / seconds, r.fed / seconds / fps, r.busyNs / (seconds * 1e7),
+               r.shown / seconds, r.dropped / seconds, mediaRate, r.maxStep, r.maxGapNs / 1e6,
+               ok ? "ok" : "FAIL", rateOk ? "" : " rate", r.backwards ? " backwards" : "",
+               r.nonSync ? " non-sync" : "", bound ? " (decoder-bound, lower --sync-only)" : "");
+        if (rate < 0.0f) {
+            reverse.emplace_back(rate, r);
+        }
+    }
+    if (!reverse.empty()) {
+        printf("\nreverse, %d cached frames:\n", cacheFrames);
+        printf("  rate  hits   fetch p50    p99    max (ms)\n");
+        for (auto& [rate, r] : reverse) {
+            int lookups = r.hits + r.misses;
+            printf("%6gx %4.0f%% %9.1f %6.1f %6.1f\n", rate, lookups ? r.hits * 100.0f / lookups : 0.0f,
+                   r.fetchUs.percentile(50) / 1000.0f, r.fetchUs.percentile(99) / 1000.0f, r.fetchUs.max() / 1000.0f);
+        }
+    }
+    return rc;
+}
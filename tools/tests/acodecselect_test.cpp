@@ -0,0 +1,116 @@
+//
+// ACodecSelect ranking and the probe cache, on fake codec profiles.
+//
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "acodecselect.h"
+#include "atest.h"
+
+namespace {
+
+const CodecRequirement UHD60{3840, 2160, 60.0f};
+
+CodecProfile fake(const char* name, bool hardware, float fps, float latencyMs) {
+    return {name, hardware, true, 0.0f, true, true, fps, latencyMs};
+}
+
+CodecProfile unprobed(const char* name, bool hardware, float declaredFps) {
+    return {name, hardware, true, declaredFps, false, false, 0.0f, 0.0f};
+}
+
+std::string order(const std::vector<CodecProfile>& ranked) {
+    std::string names;
+    for (const auto& c : ranked) {
+        names += names.empty() ? c.name : " " + c.name;
+    }
+    return names;
+}
+
+}
+
+TEST(codecselect, dropsUnsupportedAndFailedProbes) {
+    CodecProfile unsupported = fake("unsupported", true, 200, 5);
+    unsupported.supported = false;
+    CodecProfile failed = fake("failed", true, 200, 5);
+    failed.probeOk = false;
+    CHECK_EQ(order(ACodecSelect::rank({unsupported, failed, fake("ok", false, 100, 5)}, UHD60)), "ok");
+}
+
+TEST(codecselect, hardwareBeforeSoftware) {
+    // Faster and quicker to first frame, still behind hardware that sustains the rate
+    auto ranked = ACodecSelect::rank({fake("sw", false, 300, 1), fake("hw", true, 80, 20)}, UHD60);
+    CHECK_EQ(order(ranked), "hw sw");
+}
+
+TEST(codecselect, sustainingBeforeUnknownBeforeTooSlow) {
+    auto ranked = ACodecSelect::rank({fake("slow", true, 40, 1), unprobed("unknown", true, 0),
+                                      fake("sustains", false, 90, 30), fake("slower", true, 20, 1)}, UHD60);
+    CHECK_EQ(order(ranked), "sustains unknown slow slower");
+}
+
+TEST(codecselect, latencyTiesGoByThroughput) {
+    // 4.1 and 5.9 ms share a bucket, throughput decides; 8 ms is a bucket later
+    auto ranked = ACodecSelect::rank({fake("a", true, 100, 4.1f), fake("b", true, 150, 5.9f),
+                                      fake("c", true, 400, 8.0f)}, UHD60);
+    CHECK_EQ(order(ranked), "b a c");
+}
+
+TEST(codecselect, equalCandidatesKeepPlatformOrder) {
+    auto ranked = ACodecSelect::rank({fake("first", true, 100, 5), fake("second", true, 100, 5),
+                                      unprobed("third", false, 0), unprobed("fourth", false, 0)}, UHD60);
+    CHECK_EQ(order(ranked), "first second third fourth");
+}
+
+TEST(codecselect, unmeasuredLatencyAfterMeasured) {
+    auto ranked = ACodecSelect::rank({unprobed("declared", true, 500), fake("probed", true, 90, 40)}, UHD60);
+    CHECK_EQ(order(ranked), "probed declared");
+}
+
+TEST(codecselect, orderIsConsistent) {
+    // Was a cycle with a "closer than the slack" comparison: x<y by latency, y<z and
+    // z<x by throughput. Any input order has to give the same ranking now.
+    std::vector<CodecProfile> set = {fake("x", true, 80, 1.0f), fake("y", true, 300, 2.5f),
+                                     unprobed("z", true, 200)};
+    std::string expected = order(ACodecSelect::rank(set, UHD60));
+    CHECK_EQ(expected, "x y z");
+    CHECK_EQ(order(ACodecSelect::rank({set[2], set[1], set[0]}, UHD60)), expected);
+    CHECK_EQ(order(ACodecSelect::rank({set[1], set[2], set[0]}, UHD60)), expected);
+}
+
+TEST(codecselect, defaultRateWhenUnknown) {
+    CodecRequirement noRate{1920, 1080, 0.0f};
+    // 30 fps * 1.25 headroom
+    CHECK_EQ(ACodecSelect::sustains(fake("a", true, 37.5f, 1), noRate), 1);
+    CHECK_EQ(ACodecSelect::sustains(fake("b", true, 37.0f, 1), noRate), -1);
+    CHECK_EQ(ACodecSelect::sustains(unprobed("c", true, 0), noRate), 0);
+}
+
+TEST(codecselect, probeCacheRoundTrip) {
+    char path[] = "/tmp/acodecprobe_testXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    ACodecProbeCache cache;
+    cache.load(path, "build/1");
+    cache.store(fake("c2.hw.avc", true, 123.5f, 7.25f), "video/avc", UHD60);
+    CHECK(cache.save());
+
+    ACodecProbeCache same;
+    CHECK(same.load(path, "build/1"));
+    CodecProfile codec = unprobed("c2.hw.avc", true, 0);
+    CHECK(same.lookup(codec, "video/avc", UHD60));
+    CHECK(codec.probed && codec.probeOk);
+    CHECK_NEAR(codec.fps, 123.5f, 0.01);
+    CHECK_NEAR(codec.latencyMs, 7.25f, 0.001);
+    CodecProfile otherSize = unprobed("c2.hw.avc", true, 0);
+    CHECK(!same.lookup(otherSize, "video/avc", {1920, 1080, 60.0f}));
+
+    // A system update invalidates everything
+    ACodecProbeCache updated;
+    updated.load(path, "build/2");
+    CodecProfile stale = unprobed("c2.hw.avc", true, 0);
+    CHECK(!updated.lookup(stale, "video/avc", UHD60));
+    unlink(path);
+}
@@ -0,0 +1,173 @@
+//
+// ADecodeLatency against a fake codec with B-frame reordering, and its PTS table.
+//
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "adecodelatency.h"
+#include "afakecodec.h"
+#include "atest.h"
+
+namespace {
+
+const int64_t FRAME_US = 33333;
+const int64_t DECODE_NS = 5000000;
+
+struct Run {
+    int64_t minUs = INT64_MAX;
+    int64_t maxUs = 0;
+    int64_t sumUs = 0;
+    int frames = 0;
+    int maxInFlight = 0;
+};
+
+// Feeds frames samples in decode order one frame apart, takes each output as soon as
+// it is decoded and checks the latency the tracker reports against the codec's
+Run play(int depth, int frames) {
+    ADecodeLatency latency;
+    AFakeCodec codec(depth, DECODE_NS);
+    Run run;
+    auto take = [&](int64_t nowNs) {
+        int64_t ptsUs;
+        while (codec.dequeue(nowNs, ptsUs)) {
+            int64_t us = -1;
+            CHECK(latency.released(ptsUs, nowNs, &us));
+            CHECK_EQ(us, (nowNs - codec.queuedAt(ptsUs)) / 1000);
+            run.minUs = std::min(run.minUs, us);
+            run.maxUs = std::max(run.maxUs, us);
+            run.sumUs += us;
+            run.frames++;
+        }
+    };
+    std::vector<int> order = AFakeCodec::decodeOrder(frames, depth);
+    for (int i = 0; i < (int)order.size(); i++) {
+        int64_t nowNs = i * FRAME_US * 1000;
+        codec.queue(order[i] * FRAME_US, nowNs);
+        latency.queued(order[i] * FRAME_US, nowNs);
+        run.maxInFlight = std::max(run.maxInFlight, latency.inFlight());
+        take(nowNs + DECODE_NS);
+        // What the codec holds back is all that stays in flight
+        CHECK_EQ(latency.inFlight(), std::min(i + 1, depth));
+    }
+    int64_t endNs = (int64_t)order.size() * FRAME_US * 1000;
+    codec.drain(endNs);
+    take(endNs + DECODE_NS);
+    CHECK_EQ(latency.inFlight(), 0);
+    CHECK_EQ(latency.unmatched(), 0u);
+    CHECK_EQ(latency.histogram().count(), (uint32_t)frames);
+    CHECK_EQ(latency.histogram().max(), run.maxUs);
+    CHECK_EQ(latency.histogram().min(), run.minUs);
+    return run;
+}
+
+// ADecodeLatency's home slot, to build probe runs that wrap around the table
+int home(int64_t ptsUs) {
+    return (int)(((uint64_t)ptsUs * 0x9E3779B97F4A7C15ULL) >> 58) & (ADecodeLatency::SLOTS - 1);
+}
+
+std::vector<int64_t> withHome(int slot, int count) {
+    std::vector<int64_t> pts;
+    for (int64_t p = 1; (int)pts.size() < count; p++) {
+        if (home(p) == slot) {
+            pts.push_back(p);
+        }
+    }
+    return pts;
+}
+
+}
+
+TEST(decodelatency, noReorderIsDecodeTime) {
+    Run run = play(0, 90);
+    CHECK_EQ(run.frames, 90);
+    CHECK_EQ(run.minUs, DECODE_NS / 1000);
+    CHECK_EQ(run.maxUs, DECODE_NS / 1000);
+    CHECK_EQ(run.maxInFlight, 1);
+}
+
+TEST(decodelatency, reorderDepthTwo) {
+    Run run = play(2, 90);
+    CHECK_EQ(run.frames, 90);
+    // A B-frame comes out with the next input; an anchor waits for the B-frames
+    // decoded after it, then for as many inputs again to be the lowest held
+    CHECK_EQ(run.minUs, FRAME_US + DECODE_NS / 1000);
+    CHECK_EQ(run.maxUs, 2 * 2 * FRAME_US + DECODE_NS / 1000);
+    CHECK_EQ(run.maxInFlight, 3);
+}
+
+TEST(decodelatency, reorderDepthFour) {
+    Run run2 = play(2, 90);
+    Run run4 = play(4, 90);
+    CHECK_EQ(run4.frames, 90);
+    CHECK_EQ(run4.minUs, FRAME_US + DECODE_NS / 1000);
+    CHECK_EQ(run4.maxUs, 2 * 4 * FRAME_US + DECODE_NS / 1000);
+    CHECK_EQ(run4.maxInFlight, 5);
+    CHECK(run4.sumUs / run4.frames > run2.sumUs / run2.frames);
+}
+
+TEST(decodelatency, probeRunWrapsAround) {
+    ADecodeLatency latency;
+    const int last = ADecodeLatency::SLOTS - 1;
+    // Three keys homed in the last slot spill into 0 and 1, one homed in 0 lands in 2
+    std::vector<int64_t> tail = withHome(last, 3);
+    int64_t head = withHome(0, 1)[0];
+    for (int64_t p : tail) {
+        latency.queued(p, 0);
+    }
+    latency.queued(head, 1000);
+    CHECK_EQ(latency.inFlight(), 4);
+    // Deleting the first of the run shifts the others back across the wrap
+    CHECK(latency.released(tail[0], 2000000));
+    CHECK(latency.released(head, 3000000));
+    CHECK(latency.released(tail[2], 4000000));
+    CHECK(latency.released(tail[1], 5000000));
+    CHECK_EQ(latency.inFlight(), 0);
+    CHECK_EQ(latency.unmatched(), 0u);
+    CHECK(!latency.released(tail[1], 6000000));
+    CHECK_EQ(latency.unmatched(), 1u);
+}
+
+TEST(decodelatency, deletionKeepsLookups) {
+    ADecodeLatency latency;
+    const int n = 40;
+    for (int i = 0; i < n; i++) {
+        latency.queued(i * FRAME_US, i);
+    }
+    // Out of order, the way reordered outputs and codec drops leave holes
+    for (int i = 0; i < n; i += 3) {
+        CHECK(latency.released(i * FRAME_US, 1000000));
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        if (i % 3) {
+            int64_t us = -1;
+            CHECK(latency.released(i * FRAME_US, 2000000, &us));
+            CHECK_EQ(us, (2000000 - i) / 1000);
+        }
+    }
+    CHECK_EQ(latency.inFlight(), 0);
+    CHECK_EQ(latency.unmatched(), 0u);
+}
+
+TEST(decodelatency, expiresDroppedFrames) {
+    ADecodeLatency latency;
+    latency.queued(0, 0);
+    latency.queued(FRAME_US, 500000000);
+    CHECK_EQ(latency.expire(1200000000), 1);
+    CHECK_EQ(latency.inFlight(), 1);
+    CHECK(!latency.released(0, 1200000000));
+    CHECK(latency.released(FRAME_US, 1200000000));
+    CHECK_EQ(latency.expired(), 1u);
+}
+
+TEST(decodelatency, fullTableExpiresOldEntries) {
+    ADecodeLatency latency;
+    // Frames the codec dropped pile up until the table is three quarters full
+    for (int i = 0; i < ADecodeLatency::SLOTS * 3 / 4; i++) {
+        latency.queued(i * FRAME_US, 0);
+    }
+    latency.queued(1000 * FRAME_US, 2 * ADecodeLatency::EXPIRE_NS);
+    CHECK_EQ(latency.inFlight(), 1);
+    CHECK_EQ(latency.expired(), (uint32_t)(ADecodeLatency::SLOTS * 3 / 4));
+    CHECK(latency.released(1000 * FRAME_US, 2 * ADecodeLatency::EXPIRE_NS));
+}
@@ -0,0 +1,84 @@
+//
+// Stand-in for a video decoder on the host: samples go in in decode order, frames
+// come out in presentation order, held back by a configurable reorder depth.
+//
+#ifndef AFAKECODEC_H
+#define AFAKECODEC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+/**
+ * Holds up to reorderDepth decoded frames and emits the lowest PTS as soon as it
+ * holds more, decodeNs after the input that made it emit (what a B-frame decoder
+ * with that many reorder frames does). Keeps the queue time of every sample, the
+ * truth to compare a latency tracker against.
+ */
+class AFakeCodec {
+public:
+    AFakeCodec(int reorderDepth, int64_t decodeNs) : depth(reorderDepth), decodeNs(decodeNs) {}
+
+    // Decode order of frames 0..frames-1 in mini-GOPs of an anchor followed by depth
+    // B-frames: 0, D+1, 1..D, 2D+2, D+2..2D+1, ...
+    static std::vector<int> decodeOrder(int frames, int depth) {
+        std::vector<int> order;
+        if (frames > 0) {
+            order.push_back(0);
+        }
+        for (int anchor = depth + 1; anchor - depth < frames; anchor += depth + 1) {
+            if (anchor < frames) {
+                order.push_back(anchor);
+            }
+            for (int b = anchor - depth; b < anchor && b < frames; b++) {
+                order.push_back(b);
+            }
+        }
+        return order;
+    }
+
+    void queue(int64_t ptsUs, int64_t nowNs) {
+        queuedNs[ptsUs] = nowNs;
+        held.push_back(ptsUs);
+        if ((int)held.size() > depth) {
+            emit(nowNs);
+        }
+    }
+    // End of stream: everything held comes out
+    void drain(int64_t nowNs) {
+        while (!held.empty()) {
+            emit(nowNs);
+        }
+    }
+    // The next frame decoded by nowNs, false if there is none yet
+    bool dequeue(int64_t nowNs, int64_t& ptsUs) {
+        if (out.empty() || out.front().readyNs > nowNs) {
+            return false;
+        }
+        ptsUs = out.front().ptsUs;
+        out.pop_front();
+        return true;
+    }
+    int64_t queuedAt(int64_t ptsUs) const { return queuedNs.at(ptsUs); }
+
+private:
+    struct Output {
+        int64_t ptsUs;
+        int64_t readyNs;
+    };
+    int depth;
+    int64_t decodeNs;
+    std::vector<int64_t> held;
+    std::deque<Output> out;
+    std::map<int64_t, int64_t> queuedNs;
+
+    void emit(int64_t nowNs) {
+        auto lowest = std::min_element(held.begin(), held.end());
+        out.push_back({*lowest, nowNs + decodeNs});
+        held.erase(lowest);
+    }
+};
+
+#endif //AFAKECODEC_H
@@ -0,0 +1,106 @@
+//
+// AImageScale: the vector halving against the scalar one, and scale() end to end.
+//
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "aimagescale.h"
+#include "atest.h"
+
+namespace {
+
+std::vector<uint8_t> noise(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> v(size);
+    for (auto& b : v) {
+        b = (uint8_t)rng();
+    }
+    return v;
+}
+
+// Bytes past the output row that halve() must leave alone
+const int GUARD = 16;
+const uint8_t GUARD_BYTE = 0xa5;
+
+bool halvesMatch(int width, int height, int srcStride, uint32_t seed) {
+    std::vector<uint8_t> src = noise((size_t)srcStride * height, seed);
+    int dstStride = width / 2 + GUARD;
+    std::vector<uint8_t> simd((size_t)dstStride * (height / 2 + 1), GUARD_BYTE);
+    std::vector<uint8_t> scalar = simd;
+    AImageScale::halve(src.data(), width, height, srcStride, simd.data(), dstStride);
+    AImageScale::halveScalar(src.data(), width, height, srcStride, scalar.data(), dstStride);
+    return simd == scalar;
+}
+
+}
+
+TEST(imagescale, halveMatchesScalarOnEveryTail) {
+    // Every remainder of the 16-pixel vector step, odd widths and heights included
+    for (int width = 1; width <= 80; width++) {
+        for (int height : {1, 2, 3, 7}) {
+            if (!halvesMatch(width, height, width, width * 31 + height)) {
+                ATest::fail(__FILE__, __LINE__, "width " + std::to_string(width) + " height "
+                            + std::to_string(height));
+            }
+        }
+    }
+}
+
+TEST(imagescale, halveMatchesScalarWithPaddedRows) {
+    CHECK(halvesMatch(1920, 1080, 2048, 1));
+    CHECK(halvesMatch(1279, 719, 1280 + 64, 2));
+    CHECK(halvesMatch(33, 17, 63, 3));
+}
+
+TEST(imagescale, halveRoundsToNearest) {
+    const uint8_t src[] = {0, 1, 255, 255,
+                           1, 0, 254, 255};
+    uint8_t dst[2];
+    AImageScale::halve(src, 4, 2, 4, dst, 2);
+    CHECK_EQ((int)dst[0], 1);   // (2 + 2) >> 2
+    CHECK_EQ((int)dst[1], 255); // (1019 + 2) >> 2
+}
+
+TEST(imagescale, scaleKeepsFlatPlanesFlat) {
+    std::vector<uint8_t> src((size_t)1921 * 1081, 77);
+    std::vector<uint8_t> dst(160 * 90);
+    std::vector<uint8_t> scratch;
+    AImageScale::scale({src.data(), 1921, 1081, 1921}, dst.data(), 160, 90, scratch);
+    for (uint8_t b : dst) {
+        CHECK_EQ((int)b, 77);
+    }
+}
+
+TEST(imagescale, interleavedChromaScalesLikePacked) {
+    // NV12 chroma: U at even bytes, V at odd ones
+    const int w = 175, h = 97;
+    std::vector<uint8_t> uv = noise((size_t)w * 2 * h, 9);
+    std::vector<uint8_t> u((size_t)w * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            u[(size_t)y * w + x] = uv[(size_t)y * w * 2 + 2 * x];
+        }
+    }
+    std::vector<uint8_t> fromInterleaved(40 * 24), fromPacked(40 * 24), scratch;
+    AImageScale::scale({uv.data(), w, h, w * 2, 2}, fromInterleaved.data(), 40, 24, scratch);
+    AImageScale::scale({u.data(), w, h, w}, fromPacked.data(), 40, 24, scratch);
+    CHECK(fromInterleaved == fromPacked);
+}
+
+TEST(imagescale, scaleKeepsGradientsMonotonic) {
+    const int w = 640, h = 8;
+    std::vector<uint8_t> src((size_t)w * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            src[(size_t)y * w + x] = (uint8_t)(x * 255 / (w - 1));
+        }
+    }
+    std::vector<uint8_t> dst(97 * 3), scratch;
+    AImageScale::scale({src.data(), w, h, w}, dst.data(), 97, 3, scratch);
+    for (int x = 1; x < 97; x++) {
+        CHECK(dst[x] >= dst[x - 1]);
+    }
+    CHECK(dst[0] < 8);
+    CHECK(dst[96] > 247);
+}
@@ -0,0 +1,210 @@
+//
+// ALog: format() against snprintf, the per-site rate limit, and flush().
+//
+#include <unistd.h>
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alog.h"
+#include "atest.h"
+#include "util.h"
+
+namespace {
+
+template <typename... Args>
+std::string formatted(const char* fmt, Args... args) {
+    ALog::Record r;
+    ALog::capture(r, ANDROID_LOG_INFO, "alogtest", fmt, args...);
+    char out[512];
+    ALog::format(r, out, sizeof(out));
+    return out;
+}
+
+template <typename... Args>
+std::string printed(const char* fmt, Args... args) {
+    char out[512];
+    snprintf(out, sizeof(out), fmt, args...);
+    return out;
+}
+
+#define CHECK_PRINTF(fmt, ...) CHECK_EQ(formatted(fmt, __VA_ARGS__), printed(fmt, __VA_ARGS__))
+
+// stderr (where the host writer outputs) into a temporary file while alive
+class StderrCapture {
+public:
+    StderrCapture() {
+        fflush(stderr);
+        file = tmpfile();
+        saved = dup(STDERR_FILENO);
+        dup2(fileno(file), STDERR_FILENO);
+    }
+
+    ~StderrCapture() {
+        restore();
+        fclose(file);
+    }
+
+    // Restores stderr, returns the lines written meanwhile
+    std::vector<std::string> lines() {
+        restore();
+        std::vector<std::string> out;
+        rewind(file);
+        char line[512];
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            out.push_back(line);
+        }
+        return out;
+    }
+
+private:
+    FILE* file;
+    int saved;
+
+    void restore() {
+        if (saved >= 0) {
+            fflush(stderr);
+            dup2(saved, STDERR_FILENO);
+            close(saved);
+            saved = -1;
+        }
+    }
+};
+
+}
+
+TEST(alog, flagsWidthPrecision) {
+    CHECK_PRINTF("[%5d|%-5d|%05d|%+d|% d]", 42, 42, 42, 42, 42);
+    CHECK_PRINTF("[%+05d|%-+6d|%.4d|%8.3d]", -7, 7, 7, -7);
+    CHECK_PRINTF("[%#x|%#X|%#o|%08x|%-8X|]", 255, 255, 8, 0xbeef, 0xbeef);
+    CHECK_PRINTF("[%f|%.3f|%10.2f|%-10.1f|%+.0f]", 3.14159, 3.14159, -2.5, 2.25, 2.5);
+    CHECK_PRINTF("[%e|%.2E|%g|%G|%#g|%a]", 12345.678, 0.000123, 0.0001, 1e20, 1.0, 0.5);
+    CHECK_PRINTF("[%10s|%-10s|%.2s|%5.1s]", "abc", "abc", "abc", "abc");
+    CHECK_PRINTF("[%c|%3c|%-3c]", 'A', 'b', 'c');
+    CHECK_PRINTF("[%p|%p]", (void*)0x1234, (void*)nullptr);
+    CHECK_PRINTF("%.1f ms, %d frames of %s", 16.7f, 120, "render");
+}
+
+TEST(alog, lengthModifiers) {
+    CHECK_PRINTF("%hhd %hhu %hhx", 255, 255, 0x1ff);
+    CHECK_PRINTF("%hd %hu %hx", 70000, 70000, -1);
+    CHECK_PRINTF("%ld %lu %lx", LONG_MIN, ULONG_MAX, -1L);
+    CHECK_PRINTF("%lld %llu %llx", LLONG_MIN, ULLONG_MAX, -1LL);
+    CHECK_PRINTF("%zu %zx %zd", SIZE_MAX, (size_t)4096, (ptrdiff_t)-3);
+    CHECK_PRINTF("%jd %ju %td", INTMAX_MIN, UINTMAX_MAX, (ptrdiff_t)-1);
+    CHECK_PRINTF("%d %i", INT_MIN, INT_MAX);
+}
+
+TEST(alog, promotionsAndCrossConversions) {
+    // Arguments are promoted as for printf: char and short become int first, so
+    // %x of a negative short prints all 32 bits, %hx only 16
+    CHECK_PRINTF("%x %hx %hhx", (int16_t)-1, (int16_t)-1, (int8_t)-1);
+    CHECK_PRINTF("%d %u", (uint16_t)65535, (int16_t)-1);
+    CHECK_PRINTF("%d %x %o", (int8_t)-128, (uint8_t)200, (char)'z');
+    CHECK_PRINTF("%u %x", -1, INT_MIN);
+    CHECK_PRINTF("%d %i", UINT32_MAX, 0x80000000u);
+    CHECK_PRINTF("%lld %llu", (unsigned long long)ULLONG_MAX, -1LL);
+    CHECK_PRINTF("%c%c", 'o', (int)'k');
+    CHECK_EQ(formatted("%d", true), std::string("1"));
+    // Wider than the conversion (undefined for printf): the value stays whole
+    CHECK_EQ(formatted("%d", (int64_t)1 << 40), std::string("1099511627776"));
+}
+
+TEST(alog, strings) {
+    CHECK_EQ(formatted("[%s]", (const char*)nullptr), std::string("[(null)]"));
+    std::string temporary = "copied, not pointed to";
+    CHECK_EQ(formatted("%s", temporary.c_str()), temporary);
+
+    // One record has STRING_BYTES for all of its strings, NUL terminators included
+    std::string longer(ALog::STRING_BYTES + 40, 'a');
+    CHECK_EQ(formatted("%s", longer.c_str()), std::string(ALog::STRING_BYTES - 1, 'a'));
+    std::string first(100, 'x');
+    std::string second(100, 'y');
+    CHECK_EQ(formatted("%s|%s", first.c_str(), second.c_str()),
+             first + "|" + std::string(ALog::STRING_BYTES - 101 - 1, 'y'));
+    // No room left at all: the string shows as (?)
+    std::string fill(ALog::STRING_BYTES - 1, 'f');
+    CHECK_EQ(formatted("%s|%s", fill.c_str(), "gone"), fill + "|(?)");
+}
+
+TEST(alog, percentAndUnsupported) {
+    CHECK_PRINTF("100%% of %d%%", 5);
+    CHECK_EQ(formatted("%%%%"), std::string("%%"));
+    // Unsupported conversions stay as written and use up their argument
+    CHECK_EQ(formatted("a %k b %d", 1, 2), std::string("a %k b 2"));
+    CHECK_EQ(formatted("%*d", 5, 1), std::string("%*d"));
+    // Missing arguments and a trailing % are kept as well
+    CHECK_EQ(formatted("%d %d", 1), std::string("1 %d"));
+    CHECK_EQ(formatted("50%"), std::string("50%"));
+    CHECK_EQ(formatted("%ll"), std::string("%ll"));
+}
+
+TEST(alog, outputTruncation) {
+    ALog::Record r;
+    ALog::capture(r, ANDROID_LOG_INFO, "alogtest", "%s and %d", "a long enough string", 123456);
+    char out[8];
+    memset(out, 'z', sizeof(out));
+    CHECK_EQ(ALog::format(r, out, sizeof(out)), (size_t)7);
+    CHECK_EQ(std::string(out), std::string("a long "));
+    char small[12];
+    CHECK_EQ(ALog::format(r, small, sizeof(small)), (size_t)11);
+    CHECK_EQ(std::string(small), std::string("a long enou"));
+    CHECK_EQ(ALog::format(r, out, 0), (size_t)0);
+}
+
+TEST(alog, siteBurstAndSuppressed) {
+    ALog::Site site;
+    uint32_t suppressed = 99;
+    for (uint32_t i = 0; i < ALog::Site::BURST; i++) {
+        CHECK(site.allow(suppressed));
+        CHECK_EQ(suppressed, 0u);
+    }
+    for (int i = 0; i < 5; i++) {
+        CHECK(!site.allow(suppressed));
+    }
+    // The next window reports what the last one dropped, once
+    std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+    CHECK(site.allow(suppressed));
+    CHECK_EQ(suppressed, 5u);
+    CHECK(site.allow(suppressed));
+    CHECK_EQ(suppressed, 0u);
+}
+
+TEST(alog, flushWritesInOrder) {
+    const int COUNT = 60;
+    // A site per message, so the rate limit keeps out of it
+    auto sites = std::make_unique<ALog::Site[]>(2 * COUNT);
+    StderrCapture capture;
+    auto produce = [&sites](int thread) {
+        for (int i = 0; i < COUNT; i++) {
+            ALog::write(sites[thread * COUNT + i], ANDROID_LOG_INFO, "alogtest", "thread %d message %d", thread, i);
+        }
+    };
+    std::thread other(produce, 1);
+    produce(0);
+    other.join();
+    ALog::flush();
+    std::vector<std::string> lines = capture.lines();
+
+    int next[2] = {0, 0};
+    for (const std::string& line : lines) {
+        int thread, i;
+        if (sscanf(line.c_str(), "alogtest: thread %d message %d", &thread, &i) == 2 && thread >= 0 && thread < 2) {
+            // Each thread's messages in the order it logged them
+            CHECK_EQ(i, next[thread]);
+            next[thread] = i + 1;
+        }
+    }
+    // All of them written by the time flush() returned
+    CHECK_EQ(next[0], COUNT);
+    CHECK_EQ(next[1], COUNT);
+}
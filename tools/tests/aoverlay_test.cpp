@@ -0,0 +1,100 @@
+//
+// AOverlay: layer order without a merge, the padding, and regions carried over frames.
+//
+#include <vector>
+
+#include "aoverlay.h"
+#include "atest.h"
+
+namespace {
+
+// Ids (color without alpha) of the opaque quads, in stream order
+std::vector<uint32_t> quadIds(const std::vector<OverlayVertex>& stream) {
+    std::vector<uint32_t> colors;
+    for (size_t i = 0; i + 6 <= stream.size(); i += 6) {
+        const GLubyte* c = stream[i].color;
+        uint32_t rgba = (uint32_t)c[0] << 24 | c[1] << 16 | c[2] << 8 | c[3];
+        if (c[3]) {
+            colors.push_back(rgba >> 8);
+        }
+    }
+    return colors;
+}
+
+uint32_t opaque(uint32_t id) {
+    return id << 8 | 0xff;
+}
+
+void frame(AOverlay& overlay, int extraRects) {
+    overlay.begin();
+    overlay.addRect(0, 0, 1, 1, opaque(0x102), 2);
+    overlay.addRect(0, 0, 1, 1, opaque(0x101), 1);
+    overlay.addRect(0, 0, 1, 1, opaque(0x100), 0);
+    overlay.addLine(0, 0, 1, 1, 2.0f, opaque(0x103), 3);
+    for (int i = 0; i < extraRects; i++) {
+        overlay.addRect(0, 0, 1, 1, opaque(0x200 + i), 1);
+    }
+    overlay.finish();
+}
+
+}
+
+TEST(overlay, layerOrderThenSubmissionOrder) {
+    AOverlay overlay;
+    for (int f = 0; f < 3; f++) {
+        frame(overlay, 2);
+        CHECK(quadIds(overlay.vertices()) ==
+              (std::vector<uint32_t>{0x100, 0x101, 0x200, 0x201, 0x102, 0x103}));
+        CHECK_EQ(overlay.stats().items, 6u);
+        CHECK_EQ(overlay.stats().vertices, 36u);
+    }
+}
+
+TEST(overlay, paddingIsZeroArea) {
+    AOverlay overlay;
+    frame(overlay, 0);
+    // The first frame is laid out tightly, the next ones get headroom
+    CHECK_EQ(overlay.vertices().size(), (size_t)24);
+    frame(overlay, 0);
+    CHECK(overlay.vertices().size() > 24);
+    CHECK_EQ(overlay.stats().vertices, 24u);
+    size_t degenerate = 0;
+    for (const auto& v : overlay.vertices()) {
+        if (v.pos[0] == 0.0f && v.pos[1] == 0.0f && v.color[3] == 0) {
+            degenerate++;
+        }
+    }
+    CHECK_EQ(degenerate, overlay.vertices().size() - 24);
+    CHECK_EQ(overlay.vertices().size() % 3, (size_t)0);
+}
+
+TEST(overlay, outgrownLayerIsCompacted) {
+    AOverlay overlay;
+    frame(overlay, 0);
+    frame(overlay, 0);
+    // Far more than the headroom in layer 1
+    frame(overlay, 40);
+    std::vector<uint32_t> colors = quadIds(overlay.vertices());
+    CHECK_EQ(colors.size(), (size_t)44);
+    CHECK_EQ(colors.front(), 0x100u);
+    CHECK_EQ(colors[1], 0x101u);
+    CHECK_EQ(colors[2], 0x200u);
+    CHECK_EQ(colors[41], 0x227u);
+    CHECK_EQ(colors[42], 0x102u);
+    CHECK_EQ(colors.back(), 0x103u);
+    // And back down
+    frame(overlay, 1);
+    CHECK(quadIds(overlay.vertices()) == (std::vector<uint32_t>{0x100, 0x101, 0x200, 0x102, 0x103}));
+}
+
+TEST(overlay, emptyFrame) {
+    AOverlay overlay;
+    frame(overlay, 3);
+    overlay.begin();
+    overlay.finish();
+    CHECK_EQ(overlay.stats().vertices, 0u);
+    CHECK(quadIds(overlay.vertices()).empty());
+    overlay.begin();
+    overlay.finish();
+    CHECK(overlay.vertices().empty());
+}
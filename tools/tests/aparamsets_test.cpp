@@ -0,0 +1,176 @@
+//
+// AParamSets on small H.264/HEVC parameter set fixtures, and the sizing ADecoder
+// takes its input depth from (StreamSizing::queueDepth).
+//
+#include <cstdint>
+
+#include "aparamsets.h"
+#include "atest.h"
+
+namespace {
+
+// csd-0 and csd-1 as MediaExtractor hands them over for a x264-style 1080p High
+// stream: SPS (cropped from 1088, VUI timing at 30 fps, max_num_reorder_frames 2,
+// max_dec_frame_buffering 4, emulation prevention in the timing fields), then the PPS
+const uint8_t AVC_HIGH_1080P[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78,
+        0x02, 0x27, 0xe5, 0xc0, 0x44, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00,
+        0x03, 0x00, 0xf2, 0x3c, 0x60, 0xc6, 0x58, 0x00, 0x00, 0x00, 0x01, 0x68,
+        0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+
+// Constrained Baseline 720p, level 3.1, POC type 2, no VUI
+const uint8_t AVC_BASELINE_720P[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16,
+        0xe4,
+};
+
+// Main 640x480, level 3.0, POC type 0, no VUI; a bare NAL unit without start code
+const uint8_t AVC_MAIN_480P[] = {
+        0x67, 0x4d, 0x40, 0x1e, 0xec, 0x80, 0x50, 0x1e, 0xc8,
+};
+
+// HEVC csd-0 of a 1080p Main stream, level 4: VPS, SPS (conformance window from 1088,
+// sps_max_num_reorder_pics 2, max_dec_pic_buffering 5, latency increase plus1 5), PPS
+const uint8_t HEVC_MAIN_1080P[] = {
+        0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x60,
+        0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+        0x78, 0x95, 0xc0, 0x90, 0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01,
+        0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
+        0x00, 0x78, 0xa0, 0x03, 0xc0, 0x80, 0x11, 0x07, 0xcb, 0x96, 0x56, 0x69,
+        0x24, 0x6d, 0xac, 0x80, 0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc1, 0x72,
+        0xb4, 0x62, 0x40,
+};
+// The VPS alone, then the start of the SPS cut off
+const size_t HEVC_VPS_END = 28;
+const size_t HEVC_SPS_CUT = 40;
+
+// HEVC Main 10 2160p, level 5.1, 4 reorder pictures; SPS only
+const uint8_t HEVC_MAIN10_2160P[] = {
+        0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x02, 0x20, 0x00, 0x00, 0x03,
+        0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x99, 0xa0, 0x01,
+        0xe0, 0x20, 0x02, 0x1c, 0x4d, 0x96, 0x62, 0xe4, 0x91, 0xb6, 0xb2,
+};
+
+// 1080p/2160p rounded up to macroblocks, 4:2:0, plus the slice header allowance
+const int64_t RAW_1080P_8BIT = 1920LL * 1088 * 6 / 4 + 4096;
+const int64_t RAW_2160P_10BIT = 3840LL * 2160 * 6 / 4 * 10 / 8 + 4096;
+
+}
+
+TEST(paramsets, avcHighWithVui) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::AVC, AVC_HIGH_1080P, sizeof(AVC_HIGH_1080P), p));
+    CHECK(p.codec == VideoCodec::AVC);
+    CHECK_EQ(p.profile, 100);
+    CHECK_EQ(p.level, 40);
+    CHECK_EQ(p.width, 1920);
+    CHECK_EQ(p.height, 1080);
+    CHECK_EQ(p.chromaFormat, 1);
+    CHECK_EQ(p.bitDepth, 8);
+    CHECK(p.reorderSignaled);
+    CHECK_EQ(p.maxNumReorderFrames, 2);
+    CHECK_EQ(p.maxDecFrameBuffering, 4);
+    CHECK_NEAR(p.vuiFps, 30.0f, 1e-3);
+
+    // No container rate: the VUI's
+    StreamSizing s = AParamSets::sizing(p, 0.0f);
+    CHECK_EQ(s.outputDelayFrames, 2);
+    CHECK_NEAR(s.outputDelayMs, 66.667f, 1e-2);
+    CHECK_EQ(s.dpbFrames, 4);
+    CHECK_EQ(s.queueDepth, 4);
+    CHECK_EQ(s.maxSampleBytes, RAW_1080P_8BIT);
+    // The container's rate wins
+    CHECK_NEAR(AParamSets::sizing(p, 60.0f).outputDelayMs, 33.333f, 1e-2);
+}
+
+TEST(paramsets, avcPocType2HasNoReordering) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::AVC, AVC_BASELINE_720P, sizeof(AVC_BASELINE_720P), p));
+    CHECK_EQ(p.profile, 66);
+    CHECK_EQ(p.level, 31);
+    CHECK_EQ(p.width, 1280);
+    CHECK_EQ(p.height, 720);
+    CHECK(!p.reorderSignaled);
+    CHECK_EQ(p.maxNumReorderFrames, 0);
+    // MaxDpbMbs 18000 at level 3.1 over 80x45 macroblocks
+    CHECK_EQ(p.maxDecFrameBuffering, 5);
+    StreamSizing s = AParamSets::sizing(p, 30.0f);
+    CHECK_EQ(s.outputDelayFrames, 0);
+    CHECK_EQ(s.queueDepth, 2);
+    CHECK_EQ(s.dpbFrames, 5);
+}
+
+TEST(paramsets, avcReorderInferredFromLevel) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::AVC, AVC_MAIN_480P, sizeof(AVC_MAIN_480P), p));
+    CHECK_EQ(p.profile, 77);
+    CHECK_EQ(p.level, 30);
+    CHECK_EQ(p.width, 640);
+    CHECK_EQ(p.height, 480);
+    // Without VUI the whole DPB may reorder: MaxDpbMbs 8100 at level 3 over 40x30
+    CHECK(!p.reorderSignaled);
+    CHECK_EQ(p.maxNumReorderFrames, 6);
+    CHECK_EQ(AParamSets::sizing(p, 30.0f).queueDepth, 8);
+    CHECK_EQ(AParamSets::sizing(p, 30.0f).outputDelayMs, 200.0f);
+}
+
+TEST(paramsets, hevcSpsAfterVps) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::HEVC, HEVC_MAIN_1080P, sizeof(HEVC_MAIN_1080P), p));
+    CHECK(p.codec == VideoCodec::HEVC);
+    CHECK_EQ(p.profile, 1);
+    CHECK_EQ(p.level, 120);
+    CHECK_EQ(p.width, 1920);
+    CHECK_EQ(p.height, 1080);
+    CHECK_EQ(p.bitDepth, 8);
+    CHECK(p.reorderSignaled);
+    CHECK_EQ(p.maxNumReorderFrames, 2);
+    CHECK_EQ(p.maxDecFrameBuffering, 5);
+    CHECK_EQ(p.maxLatencyPictures, 6);
+    StreamSizing s = AParamSets::sizing(p, 25.0f);
+    CHECK_EQ(s.outputDelayFrames, 2);
+    CHECK_NEAR(s.outputDelayMs, 80.0f, 1e-3);
+    CHECK_EQ(s.dpbFrames, 5);
+    CHECK_EQ(s.queueDepth, 4);
+    CHECK_EQ(s.maxSampleBytes, RAW_1080P_8BIT);
+}
+
+TEST(paramsets, hevcVpsWhenSpsIsUnreadable) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::HEVC, HEVC_MAIN_1080P, HEVC_SPS_CUT, p));
+    CHECK_EQ(p.profile, 1);
+    CHECK_EQ(p.level, 120);
+    CHECK_EQ(p.maxNumReorderFrames, 2);
+    CHECK_EQ(p.maxDecFrameBuffering, 5);
+    CHECK_EQ(p.maxLatencyPictures, 0);
+    CHECK_EQ(AParamSets::sizing(p, 30.0f).queueDepth, 4);
+    CHECK(AParamSets::parse(VideoCodec::HEVC, HEVC_MAIN_1080P, HEVC_VPS_END, p));
+}
+
+TEST(paramsets, hevcMain10) {
+    StreamParams p{};
+    CHECK(AParamSets::parse(VideoCodec::HEVC, HEVC_MAIN10_2160P, sizeof(HEVC_MAIN10_2160P), p));
+    CHECK_EQ(p.profile, 2);
+    CHECK_EQ(p.level, 153);
+    CHECK_EQ(p.width, 3840);
+    CHECK_EQ(p.height, 2160);
+    CHECK_EQ(p.bitDepth, 10);
+    CHECK_EQ(p.maxNumReorderFrames, 4);
+    CHECK_EQ(p.maxDecFrameBuffering, 6);
+    StreamSizing s = AParamSets::sizing(p, 60.0f);
+    CHECK_EQ(s.queueDepth, 6);
+    CHECK_EQ(s.maxSampleBytes, RAW_2160P_10BIT);
+}
+
+TEST(paramsets, rejectsWrongCodecAndGarbage) {
+    StreamParams p{};
+    CHECK(!AParamSets::parse(VideoCodec::HEVC, AVC_HIGH_1080P, sizeof(AVC_HIGH_1080P), p));
+    CHECK(!AParamSets::parse(VideoCodec::AVC, HEVC_MAIN_1080P, sizeof(HEVC_MAIN_1080P), p));
+    CHECK(!AParamSets::parse(VideoCodec::UNKNOWN, AVC_MAIN_480P, sizeof(AVC_MAIN_480P), p));
+    // SPS cut before the picture size
+    CHECK(!AParamSets::parse(VideoCodec::AVC, AVC_MAIN_480P, 5, p));
+    CHECK(AParamSets::codecForMime("video/avc") == VideoCodec::AVC);
+    CHECK(AParamSets::codecForMime("video/hevc") == VideoCodec::HEVC);
+    CHECK(AParamSets::codecForMime("video/av01") == VideoCodec::UNKNOWN);
+}
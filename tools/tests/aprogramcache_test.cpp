@@ -0,0 +1,255 @@
+//
+// AProgramCache against the host's GL driver (Mesa's surfaceless EGL, llvmpipe
+// without a GPU): hits across instances, misses on changed sources and the stale
+// fallback for binaries from another driver or damaged files.
+//
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <string>
+#include <unistd.h>
+
+#include "aprogramcache.h"
+#include "atest.h"
+
+namespace {
+
+const char VERTEX[] =
+        "attribute vec4 vPosition;\n"
+        "void main() { gl_Position = vPosition; }\n";
+const char FRAGMENT[] =
+        "precision mediump float;\n"
+        "void main() { gl_FragColor = vec4(1.0, 0.5, 0.25, 1.0); }\n";
+const char FRAGMENT_EDITED[] =
+        "precision mediump float;\n"
+        "void main() { gl_FragColor = vec4(0.25, 0.5, 1.0, 1.0); }\n";
+
+// BinaryHeader.driverHash, after magic and format
+const long DRIVER_HASH_OFFSET = 8;
+const long HEADER_SIZE = 32;
+
+// A current GLES2 context on a 1x1 pbuffer, for the whole run
+class Context {
+public:
+    Context() {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        display = getPlatformDisplay
+                  ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+                  : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE};
+        const EGLint surfaceAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+        EGLConfig config;
+        EGLint count = 0;
+        ok = eglInitialize(display, nullptr, nullptr)
+             && eglChooseConfig(display, configAttribs, &config, 1, &count) && count == 1
+             && eglBindAPI(EGL_OPENGL_ES_API);
+        if (ok) {
+            surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+            ok = surface != EGL_NO_SURFACE && context != EGL_NO_CONTEXT
+                 && eglMakeCurrent(display, surface, surface, context);
+        }
+    }
+    ~Context() {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglDestroySurface(display, surface);
+        eglTerminate(display);
+    }
+    bool ok = false;
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+bool current() {
+    static Context context;
+    return context.ok;
+}
+
+GLuint linkProgram(const char* vertexSource, const char* fragmentSource) {
+    GLuint program = glCreateProgram();
+    for (auto [type, source] : {std::pair{GL_VERTEX_SHADER, vertexSource},
+                                std::pair{GL_FRAGMENT_SHADER, fragmentSource}}) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    glLinkProgram(program);
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE ? program : 0;
+}
+
+bool linked(GLuint program) {
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return program && status == GL_TRUE;
+}
+
+// A fresh cache directory, removed with what is in it
+class TempDir {
+public:
+    TempDir() {
+        char name[] = "/tmp/aprogramcache_testXXXXXX";
+        path = mkdtemp(name) ? name : "";
+    }
+    ~TempDir() {
+        if (DIR* d = opendir(path.c_str())) {
+            while (struct dirent* entry = readdir(d)) {
+                if (entry->d_name[0] != '.') {
+                    remove((path + "/" + entry->d_name).c_str());
+                }
+            }
+            closedir(d);
+        }
+        rmdir(path.c_str());
+    }
+    // The cached binary of the test program, once stored
+    std::string binary() const {
+        char name[32];
+        snprintf(name, sizeof(name), "/prog_%016llx.bin", (unsigned long long)AProgramCache::hash(
+                FRAGMENT, sizeof(FRAGMENT) - 1, AProgramCache::hash(VERTEX, sizeof(VERTEX) - 1)));
+        return path + name;
+    }
+    std::string path;
+};
+
+bool exists(const std::string& file) {
+    return access(file.c_str(), F_OK) == 0;
+}
+
+// Cache with the test program stored, as the first run leaves it
+bool primed(const TempDir& dir) {
+    AProgramCache cache;
+    if (!cache.init(dir.path.c_str())) {
+        return false;
+    }
+    GLuint program = linkProgram(VERTEX, FRAGMENT);
+    cache.store(program, VERTEX, FRAGMENT);
+    glDeleteProgram(program);
+    return exists(dir.binary());
+}
+
+}
+
+TEST(programcache, driverHandsOutBinaries) {
+    CHECK(current());
+    TempDir dir;
+    AProgramCache cache;
+    CHECK(cache.init(dir.path.c_str()));
+    // Without a directory nothing is cached, and nothing counts as a miss
+    CHECK(!cache.init(nullptr));
+    CHECK_EQ(cache.load(VERTEX, FRAGMENT), 0u);
+    CHECK_EQ(cache.misses(), 0);
+}
+
+TEST(programcache, hitAfterStore) {
+    CHECK(current());
+    TempDir dir;
+    {
+        AProgramCache first;
+        CHECK(first.init(dir.path.c_str()));
+        CHECK_EQ(first.load(VERTEX, FRAGMENT), 0u);
+        CHECK_EQ(first.misses(), 1);
+        GLuint program = linkProgram(VERTEX, FRAGMENT);
+        CHECK(program != 0);
+        first.store(program, VERTEX, FRAGMENT);
+        glDeleteProgram(program);
+    }
+    CHECK(exists(dir.binary()));
+    CHECK(!exists(dir.binary() + ".tmp"));
+
+    // The next window, or the next start
+    AProgramCache second;
+    CHECK(second.init(dir.path.c_str()));
+    GLuint program = second.load(VERTEX, FRAGMENT);
+    CHECK(linked(program));
+    CHECK_EQ(glGetAttribLocation(program, "vPosition"), 0);
+    CHECK_EQ(second.hits(), 1);
+    CHECK_EQ(second.misses(), 0);
+    glDeleteProgram(program);
+}
+
+TEST(programcache, editedShaderMisses) {
+    CHECK(current());
+    TempDir dir;
+    CHECK(primed(dir));
+    AProgramCache cache;
+    CHECK(cache.init(dir.path.c_str()));
+    CHECK_EQ(cache.load(VERTEX, FRAGMENT_EDITED), 0u);
+    CHECK_EQ(cache.misses(), 1);
+    // The other program's binary stays
+    CHECK(exists(dir.binary()));
+}
+
+TEST(programcache, otherDriverIsStale) {
+    CHECK(current());
+    TempDir dir;
+    CHECK(primed(dir));
+    FILE* f = fopen(dir.binary().c_str(), "r+b");
+    CHECK(f != nullptr);
+    uint64_t otherDriver = 42;
+    fseek(f, DRIVER_HASH_OFFSET, SEEK_SET);
+    fwrite(&otherDriver, sizeof(otherDriver), 1, f);
+    fclose(f);
+
+    AProgramCache cache;
+    CHECK(cache.init(dir.path.c_str()));
+    CHECK_EQ(cache.load(VERTEX, FRAGMENT), 0u);
+    CHECK_EQ(cache.misses(), 1);
+    // Removed, so the next store writes this driver's
+    CHECK(!exists(dir.binary()));
+}
+
+TEST(programcache, truncatedBinaryIsStale) {
+    CHECK(current());
+    TempDir dir;
+    CHECK(primed(dir));
+    CHECK(truncate(dir.binary().c_str(), HEADER_SIZE + 1) == 0);
+    AProgramCache cache;
+    CHECK(cache.init(dir.path.c_str()));
+    CHECK_EQ(cache.load(VERTEX, FRAGMENT), 0u);
+    CHECK(!exists(dir.binary()));
+}
+
+TEST(programcache, rejectedBinaryFallsBack) {
+    CHECK(current());
+    TempDir dir;
+    CHECK(primed(dir));
+    // Same header, a binary the driver can't take (as after an update that kept
+    // the version string)
+    FILE* f = fopen(dir.binary().c_str(), "r+b");
+    CHECK(f != nullptr);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, HEADER_SIZE, SEEK_SET);
+    for (long i = HEADER_SIZE; i < size; i++) {
+        fputc(0x5a, f);
+    }
+    fclose(f);
+
+    AProgramCache cache;
+    CHECK(cache.init(dir.path.c_str()));
+    CHECK_EQ(cache.load(VERTEX, FRAGMENT), 0u);
+    CHECK_EQ(cache.misses(), 1);
+    CHECK(!exists(dir.binary()));
+    // Compiling from source still works, and refills the cache
+    GLuint program = linkProgram(VERTEX, FRAGMENT);
+    CHECK(linked(program));
+    cache.store(program, VERTEX, FRAGMENT);
+    glDeleteProgram(program);
+    program = cache.load(VERTEX, FRAGMENT);
+    CHECK(linked(program));
+    CHECK_EQ(cache.hits(), 1);
+    glDeleteProgram(program);
+}
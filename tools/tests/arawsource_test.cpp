@@ -0,0 +1,161 @@
+//
+// ARawSource: Y4M header and frame parsing, raw frame sizes, looping and image slots.
+//
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "arawsource.h"
+#include "atest.h"
+
+namespace {
+
+// A temporary file holding data, removed with the object
+struct TempFile {
+    std::string path;
+
+    explicit TempFile(const std::string& data) {
+        char name[] = "/tmp/arawsource_testXXXXXX";
+        int fd = mkstemp(name);
+        path = name;
+        if (fd >= 0) {
+            ssize_t written = write(fd, data.data(), data.size());
+            (void)written;
+            close(fd);
+        }
+    }
+    ~TempFile() { unlink(path.c_str()); }
+};
+
+size_t i420Bytes(int w, int h) {
+    return (size_t)w * h + 2 * (size_t)((w + 1) / 2) * ((h + 1) / 2);
+}
+
+// Frame i is filled with the byte 'a' + i
+std::string y4m(const char* header, int w, int h, int frames, const char* frameLine = "FRAME\n") {
+    std::string data = header;
+    for (int i = 0; i < frames; i++) {
+        data += frameLine;
+        data += std::string(i420Bytes(w, h), (char)('a' + i));
+    }
+    return data;
+}
+
+}
+
+TEST(rawsource, y4mHeader) {
+    TempFile file(y4m("YUV4MPEG2 W6 H4 F25:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", 6, 4, 3));
+    ARawSource source;
+    CHECK(source.open(file.path.c_str()));
+    CHECK_EQ(source.frameCount(), 3);
+    CHECK_NEAR(source.frameRate(), 25.0f, 1e-6);
+    VideoFormat format;
+    CHECK(source.pollFormatChange(format));
+    CHECK_EQ(format.width, 6);
+    CHECK_EQ(format.height, 4);
+    CHECK_EQ(format.cropRight, 6);
+    CHECK_EQ(format.cropBottom, 4);
+    CHECK(!source.pollFormatChange(format));
+}
+
+TEST(rawsource, y4mFrameParametersAndOddSize) {
+    // Frame lines may carry parameters; 5x3 has 3x2 chroma planes
+    TempFile file(y4m("YUV4MPEG2 W5 H3 F30000:1001 C420\n", 5, 3, 2, "FRAME Ixyz\n"));
+    ARawSource source;
+    CHECK(source.open(file.path.c_str()));
+    CHECK_EQ(source.frameCount(), 2);
+    AImage* first = source.acquireLatestImage();
+    CHECK(first != nullptr);
+    CHECK_EQ(first->planes[0][0], (uint8_t)'a');
+    CHECK_EQ(first->planes[1] - first->planes[0], 15);
+    CHECK_EQ(first->planes[2] - first->planes[1], 6);
+    CHECK_EQ(first->planes[2][5], (uint8_t)'a');
+    AImage* second = source.acquireLatestImage();
+    CHECK_EQ(second->planes[0][0], (uint8_t)'b');
+    CHECK_EQ(second->planes[2][5], (uint8_t)'b');
+}
+
+TEST(rawsource, y4mRejectsOtherLayouts) {
+    const char* headers[] = {"YUV4MPEG2 W4 H4 C420p10\n", "YUV4MPEG2 W4 H4 C420p12\n",
+                             "YUV4MPEG2 W4 H4 C422\n", "YUV4MPEG2 W4 H4 Cmono\n", "YUV4MPEG2 H4\n"};
+    for (const char* header : headers) {
+        TempFile file(y4m(header, 4, 4, 2));
+        ARawSource source;
+        CHECK(!source.open(file.path.c_str()));
+    }
+    // Every 8-bit 4:2:0 siting, and no tag at all (4:2:0 by default)
+    const char* accepted[] = {"YUV4MPEG2 W4 H4 C420\n", "YUV4MPEG2 W4 H4 C420jpeg\n",
+                              "YUV4MPEG2 W4 H4 C420mpeg2\n", "YUV4MPEG2 W4 H4 C420paldv\n", "YUV4MPEG2 W4 H4\n"};
+    for (const char* header : accepted) {
+        TempFile file(y4m(header, 4, 4, 2));
+        ARawSource source;
+        CHECK(source.open(file.path.c_str()));
+        CHECK_EQ(source.frameCount(), 2);
+    }
+}
+
+TEST(rawsource, y4mTruncatedLastFrame) {
+    std::string data = y4m("YUV4MPEG2 W4 H4\n", 4, 4, 2);
+    data.resize(data.size() - 1);
+    TempFile file(data);
+    ARawSource source;
+    CHECK(source.open(file.path.c_str()));
+    CHECK_EQ(source.frameCount(), 1);
+}
+
+TEST(rawsource, rawI420AndNv12) {
+    // 3 frames and a partial one
+    std::string data(i420Bytes(7, 5) * 3 + 10, 'x');
+    TempFile file(data);
+    ARawSource i420;
+    CHECK(!i420.open(file.path.c_str()));
+    CHECK(i420.open(file.path.c_str(), 7, 5, AImage::I420));
+    CHECK_EQ(i420.frameCount(), 3);
+    CHECK_NEAR(i420.frameRate(), 30.0f, 1e-6);
+    AImage* image = i420.acquireLatestImage();
+    CHECK_EQ(image->format, AImage::I420);
+    CHECK_EQ(image->planes[1] - image->planes[0], 35);
+    CHECK_EQ(image->planes[2] - image->planes[1], 12);
+
+    ARawSource nv12;
+    CHECK(nv12.open(file.path.c_str(), 7, 5, AImage::NV12, 60.0f));
+    CHECK_EQ(nv12.frameCount(), 3);
+    CHECK_NEAR(nv12.frameRate(), 60.0f, 1e-6);
+    image = nv12.acquireLatestImage();
+    CHECK_EQ(image->format, AImage::NV12);
+    CHECK_EQ(image->planes[1] - image->planes[0], 35);
+    CHECK(image->planes[2] == nullptr);
+    // Y then 4x3 interleaved UV pairs, same size as I420
+    const uint8_t* firstFrame = image->planes[0];
+    nv12.releaseImage(image);
+    image = nv12.acquireLatestImage();
+    CHECK_EQ(image->planes[0] - firstFrame, (long)i420Bytes(7, 5));
+}
+
+TEST(rawsource, loopsWithIncreasingPts) {
+    TempFile file(y4m("YUV4MPEG2 W2 H2 F10:1\n", 2, 2, 3));
+    ARawSource source;
+    CHECK(source.open(file.path.c_str()));
+    for (int i = 0; i < 7; i++) {
+        AImage* image = source.acquireLatestImage();
+        CHECK(image != nullptr);
+        CHECK_EQ(image->index, i % 3);
+        CHECK_EQ(image->planes[0][0], (uint8_t)('a' + i % 3));
+        CHECK_EQ(image->ptsUs, (int64_t)i * 100000);
+        source.releaseImage(image);
+    }
+}
+
+TEST(rawsource, imageSlots) {
+    TempFile file(y4m("YUV4MPEG2 W2 H2\n", 2, 2, 1));
+    ARawSource source;
+    CHECK(source.open(file.path.c_str()));
+    AImage* held[ARawSource::MAX_IMAGES];
+    for (auto& image : held) {
+        image = source.acquireLatestImage();
+        CHECK(image != nullptr);
+    }
+    CHECK(source.acquireLatestImage() == nullptr);
+    source.releaseImage(held[1]);
+    CHECK(source.acquireLatestImage() == held[1]);
+}
@@ -0,0 +1,106 @@
+//
+// ARefreshRate mode selection, cadence and judder.
+//
+#include <cmath>
+#include <vector>
+
+#include "arefreshrate.h"
+#include "atest.h"
+
+namespace {
+
+const float PHONE_MODES[] = {60.0f, 90.0f, 120.0f};
+
+std::vector<int> cadence(float fps, float hz, int count) {
+    std::vector<int> out(count);
+    ARefreshRate::cadence(fps, hz, out.data(), count);
+    return out;
+}
+
+}
+
+TEST(refreshrate, multiples) {
+    CHECK_EQ(ARefreshRate::multiple(30.0f, 60.0f), 2);
+    CHECK_EQ(ARefreshRate::multiple(24.0f, 120.0f), 5);
+    CHECK_EQ(ARefreshRate::multiple(60.0f, 60.0f), 1);
+    // NTSC rates are within the tolerance of the integer ones
+    CHECK_EQ(ARefreshRate::multiple(23.976f, 120.0f), 5);
+    CHECK_EQ(ARefreshRate::multiple(29.97f, 60.0f), 2);
+    CHECK_EQ(ARefreshRate::multiple(59.94f, 60.0f), 1);
+    CHECK_EQ(ARefreshRate::multiple(25.0f, 60.0f), 0);
+    CHECK_EQ(ARefreshRate::multiple(24.0f, 60.0f), 0);
+    CHECK_EQ(ARefreshRate::multiple(120.0f, 60.0f), 0);
+    CHECK_EQ(ARefreshRate::multiple(0.0f, 60.0f), 0);
+    CHECK_EQ(ARefreshRate::multiple(30.0f, 0.0f), 0);
+}
+
+TEST(refreshrate, lowestIntegerMultiple) {
+    RefreshChoice c = ARefreshRate::select(30.0f, PHONE_MODES, 3);
+    CHECK_EQ(c.hz, 60.0f);
+    CHECK_EQ(c.multiple, 2);
+    CHECK_EQ(c.judderMs, 0.0f);
+
+    c = ARefreshRate::select(24.0f, PHONE_MODES, 3);
+    CHECK_EQ(c.hz, 120.0f);
+    CHECK_EQ(c.multiple, 5);
+
+    c = ARefreshRate::select(23.976f, PHONE_MODES, 3);
+    CHECK_EQ(c.hz, 120.0f);
+    CHECK_EQ(c.multiple, 5);
+}
+
+TEST(refreshrate, minimumRate) {
+    // Not below minHz while a multiple above it exists
+    RefreshChoice c = ARefreshRate::select(30.0f, PHONE_MODES, 3, 90.0f);
+    CHECK_EQ(c.hz, 90.0f);
+    CHECK_EQ(c.multiple, 3);
+    c = ARefreshRate::select(30.0f, PHONE_MODES, 3, 100.0f);
+    CHECK_EQ(c.hz, 120.0f);
+    CHECK_EQ(c.multiple, 4);
+    // A single mode is taken whatever minHz says
+    const float only = 60.0f;
+    c = ARefreshRate::select(25.0f, &only, 1, 90.0f);
+    CHECK_EQ(c.hz, 60.0f);
+}
+
+TEST(refreshrate, leastJudderWithoutMultiple) {
+    // 25 fps: no multiple, a vsync period of spread at most and the shortest at 120 Hz
+    CHECK_NEAR(ARefreshRate::judderMs(25.0f, 60.0f), 13.333, 0.01);
+    CHECK_NEAR(ARefreshRate::judderMs(25.0f, 90.0f), 8.889, 0.01);
+    CHECK_NEAR(ARefreshRate::judderMs(25.0f, 120.0f), 6.667, 0.01);
+    RefreshChoice c = ARefreshRate::select(25.0f, PHONE_MODES, 3);
+    CHECK_EQ(c.hz, 120.0f);
+    CHECK_EQ(c.multiple, 0);
+    CHECK_NEAR(c.judderMs, 6.667, 0.01);
+
+    // Equal judder goes to the higher mode: with no content rate every mode ties
+    CHECK_EQ(ARefreshRate::select(0.0f, PHONE_MODES, 3).hz, 120.0f);
+
+    CHECK_EQ(ARefreshRate::select(30.0f, PHONE_MODES, 0).hz, 0.0f);
+}
+
+TEST(refreshrate, pulldownCadence) {
+    // 3:2 pulldown, the first frame the long one
+    CHECK(cadence(24.0f, 60.0f, 6) == (std::vector<int>{3, 2, 3, 2, 3, 2}));
+    CHECK(cadence(30.0f, 60.0f, 4) == (std::vector<int>{2, 2, 2, 2}));
+    CHECK(cadence(24.0f, 120.0f, 4) == (std::vector<int>{5, 5, 5, 5}));
+    CHECK(cadence(60.0f, 60.0f, 3) == (std::vector<int>{1, 1, 1}));
+    // 24 fps at 60 Hz alternates 50 and 33 ms frames, half a vsync off either way
+    CHECK_NEAR(ARefreshRate::judderMs(24.0f, 60.0f), 8.333, 0.01);
+    CHECK_EQ(ARefreshRate::judderMs(24.0f, 120.0f), 0.0f);
+}
+
+TEST(refreshrate, slightMismatchSlipsRarely) {
+    // 23.976 at 72 Hz counts as 3:3, a frame gets a fourth vsync once the error
+    // adds up to half of one
+    const int frames = 2000;
+    std::vector<int> c = cadence(23.976f, 72.0f, frames);
+    int threes = 0, total = 0;
+    for (int v : c) {
+        threes += v == 3;
+        total += v;
+        CHECK(v == 3 || v == 4);
+    }
+    CHECK(threes > frames - 10);
+    CHECK_EQ(total, (int)std::lround(frames * 72.0 / 23.976f));
+}
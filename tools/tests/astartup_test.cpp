@@ -0,0 +1,124 @@
+//
+// AStartup ordering, thread placement, failure propagation and the serial baseline.
+//
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "astartup.h"
+#include "atest.h"
+
+namespace {
+
+// Which step ran when, and on which thread
+struct Log {
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::thread::id> threads;
+
+    AStartup::Step step(int id, bool ok = true) {
+        return [this, id, ok] {
+            std::lock_guard lock(mtx);
+            order.push_back(id);
+            threads.push_back(std::this_thread::get_id());
+            return ok;
+        };
+    }
+
+    // Position of id in order, -1 if it never ran
+    int at(int id) {
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] == id) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    std::thread::id thread(int id) {
+        int i = at(id);
+        return i < 0 ? std::thread::id() : threads[i];
+    }
+};
+
+}
+
+TEST(startup, dependencyOrder) {
+    for (int round = 0; round < 20; round++) {
+        Log log;
+        AStartup startup;
+        int font = startup.add("font", {}, log.step(0));
+        int egl = startup.add("egl", {}, log.step(1), true);
+        int atlas = startup.add("atlas", {font, egl}, log.step(2), true);
+        int extractor = startup.add("extractor", {}, log.step(3));
+        int codec = startup.add("codec", {extractor, atlas}, log.step(4));
+        CHECK(startup.run());
+        CHECK_EQ(log.order.size(), (size_t)5);
+        CHECK(log.at(font) < log.at(atlas));
+        CHECK(log.at(egl) < log.at(atlas));
+        CHECK(log.at(extractor) < log.at(codec));
+        CHECK(log.at(atlas) < log.at(codec));
+        for (int id : {font, egl, atlas, extractor, codec}) {
+            CHECK(startup.succeeded(id));
+        }
+        CHECK(startup.wallNs() >= 0);
+    }
+}
+
+TEST(startup, callerStepsOnCallerInOrder) {
+    Log log;
+    AStartup startup;
+    int worker = startup.add("worker", {}, log.step(0));
+    // The first caller step waits on a worker, the next ones still run after it
+    int first = startup.add("first", {worker}, log.step(1), true);
+    int second = startup.add("second", {}, log.step(2), true);
+    int third = startup.add("third", {}, log.step(3), true);
+    CHECK(startup.run());
+    std::thread::id caller = std::this_thread::get_id();
+    CHECK(log.thread(first) == caller);
+    CHECK(log.thread(second) == caller);
+    CHECK(log.thread(third) == caller);
+    CHECK(log.thread(worker) != caller);
+    CHECK(log.at(worker) < log.at(first));
+    CHECK(log.at(first) < log.at(second));
+    CHECK(log.at(second) < log.at(third));
+}
+
+TEST(startup, failureSkipsDependents) {
+    Log log;
+    AStartup startup;
+    int failing = startup.add("failing", {}, log.step(0, false));
+    int child = startup.add("child", {failing}, log.step(1));
+    int grandchild = startup.add("grandchild", {child}, log.step(2), true);
+    int independent = startup.add("independent", {}, log.step(3));
+    int mixed = startup.add("mixed", {independent, grandchild}, log.step(4));
+    CHECK(!startup.run());
+    CHECK(!startup.succeeded(failing));
+    CHECK(!startup.succeeded(child));
+    CHECK(!startup.succeeded(grandchild));
+    CHECK(!startup.succeeded(mixed));
+    CHECK(startup.succeeded(independent));
+    // Skipped steps never run
+    CHECK_EQ(log.at(child), -1);
+    CHECK_EQ(log.at(grandchild), -1);
+    CHECK_EQ(log.at(mixed), -1);
+    CHECK(log.at(failing) >= 0);
+    CHECK(log.at(independent) >= 0);
+    CHECK(!startup.succeeded(-1));
+    CHECK(!startup.succeeded(99));
+}
+
+TEST(startup, serial) {
+    Log log;
+    AStartup startup;
+    int a = startup.add("a", {}, log.step(0));
+    int b = startup.add("b", {a}, log.step(1), true);
+    int c = startup.add("c", {}, log.step(2));
+    startup.add("d", {b, c}, log.step(3));
+    CHECK(startup.run(false));
+    // Everything on the caller, in the order added
+    CHECK(log.order == (std::vector<int>{0, 1, 2, 3}));
+    for (std::thread::id id : log.threads) {
+        CHECK(id == std::this_thread::get_id());
+    }
+}
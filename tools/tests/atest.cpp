@@ -0,0 +1,60 @@
+//
+// Host test runner.
+//
+#include "atest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Entry {
+    const char* suite;
+    const char* name;
+    ATest::Fn fn;
+};
+
+std::vector<Entry>& registry() {
+    static std::vector<Entry> tests;
+    return tests;
+}
+
+int failures = 0;
+
+}
+
+void ATest::add(const char* suite, const char* name, Fn fn) {
+    registry().push_back({suite, name, fn});
+}
+
+void ATest::fail(const char* file, int line, const std::string& what) {
+    fprintf(stderr, "%s:%d: FAILED %s\n", file, line, what.c_str());
+    failures++;
+}
+
+int ATest::run(int argc, char** argv) {
+    int ran = 0;
+    int failed = 0;
+    for (const auto& test : registry()) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; i++) {
+            selected = selected || !strcmp(argv[i], test.suite);
+        }
+        if (!selected) {
+            continue;
+        }
+        int before = failures;
+        test.fn();
+        ran++;
+        bool ok = failures == before;
+        failed += ok ? 0 : 1;
+        printf("%s %s.%s\n", ok ? "ok  " : "FAIL", test.suite, test.name);
+    }
+    printf("%d tests, %d failed\n", ran, failed);
+    return ran == 0 || failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    return ATest::run(argc, argv);
+}
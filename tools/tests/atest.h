@@ -0,0 +1,46 @@
+//
+// Minimal host test harness: TEST(suite, name) registers a test, CHECK* report a
+// failure and carry on. aplayer_tests [suite...] runs everything or the named suites.
+//
+#ifndef ATEST_H
+#define ATEST_H
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+class ATest {
+public:
+    using Fn = void (*)();
+
+    static void add(const char* suite, const char* name, Fn fn);
+    static int run(int argc, char** argv);
+    static void fail(const char* file, int line, const std::string& what);
+
+    template <typename A, typename B>
+    static void checkEq(const A& a, const B& b, const char* as, const char* bs, const char* file, int line) {
+        if (!(a == b)) {
+            std::ostringstream out;
+            out << as << " == " << bs << ": " << a << " vs " << b;
+            fail(file, line, out.str());
+        }
+    }
+};
+
+struct ATestRegistrar {
+    ATestRegistrar(const char* suite, const char* name, ATest::Fn fn) { ATest::add(suite, name, fn); }
+};
+
+#define TEST(suite, name)                                                               \
+    static void suite##_##name();                                                       \
+    static ATestRegistrar suite##_##name##_registrar(#suite, #name, suite##_##name);    \
+    static void suite##_##name()
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) ATest::fail(__FILE__, __LINE__, #cond);                            \
+    } while (0)
+#define CHECK_EQ(a, b) ATest::checkEq((a), (b), #a, #b, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, eps) CHECK(std::fabs((double)(a) - (double)(b)) <= (eps))
+
+#endif //ATEST_H
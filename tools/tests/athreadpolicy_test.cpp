@@ -0,0 +1,186 @@
+//
+// AThreadPolicy affinity, nice and the /proc scheduling stats, on the host's own threads.
+//
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "athreadpolicy.h"
+#include "atest.h"
+
+namespace {
+
+const int WAKEUPS = 20;
+
+uint64_t affinityMask() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+    uint64_t mask = 0;
+    for (int cpu = 0; cpu < 64; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            mask |= 1ull << cpu;
+        }
+    }
+    return mask;
+}
+
+// True when no core reports a lower cpuinfo_max_freq than another (or none reports one)
+bool symmetricHost() {
+    long first = -1;
+    for (int cpu = 0; cpu < 64; cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        long freq = -1;
+        bool read = fscanf(f, "%ld", &freq) == 1;
+        fclose(f);
+        if (read && first >= 0 && freq != first) {
+            return false;
+        }
+        if (read && first < 0) {
+            first = freq;
+        }
+    }
+    return true;
+}
+
+// Names itself, then sleeps and wakes WAKEUPS times once told to, and stays until released
+struct Sleeper {
+    std::atomic<int> tid{0};
+    std::atomic<bool> go{false};
+    std::atomic<bool> slept{false};
+    std::atomic<bool> release{false};
+    std::thread thread;
+
+    explicit Sleeper(const char* name) {
+        thread = std::thread([this, name] {
+            AThreadPolicy::setName(name);
+            tid = AThreadPolicy::tid();
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < WAKEUPS; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            slept = true;
+            while (!release) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        while (!tid) {
+            std::this_thread::yield();
+        }
+    }
+
+    ~Sleeper() {
+        go = release = true;
+        thread.join();
+    }
+};
+
+}
+
+TEST(threadpolicy, affinity) {
+    // What the cpuset lets this process use: a wider request is cut down to it
+    uint64_t allowed = affinityMask();
+    CHECK(allowed != 0);
+    for (CoreSet cores : {CoreSet::ANY, CoreSet::BIG, CoreSet::LITTLE}) {
+        uint64_t want = AThreadPolicy::coreMask(cores);
+        CHECK(want != 0);
+        // On a thread of its own, the test runner keeps its affinity
+        std::thread([&] {
+            bool ok = AThreadPolicy::setAffinity(cores);
+            CHECK_EQ(ok, (want & allowed) != 0);
+            if (ok) {
+                CHECK_EQ(affinityMask(), want & allowed);
+            }
+        }).join();
+    }
+    CHECK_EQ(affinityMask(), allowed);
+}
+
+TEST(threadpolicy, coreMask) {
+    uint64_t any = AThreadPolicy::coreMask(CoreSet::ANY);
+    uint64_t big = AThreadPolicy::coreMask(CoreSet::BIG);
+    uint64_t little = AThreadPolicy::coreMask(CoreSet::LITTLE);
+    CHECK(any != 0);
+    CHECK_EQ(big | little, any);
+    if (symmetricHost()) {
+        // Every core is both big and little
+        CHECK_EQ(big, any);
+        CHECK_EQ(little, any);
+    } else {
+        CHECK_EQ(big & little, 0ull);
+        CHECK(big != 0 && little != 0);
+    }
+}
+
+TEST(threadpolicy, nice) {
+    int before = getpriority(PRIO_PROCESS, AThreadPolicy::tid());
+    int target = before < 10 ? before + 5 : before;
+    std::thread([target] {
+        // Lowering its own priority needs no privilege
+        CHECK(AThreadPolicy::setNice(target));
+        CHECK_EQ(getpriority(PRIO_PROCESS, AThreadPolicy::tid()), target);
+    }).join();
+    // Per thread: the caller's is untouched
+    CHECK_EQ(getpriority(PRIO_PROCESS, AThreadPolicy::tid()), before);
+}
+
+TEST(threadpolicy, readStats) {
+    std::thread([] {
+        int tid = AThreadPolicy::tid();
+        ThreadStats before, after;
+        CHECK(AThreadPolicy::readStats(tid, before));
+        for (int i = 0; i < WAKEUPS; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(AThreadPolicy::readStats(tid, after));
+        CHECK(after.timeslices - before.timeslices >= WAKEUPS);
+        CHECK(before.cpuNs >= 0);
+        CHECK(after.cpuNs >= before.cpuNs);
+        CHECK(after.runDelayNs >= before.runDelayNs);
+        CHECK(after.cpu >= 0);
+    }).join();
+    ThreadStats none;
+    CHECK(!AThreadPolicy::readStats(-1, none));
+}
+
+TEST(threadpolicy, sampleProcess) {
+    Sleeper sleeper("tp-sleeper");
+    std::vector<ThreadSample> before = AThreadPolicy::sampleProcess();
+    const ThreadSample* found = nullptr;
+    for (const auto& t : before) {
+        if (t.tid == sleeper.tid) {
+            found = &t;
+        }
+    }
+    CHECK(found != nullptr);
+    if (found) {
+        CHECK_EQ(std::string(found->name), std::string("tp-sleeper"));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sleeper.go = true;
+    while (!sleeper.slept) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int64_t spanNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    // The sleeper's wakeups alone, the runner's add to them
+    float perSecond = AThreadPolicy::logWakeups("test", before, spanNs);
+    CHECK(perSecond >= WAKEUPS * 1e9f / spanNs);
+    CHECK_EQ(AThreadPolicy::logWakeups("test", before, 0), 0.0f);
+}
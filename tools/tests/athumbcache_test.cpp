@@ -0,0 +1,169 @@
+//
+// AThumbCache round trips, invalidation and trimming, in a temporary directory.
+//
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "athumbcache.h"
+#include "atest.h"
+
+namespace {
+
+// A fresh directory, removed with what is in it
+class TempDir {
+public:
+    TempDir() {
+        char name[] = "/tmp/athumbcache_testXXXXXX";
+        path = mkdtemp(name) ? name : "";
+    }
+    ~TempDir() {
+        if (DIR* d = opendir(path.c_str())) {
+            while (struct dirent* entry = readdir(d)) {
+                if (entry->d_name[0] != '.') {
+                    remove((path + "/" + entry->d_name).c_str());
+                }
+            }
+            closedir(d);
+        }
+        rmdir(path.c_str());
+    }
+    std::string path;
+};
+
+Thumbnails strip(int count, uint8_t seed) {
+    Thumbnails t;
+    t.width = 16;
+    t.height = 10;
+    for (int i = 0; i < count; i++) {
+        t.ptsUs.push_back(i * 2000000LL);
+    }
+    t.pixels.resize(t.frameBytes() * count);
+    for (size_t i = 0; i < t.pixels.size(); i++) {
+        t.pixels[i] = (uint8_t)(i * 7 + seed);
+    }
+    return t;
+}
+
+void setMtime(const std::string& file, time_t seconds) {
+    struct timespec times[2] = {{seconds, 0}, {seconds, 0}};
+    utimensat(AT_FDCWD, file.c_str(), times, 0);
+}
+
+const ThumbSource CLIP{"/sdcard/Movies/clip.mp4", 1700000000123456789LL, 123456789};
+
+}
+
+TEST(thumbcache, roundTrip) {
+    TempDir dir;
+    AThumbCache cache(dir.path);
+    Thumbnails saved = strip(12, 1);
+    CHECK(cache.save(CLIP, saved));
+    Thumbnails loaded;
+    CHECK(cache.load(CLIP, loaded));
+    CHECK_EQ(loaded.width, 16);
+    CHECK_EQ(loaded.height, 10);
+    CHECK(loaded.ptsUs == saved.ptsUs);
+    CHECK(loaded.pixels == saved.pixels);
+
+    ThumbSource source;
+    Thumbnails read;
+    CHECK(AThumbCache::read(cache.fileFor(CLIP.path).c_str(), source, read));
+    CHECK_EQ(source.path, CLIP.path);
+    CHECK_EQ(source.mtimeNs, CLIP.mtimeNs);
+    CHECK_EQ(source.size, CLIP.size);
+    CHECK_EQ(read.count(), 12);
+    // No temporary file left behind
+    CHECK(access((cache.fileFor(CLIP.path) + ".tmp").c_str(), F_OK) != 0);
+}
+
+TEST(thumbcache, editedVideoMisses) {
+    TempDir dir;
+    AThumbCache cache(dir.path);
+    CHECK(cache.save(CLIP, strip(4, 2)));
+    Thumbnails out;
+    ThumbSource touched = CLIP;
+    touched.mtimeNs++;
+    CHECK(!cache.load(touched, out));
+    ThumbSource resized = CLIP;
+    resized.size--;
+    CHECK(!cache.load(resized, out));
+    ThumbSource other = CLIP;
+    other.path += ".bak";
+    CHECK(!cache.load(other, out));
+    CHECK(cache.load(CLIP, out));
+
+    // Saving the new version replaces the old one
+    CHECK(cache.save(touched, strip(5, 3)));
+    CHECK(!cache.load(CLIP, out));
+    CHECK(cache.load(touched, out));
+    CHECK_EQ(out.count(), 5);
+}
+
+TEST(thumbcache, damagedFilesMiss) {
+    TempDir dir;
+    AThumbCache cache(dir.path);
+    CHECK(cache.save(CLIP, strip(3, 4)));
+    std::string file = cache.fileFor(CLIP.path);
+    struct stat st;
+    CHECK(stat(file.c_str(), &st) == 0);
+    Thumbnails out;
+
+    CHECK(truncate(file.c_str(), st.st_size - 1) == 0);
+    CHECK(!cache.load(CLIP, out));
+
+    CHECK(cache.save(CLIP, strip(3, 4)));
+    FILE* f = fopen(file.c_str(), "ab");
+    fputc(0, f);
+    fclose(f);
+    CHECK(!cache.load(CLIP, out));
+
+    // Another format version
+    CHECK(cache.save(CLIP, strip(3, 4)));
+    f = fopen(file.c_str(), "r+b");
+    fseek(f, 4, SEEK_SET);
+    uint32_t version = AThumbCache::VERSION + 1;
+    fwrite(&version, sizeof(version), 1, f);
+    fclose(f);
+    CHECK(!cache.load(CLIP, out));
+}
+
+TEST(thumbcache, rejectsBadGeometry) {
+    TempDir dir;
+    AThumbCache cache(dir.path);
+    Thumbnails t = strip(2, 5);
+    t.pixels.pop_back();
+    CHECK(!cache.save(CLIP, t));
+    CHECK(access(cache.fileFor(CLIP.path).c_str(), F_OK) != 0);
+}
+
+TEST(thumbcache, trimGoesByLastUse) {
+    TempDir dir;
+    AThumbCache cache(dir.path);
+    ThumbSource a = CLIP, b = CLIP, c = CLIP;
+    a.path = "/a.mp4";
+    b.path = "/b.mp4";
+    c.path = "/c.mp4";
+    for (const auto* s : {&a, &b, &c}) {
+        CHECK(cache.save(*s, strip(6, 6)));
+    }
+    setMtime(cache.fileFor(a.path), 1000);
+    setMtime(cache.fileFor(b.path), 2000);
+    setMtime(cache.fileFor(c.path), 3000);
+    // Using a makes b the oldest
+    Thumbnails out;
+    CHECK(cache.load(a, out));
+
+    struct stat st;
+    CHECK(stat(cache.fileFor(a.path).c_str(), &st) == 0);
+    CHECK_EQ(cache.trim(st.st_size * 3), 0);
+    CHECK_EQ(cache.trim(st.st_size * 2), 1);
+    CHECK(!cache.load(b, out));
+    CHECK(cache.load(c, out));
+    CHECK(cache.load(a, out));
+    CHECK_EQ(cache.trim(0), 2);
+}
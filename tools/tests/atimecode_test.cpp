@@ -0,0 +1,163 @@
+//
+// ATimecode payload and CRC, and ATimecodeReader on frames rasterized from the
+// geometry the app draws.
+//
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "aoverlay.h"
+#include "atest.h"
+#include "atimecode.h"
+#include "atimecodereader.h"
+
+namespace {
+
+const Timecode CODES[] = {
+    {0, 0},
+    {0xffffffffu, 0xffffffffu},
+    {123456789, 33366},
+    {0x80000001u, 0x7ffffffeu},
+};
+
+// Luma plane of a window with the code in its bottom-right corner, as ATimecode::build
+// places it: the overlay quads filled at pixel centers, plus noise
+struct Frame {
+    int width;
+    int height;
+    std::vector<uint8_t> luma;
+
+    Frame(int w, int h, const Timecode& tc, int cellPixels, int noise, uint32_t seed) :
+        width(w), height(h), luma((size_t)w * h, 24) {
+        AOverlay overlay;
+        overlay.setPixelSize(2.0f / w, 2.0f / h);
+        overlay.begin();
+        ATimecode::build(overlay, tc, cellPixels);
+        const std::vector<OverlayVertex>& stream = overlay.finish();
+        for (size_t i = 0; i + 6 <= stream.size(); i += 6) {
+            // Zero-alpha entries are region padding
+            if (!stream[i].color[3]) {
+                continue;
+            }
+            float x0 = 1.0f, x1 = -1.0f, y0 = 1.0f, y1 = -1.0f;
+            for (size_t v = i; v < i + 6; v++) {
+                x0 = std::min(x0, stream[v].pos[0]);
+                x1 = std::max(x1, stream[v].pos[0]);
+                y0 = std::min(y0, stream[v].pos[1]);
+                y1 = std::max(y1, stream[v].pos[1]);
+            }
+            for (int y = 0; y < h; y++) {
+                float cy = 1.0f - (y + 0.5f) * 2.0f / h;
+                if (cy < y0 || cy > y1) {
+                    continue;
+                }
+                for (int x = 0; x < w; x++) {
+                    float cx = (x + 0.5f) * 2.0f / w - 1.0f;
+                    if (cx >= x0 && cx <= x1) {
+                        luma[(size_t)y * w + x] = stream[i].color[0] ? 235 : 16;
+                    }
+                }
+            }
+        }
+        for (uint8_t& p : luma) {
+            seed = seed * 1664525u + 1013904223u;
+            int n = (int)(seed >> 24) % (2 * noise + 1) - noise;
+            p = (uint8_t)std::clamp(p + n, 0, 255);
+        }
+    }
+
+    // The corner the code is drawn into, with margin pixels of the frame around its quiet zone
+    Rect corner(int cellPixels, int margin) const {
+        int w = (ATimecode::COLS + 2) * cellPixels + margin;
+        int h = (ATimecode::ROWS + 2) * cellPixels + margin;
+        return {width - w, height - h, w, h};
+    }
+
+    // The white ring alone, no quiet zone: the code touches the right and bottom edges
+    Rect ring(int cellPixels) const {
+        int w = ATimecode::COLS * cellPixels;
+        int h = ATimecode::ROWS * cellPixels;
+        return {width - w - cellPixels, height - h - cellPixels, w, h};
+    }
+};
+
+bool same(const Timecode& a, const Timecode& b) {
+    return a.renderUs == b.renderUs && a.ptsUs == b.ptsUs;
+}
+
+}
+
+TEST(timecode, crc8) {
+    // CRC-8/SMBUS check value
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK_EQ((int)ATimecode::crc8(check, sizeof(check)), 0xf4);
+    CHECK_EQ((int)ATimecode::crc8(check, 0), 0);
+}
+
+TEST(timecode, encodeDecode) {
+    for (const Timecode& tc : CODES) {
+        uint8_t bits[ATimecode::BITS];
+        ATimecode::encode(tc, bits);
+        for (uint8_t b : bits) {
+            CHECK(b == 0 || b == 1);
+        }
+        Timecode out{1, 1};
+        CHECK(ATimecode::decode(bits, out));
+        CHECK(same(out, tc));
+    }
+}
+
+TEST(timecode, flippedBitRejected) {
+    for (const Timecode& tc : CODES) {
+        uint8_t bits[ATimecode::BITS];
+        ATimecode::encode(tc, bits);
+        // A CRC catches every single bit error, payload or CRC alike
+        for (int i = 0; i < ATimecode::BITS; i++) {
+            bits[i] ^= 1;
+            Timecode out;
+            CHECK(!ATimecode::decode(bits, out));
+            bits[i] ^= 1;
+        }
+    }
+}
+
+TEST(timecode, readRoundTrip) {
+    ATimecodeReader reader;
+    uint32_t seed = 1;
+    for (int cellPixels : {2, 3, 5, 16}) {
+        for (const Timecode& tc : CODES) {
+            Frame frame(320, 240, tc, cellPixels, 20, seed++);
+            Timecode out{};
+            CHECK(reader.read(frame.luma.data(), frame.width, frame.corner(cellPixels, 6), out));
+            CHECK(same(out, tc));
+        }
+    }
+}
+
+TEST(timecode, readRingOnRoiEdge) {
+    // Small cells with the roi cut to the ring: a sampling window around the centers
+    // of the last column and row would reach past the roi
+    ATimecodeReader reader;
+    for (int cellPixels : {2, 3}) {
+        for (const Timecode& tc : CODES) {
+            Frame frame(96, 64, tc, cellPixels, 0, 7);
+            Timecode out{};
+            CHECK(reader.read(frame.luma.data(), frame.width, frame.ring(cellPixels), out));
+            CHECK(same(out, tc));
+        }
+    }
+}
+
+TEST(timecode, readRejects) {
+    ATimecodeReader reader;
+    Timecode out;
+    // Flat frame, no contrast
+    std::vector<uint8_t> flat(100 * 60, 128);
+    CHECK(!reader.read(flat.data(), 100, {0, 0, 100, 60}, out));
+    // Smaller than one pixel per cell
+    Frame frame(320, 240, CODES[2], 3, 0, 1);
+    CHECK(!reader.read(frame.luma.data(), frame.width, {0, 0, ATimecode::COLS, ATimecode::ROWS}, out));
+    // Cells under two pixels
+    Frame tiny(320, 240, CODES[2], 1, 0, 1);
+    CHECK(!reader.read(tiny.luma.data(), tiny.width, tiny.corner(1, 4), out));
+}
@@ -0,0 +1,157 @@
+//
+// AViewport scale modes, the crop rect and when update() reports a change.
+//
+#include "atest.h"
+#include "aviewport.h"
+
+namespace {
+
+const float EPS = 1e-5f;
+
+VideoFormat full(int32_t width, int32_t height) {
+    return {width, height, 0, 0, width, height};
+}
+
+// Window pixel the quad's edge (unit quad coordinate -1 or 1) lands on, per axis
+float edgePixel(const float* m, int axis, float unit, int32_t windowSize) {
+    float clip = m[axis * 5] * unit + m[12 + axis];
+    return (clip + 1.0f) * 0.5f * windowSize;
+}
+
+AViewport updated(int32_t windowWidth, int32_t windowHeight, const VideoFormat& format, ScaleMode mode) {
+    AViewport viewport;
+    viewport.setWindowSize(windowWidth, windowHeight);
+    viewport.setVideoFormat(format);
+    viewport.setScaleMode(mode);
+    viewport.update();
+    return viewport;
+}
+
+}
+
+TEST(viewport, fitLetterbox) {
+    // 2.39:1 in 16:9: full width, bars above and below
+    AViewport v = updated(1920, 1080, full(1920, 804), ScaleMode::Fit);
+    const float* m = v.positionMatrix();
+    CHECK_NEAR(m[0], 1.0f, EPS);
+    CHECK_NEAR(m[5], 804.0f / 1080.0f, EPS);
+    CHECK_NEAR(m[12], 0.0f, EPS);
+    CHECK_NEAR(m[13], 0.0f, EPS);
+    // Upscaled to the width
+    v = updated(1920, 1080, full(960, 402), ScaleMode::Fit);
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 804.0f / 1080.0f, EPS);
+}
+
+TEST(viewport, fitPillarbox) {
+    // 4:3 in 16:9: full height, bars left and right
+    AViewport v = updated(1920, 1080, full(640, 480), ScaleMode::Fit);
+    const float* m = v.positionMatrix();
+    CHECK_NEAR(m[0], 1440.0f / 1920.0f, EPS);
+    CHECK_NEAR(m[5], 1.0f, EPS);
+    // Portrait window, landscape video: letterboxed instead
+    v = updated(1080, 2400, full(1920, 1080), ScaleMode::Fit);
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1080.0f * 1080.0f / 1920.0f / 2400.0f, EPS);
+}
+
+TEST(viewport, fillCoversAndStretch) {
+    // 4:3 in 16:9: full width, top and bottom fall outside the window
+    AViewport v = updated(1920, 1080, full(640, 480), ScaleMode::Fill);
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1440.0f / 1080.0f, EPS);
+    v = updated(1920, 1080, full(640, 480), ScaleMode::Stretch);
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1.0f, EPS);
+}
+
+TEST(viewport, cropRect) {
+    // 1080p decoded into a 1920x1088 buffer with 8 rows of padding, then a 4:3 crop
+    // inside it: the texture matrix selects the crop, placement uses the crop's size
+    VideoFormat format{1920, 1088, 240, 4, 1680, 1084};
+    AViewport v = updated(1920, 1080, format, ScaleMode::Fill);
+    const float* t = v.textureMatrix();
+    CHECK_NEAR(t[0], 1440.0f / 1920.0f, EPS);
+    CHECK_NEAR(t[5], 1080.0f / 1088.0f, EPS);
+    CHECK_NEAR(t[12], 240.0f / 1920.0f, EPS);
+    CHECK_NEAR(t[13], 4.0f / 1088.0f, EPS);
+    // Texture coordinates 0..1 of the quad land on the crop's edges
+    CHECK_NEAR((t[0] * 0.0f + t[12]) * 1920.0f, 240.0f, 1e-3f);
+    CHECK_NEAR((t[0] * 1.0f + t[12]) * 1920.0f, 1680.0f, 1e-3f);
+    CHECK_NEAR((t[5] * 1.0f + t[13]) * 1088.0f, 1084.0f, 1e-3f);
+    // Filling 16:9 with the 4:3 crop: its width across the window, height beyond it
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1920.0f / 1440.0f, EPS);
+    // The crop, not the buffer, sets the aspect ratio
+    v = updated(1920, 1080, format, ScaleMode::Fit);
+    CHECK_NEAR(v.positionMatrix()[0], 1440.0f / 1920.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1.0f, EPS);
+}
+
+TEST(viewport, originalPixelAligned) {
+    // Even differences center on whole pixels as they are
+    AViewport v = updated(1920, 1080, full(1280, 720), ScaleMode::Original);
+    const float* m = v.positionMatrix();
+    CHECK_NEAR(m[0], 1280.0f / 1920.0f, EPS);
+    CHECK_NEAR(m[5], 720.0f / 1080.0f, EPS);
+    CHECK_NEAR(m[12], 0.0f, EPS);
+    CHECK_NEAR(m[13], 0.0f, EPS);
+    CHECK_NEAR(edgePixel(m, 0, -1.0f, 1920), 320.0f, 1e-3f);
+
+    // Odd ones shift by half a pixel, both edges on pixel boundaries
+    v = updated(1921, 1081, full(1280, 720), ScaleMode::Original);
+    m = v.positionMatrix();
+    CHECK_NEAR(m[12], 1.0f / 1921.0f, EPS);
+    CHECK_NEAR(m[13], 1.0f / 1081.0f, EPS);
+    CHECK_NEAR(edgePixel(m, 0, -1.0f, 1921), 321.0f, 1e-2f);
+    CHECK_NEAR(edgePixel(m, 0, 1.0f, 1921), 1601.0f, 1e-2f);
+    CHECK_NEAR(edgePixel(m, 1, -1.0f, 1081), 181.0f, 1e-2f);
+    CHECK_NEAR(edgePixel(m, 1, 1.0f, 1081), 901.0f, 1e-2f);
+    // Only the odd axis
+    v = updated(1921, 1080, full(1280, 720), ScaleMode::Original);
+    CHECK_NEAR(v.positionMatrix()[12], 1.0f / 1921.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[13], 0.0f, EPS);
+}
+
+TEST(viewport, updateOnlyAfterChange) {
+    AViewport v;
+    // The first call always uploads
+    CHECK(v.update());
+    CHECK(!v.update());
+    v.setWindowSize(1920, 1080);
+    CHECK(v.update());
+    CHECK(!v.update());
+    // The same values again are no change
+    v.setWindowSize(1920, 1080);
+    CHECK(!v.update());
+    v.setVideoFormat(full(1280, 720));
+    CHECK(v.update());
+    v.setVideoFormat(full(1280, 720));
+    CHECK(!v.update());
+    VideoFormat cropped = full(1280, 720);
+    cropped.cropBottom = 716;
+    v.setVideoFormat(cropped);
+    CHECK(v.update());
+    v.setScaleMode(ScaleMode::Fit);
+    CHECK(!v.update());
+    v.setScaleMode(ScaleMode::Fill);
+    CHECK(v.update());
+    v.invalidate();
+    CHECK(v.update());
+    CHECK(!v.update());
+}
+
+TEST(viewport, nothingToFit) {
+    // No window or no format yet: identity, the quad over the whole window
+    AViewport v;
+    v.setVideoFormat(full(1280, 720));
+    CHECK(v.update());
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.positionMatrix()[5], 1.0f, EPS);
+    CHECK_NEAR(v.textureMatrix()[0], 1.0f, EPS);
+    v.setWindowSize(1920, 1080);
+    v.setVideoFormat({1280, 720, 10, 0, 10, 720});
+    CHECK(v.update());
+    CHECK_NEAR(v.positionMatrix()[0], 1.0f, EPS);
+    CHECK_NEAR(v.textureMatrix()[12], 0.0f, EPS);
+}